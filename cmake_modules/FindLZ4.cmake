@@ -0,0 +1,17 @@
+FIND_PATH(LZ4_INCLUDE_DIR lz4.h /usr/include /usr/local/include)
+FIND_LIBRARY(LZ4_LIBRARY NAMES lz4 PATH /usr/lib /usr/local/lib)
+
+IF (LZ4_INCLUDE_DIR AND LZ4_LIBRARY)
+   SET(LZ4_FOUND TRUE)
+ENDIF (LZ4_INCLUDE_DIR AND LZ4_LIBRARY)
+
+
+IF (LZ4_FOUND)
+   IF (NOT LZ4_FIND_QUIETLY)
+      MESSAGE(STATUS "Found lz4: ${LZ4_LIBRARY}")
+   ENDIF (NOT LZ4_FIND_QUIETLY)
+ELSE (LZ4_FOUND)
+   IF (LZ4_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find lz4")
+   ENDIF (LZ4_FIND_REQUIRED)
+ENDIF (LZ4_FOUND)
@@ -31,7 +31,8 @@ export GLC_CAPTURE_GLFINISH=0
 # take picture from front or back buffer
 export GLC_CAPTURE=back
 
-# compress stream using 'lzo', 'quicklz', 'lzjb' or 'none'
+# compress stream using 'lzo', 'quicklz', 'lzjb', 'lz4', 'lz4hc', 'lossless',
+# 'jpeg' or 'none'
 export GLC_COMPRESS=quicklz
 
 # try GL_ARB_pixel_buffer_object to speed up readback
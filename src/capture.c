@@ -53,9 +53,24 @@ int main(int argc, char *argv[])
 		{'k', "hotkey",			"GLC_HOTKEY",			NULL},
 		{ 0 , "reload",			"GLC_RELOAD_HOTKEY",		NULL},
 		{'n', "lock-fps",		"GLC_LOCK_FPS",			 "1"},
+		{ 0 , "frame-budget",		"GLC_FRAME_BUDGET",		NULL},
 		{ 0 , "pbo",			"GLC_TRY_PBO",			 "1"},
+		{ 0 , "pbo-num",		"GLC_PBO_NUM",			NULL},
+		{ 0 , "copy-thread",		"GLC_COPY_THREAD",		 "1"},
+		{ 0 , "gpu-scale",		"GLC_GPU_SCALE",		 "1"},
+		{ 0 , "gpu-ycbcr",		"GLC_GPU_YCBCR",		 "1"},
+		{ 0 , "skip-repeats",		"GLC_SKIP_REPEATS",		NULL},
 		{'z', "compression",		"GLC_COMPRESS",			NULL},
+		{ 0 , "delta",			"GLC_DELTA",			NULL},
+		{ 0 , "slices",			"GLC_SLICES",			NULL},
+		{ 0 , "adaptive",		"GLC_ADAPTIVE",			 "1"},
+		{ 0 , "filter",			"GLC_FILTER",			 "1"},
+		{ 0 , "strong-compression",	"GLC_COMPRESS_STRONG",		NULL},
+		{ 0 , "jpeg-quality",		"GLC_JPEG_QUALITY",		NULL},
 		{ 0 , "sync",			"GLC_SYNC",			 "1"},
+		{ 0 , "async-write",		"GLC_ASYNC_WRITE",		NULL},
+		{ 0 , "split-size",		"GLC_SPLIT_SIZE",		NULL},
+		{ 0 , "split-time",		"GLC_SPLIT_TIME",		NULL},
 		{ 0 , "byte-aligned",		"GLC_CAPTURE_DWORD_ALIGNED",	 "0"},
 		{'i', "draw-indicator",		"GLC_INDICATOR",		 "1"},
 		{'v', "log",			"GLC_LOG",			NULL},
@@ -70,6 +85,7 @@ int main(int argc, char *argv[])
 		{ 0 , "uncompressed",		"GLC_UNCOMPRESSED_BUFFER_SIZE",	NULL},
 		{ 0 , "unscaled",		"GLC_UNSCALED_BUFFER_SIZE",	NULL},
 		{'P', "rtprio",                 "GLC_RTPRIO",                   NULL},
+		{ 0 , "sched",			"GLC_SCHED",			NULL},
 		{ 0 , "pipe",                   "GLC_PIPE",                     NULL},
 		{ 0 , "pipe_invert",            "GLC_PIPE_INVERT",               "1"},
 		{ 0 , NULL,			NULL,				NULL}
@@ -167,11 +183,36 @@ usage:
 	       "      --reload=HOTKEY        reload hotkey, switches to next capture file\n"
 	       "                               default reload key is '<Shift>F9'\n"
 	       "  -n, --lock-fps             lock fps when capturing\n"
+	       "      --frame-budget=MS      degrade capture to keep its cost per swap under MS\n"
 	       "      --pbo                  use GL_ARB_pixel_buffer_object if available\n"
+	       "      --pbo-num=NUM          number of PBO transfers in flight, default is 3\n"
+	       "      --copy-thread          copy PBO frames to buffer in a separate thread\n"
+	       "      --gpu-scale            downscale pictures on GPU before reading them\n"
+	       "      --gpu-ycbcr            convert pictures to Y'CbCr on GPU before reading them\n"
+	       "      --skip-repeats=MODE    record repeated frames as a reference to the previous one\n"
+	       "                               1 compares sampled tiles, 2 compares whole frames\n"
 	       "  -z, --compression=METHOD   compress stream using METHOD\n"
-	       "                               'none', 'quicklz' and 'lzo' are supported\n"
+	       "                               'none', 'quicklz', 'lzo', 'lzjb', 'lz4', 'lz4hc'\n"
+	       "                               'lossless' and 'jpeg'\n"
+	       "                               are supported\n"
 	       "                               'quicklz' is used by default\n"
+	       "      --delta=NUM            compress pictures as changes to the previous one,\n"
+	       "                               with a full picture every NUM frames\n"
+	       "      --slices=NUM           compress large pictures in up to NUM slices in parallel\n"
+	       "      --filter               split pictures in predicted planes before compression\n"
+	       "      --adaptive             store or compress each message depending on its\n"
+	       "                               compression ratio and on buffer pressure\n"
+	       "      --strong-compression=METHOD\n"
+	       "                             with --adaptive, use METHOD when writing is slow\n"
+	       "      --jpeg-quality=NUM     quality of 'jpeg' compression from 1 to 100,\n"
+	       "                               default is 85\n"
 	       "      --sync                 force synchronized write mode\n"
+	       "      --async-write=NUM      write stream file in large segments with NUM\n"
+	       "                               writes in flight, using direct io if possible,\n"
+	       "                               with --sync, data is synced every second\n"
+	       "      --split-size=MIB       continue stream in a new file every MIB MiB\n"
+	       "      --split-time=SEC       continue stream in a new file every SEC seconds\n"
+	       "                               parts are named FILE-001, FILE-002...\n"
 	       "      --byte-aligned         use GL_PACK_ALIGNMENT 1 instead of 8\n"
 	       "  -i, --draw-indicator       draw indicator when capturing\n"
 	       "                               indicator does not work with -b 'front'\n"
@@ -197,6 +238,10 @@ usage:
 	       "      --unscaled=SIZE        unscaled picture stream buffer size in MiB,\n"
 	       "                               default is 25 MiB\n"
 	       "  -P, --rtprio               use rt priority for alsa threads\n"
+	       "      --sched=CONFIG         per thread cpu affinity and scheduling policy\n"
+	       "                               format is thread:option/option;thread2:...\n"
+	       "                               options: cpus=LIST, nice=N, rr=PRIO,\n"
+	       "                               fifo=PRIO, deadline=RUNTIME,DEADLINE,PERIOD (us)\n"
 	       "      --pipe=rhs_cmd         pipe the video stream to an ext. app (ie: ffmpeg)\n"
 	       "                               The external program will be invoked with 4 args:\n"
 	       "                                 1. video_size (wxh)\n"
@@ -287,6 +287,7 @@ int alsa_hook_get_stream(alsa_hook_t alsa_hook, snd_pcm_t *pcm, struct alsa_hook
 
 		find->alsa_hook     = alsa_hook;
 		find->thread.ask_rt = 1;
+		find->thread.name   = "alsa_hook";
 		find->next          = alsa_hook->stream;
 		alsa_hook->stream = find;
 	}
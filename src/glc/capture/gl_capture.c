@@ -48,6 +48,7 @@
 #include <glc/common/log.h>
 #include <glc/common/state.h>
 #include <glc/common/util.h>
+#include <glc/common/thread.h>
 
 #include "gl_capture.h"
 #include "optimization.h"
@@ -59,6 +60,52 @@
 #define GL_CAPTURE_CROP            0x10
 #define GL_CAPTURE_LOCK_FPS        0x20
 #define GL_CAPTURE_IGNORE_TIME     0x40
+#define GL_CAPTURE_TRY_COPIER      0x80
+#define GL_CAPTURE_USE_COPIER     0x100
+#define GL_CAPTURE_TRY_SCALE      0x200
+#define GL_CAPTURE_USE_SCALE      0x400
+#define GL_CAPTURE_TRY_YCBCR      0x800
+#define GL_CAPTURE_USE_YCBCR     0x1000
+#define GL_CAPTURE_SKIP_REPEATS  0x2000
+#define GL_CAPTURE_HASH_ALL      0x4000
+
+/* pace levels, frames are captured every (level - 1) intervals from level 2 */
+#define GL_CAPTURE_PACE_DEFER         1 /* finished PBO transfers spread over swaps */
+#define GL_CAPTURE_PACE_MAX           4
+
+/* pacing is pointless when application is throttled anyway */
+#define GL_CAPTURE_PACING(gl_capture) \
+	(((gl_capture)->budget) && \
+	 (!((gl_capture)->flags & (GL_CAPTURE_LOCK_FPS | GL_CAPTURE_IGNORE_TIME))))
+
+/* time between captures */
+#define GL_CAPTURE_INTERVAL(gl_capture, video) \
+	((video)->pace_level > GL_CAPTURE_PACE_DEFER ? \
+	 (gl_capture)->fps * ((video)->pace_level - GL_CAPTURE_PACE_DEFER) : \
+	 (gl_capture)->fps)
+
+/* sampled repeat check hashes one tile out of every step bytes */
+#define GL_CAPTURE_REPEAT_TILE      256
+#define GL_CAPTURE_REPEAT_STEP     1024
+
+#define GL_CAPTURE_HASH_PRIME1 0x9e3779b185ebca87ULL
+#define GL_CAPTURE_HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define GL_CAPTURE_HASH_PRIME3 0x165667b19e3779f9ULL
+
+#define GL_CAPTURE_HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#ifndef GL_MAP_READ_BIT
+# define GL_MAP_READ_BIT          0x0001
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+# define GL_MAP_PERSISTENT_BIT    0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+# define GL_MAP_COHERENT_BIT      0x0080
+#endif
+
+#define GL_CAPTURE_PBO_STORAGE \
+	(GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
 
 typedef void (*FuncPtr)(void);
 typedef FuncPtr (*GLXGetProcAddressProc)(const GLubyte *procName);
@@ -75,6 +122,131 @@ typedef void (*glBindBufferProc)(GLenum target,
 typedef GLvoid *(*glMapBufferProc)(GLenum target,
                                    GLenum access);
 typedef GLboolean (*glUnmapBufferProc)(GLenum target);
+typedef GLsync (*glFenceSyncProc)(GLenum condition,
+                                  GLbitfield flags);
+typedef GLenum (*glClientWaitSyncProc)(GLsync sync,
+                                       GLbitfield flags,
+                                       GLuint64 timeout);
+typedef void (*glDeleteSyncProc)(GLsync sync);
+typedef void (*glBufferStorageProc)(GLenum target,
+                                    GLsizeiptr size,
+                                    const GLvoid *data,
+                                    GLbitfield flags);
+typedef GLvoid *(*glMapBufferRangeProc)(GLenum target,
+                                        GLintptr offset,
+                                        GLsizeiptr length,
+                                        GLbitfield access);
+
+typedef void (*glGenFramebuffersProc)(GLsizei n,
+                                      GLuint *framebuffers);
+typedef void (*glDeleteFramebuffersProc)(GLsizei n,
+                                         const GLuint *framebuffers);
+typedef void (*glBindFramebufferProc)(GLenum target,
+                                      GLuint framebuffer);
+typedef void (*glGenRenderbuffersProc)(GLsizei n,
+                                       GLuint *renderbuffers);
+typedef void (*glDeleteRenderbuffersProc)(GLsizei n,
+                                          const GLuint *renderbuffers);
+typedef void (*glBindRenderbufferProc)(GLenum target,
+                                       GLuint renderbuffer);
+typedef void (*glRenderbufferStorageProc)(GLenum target,
+                                          GLenum internalformat,
+                                          GLsizei width,
+                                          GLsizei height);
+typedef void (*glFramebufferRenderbufferProc)(GLenum target,
+                                              GLenum attachment,
+                                              GLenum renderbuffertarget,
+                                              GLuint renderbuffer);
+typedef GLenum (*glCheckFramebufferStatusProc)(GLenum target);
+typedef void (*glBlitFramebufferProc)(GLint srcX0, GLint srcY0,
+                                      GLint srcX1, GLint srcY1,
+                                      GLint dstX0, GLint dstY0,
+                                      GLint dstX1, GLint dstY1,
+                                      GLbitfield mask,
+                                      GLenum filter);
+typedef void (*glActiveTextureProc)(GLenum texture);
+typedef GLuint (*glCreateShaderProc)(GLenum type);
+typedef void (*glShaderSourceProc)(GLuint shader,
+                                   GLsizei count,
+                                   const GLchar **string,
+                                   const GLint *length);
+typedef void (*glCompileShaderProc)(GLuint shader);
+typedef void (*glGetShaderivProc)(GLuint shader,
+                                  GLenum pname,
+                                  GLint *params);
+typedef void (*glDeleteShaderProc)(GLuint shader);
+typedef GLuint (*glCreateProgramProc)(void);
+typedef void (*glAttachShaderProc)(GLuint program,
+                                   GLuint shader);
+typedef void (*glLinkProgramProc)(GLuint program);
+typedef void (*glGetProgramivProc)(GLuint program,
+                                   GLenum pname,
+                                   GLint *params);
+typedef void (*glUseProgramProc)(GLuint program);
+typedef void (*glDeleteProgramProc)(GLuint program);
+typedef GLint (*glGetUniformLocationProc)(GLuint program,
+                                          const GLchar *name);
+typedef void (*glUniform1iProc)(GLint location,
+                                GLint v0);
+typedef void (*glUniform2fProc)(GLint location,
+                                GLfloat v0,
+                                GLfloat v1);
+
+/*
+ * Renders Y' plane at the bottom of the target and Cb, Cr planes side
+ * by side above it. Target rows are read back bottom first, so the
+ * picture is flipped here to get top-down Y'CbCr like ycbcr filter.
+ * Integer math is the same as RGB_TO_YCbCrJPEG_* in ycbcr.c and
+ * exact in float, Cb of pure blue is clamped to 255 where ycbcr
+ * filter wraps around.
+ */
+static const char gl_capture_ycbcr_shader[] =
+	"uniform sampler2D picture;\n"
+	"uniform vec2 size;   /* source picture */\n"
+	"uniform vec2 planes; /* chroma width, luma height */\n"
+	"\n"
+	"vec3 fetch(float x, float y)\n"
+	"{\n"
+	"	return floor(texture2D(picture, (vec2(x, y) + 0.5) / size).rgb * 255.0 + 0.5);\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = floor(gl_FragCoord.xy);\n"
+	"	vec3 c;\n"
+	"	float v, x, y;\n"
+	"\n"
+	"	if (p.y < planes.y) {\n"
+	"		c = fetch(p.x, size.y - 1.0 - p.y);\n"
+	"		v = floor(dot(c, vec3(306.0, 601.0, 117.0)) / 1024.0);\n"
+	"	} else {\n"
+	"		x = 2.0 * (p.x < planes.x ? p.x : p.x - planes.x);\n"
+	"		y = size.y - 2.0 - 2.0 * (p.y - planes.y);\n"
+	"		c = floor((fetch(x, y) + fetch(x + 1.0, y) +\n"
+	"			   fetch(x, y + 1.0) + fetch(x + 1.0, y + 1.0)) / 4.0);\n"
+	"		if (p.x < planes.x)\n"
+	"			v = 128.0 - floor(dot(c, vec3(173.0, 339.0, -512.0)) / 1024.0);\n"
+	"		else\n"
+	"			v = 128.0 + floor(dot(c, vec3(512.0, -429.0, -83.0)) / 1024.0);\n"
+	"	}\n"
+	"\n"
+	"	gl_FragColor = vec4(clamp(v, 0.0, 255.0) / 255.0);\n"
+	"}\n";
+
+/* oldest transfer in PBO ring */
+#define GL_CAPTURE_PBO_TAIL(video) \
+	(((video)->pbo_head + (video)->pbo_num - (video)->pbo_pending) % (video)->pbo_num)
+
+struct gl_capture_video_stream_s;
+
+/* finished transfer handed over to copier thread */
+struct gl_capture_copy_job_s {
+	struct gl_capture_video_stream_s *video;
+	unsigned int slot;
+	glc_utime_t time;
+
+	struct gl_capture_copy_job_s *next;
+};
 
 struct gl_capture_video_stream_s {
 	glc_state_video_t state_video;
@@ -87,10 +259,18 @@ struct gl_capture_video_stream_s {
 	GLXDrawable drawable;
 	Window attribWin;
 	ps_packet_t packet;
-	glc_utime_t last, pbo_time;
+	glc_utime_t last;
 
 	unsigned int w, h;
 	unsigned int cw, ch, row, cx, cy;
+	/* size of the picture read back, smaller than cw x ch when scaled on GPU */
+	unsigned int ow, oh;
+	GLuint scale_fbo, scale_rbo;
+	/* Y'CbCr picture size when converted on GPU */
+	unsigned int yw, yh;
+	GLuint ycbcr_program, ycbcr_tex, ycbcr_fbo, ycbcr_rbo;
+	/* bytes per frame */
+	size_t size;
 
 	float brightness, contrast;
 	float gamma_red, gamma_green, gamma_blue;
@@ -99,8 +279,30 @@ struct gl_capture_video_stream_s {
 
 	struct gl_capture_video_stream_s *next;
 
-	GLuint pbo;
-	int pbo_active;
+	/* PBO ring, transfers are read back in the order they were started */
+	GLuint *pbo;
+	GLsync *pbo_fence;
+	glc_utime_t *pbo_time;
+	unsigned int pbo_num, pbo_head, pbo_pending;
+
+	/* persistently mapped PBOs, only with copier thread */
+	GLvoid **pbo_map;
+	struct gl_capture_copy_job_s *pbo_job;
+	unsigned int pbo_copying;
+
+	/* pacing, see gl_capture_pace() */
+	glc_utime_t overhead;
+	unsigned int pace_level, pace_max, pace_changes;
+	unsigned int pace_frames, pace_calm;
+	/* dropped and num_frames are updated from both the application
+	   and the copier thread, always use atomic operations on them */
+	unsigned int dropped, pace_dropped, pace_reported;
+	int pace_report;
+
+	/* hash of last frame written, valid while repeat_epoch matches */
+	u_int64_t repeat_hash, frame_hash;
+	unsigned int repeat_epoch;
+	unsigned int repeats;
 
 	/* stats related vars */
 	unsigned num_frames;
@@ -114,13 +316,27 @@ struct gl_capture_s {
 
 	GLenum capture_buffer;
 	glc_utime_t fps;
+	glc_utime_t budget;
+	/* bumped on every start, repeats never cross a stream reload */
+	unsigned int repeat_epoch;
 
-	pthread_rwlock_t videolist_lock;
-	struct gl_capture_video_stream_s *video;
+	/* streams are only prepended, readers walk the list without lock */
+	pthread_mutex_t videolist_mutex;
+	struct gl_capture_video_stream_s *volatile video;
+	unsigned int gen;
 
 	ps_buffer_t *to;
 
 	pthread_mutex_t init_pbo_mutex;
+	unsigned int pbo_num;
+	double gpu_scale;
+
+	/* copier thread streams finished transfers to buffer */
+	glc_simple_thread_t copier;
+	pthread_mutex_t copier_mutex;
+	pthread_cond_t copier_cond, copier_done;
+	struct gl_capture_copy_job_s *copier_first, *copier_last;
+	int copier_stop;
 
 	unsigned int bpp;
 	GLenum format;
@@ -137,8 +353,49 @@ struct gl_capture_s {
 	glBindBufferProc      glBindBuffer;
 	glMapBufferProc       glMapBuffer;
 	glUnmapBufferProc     glUnmapBuffer;
+	glFenceSyncProc       glFenceSync;
+	glClientWaitSyncProc  glClientWaitSync;
+	glDeleteSyncProc      glDeleteSync;
+	glBufferStorageProc   glBufferStorage;
+	glMapBufferRangeProc  glMapBufferRange;
+
+	glGenFramebuffersProc         glGenFramebuffers;
+	glDeleteFramebuffersProc      glDeleteFramebuffers;
+	glBindFramebufferProc         glBindFramebuffer;
+	glGenRenderbuffersProc        glGenRenderbuffers;
+	glDeleteRenderbuffersProc     glDeleteRenderbuffers;
+	glBindRenderbufferProc        glBindRenderbuffer;
+	glRenderbufferStorageProc     glRenderbufferStorage;
+	glFramebufferRenderbufferProc glFramebufferRenderbuffer;
+	glCheckFramebufferStatusProc  glCheckFramebufferStatus;
+	glBlitFramebufferProc         glBlitFramebuffer;
+
+	glActiveTextureProc           glActiveTexture;
+	glCreateShaderProc            glCreateShader;
+	glShaderSourceProc            glShaderSource;
+	glCompileShaderProc           glCompileShader;
+	glGetShaderivProc             glGetShaderiv;
+	glDeleteShaderProc            glDeleteShader;
+	glCreateProgramProc           glCreateProgram;
+	glAttachShaderProc            glAttachShader;
+	glLinkProgramProc             glLinkProgram;
+	glGetProgramivProc            glGetProgramiv;
+	glUseProgramProc              glUseProgram;
+	glDeleteProgramProc           glDeleteProgram;
+	glGetUniformLocationProc      glGetUniformLocation;
+	glUniform1iProc               glUniform1i;
+	glUniform2fProc               glUniform2f;
 };
 
+/* gl_capture objects ever created, tells apart stale per-thread caches */
+static unsigned int gl_capture_gen = 0;
+
+/* last video stream looked up by this thread */
+static __thread struct gl_capture_video_stream_s *gl_capture_last_video = NULL;
+static __thread unsigned int gl_capture_last_gen = 0;
+
+static struct gl_capture_video_stream_s *gl_capture_find_video_stream(
+				gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable);
 static int gl_capture_get_video_stream(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s **video,
 				Display *dpy, GLXDrawable drawable);
@@ -167,15 +424,65 @@ static int gl_capture_get_pixels(gl_capture_t gl_capture,
 static int gl_capture_gen_indicator_list(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 
+static int gl_capture_load_libgl(gl_capture_t gl_capture);
 static int gl_capture_init_pbo(gl_capture_t gl);
 static int gl_capture_create_pbo(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 static int gl_capture_destroy_pbo(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 static int gl_capture_start_pbo(gl_capture_t gl_capture,
-				struct gl_capture_video_stream_s *video);
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now);
 static int gl_capture_read_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now);
+static int gl_capture_flush_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now, int need_slot);
+static int gl_capture_write_pbo(gl_capture_t gl_capture, ps_packet_t *packet,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t time, const GLvoid *buf);
+
+static int gl_capture_init_copier(gl_capture_t gl_capture, const char *gl_extensions);
+static int gl_capture_queue_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now);
+static void gl_capture_drain_copier(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static void *gl_capture_copier_thread(void *argptr);
+
+static int gl_capture_load_fbo(gl_capture_t gl_capture, const char *gl_extensions);
+static int gl_capture_init_scale(gl_capture_t gl_capture);
+static int gl_capture_create_scale(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static int gl_capture_destroy_scale(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+
+static void gl_capture_pace(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now, glc_utime_t end);
+static int gl_capture_write_pace_message(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t now);
+
+static u_int64_t gl_capture_hash(const unsigned char *data, size_t size,
+				size_t tile, size_t step);
+static int gl_capture_repeated(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				const void *buf);
+static void gl_capture_set_repeat_hash(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static int gl_capture_write_repeat_message(gl_capture_t gl_capture, ps_packet_t *packet,
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t time);
+
+static int gl_capture_init_ycbcr(gl_capture_t gl_capture);
+static int gl_capture_create_ycbcr(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static int gl_capture_destroy_ycbcr(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
+static int gl_capture_read_ycbcr(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video, char *to);
 
 int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 {
@@ -187,9 +494,15 @@ int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 	(*gl_capture)->format = GL_BGRA;		/* capture as BGRA data by default */
 	(*gl_capture)->bpp = 4;				/* since we use BGRA */
 	(*gl_capture)->capture_buffer = GL_FRONT;	/* front buffer is default */
+	(*gl_capture)->pbo_num = 3;			/* transfers in flight with PBO */
+	(*gl_capture)->gpu_scale = 1.0;			/* no scaling on GPU */
 
 	pthread_mutex_init(&(*gl_capture)->init_pbo_mutex, NULL);
-	pthread_rwlock_init(&(*gl_capture)->videolist_lock, NULL);
+	pthread_mutex_init(&(*gl_capture)->copier_mutex, NULL);
+	pthread_cond_init(&(*gl_capture)->copier_cond, NULL);
+	pthread_cond_init(&(*gl_capture)->copier_done, NULL);
+	pthread_mutex_init(&(*gl_capture)->videolist_mutex, NULL);
+	(*gl_capture)->gen = __sync_add_and_fetch(&gl_capture_gen, 1);
 
 	return 0;
 }
@@ -233,6 +546,37 @@ int gl_capture_set_fps(gl_capture_t gl_capture, double fps)
 	return 0;
 }
 
+int gl_capture_set_frame_budget(gl_capture_t gl_capture, double budget)
+{
+	if (unlikely(budget < 0.0))
+		return EINVAL;
+
+	gl_capture->budget = budget * 1000000;
+	if (gl_capture->budget)
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "pacing capture to %f ms per swap", budget);
+
+	return 0;
+}
+
+int gl_capture_skip_repeats(gl_capture_t gl_capture, int skip_repeats)
+{
+	if (unlikely((skip_repeats < 0) || (skip_repeats > 2)))
+		return EINVAL;
+
+	gl_capture->flags &= ~(GL_CAPTURE_SKIP_REPEATS | GL_CAPTURE_HASH_ALL);
+	if (skip_repeats) {
+		gl_capture->flags |= GL_CAPTURE_SKIP_REPEATS;
+		if (skip_repeats == 2)
+			gl_capture->flags |= GL_CAPTURE_HASH_ALL;
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "skipping repeated frames, checking %s",
+			 skip_repeats == 2 ? "whole frames" : "sampled tiles");
+	}
+
+	return 0;
+}
+
 int gl_capture_set_pack_alignment(gl_capture_t gl_capture, GLint pack_alignment)
 {
 	if (pack_alignment == 1)
@@ -270,6 +614,70 @@ int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo)
 	return 0;
 }
 
+int gl_capture_set_pbo_num(gl_capture_t gl_capture, unsigned int num)
+{
+	if (unlikely(!num))
+		return EINVAL;
+
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_PBO)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change PBO count; PBO is in use");
+		return EAGAIN;
+	}
+
+	gl_capture->pbo_num = num;
+	return 0;
+}
+
+int gl_capture_copy_thread(gl_capture_t gl_capture, int copy_thread)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_PBO)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change copy thread mode; PBO is in use");
+		return EAGAIN;
+	}
+
+	if (copy_thread)
+		gl_capture->flags |= GL_CAPTURE_TRY_COPIER;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TRY_COPIER;
+	return 0;
+}
+
+int gl_capture_set_gpu_scale(gl_capture_t gl_capture, double scale)
+{
+	if (unlikely((scale <= 0.0) || (scale > 1.0)))
+		return EINVAL;
+
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_SCALE)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change GPU scale factor; it is in use");
+		return EAGAIN;
+	}
+
+	gl_capture->gpu_scale = scale;
+	if (scale == 1.0)
+		gl_capture->flags &= ~GL_CAPTURE_TRY_SCALE;
+	else
+		gl_capture->flags |= GL_CAPTURE_TRY_SCALE;
+	return 0;
+}
+
+int gl_capture_try_gpu_ycbcr(gl_capture_t gl_capture, int try_ycbcr)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_YCBCR)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change Y'CbCr conversion; it is in use");
+		return EAGAIN;
+	}
+
+	if (try_ycbcr)
+		gl_capture->flags |= GL_CAPTURE_TRY_YCBCR;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TRY_YCBCR;
+	return 0;
+}
+
 int gl_capture_set_pixel_format(gl_capture_t gl_capture, GLenum format)
 {
 	if (format == GL_BGRA) {
@@ -355,6 +763,10 @@ int gl_capture_start(gl_capture_t gl_capture)
 		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 			 "starting capturing");
 
+	/* stream may have been reloaded, first frames must be written in full */
+	if (!++gl_capture->repeat_epoch)
+		gl_capture->repeat_epoch = 1;
+
 	gl_capture->flags |= GL_CAPTURE_CAPTURING;
 	gl_capture_refresh_color_correction(gl_capture);
 	return 0;
@@ -392,6 +804,16 @@ int gl_capture_destroy(gl_capture_t gl_capture)
 {
 	struct gl_capture_video_stream_s *del;
 
+	/* copier finishes queued frames before leaving */
+	if (gl_capture->flags & GL_CAPTURE_USE_COPIER) {
+		pthread_mutex_lock(&gl_capture->copier_mutex);
+		gl_capture->copier_stop = 1;
+		pthread_cond_signal(&gl_capture->copier_cond);
+		pthread_mutex_unlock(&gl_capture->copier_mutex);
+
+		glc_simple_thread_wait(gl_capture->glc, &gl_capture->copier);
+	}
+
 	while (gl_capture->video != NULL) {
 		del = gl_capture->video;
 		gl_capture->video = gl_capture->video->next;
@@ -399,6 +821,11 @@ int gl_capture_destroy(gl_capture_t gl_capture)
 		glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
 			"captured %u frames in %llu nsec",
 			del->num_frames, del->capture_time_ns);
+		glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+			"dropped %u frames, %u pace level changes, highest level %u",
+			del->dropped, del->pace_changes, del->pace_max);
+		glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+			"skipped %u repeated frames", del->repeats);
 
 		/* we might be in wrong thread */
 		if (del->indicator_list)
@@ -407,12 +834,21 @@ int gl_capture_destroy(gl_capture_t gl_capture)
 		if (del->pbo)
 			gl_capture_destroy_pbo(gl_capture, del);
 
+		if (del->scale_fbo)
+			gl_capture_destroy_scale(gl_capture, del);
+
+		if (del->ycbcr_program)
+			gl_capture_destroy_ycbcr(gl_capture, del);
+
 		ps_packet_destroy(&del->packet);
 		free(del);
 	}
 
-	pthread_rwlock_destroy(&gl_capture->videolist_lock);
+	pthread_mutex_destroy(&gl_capture->videolist_mutex);
 	pthread_mutex_destroy(&gl_capture->init_pbo_mutex);
+	pthread_cond_destroy(&gl_capture->copier_done);
+	pthread_cond_destroy(&gl_capture->copier_cond);
+	pthread_mutex_destroy(&gl_capture->copier_mutex);
 
 	if (gl_capture->libGL_handle)
 		dlclose(gl_capture->libGL_handle);
@@ -480,23 +916,88 @@ int gl_capture_calc_geometry(gl_capture_t gl_capture, struct gl_capture_video_st
 		 "calculated capture area for video %d is %ux%u+%u+%u",
 		 video->id, video->cw, video->ch, video->cx, video->cy);
 
-	video->row = video->cw * gl_capture->bpp;
+	if (gl_capture->flags & GL_CAPTURE_USE_SCALE) {
+		video->ow = video->cw * gl_capture->gpu_scale;
+		video->oh = video->ch * gl_capture->gpu_scale;
+		if (unlikely(video->ow < 2))
+			video->ow = 2;
+		if (unlikely(video->oh < 2))
+			video->oh = 2;
+	} else {
+		video->ow = video->cw;
+		video->oh = video->ch;
+	}
+
+	video->row = video->ow * gl_capture->bpp;
 	if (unlikely(video->row % gl_capture->pack_alignment != 0))
 		video->row += gl_capture->pack_alignment -
 			      video->row % gl_capture->pack_alignment;
+	video->size = video->row * video->oh;
+
+	/* same geometry as ycbcr filter */
+	if (gl_capture->flags & GL_CAPTURE_USE_YCBCR) {
+		video->yw = video->ow - video->ow % 2;
+		video->yh = video->oh - video->oh % 2;
+		video->size = video->yw * video->yh + 2 * ((video->yw / 2) * (video->yh / 2));
+	}
 	return 0;
 }
 
+/**
+ * \brief read picture from capture buffer
+ *
+ * With GPU scaling the capture area is first blitted into the
+ * scale framebuffer and only the scaled picture is read back.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param to destination, offset in bound PBO when using PBO
+ * \return 0 on success otherwise an error code
+ */
 int gl_capture_get_pixels(gl_capture_t gl_capture,
 			  struct gl_capture_video_stream_s *video, char *to)
 {
+	GLint read_fbo, draw_fbo;
+
 	glPushAttrib(GL_PIXEL_MODE_BIT);
 	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
 
 	glReadBuffer(gl_capture->capture_buffer);
 	glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
-	glReadPixels(video->cx, video->cy, video->cw, video->ch,
-		gl_capture->format, GL_UNSIGNED_BYTE, to);
+
+	if ((video->scale_fbo) || (video->ycbcr_program)) {
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	}
+
+	if (video->scale_fbo) {
+		glPushAttrib(GL_SCISSOR_BIT);
+		glDisable(GL_SCISSOR_TEST); /* blit is clipped by scissor test */
+
+		gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, video->scale_fbo);
+		gl_capture->glBlitFramebuffer(video->cx, video->cy,
+					      video->cx + video->cw, video->cy + video->ch,
+					      0, 0, video->ow, video->oh,
+					      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+		glPopAttrib();
+
+		gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, video->scale_fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+	}
+
+	if (video->ycbcr_program)
+		gl_capture_read_ycbcr(gl_capture, video, to);
+	else if (video->scale_fbo)
+		glReadPixels(0, 0, video->ow, video->oh,
+			gl_capture->format, GL_UNSIGNED_BYTE, to);
+	else
+		glReadPixels(video->cx, video->cy, video->cw, video->ch,
+			gl_capture->format, GL_UNSIGNED_BYTE, to);
+
+	if ((video->scale_fbo) || (video->ycbcr_program)) {
+		gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+		gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	}
 
 	glPopClientAttrib();
 	glPopAttrib();
@@ -535,6 +1036,31 @@ int gl_capture_gen_indicator_list(gl_capture_t gl_capture,
 	return 0;
 }
 
+/**
+ * \brief look up glXGetProcAddressARB() in libGL
+ *
+ * Shared by PBO and GPU scaling, libGL is opened only once.
+ * \param gl_capture gl_capture object
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_load_libgl(gl_capture_t gl_capture)
+{
+	if (gl_capture->glXGetProcAddress)
+		return 0;
+
+	if (!gl_capture->libGL_handle) {
+		gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
+		if (unlikely(!gl_capture->libGL_handle))
+			return ENOTSUP;
+	}
+	gl_capture->glXGetProcAddress =
+		(GLXGetProcAddressProc)
+		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
+	if (unlikely(!gl_capture->glXGetProcAddress))
+		return ENOTSUP;
+	return 0;
+}
+
 int gl_capture_init_pbo(gl_capture_t gl_capture)
 {
 	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
@@ -545,13 +1071,7 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	if (unlikely(!strstr(gl_extensions, "GL_ARB_pixel_buffer_object")))
 		return ENOTSUP;
 
-	gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
-	if (unlikely(!gl_capture->libGL_handle))
-		return ENOTSUP;
-	gl_capture->glXGetProcAddress =
-		(GLXGetProcAddressProc)
-		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
-	if (unlikely(!gl_capture->glXGetProcAddress))
+	if (unlikely(gl_capture_load_libgl(gl_capture)))
 		return ENOTSUP;
 	gl_capture->glGenBuffers =
 		(glGenBuffersProc)
@@ -587,136 +1107,1025 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 		 "using GL_ARB_pixel_buffer_object");
 
+	/* without fences the oldest transfer is mapped when a PBO is needed */
+	if (strstr(gl_extensions, "GL_ARB_sync")) {
+		gl_capture->glFenceSync =
+			(glFenceSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glFenceSync");
+		gl_capture->glClientWaitSync =
+			(glClientWaitSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glClientWaitSync");
+		gl_capture->glDeleteSync =
+			(glDeleteSyncProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteSync");
+	}
+
+	if ((gl_capture->glFenceSync) && (gl_capture->glClientWaitSync) &&
+	    (gl_capture->glDeleteSync))
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "using GL_ARB_sync, %u PBOs", gl_capture->pbo_num);
+	else {
+		gl_capture->glFenceSync = NULL;
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "GL_ARB_sync not supported, reading %u PBOs may block",
+			 gl_capture->pbo_num);
+	}
+
+	if (gl_capture->flags & GL_CAPTURE_TRY_COPIER) {
+		if (!gl_capture_init_copier(gl_capture, gl_extensions))
+			gl_capture->flags |= GL_CAPTURE_USE_COPIER;
+		else
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				 "can't use copy thread, copying frames at swap");
+	}
+
+	return 0;
+}
+
+/**
+ * \brief start copier thread
+ *
+ * Needs fences and persistently mapped buffers. GL calls stay
+ * on the application thread, the copier thread only reads mapped
+ * memory once the application thread has seen the fence signaled.
+ * \param gl_capture gl_capture object
+ * \param gl_extensions GL extension string
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_init_copier(gl_capture_t gl_capture, const char *gl_extensions)
+{
+	int ret;
+
+	if (unlikely(!gl_capture->glFenceSync))
+		return ENOTSUP;
+	if (unlikely(!strstr(gl_extensions, "GL_ARB_buffer_storage")))
+		return ENOTSUP;
+
+	gl_capture->glBufferStorage =
+		(glBufferStorageProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glBufferStorage");
+	if (unlikely(!gl_capture->glBufferStorage))
+		return ENOTSUP;
+	gl_capture->glMapBufferRange =
+		(glMapBufferRangeProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glMapBufferRange");
+	if (unlikely(!gl_capture->glMapBufferRange))
+		return ENOTSUP;
+
+	gl_capture->copier_stop = 0;
+	gl_capture->copier.name = "gl_copier";
+	if (unlikely((ret = glc_simple_thread_create(gl_capture->glc, &gl_capture->copier,
+						     gl_capture_copier_thread, gl_capture))))
+		return ret;
+
+	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+		 "using GL_ARB_buffer_storage, copying frames in a separate thread");
 	return 0;
 }
 
 int gl_capture_create_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
 	GLint binding;
+	unsigned int i;
+	int ret = 0;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "creating %u PBOs", gl_capture->pbo_num);
+
+	video->pbo = (GLuint *) calloc(gl_capture->pbo_num, sizeof(GLuint));
+	video->pbo_fence = (GLsync *) calloc(gl_capture->pbo_num, sizeof(GLsync));
+	video->pbo_time = (glc_utime_t *) calloc(gl_capture->pbo_num, sizeof(glc_utime_t));
+	if (unlikely((!video->pbo) || (!video->pbo_fence) || (!video->pbo_time))) {
+		free(video->pbo);
+		free(video->pbo_fence);
+		free(video->pbo_time);
+		video->pbo = NULL;
+		video->pbo_fence = NULL;
+		video->pbo_time = NULL;
+		return ENOMEM;
+	}
 
-	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "creating PBO");
+	video->pbo_num = gl_capture->pbo_num;
+	video->pbo_head = video->pbo_pending = 0;
+
+	if (gl_capture->flags & GL_CAPTURE_USE_COPIER) {
+		video->pbo_map = (GLvoid **) calloc(video->pbo_num, sizeof(GLvoid *));
+		video->pbo_job = (struct gl_capture_copy_job_s *)
+			calloc(video->pbo_num, sizeof(struct gl_capture_copy_job_s));
+		if (unlikely((!video->pbo_map) || (!video->pbo_job))) {
+			gl_capture_destroy_pbo(gl_capture, video);
+			return ENOMEM;
+		}
+	}
 
 	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
 	glPushAttrib(GL_ALL_ATTRIB_BITS);
 
-	gl_capture->glGenBuffers(1, &video->pbo);
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
-	gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->row * video->ch,
-				NULL, GL_STREAM_READ);
+	gl_capture->glGenBuffers(video->pbo_num, video->pbo);
+	for (i = 0; i < video->pbo_num; i++) {
+		gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[i]);
+
+		if (gl_capture->flags & GL_CAPTURE_USE_COPIER) {
+			/* mapped once, read by copier thread while GL keeps using it */
+			gl_capture->glBufferStorage(GL_PIXEL_PACK_BUFFER_ARB,
+						    video->size, NULL,
+						    GL_CAPTURE_PBO_STORAGE);
+			video->pbo_map[i] =
+				gl_capture->glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0,
+							     video->size,
+							     GL_CAPTURE_PBO_STORAGE);
+			if (unlikely(!video->pbo_map[i]))
+				ret = EINVAL;
+		} else
+			gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->size,
+						NULL, GL_STREAM_READ);
+	}
 
 	glPopAttrib();
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
-	return 0;
+
+	if (unlikely(ret)) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "can't map PBO persistently");
+		gl_capture_destroy_pbo(gl_capture, video);
+	}
+	return ret;
 }
 
 int gl_capture_destroy_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
 {
+	unsigned int i;
+
 	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying PBO");
-	gl_capture->glDeleteBuffers(1, &video->pbo);
+
+	/* mapped memory must not go away under copier thread */
+	gl_capture_drain_copier(gl_capture, video);
+
+	if (video->pbo_pending)
+		glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+			 "dropping %u frames still in PBO", video->pbo_pending);
+
+	for (i = 0; i < video->pbo_num; i++) {
+		if (video->pbo_fence[i])
+			gl_capture->glDeleteSync(video->pbo_fence[i]);
+	}
+	/* deleting a mapped buffer unmaps it */
+	gl_capture->glDeleteBuffers(video->pbo_num, video->pbo);
+
+	free(video->pbo);
+	free(video->pbo_fence);
+	free(video->pbo_time);
+	free(video->pbo_map);
+	free(video->pbo_job);
+	video->pbo = NULL;
+	video->pbo_fence = NULL;
+	video->pbo_time = NULL;
+	video->pbo_map = NULL;
+	video->pbo_job = NULL;
+	video->pbo_num = video->pbo_head = video->pbo_pending = 0;
 	return 0;
 }
 
-int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t now)
 {
 	GLint binding;
+	unsigned int slot;
+
+	/* copier only ever lowers pbo_copying, a stale value is harmless */
+	if (video->pbo_pending + video->pbo_copying == video->pbo_num)
+		return EBUSY; /* every PBO is still in flight */
+	slot = video->pbo_head;
 
 	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
-	glPushAttrib(GL_PIXEL_MODE_BIT);
-	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[slot]);
 
-	glReadBuffer(gl_capture->capture_buffer);
-	glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
 	/* to = ((char *)NULL + (offset)) */
-	glReadPixels(video->cx, video->cy, video->cw, video->ch,
-		gl_capture->format, GL_UNSIGNED_BYTE, NULL);
+	gl_capture_get_pixels(gl_capture, video, NULL);
+
+	if (gl_capture->glFenceSync)
+		video->pbo_fence[slot] =
+			gl_capture->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-	glPopClientAttrib();
-	glPopAttrib();
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
+
+	video->pbo_time[slot] = now;
+	video->pbo_head = (slot + 1) % video->pbo_num;
+	video->pbo_pending++;
 	return 0;
 }
 
-int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			glc_utime_t now)
 {
 	GLvoid *buf;
 	GLint binding;
+	unsigned int slot = GL_CAPTURE_PBO_TAIL(video);
+	int ret;
+
+	/* slot is released whatever happens to the frame */
+	video->pbo_pending--;
+	if (video->pbo_fence[slot]) {
+		gl_capture->glDeleteSync(video->pbo_fence[slot]);
+		video->pbo_fence[slot] = NULL;
+	}
 
 	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[slot]);
 	buf = gl_capture->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
-	if (unlikely(!buf))
+	if (unlikely(!buf)) {
+		gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
 		return EINVAL;
+	}
 
-	ps_packet_write(&video->packet, buf, video->row * video->ch);
+	/*
+	 * Make sure that the transfer time is not in the future. This could
+	 * happen if the state time is reset by reloading the capture between
+	 * a pbo start and a pbo read.
+	 */
+	ret = gl_capture_write_pbo(gl_capture, &video->packet, video,
+				   (video->pbo_time[slot] < now) ? video->pbo_time[slot] : now,
+				   buf);
 
 	gl_capture->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
-
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
-	return 0;
+	return ret;
 }
 
-int gl_capture_get_video_stream(gl_capture_t gl_capture,
-				struct gl_capture_video_stream_s **video,
-				Display *dpy, GLXDrawable drawable)
+/**
+ * \brief write a frame read back through PBO to buffer
+ * \param gl_capture gl_capture object
+ * \param packet packet to use
+ * \param video video stream
+ * \param time frame time
+ * \param buf mapped PBO
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_write_pbo(gl_capture_t gl_capture, ps_packet_t *packet,
+			 struct gl_capture_video_stream_s *video,
+			 glc_utime_t time, const GLvoid *buf)
 {
-	struct gl_capture_video_stream_s *fvideo;
+	glc_message_header_t msg;
+	glc_video_frame_header_t pic;
+	int ret = 0;
 
-	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
-	fvideo = gl_capture->video;
-	while (fvideo != NULL) {
-		if ((fvideo->drawable == drawable) && (fvideo->dpy == dpy))
-			break;
+	if ((gl_capture->flags & GL_CAPTURE_SKIP_REPEATS) &&
+	    (gl_capture_repeated(gl_capture, video, buf)))
+		return gl_capture_write_repeat_message(gl_capture, packet, video, time);
 
-		fvideo = fvideo->next;
+	if (unlikely(ps_packet_open(packet,
+				((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
+				(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+				(PS_PACKET_WRITE) :
+				(PS_PACKET_WRITE | PS_PACKET_TRY)))) {
+		__sync_fetch_and_add(&video->dropped, 1);
+		return 0;
 	}
-	pthread_rwlock_unlock(&gl_capture->videolist_lock);
 
-	if (fvideo == NULL) {
-		fvideo = (struct gl_capture_video_stream_s *)
-			calloc(1, sizeof(struct gl_capture_video_stream_s));
+	if (unlikely((ret = ps_packet_setsize(packet, video->size
+						+ sizeof(glc_message_header_t)
+						+ sizeof(glc_video_frame_header_t)))))
+		goto cancel;
 
-		fvideo->dpy          = dpy;
-		fvideo->drawable     = drawable;
-		fvideo->gather_stats = glc_log_get_level(gl_capture->glc) >= GLC_PERF;
-		ps_packet_init(&fvideo->packet, gl_capture->to);
+	msg.type = GLC_MESSAGE_VIDEO_FRAME;
+	if (unlikely((ret = ps_packet_write(packet,
+					    &msg, sizeof(glc_message_header_t)))))
+		goto cancel;
 
-		glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
+	pic.time = time;
+	pic.id   = video->id;
+	if (unlikely((ret = ps_packet_write(packet,
+					    &pic, sizeof(glc_video_frame_header_t)))))
+		goto cancel;
 
-		/* these functions need to be thread-safe */
-		pthread_rwlock_wrlock(&gl_capture->videolist_lock);
+	if (unlikely((ret = ps_packet_write(packet, (void *) buf,
+					    video->size))))
+		goto cancel;
 
-		fvideo->next      = gl_capture->video;
-		gl_capture->video = fvideo;
+	ps_packet_close(packet);
+	__sync_fetch_and_add(&video->num_frames, 1);
+	gl_capture_set_repeat_hash(gl_capture, video);
+	return 0;
 
-		pthread_rwlock_unlock(&gl_capture->videolist_lock);
+cancel:
+	if (ret == EBUSY) {
+		ret = 0;
+		__sync_fetch_and_add(&video->dropped, 1);
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "dropped frame, buffer not ready");
 	}
-	
-	*video = fvideo;
-	return 0;
+	ps_packet_cancel(packet);
+	return ret;
 }
 
-int gl_capture_init_video_format(gl_capture_t gl_capture,
-				struct gl_capture_video_stream_s *video)
+/**
+ * \brief hand over finished PBO transfers to the buffer
+ *
+ * Transfers are read back in the order they were started. With
+ * GL_ARB_sync only transfers completed by the GPU are mapped, so
+ * the application never waits for the GPU here. Without it, the
+ * oldest transfer is mapped only when its PBO is needed again.
+ * With copier thread, finished transfers are only queued.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param now current time
+ * \param need_slot a free PBO is needed for a new transfer
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_flush_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t now, int need_slot)
 {
-	/* initialize screen information */
-	gl_capture_update_screen(gl_capture, video);
+	unsigned int slot, read = 0;
+	int ret;
 
-	/* reset gamma values */
-	video->gamma_red = video->gamma_green = video->gamma_blue = 1.0;
+	while (video->pbo_pending) {
+		/* under pressure, capture swaps only free a PBO and others read one */
+		if (video->pace_level >= GL_CAPTURE_PACE_DEFER) {
+			if (need_slot ?
+			    (video->pbo_pending + video->pbo_copying < video->pbo_num) :
+			    (read > 0))
+				break;
+		}
 
-	if (gl_capture->format == GL_BGRA)
-		video->format = GLC_VIDEO_BGRA;
-	else
-		video->format = GLC_VIDEO_BGR;
+		slot = GL_CAPTURE_PBO_TAIL(video);
 
-	if (gl_capture->pack_alignment == 8)
-		video->flags |= GLC_VIDEO_DWORD_ALIGNED;
+		if (video->pbo_fence[slot]) {
+			if (gl_capture->glClientWaitSync(video->pbo_fence[slot],
+							 GL_SYNC_FLUSH_COMMANDS_BIT, 0) ==
+			    GL_TIMEOUT_EXPIRED)
+				break; /* still in flight, try again on next swap */
+		} else if ((!need_slot) || (video->pbo_pending < video->pbo_num))
+			break;
 
-	return 0;
-}
+		if (gl_capture->flags & GL_CAPTURE_USE_COPIER)
+			ret = gl_capture_queue_pbo(gl_capture, video, now);
+		else
+			ret = gl_capture_read_pbo(gl_capture, video, now);
+		if (unlikely(ret))
+			return ret;
+		read++;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief hand oldest transfer over to copier thread
+ *
+ * Called once the fence of the transfer is signaled, so the
+ * copier thread can read the coherent mapping without any GL call.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param now current time
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_queue_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t now)
+{
+	unsigned int slot = GL_CAPTURE_PBO_TAIL(video);
+	struct gl_capture_copy_job_s *job = &video->pbo_job[slot];
+
+	video->pbo_pending--;
+	if (video->pbo_fence[slot]) {
+		gl_capture->glDeleteSync(video->pbo_fence[slot]);
+		video->pbo_fence[slot] = NULL;
+	}
+
+	job->video = video;
+	job->slot = slot;
+	/* state time may have been reset by a reload, see gl_capture_read_pbo() */
+	job->time = (video->pbo_time[slot] < now) ? video->pbo_time[slot] : now;
+	job->next = NULL;
+
+	pthread_mutex_lock(&gl_capture->copier_mutex);
+	video->pbo_copying++;
+	if (gl_capture->copier_last)
+		gl_capture->copier_last->next = job;
+	else
+		gl_capture->copier_first = job;
+	gl_capture->copier_last = job;
+	pthread_cond_signal(&gl_capture->copier_cond);
+	pthread_mutex_unlock(&gl_capture->copier_mutex);
+
+	return 0;
+}
+
+/**
+ * \brief wait until copier thread is done with video stream
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ */
+void gl_capture_drain_copier(gl_capture_t gl_capture,
+			     struct gl_capture_video_stream_s *video)
+{
+	if (!(gl_capture->flags & GL_CAPTURE_USE_COPIER))
+		return;
+
+	pthread_mutex_lock(&gl_capture->copier_mutex);
+	while (video->pbo_copying)
+		pthread_cond_wait(&gl_capture->copier_done, &gl_capture->copier_mutex);
+	pthread_mutex_unlock(&gl_capture->copier_mutex);
+}
+
+/**
+ * \brief copier thread
+ *
+ * Streams finished transfers from persistently mapped PBOs
+ * to buffer, in the order they were queued. Exits once
+ * stopped and every queued frame is released.
+ * \param argptr gl_capture object
+ * \return always NULL
+ */
+void *gl_capture_copier_thread(void *argptr)
+{
+	gl_capture_t gl_capture = (gl_capture_t) argptr;
+	struct gl_capture_copy_job_s *job;
+	ps_packet_t packet;
+	int ret = 0;
+
+	ps_packet_init(&packet, gl_capture->to);
+
+	pthread_mutex_lock(&gl_capture->copier_mutex);
+	for (;;) {
+		while ((!gl_capture->copier_first) && (!gl_capture->copier_stop))
+			pthread_cond_wait(&gl_capture->copier_cond, &gl_capture->copier_mutex);
+		if (!gl_capture->copier_first)
+			break;
+
+		job = gl_capture->copier_first;
+		gl_capture->copier_first = job->next;
+		if (!gl_capture->copier_first)
+			gl_capture->copier_last = NULL;
+		pthread_mutex_unlock(&gl_capture->copier_mutex);
+
+		/* after an error frames are only released */
+		if (likely(!ret)) {
+			ret = gl_capture_write_pbo(gl_capture, &packet, job->video, job->time,
+						   job->video->pbo_map[job->slot]);
+			if (unlikely(ret) && (ret != EINTR))
+				gl_capture_error(gl_capture, ret);
+		}
+
+		pthread_mutex_lock(&gl_capture->copier_mutex);
+		job->video->pbo_copying--;
+		pthread_cond_broadcast(&gl_capture->copier_done);
+	}
+	pthread_mutex_unlock(&gl_capture->copier_mutex);
+
+	ps_packet_destroy(&packet);
+	return NULL;
+}
+
+/**
+ * \brief look up framebuffer object functions
+ *
+ * Shared by GPU scaling and GPU Y'CbCr conversion.
+ * \param gl_capture gl_capture object
+ * \param gl_extensions GL extension string
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_load_fbo(gl_capture_t gl_capture, const char *gl_extensions)
+{
+	if (gl_capture->glBlitFramebuffer)
+		return 0;
+
+	if (unlikely(!strstr(gl_extensions, "GL_ARB_framebuffer_object"))) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "GL_ARB_framebuffer_object not supported");
+		return ENOTSUP;
+	}
+
+	if (unlikely(gl_capture_load_libgl(gl_capture)))
+		return ENOTSUP;
+
+	gl_capture->glGenFramebuffers =
+		(glGenFramebuffersProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glGenFramebuffers");
+	gl_capture->glDeleteFramebuffers =
+		(glDeleteFramebuffersProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteFramebuffers");
+	gl_capture->glBindFramebuffer =
+		(glBindFramebufferProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glBindFramebuffer");
+	gl_capture->glGenRenderbuffers =
+		(glGenRenderbuffersProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glGenRenderbuffers");
+	gl_capture->glDeleteRenderbuffers =
+		(glDeleteRenderbuffersProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteRenderbuffers");
+	gl_capture->glBindRenderbuffer =
+		(glBindRenderbufferProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glBindRenderbuffer");
+	gl_capture->glRenderbufferStorage =
+		(glRenderbufferStorageProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glRenderbufferStorage");
+	gl_capture->glFramebufferRenderbuffer =
+		(glFramebufferRenderbufferProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glFramebufferRenderbuffer");
+	gl_capture->glCheckFramebufferStatus =
+		(glCheckFramebufferStatusProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glCheckFramebufferStatus");
+	gl_capture->glBlitFramebuffer =
+		(glBlitFramebufferProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glBlitFramebuffer");
+
+	if (unlikely((!gl_capture->glGenFramebuffers) ||
+		     (!gl_capture->glDeleteFramebuffers) ||
+		     (!gl_capture->glBindFramebuffer) ||
+		     (!gl_capture->glGenRenderbuffers) ||
+		     (!gl_capture->glDeleteRenderbuffers) ||
+		     (!gl_capture->glBindRenderbuffer) ||
+		     (!gl_capture->glRenderbufferStorage) ||
+		     (!gl_capture->glFramebufferRenderbuffer) ||
+		     (!gl_capture->glCheckFramebufferStatus) ||
+		     (!gl_capture->glBlitFramebuffer))) {
+		gl_capture->glBlitFramebuffer = NULL;
+		return ENOTSUP;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief prepare scaling on GPU
+ *
+ * Needs GL_ARB_framebuffer_object for glBlitFramebuffer(). A
+ * multisampled window can't be blitted with scaling, so scaling
+ * is left to the CPU in that case.
+ * \param gl_capture gl_capture object
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_init_scale(gl_capture_t gl_capture)
+{
+	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
+	GLint sample_buffers = 0;
+
+	if (unlikely(gl_extensions == NULL))
+		return EINVAL;
+
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &sample_buffers);
+	if (unlikely(sample_buffers)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "multisampled drawable, can't scale on GPU");
+		return ENOTSUP;
+	}
+
+	if (unlikely(gl_capture_load_fbo(gl_capture, gl_extensions)))
+		return ENOTSUP;
+
+	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+		 "using GL_ARB_framebuffer_object, scaling with factor %f on GPU",
+		 gl_capture->gpu_scale);
+	return 0;
+}
+
+/**
+ * \brief create or resize scale framebuffer of video stream
+ *
+ * Fails when the framebuffer isn't complete, the caller then
+ * falls back to scaling after capture.
+ * \param gl_capture gl_capture object
+ * \param video video stream, ow and oh already calculated
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_create_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	GLint fbo, rbo, max_size = 0;
+	GLenum status;
+
+	/* oversized storage would leave GL_INVALID_VALUE to the application */
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+	if (unlikely((video->ow > (unsigned int) max_size) ||
+		     (video->oh > (unsigned int) max_size))) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "scaled picture %ux%u is larger than renderbuffer limit %d",
+			 video->ow, video->oh, max_size);
+		if (video->scale_fbo)
+			gl_capture_destroy_scale(gl_capture, video);
+		return ENOTSUP;
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+	glGetIntegerv(GL_RENDERBUFFER_BINDING, &rbo);
+
+	if (!video->scale_fbo) {
+		gl_capture->glGenFramebuffers(1, &video->scale_fbo);
+		gl_capture->glGenRenderbuffers(1, &video->scale_rbo);
+	}
+
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, video->scale_rbo);
+	gl_capture->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, video->ow, video->oh);
+
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, video->scale_fbo);
+	gl_capture->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					      GL_RENDERBUFFER, video->scale_rbo);
+	status = gl_capture->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	if (unlikely(status != GL_FRAMEBUFFER_COMPLETE)) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "scale framebuffer incomplete (0x%04x)", status);
+		gl_capture_destroy_scale(gl_capture, video);
+		return ENOTSUP;
+	}
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "scaling video %d on GPU from %ux%u to %ux%u", video->id,
+		 video->cw, video->ch, video->ow, video->oh);
+	return 0;
+}
+
+int gl_capture_destroy_scale(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying scale framebuffer");
+
+	gl_capture->glDeleteFramebuffers(1, &video->scale_fbo);
+	gl_capture->glDeleteRenderbuffers(1, &video->scale_rbo);
+	video->scale_fbo = video->scale_rbo = 0;
+	return 0;
+}
+
+/**
+ * \brief prepare Y'CbCr conversion on GPU
+ *
+ * Needs OpenGL 2.0 for GLSL and GL_ARB_framebuffer_object. When
+ * a scale factor is set, picture must be scaled on GPU too since
+ * the ycbcr filter can't scale Y'CbCr data.
+ * \param gl_capture gl_capture object
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_init_ycbcr(gl_capture_t gl_capture)
+{
+	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
+	const char *gl_version = (const char *) glGetString(GL_VERSION);
+	int major = 0;
+
+	if (unlikely((gl_extensions == NULL) || (gl_version == NULL)))
+		return EINVAL;
+
+	if (unlikely((gl_capture->gpu_scale != 1.0) &&
+		     (!(gl_capture->flags & GL_CAPTURE_USE_SCALE)))) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "picture isn't scaled on GPU, can't convert to Y'CbCr on GPU");
+		return ENOTSUP;
+	}
+
+	if (unlikely((sscanf(gl_version, "%d.", &major) != 1) || (major < 2))) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "OpenGL 2.0 not supported, can't convert to Y'CbCr on GPU");
+		return ENOTSUP;
+	}
+
+	if (unlikely(gl_capture_load_fbo(gl_capture, gl_extensions)))
+		return ENOTSUP;
+
+	gl_capture->glActiveTexture =
+		(glActiveTextureProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glActiveTexture");
+	gl_capture->glCreateShader =
+		(glCreateShaderProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glCreateShader");
+	gl_capture->glShaderSource =
+		(glShaderSourceProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glShaderSource");
+	gl_capture->glCompileShader =
+		(glCompileShaderProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glCompileShader");
+	gl_capture->glGetShaderiv =
+		(glGetShaderivProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glGetShaderiv");
+	gl_capture->glDeleteShader =
+		(glDeleteShaderProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteShader");
+	gl_capture->glCreateProgram =
+		(glCreateProgramProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glCreateProgram");
+	gl_capture->glAttachShader =
+		(glAttachShaderProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glAttachShader");
+	gl_capture->glLinkProgram =
+		(glLinkProgramProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glLinkProgram");
+	gl_capture->glGetProgramiv =
+		(glGetProgramivProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glGetProgramiv");
+	gl_capture->glUseProgram =
+		(glUseProgramProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glUseProgram");
+	gl_capture->glDeleteProgram =
+		(glDeleteProgramProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteProgram");
+	gl_capture->glGetUniformLocation =
+		(glGetUniformLocationProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glGetUniformLocation");
+	gl_capture->glUniform1i =
+		(glUniform1iProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glUniform1i");
+	gl_capture->glUniform2f =
+		(glUniform2fProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glUniform2f");
+
+	if (unlikely((!gl_capture->glActiveTexture) ||
+		     (!gl_capture->glCreateShader) ||
+		     (!gl_capture->glShaderSource) ||
+		     (!gl_capture->glCompileShader) ||
+		     (!gl_capture->glGetShaderiv) ||
+		     (!gl_capture->glDeleteShader) ||
+		     (!gl_capture->glCreateProgram) ||
+		     (!gl_capture->glAttachShader) ||
+		     (!gl_capture->glLinkProgram) ||
+		     (!gl_capture->glGetProgramiv) ||
+		     (!gl_capture->glUseProgram) ||
+		     (!gl_capture->glDeleteProgram) ||
+		     (!gl_capture->glGetUniformLocation) ||
+		     (!gl_capture->glUniform1i) ||
+		     (!gl_capture->glUniform2f)))
+		return ENOTSUP;
+
+	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+		 "converting pictures to Y'CbCr 4:2:0 on GPU");
+	return 0;
+}
+
+/**
+ * \brief create or resize Y'CbCr conversion objects of video stream
+ *
+ * Source texture holds the captured picture, planes are rendered
+ * into a single renderbuffer: Y' at the bottom, Cb and Cr side by
+ * side above it.
+ * \param gl_capture gl_capture object
+ * \param video video stream, ow, oh, yw and yh already calculated
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_create_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	const GLchar *source = gl_capture_ycbcr_shader;
+	GLint fbo, rbo, tex, program, status;
+	GLuint shader;
+	int ret = 0;
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+	glGetIntegerv(GL_RENDERBUFFER_BINDING, &rbo);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &tex);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	if (!video->ycbcr_program) {
+		shader = gl_capture->glCreateShader(GL_FRAGMENT_SHADER);
+		gl_capture->glShaderSource(shader, 1, &source, NULL);
+		gl_capture->glCompileShader(shader);
+		gl_capture->glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (unlikely(!status)) {
+			glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+				 "can't compile Y'CbCr shader");
+			gl_capture->glDeleteShader(shader);
+			return ENOTSUP;
+		}
+
+		video->ycbcr_program = gl_capture->glCreateProgram();
+		gl_capture->glAttachShader(video->ycbcr_program, shader);
+		gl_capture->glLinkProgram(video->ycbcr_program);
+		gl_capture->glDeleteShader(shader); /* program keeps it */
+		gl_capture->glGetProgramiv(video->ycbcr_program, GL_LINK_STATUS, &status);
+		if (unlikely(!status)) {
+			glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+				 "can't link Y'CbCr shader");
+			ret = ENOTSUP;
+			goto finish;
+		}
+
+		glGenTextures(1, &video->ycbcr_tex);
+		gl_capture->glGenFramebuffers(1, &video->ycbcr_fbo);
+		gl_capture->glGenRenderbuffers(1, &video->ycbcr_rbo);
+	}
+
+	/* texels are fetched at their centers, filtering doesn't matter */
+	glBindTexture(GL_TEXTURE_2D, video->ycbcr_tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, video->ow, video->oh, 0,
+		     GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, video->ycbcr_rbo);
+	gl_capture->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8,
+					  video->yw, video->yh + video->yh / 2);
+
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, video->ycbcr_fbo);
+	gl_capture->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					      GL_RENDERBUFFER, video->ycbcr_rbo);
+	if (unlikely(gl_capture->glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+		     GL_FRAMEBUFFER_COMPLETE)) {
+		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
+			 "Y'CbCr framebuffer incomplete");
+		ret = ENOTSUP;
+		goto finish;
+	}
+
+	gl_capture->glUseProgram(video->ycbcr_program);
+	gl_capture->glUniform1i(gl_capture->glGetUniformLocation(video->ycbcr_program,
+								 "picture"), 0);
+	gl_capture->glUniform2f(gl_capture->glGetUniformLocation(video->ycbcr_program,
+								 "size"),
+				video->ow, video->oh);
+	gl_capture->glUniform2f(gl_capture->glGetUniformLocation(video->ycbcr_program,
+								 "planes"),
+				video->yw / 2, video->yh);
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		 "converting video %d to Y'CbCr on GPU, %ux%u", video->id,
+		 video->yw, video->yh);
+
+finish:
+	gl_capture->glUseProgram(program);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	gl_capture->glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+	gl_capture->glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	if (unlikely(ret))
+		gl_capture_destroy_ycbcr(gl_capture, video);
+	return ret;
+}
+
+int gl_capture_destroy_ycbcr(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying Y'CbCr objects");
+
+	gl_capture->glDeleteProgram(video->ycbcr_program);
+	glDeleteTextures(1, &video->ycbcr_tex);
+	gl_capture->glDeleteFramebuffers(1, &video->ycbcr_fbo);
+	gl_capture->glDeleteRenderbuffers(1, &video->ycbcr_rbo);
+	video->ycbcr_program = 0;
+	video->ycbcr_tex = video->ycbcr_fbo = video->ycbcr_rbo = 0;
+	return 0;
+}
+
+/**
+ * \brief convert picture in current read buffer and read planes
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param to destination, offset in bound PBO when using PBO
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_read_ycbcr(gl_capture_t gl_capture,
+			  struct gl_capture_video_stream_s *video, char *to)
+{
+	unsigned int cw = video->yw / 2, ch = video->yh / 2;
+	GLint program, draw_fbo;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+	/* copy picture from read buffer, which is already set up */
+	gl_capture->glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, video->ycbcr_tex);
+	if (video->scale_fbo)
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, video->ow, video->oh);
+	else
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, video->cx, video->cy,
+				    video->cw, video->ch);
+
+	/* nothing but the shader should touch fragments */
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_COLOR_LOGIC_OP);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_DITHER);
+	glDisable(GL_FOG);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, video->ycbcr_fbo);
+	glViewport(0, 0, video->yw, video->yh + ch);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	gl_capture->glUseProgram(video->ycbcr_program);
+	glRectf(-1.0f, -1.0f, 1.0f, 1.0f);
+	gl_capture->glUseProgram(program);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+
+	/* attributes are restored to the application framebuffer */
+	gl_capture->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	glPopAttrib();
+
+	/* planes are read tightly packed, one byte per sample */
+	gl_capture->glBindFramebuffer(GL_READ_FRAMEBUFFER, video->ycbcr_fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, video->yw, video->yh, GL_RED, GL_UNSIGNED_BYTE, to);
+	glReadPixels(0, video->yh, cw, ch, GL_RED, GL_UNSIGNED_BYTE,
+		     to + video->yw * video->yh);
+	glReadPixels(cw, video->yh, cw, ch, GL_RED, GL_UNSIGNED_BYTE,
+		     to + video->yw * video->yh + cw * ch);
+
+	return 0;
+}
+
+/**
+ * \brief walk published video stream list
+ *
+ * Streams are fully initialized before being published and stay
+ * until gl_capture_destroy(), so no lock is needed.
+ * \param gl_capture gl_capture object
+ * \param dpy display
+ * \param drawable drawable
+ * \return stream or NULL if not found
+ */
+struct gl_capture_video_stream_s *gl_capture_find_video_stream(gl_capture_t gl_capture,
+							     Display *dpy,
+							     GLXDrawable drawable)
+{
+	struct gl_capture_video_stream_s *fvideo = gl_capture->video;
+
+	while (fvideo != NULL) {
+		if ((fvideo->drawable == drawable) && (fvideo->dpy == dpy))
+			break;
+
+		fvideo = fvideo->next;
+	}
+
+	return fvideo;
+}
+
+int gl_capture_get_video_stream(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s **video,
+				Display *dpy, GLXDrawable drawable)
+{
+	struct gl_capture_video_stream_s *fvideo = gl_capture_last_video;
+
+	/* common case, same drawable as on last swap of this thread */
+	if (likely((gl_capture_last_gen == gl_capture->gen) &&
+		   (fvideo->drawable == drawable) && (fvideo->dpy == dpy))) {
+		*video = fvideo;
+		return 0;
+	}
+
+	fvideo = gl_capture_find_video_stream(gl_capture, dpy, drawable);
+
+	if (fvideo == NULL) {
+		/* writers are serialized, stream might have been added meanwhile */
+		pthread_mutex_lock(&gl_capture->videolist_mutex);
+
+		fvideo = gl_capture_find_video_stream(gl_capture, dpy, drawable);
+		if (fvideo == NULL) {
+			fvideo = (struct gl_capture_video_stream_s *)
+				calloc(1, sizeof(struct gl_capture_video_stream_s));
+
+			fvideo->dpy          = dpy;
+			fvideo->drawable     = drawable;
+			fvideo->gather_stats = glc_log_get_level(gl_capture->glc) >= GLC_PERF;
+			ps_packet_init(&fvideo->packet, gl_capture->to);
+
+			glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
+
+			fvideo->next = gl_capture->video;
+			__sync_synchronize(); /* stream is complete before it is published */
+			gl_capture->video = fvideo;
+		}
+
+		pthread_mutex_unlock(&gl_capture->videolist_mutex);
+	}
+
+	gl_capture_last_video = fvideo;
+	gl_capture_last_gen   = gl_capture->gen;
+
+	*video = fvideo;
+	return 0;
+}
+
+int gl_capture_init_video_format(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video)
+{
+	/* initialize screen information */
+	gl_capture_update_screen(gl_capture, video);
+
+	/* reset gamma values */
+	video->gamma_red = video->gamma_green = video->gamma_blue = 1.0;
+
+	if (gl_capture->format == GL_BGRA)
+		video->format = GLC_VIDEO_BGRA;
+	else
+		video->format = GLC_VIDEO_BGR;
+
+	if (gl_capture->pack_alignment == 8)
+		video->flags |= GLC_VIDEO_DWORD_ALIGNED;
+
+	return 0;
+}
 
 int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 			struct gl_capture_video_stream_s *video,
@@ -725,17 +2134,57 @@ int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 	glc_message_header_t msg;
 	glc_video_format_message_t format_msg;
 
+	/*
+	 * frames of previous size must be in buffer before new format,
+	 * and copier must not see new geometry while copying them
+	 */
+	gl_capture_drain_copier(gl_capture, video);
+	video->repeat_epoch = 0;
+
 	gl_capture_calc_geometry(gl_capture, video, w, h);
 
 	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 		 "creating/updating configuration for video %d", video->id);
 
+	if (gl_capture->flags & GL_CAPTURE_USE_SCALE) {
+		if (unlikely(gl_capture_create_scale(gl_capture, video))) {
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				 "can't scale on GPU, picture is scaled after capture");
+			/* ycbcr filter can't scale converted pictures */
+			gl_capture->flags &= ~(GL_CAPTURE_TRY_SCALE | GL_CAPTURE_USE_SCALE |
+					       GL_CAPTURE_TRY_YCBCR | GL_CAPTURE_USE_YCBCR);
+			gl_capture_calc_geometry(gl_capture, video, w, h);
+		}
+	} else if (video->scale_fbo)
+		gl_capture_destroy_scale(gl_capture, video);
+
+	if (gl_capture->flags & GL_CAPTURE_USE_YCBCR) {
+		if (unlikely(gl_capture_create_ycbcr(gl_capture, video))) {
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				 "can't convert to Y'CbCr on GPU, picture is converted after capture");
+			gl_capture->flags &= ~(GL_CAPTURE_TRY_YCBCR | GL_CAPTURE_USE_YCBCR);
+			gl_capture_calc_geometry(gl_capture, video, w, h);
+		}
+	} else if (video->ycbcr_program)
+		gl_capture_destroy_ycbcr(gl_capture, video);
+
 	msg.type = GLC_MESSAGE_VIDEO_FORMAT;
-	format_msg.flags  = video->flags;
-	format_msg.format = video->format;
 	format_msg.id     = video->id;
-	format_msg.width  = video->cw;
-	format_msg.height = video->ch;
+	if (video->ycbcr_program) {
+		format_msg.flags  = video->flags & ~GLC_VIDEO_DWORD_ALIGNED;
+		format_msg.format = GLC_VIDEO_YCBCR_420JPEG;
+		format_msg.width  = video->yw;
+		format_msg.height = video->yh;
+	} else {
+		format_msg.flags  = video->flags;
+		format_msg.format = video->format;
+		format_msg.width  = video->ow;
+		format_msg.height = video->oh;
+	}
+
+	/* tell scale and ycbcr not to scale this picture again */
+	if (video->scale_fbo)
+		format_msg.flags |= GLC_VIDEO_SCALED;
 
 	ps_packet_open(&video->packet, PS_PACKET_WRITE);
 	ps_packet_write(&video->packet, &msg, sizeof(glc_message_header_t));
@@ -744,7 +2193,7 @@ int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 
 	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
 		 "video %d: %ux%u (%ux%u), 0x%02x flags", video->id,
-		 video->cw, video->ch, video->w, video->h, video->flags);
+		 format_msg.width, format_msg.height, video->w, video->h, format_msg.flags);
 
 	/* how about color correction? */
 	gl_capture_update_color(gl_capture, video);
@@ -782,6 +2231,32 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 		pthread_mutex_unlock(&gl_capture->init_pbo_mutex);
 	}
 
+	/* same for scale framebuffer */
+	if ((!(gl_capture->flags & GL_CAPTURE_USE_SCALE)) &&
+	    (gl_capture->flags & GL_CAPTURE_TRY_SCALE)) {
+		pthread_mutex_lock(&gl_capture->init_pbo_mutex);
+
+		if (!gl_capture_init_scale(gl_capture))
+			gl_capture->flags |= GL_CAPTURE_USE_SCALE;
+		else
+			gl_capture->flags &= ~GL_CAPTURE_TRY_SCALE;
+
+		pthread_mutex_unlock(&gl_capture->init_pbo_mutex);
+	}
+
+	/* and Y'CbCr conversion, after scaling which it depends on */
+	if ((!(gl_capture->flags & GL_CAPTURE_USE_YCBCR)) &&
+	    (gl_capture->flags & GL_CAPTURE_TRY_YCBCR)) {
+		pthread_mutex_lock(&gl_capture->init_pbo_mutex);
+
+		if (!gl_capture_init_ycbcr(gl_capture))
+			gl_capture->flags |= GL_CAPTURE_USE_YCBCR;
+		else
+			gl_capture->flags &= ~GL_CAPTURE_TRY_YCBCR;
+
+		pthread_mutex_unlock(&gl_capture->init_pbo_mutex);
+	}
+
 	gl_capture_get_geometry(gl_capture, video->dpy,
 				video->attribWin ? video->attribWin : video->drawable,
 				&w, &h);
@@ -812,7 +2287,7 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 	struct gl_capture_video_stream_s *video;
 	glc_message_header_t msg;
 	glc_video_frame_header_t pic;
-	glc_utime_t now;
+	glc_utime_t now, start;
 	glc_utime_t before_capture,after_capture;
 	char *dma;
 	int ret = 0;
@@ -827,76 +2302,91 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 		now = video->last + gl_capture->fps;
 	else
 		now = glc_state_time(gl_capture->glc);
+	start = now;
 
-	/* has gl_capture->fps nanoseconds elapsed since last capture */
-	if ((now - video->last < gl_capture->fps) &&
+	/* has capture interval elapsed since last capture */
+	if ((now - video->last < GL_CAPTURE_INTERVAL(gl_capture, video)) &&
 	    !(gl_capture->flags & GL_CAPTURE_LOCK_FPS) &&
-	    !(gl_capture->flags & GL_CAPTURE_IGNORE_TIME))
+	    !(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) {
+		/* finished transfers are still handed over on every swap */
+		if ((gl_capture->flags & GL_CAPTURE_USE_PBO) && (video->pbo_pending)) {
+			ret = gl_capture_flush_pbo(gl_capture, video, now, 0);
+			if (GL_CAPTURE_PACING(gl_capture))
+				gl_capture_pace(gl_capture, video, now,
+						glc_state_time(gl_capture->glc));
+		}
 		goto finish;
+	}
 
 	/* not really needed until now */
 	gl_capture_update_video_stream(gl_capture, video);
 
-	/* if PBO is not active, just start transfer and finish */
-	if (unlikely((gl_capture->flags & GL_CAPTURE_USE_PBO) &&
-	     __sync_bool_compare_and_swap(&video->pbo_active,0,1))) {
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
-		goto finish;
-	}
-
-	if (unlikely(ps_packet_open(&video->packet,
-				((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
-				(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
-				(PS_PACKET_WRITE) :
-				(PS_PACKET_WRITE | PS_PACKET_TRY))))
-		goto finish;
+	if (video->gather_stats)
+		before_capture = glc_state_time(gl_capture->glc);
 
-	if (unlikely((ret = ps_packet_setsize(&video->packet, video->row * video->ch
-						+ sizeof(glc_message_header_t)
-						+ sizeof(glc_video_frame_header_t)))))
-		goto cancel;
+	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
+		/* previous pictures are written to buffer once their transfer is done */
+		if (unlikely((ret = gl_capture_flush_pbo(gl_capture, video, now, 1))))
+			goto finish;
+
+		if (unlikely((ret = gl_capture_start_pbo(gl_capture, video, now)))) {
+			if (ret == EBUSY) {
+				ret = 0;
+				__sync_fetch_and_add(&video->dropped, 1);
+				glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+					 "dropped frame, no PBO available");
+			}
+			goto paced;
+		}
+	} else {
+		if (unlikely(ps_packet_open(&video->packet,
+					((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
+					(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+					(PS_PACKET_WRITE) :
+					(PS_PACKET_WRITE | PS_PACKET_TRY)))) {
+			__sync_fetch_and_add(&video->dropped, 1);
+			goto paced;
+		}
 
-	msg.type = GLC_MESSAGE_VIDEO_FRAME;
-	if (unlikely((ret = ps_packet_write(&video->packet,
-					    &msg, sizeof(glc_message_header_t)))))
-		goto cancel;
+		if (unlikely((ret = ps_packet_setsize(&video->packet, video->size
+							+ sizeof(glc_message_header_t)
+							+ sizeof(glc_video_frame_header_t)))))
+			goto cancel;
 
-	/*
-	 * if we are using PBO we will actually write previous picture to buffer.
-	 * Also, make sure that pbo_time is not in the future. This could happen if
-	 * the state time is reset by reloading the capture between a pbo start
-	 * and a pbo read.
-	 */
-	pic.time = (gl_capture->flags & GL_CAPTURE_USE_PBO &&
-		    video->pbo_time < now)?video->pbo_time:now;
-	pic.id   = video->id;
-	if (unlikely((ret = ps_packet_write(&video->packet,
-					    &pic, sizeof(glc_video_frame_header_t)))))
-		goto cancel;
+		msg.type = GLC_MESSAGE_VIDEO_FRAME;
+		if (unlikely((ret = ps_packet_write(&video->packet,
+						    &msg, sizeof(glc_message_header_t)))))
+			goto cancel;
 
-	if (video->gather_stats)
-		before_capture = glc_state_time(gl_capture->glc);
-	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
-		if (unlikely((ret = gl_capture_read_pbo(gl_capture, video))))
+		pic.time = now;
+		pic.id   = video->id;
+		if (unlikely((ret = ps_packet_write(&video->packet,
+						    &pic, sizeof(glc_video_frame_header_t)))))
 			goto cancel;
 
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
-	} else {
 		if (unlikely((ret = ps_packet_dma(&video->packet, (void *) &dma,
-					video->row * video->ch, PS_ACCEPT_FAKE_DMA))))
+					video->size, PS_ACCEPT_FAKE_DMA))))
 			goto cancel;
 
 		ret = gl_capture_get_pixels(gl_capture, video, dma);
+
+		if ((gl_capture->flags & GL_CAPTURE_SKIP_REPEATS) && (likely(!ret)) &&
+		    (gl_capture_repeated(gl_capture, video, dma))) {
+			ps_packet_cancel(&video->packet);
+			ret = gl_capture_write_repeat_message(gl_capture, &video->packet,
+							      video, now);
+		} else {
+			ps_packet_close(&video->packet);
+			__sync_fetch_and_add(&video->num_frames, 1);
+			gl_capture_set_repeat_hash(gl_capture, video);
+		}
 	}
+
 	if (video->gather_stats) {
 		after_capture = glc_state_time(gl_capture->glc);
 		video->capture_time_ns += after_capture - before_capture;
 	}
 
-	ps_packet_close(&video->packet);
-	video->num_frames++;
 	now = glc_state_time(gl_capture->glc);
 
 	if (unlikely((gl_capture->flags & GL_CAPTURE_LOCK_FPS) &&
@@ -908,8 +2398,12 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 		}
 	}
 
-	/* increment by 1/fps seconds */
-	video->last += gl_capture->fps;
+	/* increment by capture interval */
+	video->last += GL_CAPTURE_INTERVAL(gl_capture, video);
+
+paced:
+	if (GL_CAPTURE_PACING(gl_capture))
+		gl_capture_pace(gl_capture, video, start, glc_state_time(gl_capture->glc));
 
 finish:
 	if (unlikely(ret != 0))
@@ -920,15 +2414,267 @@ finish:
 
 	return ret;
 cancel:
+	ps_packet_cancel(&video->packet);
 	if (ret == EBUSY) {
 		ret = 0;
+		__sync_fetch_and_add(&video->dropped, 1);
 		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 			 "dropped frame, buffer not ready");
+		goto paced;
 	}
-	ps_packet_cancel(&video->packet);
 	goto finish;
 }
 
+/**
+ * \brief adapt capture to frame time budget
+ *
+ * Called on swaps where gl_capture did some work. Capture cost is
+ * averaged over 8 swaps. Cost over budget or frames dropped because
+ * buffer or PBOs were full degrade capture by one level, at most
+ * every 8 swaps. 64 calm swaps under half the budget restore one
+ * level. Level changes are written to stream.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param now time when swap started
+ * \param end time when gl_capture was done
+ */
+void gl_capture_pace(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+		     glc_utime_t now, glc_utime_t end)
+{
+	unsigned int level = video->pace_level;
+	unsigned int dropped = __sync_fetch_and_add(&video->dropped, 0);
+	int busy = (dropped != video->pace_dropped);
+
+	video->overhead = video->overhead - video->overhead / 8 + (end - now) / 8;
+	video->pace_dropped = dropped;
+	video->pace_frames++;
+
+	if ((busy) || (video->overhead > gl_capture->budget)) {
+		video->pace_calm = 0;
+		if ((level < GL_CAPTURE_PACE_MAX) && (video->pace_frames >= 8)) {
+			level++;
+			/* nothing to defer without PBO */
+			if ((level == GL_CAPTURE_PACE_DEFER) &&
+			    (!(gl_capture->flags & GL_CAPTURE_USE_PBO)))
+				level++;
+		}
+	} else if ((level) && (video->overhead < gl_capture->budget / 2) &&
+		   (++video->pace_calm >= 64)) {
+		level--;
+		if ((level == GL_CAPTURE_PACE_DEFER) &&
+		    (!(gl_capture->flags & GL_CAPTURE_USE_PBO)))
+			level--;
+	}
+
+	if (level != video->pace_level) {
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "video %d: %s to pace level %u, overhead %llu nsec, %u frames dropped",
+			 video->id, level > video->pace_level ? "degrading" : "restoring",
+			 level, (unsigned long long) video->overhead,
+			 dropped - video->pace_reported);
+
+		video->pace_level = level;
+		video->pace_frames = video->pace_calm = 0;
+		video->pace_changes++;
+		if (level > video->pace_max)
+			video->pace_max = level;
+		video->pace_report = 1;
+	}
+
+	if (video->pace_report)
+		gl_capture_write_pace_message(gl_capture, video, now);
+}
+
+/**
+ * \brief write pace level of video stream to buffer
+ *
+ * Never blocks, message is tried again on next swap when buffer
+ * is full.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param now current time
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_write_pace_message(gl_capture_t gl_capture,
+				  struct gl_capture_video_stream_s *video, glc_utime_t now)
+{
+	glc_message_header_t msg_hdr;
+	glc_video_pace_message_t msg;
+	int ret;
+
+	msg_hdr.type = GLC_MESSAGE_VIDEO_PACE;
+	msg.id = video->id;
+	msg.time = now;
+	msg.level = video->pace_level;
+	msg.interval = GL_CAPTURE_INTERVAL(gl_capture, video);
+	msg.overhead = video->overhead;
+	msg.dropped = video->pace_dropped - video->pace_reported;
+
+	if (unlikely((ret = ps_packet_open(&video->packet, PS_PACKET_WRITE | PS_PACKET_TRY))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(&video->packet,
+				&msg_hdr, sizeof(glc_message_header_t)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(&video->packet,
+				&msg, sizeof(glc_video_pace_message_t)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_close(&video->packet))))
+		goto cancel;
+
+	video->pace_reported = video->pace_dropped;
+	video->pace_report = 0;
+	return 0;
+
+cancel:
+	ps_packet_cancel(&video->packet);
+	return ret;
+}
+
+/**
+ * \brief hash picture data
+ *
+ * xxHash64 style with four independent lanes over 32 byte stripes,
+ * so compiler can keep all of them in flight. Only tile bytes out
+ * of every step bytes are hashed, tile equal to step hashes all.
+ * Step is not a multiple of row size, so sampled tiles shift from
+ * row to row and cover whole picture width over a few rows.
+ * \param data picture data
+ * \param size size of picture data
+ * \param tile bytes hashed per step
+ * \param step distance between tiles
+ * \return hash value
+ */
+u_int64_t gl_capture_hash(const unsigned char *data, size_t size,
+			  size_t tile, size_t step)
+{
+	u_int64_t acc[4] = { GL_CAPTURE_HASH_PRIME1 + GL_CAPTURE_HASH_PRIME2,
+			     GL_CAPTURE_HASH_PRIME2, 0, -GL_CAPTURE_HASH_PRIME1 };
+	u_int64_t in[4], h;
+	size_t off, len, i;
+	int lane;
+
+	for (off = 0; off < size; off += step) {
+		len = (size - off < tile) ? size - off : tile;
+
+		for (i = 0; i < len; i += sizeof(in)) {
+			/* data is not aligned in packets, partial stripe is zero padded */
+			if (likely(len - i >= sizeof(in)))
+				memcpy(in, &data[off + i], sizeof(in));
+			else {
+				memset(in, 0, sizeof(in));
+				memcpy(in, &data[off + i], len - i);
+			}
+
+			for (lane = 0; lane < 4; lane++) {
+				acc[lane] += in[lane] * GL_CAPTURE_HASH_PRIME2;
+				acc[lane] = GL_CAPTURE_HASH_ROTL(acc[lane], 31);
+				acc[lane] *= GL_CAPTURE_HASH_PRIME1;
+			}
+		}
+	}
+
+	h = GL_CAPTURE_HASH_ROTL(acc[0], 1) + GL_CAPTURE_HASH_ROTL(acc[1], 7) +
+	    GL_CAPTURE_HASH_ROTL(acc[2], 12) + GL_CAPTURE_HASH_ROTL(acc[3], 18);
+	h += size;
+
+	h ^= h >> 33;
+	h *= GL_CAPTURE_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= GL_CAPTURE_HASH_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * \brief check if frame repeats last frame written
+ *
+ * Sampled tiles miss changes that fall between them, like a
+ * blinking cursor, hashing whole frames doesn't.
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ * \param buf frame data
+ * \return 1 if frame is a repeat, otherwise 0
+ */
+int gl_capture_repeated(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			const void *buf)
+{
+	if (gl_capture->flags & GL_CAPTURE_HASH_ALL)
+		video->frame_hash = gl_capture_hash(buf, video->size, video->size, video->size);
+	else
+		video->frame_hash = gl_capture_hash(buf, video->size, GL_CAPTURE_REPEAT_TILE,
+						    GL_CAPTURE_REPEAT_STEP);
+
+	return (video->repeat_epoch == gl_capture->repeat_epoch) &&
+	       (video->frame_hash == video->repeat_hash);
+}
+
+/**
+ * \brief remember frame just written
+ * \param gl_capture gl_capture object
+ * \param video video stream
+ */
+void gl_capture_set_repeat_hash(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video)
+{
+	if (!(gl_capture->flags & GL_CAPTURE_SKIP_REPEATS))
+		return;
+
+	video->repeat_hash = video->frame_hash;
+	video->repeat_epoch = gl_capture->repeat_epoch;
+}
+
+/**
+ * \brief write repeated frame to buffer
+ *
+ * Frame is dropped like a full one when buffer is not ready.
+ * \param gl_capture gl_capture object
+ * \param packet packet to use
+ * \param video video stream
+ * \param time frame time
+ * \return 0 on success otherwise an error code
+ */
+int gl_capture_write_repeat_message(gl_capture_t gl_capture, ps_packet_t *packet,
+				    struct gl_capture_video_stream_s *video,
+				    glc_utime_t time)
+{
+	glc_message_header_t msg_hdr;
+	glc_video_repeat_message_t msg;
+	int ret;
+
+	if (unlikely(ps_packet_open(packet,
+				((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
+				(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+				(PS_PACKET_WRITE) :
+				(PS_PACKET_WRITE | PS_PACKET_TRY)))) {
+		__sync_fetch_and_add(&video->dropped, 1);
+		return 0;
+	}
+
+	msg_hdr.type = GLC_MESSAGE_VIDEO_REPEAT;
+	msg.id = video->id;
+	msg.time = time;
+
+	if (unlikely((ret = ps_packet_write(packet,
+				&msg_hdr, sizeof(glc_message_header_t)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(packet,
+				&msg, sizeof(glc_video_repeat_message_t)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_close(packet))))
+		goto cancel;
+
+	video->repeats++;
+	return 0;
+
+cancel:
+	if (ret == EBUSY) {
+		ret = 0;
+		__sync_fetch_and_add(&video->dropped, 1);
+	}
+	ps_packet_cancel(packet);
+	return ret;
+}
+
 int gl_capture_refresh_color_correction(gl_capture_t gl_capture)
 {
 	struct gl_capture_video_stream_s *video;
@@ -939,13 +2685,11 @@ int gl_capture_refresh_color_correction(gl_capture_t gl_capture)
 	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 		 "refreshing color correction");
 
-	pthread_rwlock_rdlock(&gl_capture->videolist_lock);
 	video = gl_capture->video;
 	while (video != NULL) {
 		gl_capture_update_color(gl_capture, video);
 		video = video->next;
 	}
-	pthread_rwlock_unlock(&gl_capture->videolist_lock);
 
 	return 0;
 }
@@ -965,6 +2709,8 @@ int gl_capture_update_color(gl_capture_t gl_capture, struct gl_capture_video_str
 	    (gamma.blue == video->gamma_blue))
 		return 0; /* nothing to update */
 
+	gl_capture_drain_copier(gl_capture, video);
+
 	msg_hdr.type = GLC_MESSAGE_COLOR;
 	msg.id = video->id;
 	msg.red = gamma.red;
@@ -66,6 +66,34 @@ __PUBLIC int gl_capture_set_read_buffer(gl_capture_t gl_capture, GLenum buffer);
  */
 __PUBLIC int gl_capture_set_fps(gl_capture_t gl_capture, double fps);
 
+/**
+ * \brief set frame time budget
+ *
+ * When capture overhead per swap goes over budget or frames are
+ * dropped because buffer is full, capture is degraded step by step:
+ * finished PBO transfers are spread over swaps, then only every
+ * 2nd, 3rd or 4th frame is captured. Pace level changes are written
+ * to stream as GLC_MESSAGE_VIDEO_PACE. Not used with locked fps or
+ * ignored time.
+ * \param gl_capture gl_capture object
+ * \param budget budget in milliseconds, 0 disables pacing
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_frame_budget(gl_capture_t gl_capture, double budget);
+
+/**
+ * \brief skip repeated frames
+ *
+ * A frame that hashes the same as the previous frame written is
+ * recorded as a tiny GLC_MESSAGE_VIDEO_REPEAT instead. Sampled
+ * tiles are cheap to hash but can miss changes between them.
+ * \param gl_capture gl_capture object
+ * \param skip_repeats 0 writes every frame, 1 hashes sampled tiles,
+ *                     2 hashes whole frames
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_skip_repeats(gl_capture_t gl_capture, int skip_repeats);
+
 /**
  * \brief set GL_PACK_ALIGNMENT for OpenGL read calls
  * \param gl_capture gl_capture object
@@ -84,6 +112,60 @@ __PUBLIC int gl_capture_set_pack_alignment(gl_capture_t gl_capture,
  */
 __PUBLIC int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo);
 
+/**
+ * \brief set number of PBOs per video stream
+ *
+ * Frames are read back into a ring of PBOs. With GL_ARB_sync
+ * a PBO is mapped only after the GPU has finished the transfer
+ * and a frame is dropped when all of them are still in flight.
+ * Default is 3. Can't be changed once PBO is in use.
+ * \param gl_capture gl_capture object
+ * \param num number of PBOs
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_pbo_num(gl_capture_t gl_capture, unsigned int num);
+
+/**
+ * \brief copy frames to buffer in a separate thread
+ *
+ * With PBO, GL_ARB_sync and GL_ARB_buffer_storage, frames are read
+ * into persistently mapped PBOs and a copier thread writes them
+ * to buffer, so the application thread only starts transfers and
+ * polls fences. Can't be changed once PBO is in use.
+ * \param gl_capture gl_capture object
+ * \param copy_thread 1 enables copier thread, 0 disables it
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_copy_thread(gl_capture_t gl_capture, int copy_thread);
+
+/**
+ * \brief downscale picture on GPU before reading it
+ *
+ * With GL_ARB_framebuffer_object, the capture area is blitted
+ * into a smaller framebuffer with linear filtering and only the
+ * scaled picture is read back. Video format message then has
+ * GLC_VIDEO_SCALED set. Falls back to full size capture when
+ * not supported. Can't be changed once in use.
+ * \param gl_capture gl_capture object
+ * \param scale scale factor, 1.0 disables GPU scaling
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_gpu_scale(gl_capture_t gl_capture, double scale);
+
+/**
+ * \brief convert picture to Y'CbCr 4:2:0 on GPU before reading it
+ *
+ * With OpenGL 2.0 and GL_ARB_framebuffer_object, a fragment shader
+ * renders Y', Cb and Cr planes with the same integer math as the
+ * ycbcr filter and GLC_VIDEO_YCBCR_420JPEG frames are written to
+ * buffer. Needs GPU scaling when a GPU scale factor is set.
+ * Can't be changed once in use.
+ * \param gl_capture gl_capture object
+ * \param try_ycbcr 1 enables GPU conversion, 0 disables it
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_try_gpu_ycbcr(gl_capture_t gl_capture, int try_ycbcr);
+
 /**
  * \brief set pixel format
  *
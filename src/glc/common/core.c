@@ -33,6 +33,10 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "glc.h"
 #include "core.h"
@@ -40,14 +44,67 @@
 #include "util.h"
 #include "optimization.h"
 
+/**
+ * \brief per stage scheduling configuration
+ */
+struct glc_sched_s {
+	char stage[32];
+	int has_cpus;
+	cpu_set_t cpus;
+	int policy;
+	int priority;
+	glc_utime_t runtime, deadline, period;
+};
+
+#ifdef SYS_sched_setattr
+/* not provided by glibc */
+struct glc_sched_attr_s {
+	u_int32_t size;
+	u_int32_t sched_policy;
+	u_int64_t sched_flags;
+	int32_t sched_nice;
+	u_int32_t sched_priority;
+	u_int64_t sched_runtime;
+	u_int64_t sched_deadline;
+	u_int64_t sched_period;
+};
+# ifndef SCHED_DEADLINE
+#  define SCHED_DEADLINE 6
+# endif
+#endif
+
+/* buffer accepting references and payload bytes queued in it */
+struct glc_ref_buffer_s {
+	int used;
+	ps_buffer_t *buffer;
+	size_t budget;
+	size_t queued;
+};
+
 struct glc_core_s {
 	struct timespec init_time;
 	long int single_process_num;
 	long int multi_process_num;
 	long int threads_hint;
 	int      allow_rt;
+
+	long int shared_workers;
+	sem_t    worker_slots;
+
+	struct glc_sched_s *sched;
+	size_t sched_num;
+
+	struct glc_ref_buffer_s ref_buffers[GLC_REF_MAX_BUFFERS];
+	size_t ref_budget;
+	pthread_mutex_t ref_mutex;
+	pthread_cond_t ref_cond;
+	int ref_waiters;
 };
 
+static struct glc_ref_buffer_s *glc_ref_find(glc_t *glc, ps_buffer_t *buffer);
+static int glc_sched_parse_cpus(const char *list, cpu_set_t *cpus);
+static int glc_sched_parse_opt(glc_t *glc, struct glc_sched_s *sched, char *opt);
+
 const char *glc_version()
 {
 	return GLC_VERSION;
@@ -68,6 +125,9 @@ int glc_init(glc_t *glc)
 	clock_gettime(CLOCK_MONOTONIC, &glc->core->init_time);
 
 	glc->core->threads_hint = 1; /* safe conservative default value */
+	glc->core->ref_budget = GLC_REF_DEFAULT_BUDGET;
+	pthread_mutex_init(&glc->core->ref_mutex, NULL);
+	pthread_cond_init(&glc->core->ref_cond, NULL);
 
 	if (unlikely((ret = glc_log_init(glc))))
 		return ret;
@@ -77,6 +137,12 @@ int glc_init(glc_t *glc)
 
 int glc_destroy(glc_t *glc)
 {
+	if (glc->core->shared_workers)
+		sem_destroy(&glc->core->worker_slots);
+	free(glc->core->sched);
+	pthread_cond_destroy(&glc->core->ref_cond);
+	pthread_mutex_destroy(&glc->core->ref_mutex);
+
 	glc_util_destroy(glc);
 	glc_log_destroy(glc);
 
@@ -129,16 +195,228 @@ void glc_account_threads(glc_t *glc, long int single, long int multi)
 
 void glc_compute_threads_hint(glc_t *glc)
 {
-	if (unlikely(!glc->core->multi_process_num))
-		glc->core->multi_process_num = 1; /* Avoid division by 0 */
 	glc->core->threads_hint  = sysconf(_SC_NPROCESSORS_ONLN) - glc->core->single_process_num;
-	glc->core->threads_hint /= glc->core->multi_process_num;
 	if (unlikely(glc->core->threads_hint <  1))
 		glc->core->threads_hint = 1;
+
+	/*
+	 * Rather than splitting the processors between the multi threaded
+	 * filters, every filter may use all of them. Filter threads and
+	 * slice pools hold one of the shared worker slots while they
+	 * process a packet or a slice, so no more than threads_hint of
+	 * them are busy at once and processors go to whichever filter
+	 * has work.
+	 */
+	glc_set_shared_workers(glc, glc->core->threads_hint);
+
 	glc_log(glc, GLC_INFO, "core",
-		"single proc num %ld multi proc num %d, threads num per multi proc %d",
+		"single proc num %ld multi proc num %ld, threads num per multi proc %ld, shared workers %ld",
 		glc->core->single_process_num, glc->core->multi_process_num,
-		glc->core->threads_hint);
+		glc->core->threads_hint, glc->core->shared_workers);
+}
+
+int glc_set_shared_workers(glc_t *glc, long int count)
+{
+	if (unlikely(count < 0))
+		return EINVAL;
+
+	if (glc->core->shared_workers)
+		sem_destroy(&glc->core->worker_slots);
+
+	if (count && unlikely(sem_init(&glc->core->worker_slots, 0, count)))
+		return errno;
+
+	glc->core->shared_workers = count;
+	return 0;
+}
+
+long int glc_shared_workers(glc_t *glc)
+{
+	return glc->core->shared_workers;
+}
+
+void glc_worker_acquire(glc_t *glc)
+{
+	if (!glc->core->shared_workers)
+		return;
+
+	while (unlikely(sem_wait(&glc->core->worker_slots) == -1) &&
+	       (errno == EINTR))
+		; /* retry */
+}
+
+void glc_worker_release(glc_t *glc)
+{
+	if (!glc->core->shared_workers)
+		return;
+
+	sem_post(&glc->core->worker_slots);
+}
+
+glc_ref_t *glc_ref_create(glc_message_header_t *header,
+			  const void *data, size_t size)
+{
+	glc_ref_t *ref = (glc_ref_t *) malloc(sizeof(glc_ref_t) + size);
+
+	if (unlikely(!ref))
+		return NULL;
+
+	ref->refcount = 1;
+	ref->header = *header;
+	ref->size = size;
+	ref->data = (char *) &ref[1];
+	ref->release = NULL;
+	memcpy(ref->data, data, size);
+
+	return ref;
+}
+
+glc_ref_t *glc_ref_wrap(glc_message_header_t *header,
+			char *data, size_t size,
+			void (*release)(void *arg), void *arg)
+{
+	glc_ref_t *ref = (glc_ref_t *) malloc(sizeof(glc_ref_t));
+
+	if (unlikely(!ref))
+		return NULL;
+
+	ref->refcount = 1;
+	ref->header = *header;
+	ref->size = size;
+	ref->data = data;
+	ref->release = release;
+	ref->arg = arg;
+
+	return ref;
+}
+
+void glc_ref_get(glc_ref_t *ref)
+{
+	__sync_fetch_and_add(&ref->refcount, 1);
+}
+
+void glc_ref_put(glc_ref_t *ref)
+{
+	if (__sync_sub_and_fetch(&ref->refcount, 1) == 0) {
+		if (ref->release)
+			ref->release(ref->arg);
+		free(ref);
+	}
+}
+
+void glc_ref_set_budget(glc_t *glc, size_t budget)
+{
+	glc->core->ref_budget = budget;
+}
+
+int glc_ref_accept(glc_t *glc, ps_buffer_t *buffer)
+{
+	struct glc_ref_buffer_s *entry;
+	int i;
+
+	if (glc_ref_find(glc, buffer))
+		return 0;
+
+	for (i = 0; i < GLC_REF_MAX_BUFFERS; i++) {
+		entry = &glc->core->ref_buffers[i];
+		if (!__sync_bool_compare_and_swap(&entry->used, 0, 1))
+			continue;
+
+		entry->budget = glc->core->ref_budget;
+		entry->queued = 0;
+		/* writers may miss the buffer for a while, they just copy */
+		__sync_synchronize();
+		entry->buffer = buffer;
+		return 0;
+	}
+
+	return ENOMEM;
+}
+
+void glc_ref_refuse(glc_t *glc, ps_buffer_t *buffer)
+{
+	struct glc_ref_buffer_s *entry = glc_ref_find(glc, buffer);
+
+	if (!entry)
+		return;
+
+	entry->buffer = NULL;
+	__sync_synchronize();
+	entry->used = 0;
+
+	/* writers waiting for budget copy from now on */
+	pthread_mutex_lock(&glc->core->ref_mutex);
+	pthread_cond_broadcast(&glc->core->ref_cond);
+	pthread_mutex_unlock(&glc->core->ref_mutex);
+}
+
+int glc_ref_accepted(glc_t *glc, ps_buffer_t *buffer)
+{
+	return glc_ref_find(glc, buffer) ? 1 : 0;
+}
+
+int glc_ref_charge(glc_t *glc, ps_buffer_t *buffer, size_t size)
+{
+	struct glc_ref_buffer_s *entry = glc_ref_find(glc, buffer);
+	size_t queued;
+
+	if (!entry)
+		return ENOTSUP;
+
+	/* a payload larger than budget is sent alone */
+	do {
+		queued = entry->queued;
+		if ((queued) && (queued + size > entry->budget))
+			return ENOSPC;
+	} while (!__sync_bool_compare_and_swap(&entry->queued, queued,
+					       queued + size));
+	return 0;
+}
+
+int glc_ref_charge_wait(glc_t *glc, ps_buffer_t *buffer, size_t size)
+{
+	int ret;
+
+	pthread_mutex_lock(&glc->core->ref_mutex);
+	__sync_fetch_and_add(&glc->core->ref_waiters, 1);
+	while ((ret = glc_ref_charge(glc, buffer, size)) == ENOSPC)
+		pthread_cond_wait(&glc->core->ref_cond, &glc->core->ref_mutex);
+	__sync_fetch_and_sub(&glc->core->ref_waiters, 1);
+	pthread_mutex_unlock(&glc->core->ref_mutex);
+
+	return ret;
+}
+
+void glc_ref_uncharge(glc_t *glc, ps_buffer_t *buffer, size_t size)
+{
+	struct glc_ref_buffer_s *entry = glc_ref_find(glc, buffer);
+
+	if (!entry)
+		return;
+
+	__sync_fetch_and_sub(&entry->queued, size);
+	if (unlikely(glc->core->ref_waiters)) {
+		pthread_mutex_lock(&glc->core->ref_mutex);
+		pthread_cond_broadcast(&glc->core->ref_cond);
+		pthread_mutex_unlock(&glc->core->ref_mutex);
+	}
+}
+
+/**
+ * \brief look up buffer accepting references
+ * \param glc glc
+ * \param buffer buffer
+ * \return buffer entry or NULL if buffer doesn't accept references
+ */
+struct glc_ref_buffer_s *glc_ref_find(glc_t *glc, ps_buffer_t *buffer)
+{
+	int i;
+
+	for (i = 0; i < GLC_REF_MAX_BUFFERS; i++) {
+		if (glc->core->ref_buffers[i].buffer == buffer)
+			return &glc->core->ref_buffers[i];
+	}
+	return NULL;
 }
 
 void glc_set_allow_rt(glc_t *glc, int allow)
@@ -151,4 +429,209 @@ int glc_allow_rt(glc_t *glc)
 	return glc->core->allow_rt;
 }
 
+int glc_set_sched(glc_t *glc, const char *spec)
+{
+	struct glc_sched_s *sched = NULL, *cur;
+	size_t sched_num = 0;
+	char *str, *entry, *opt, *entry_save, *opt_save, *name_end;
+	int ret = 0;
+
+	if (unlikely(!(str = strdup(spec))))
+		return ENOMEM;
+
+	for (entry = strtok_r(str, ";", &entry_save); entry != NULL;
+	     entry = strtok_r(NULL, ";", &entry_save)) {
+		if (unlikely(!(name_end = strchr(entry, ':')) ||
+			     (name_end == entry) ||
+			     (name_end - entry >= sizeof(cur->stage)))) {
+			glc_log(glc, GLC_ERROR, "core",
+				"invalid scheduling entry '%s'", entry);
+			ret = EINVAL;
+			goto err;
+		}
+		*name_end = '\0';
+
+		cur = (struct glc_sched_s *) realloc(sched,
+				sizeof(struct glc_sched_s) * (sched_num + 1));
+		if (unlikely(!cur)) {
+			ret = ENOMEM;
+			goto err;
+		}
+		sched = cur;
+		cur = &sched[sched_num++];
+		memset(cur, 0, sizeof(struct glc_sched_s));
+		strcpy(cur->stage, entry);
+
+		for (opt = strtok_r(&name_end[1], "/", &opt_save); opt != NULL;
+		     opt = strtok_r(NULL, "/", &opt_save)) {
+			if (unlikely((ret = glc_sched_parse_opt(glc, cur, opt))))
+				goto err;
+		}
+	}
+
+	free(str);
+	free(glc->core->sched);
+	glc->core->sched = sched;
+	glc->core->sched_num = sched_num;
+	return 0;
+err:
+	free(str);
+	free(sched);
+	return ret;
+}
+
+/**
+ * \brief parse a single 'key=value' scheduling option
+ * \param glc glc
+ * \param sched entry to fill
+ * \param opt option string
+ * \return 0 on success otherwise an error code
+ */
+int glc_sched_parse_opt(glc_t *glc, struct glc_sched_s *sched, char *opt)
+{
+	char *val;
+	unsigned long long runtime, deadline, period;
+
+	if (unlikely(!(val = strchr(opt, '='))))
+		goto err;
+	*val++ = '\0';
+
+	if (!strcmp(opt, "cpus")) {
+		if (unlikely(glc_sched_parse_cpus(val, &sched->cpus)))
+			goto err;
+		sched->has_cpus = 1;
+	} else if (!strcmp(opt, "nice")) {
+		sched->policy = GLC_SCHED_NICE;
+		sched->priority = atoi(val);
+	} else if ((!strcmp(opt, "rr")) || (!strcmp(opt, "fifo"))) {
+		sched->policy = strcmp(opt, "rr") ? GLC_SCHED_FIFO : GLC_SCHED_RR;
+		sched->priority = atoi(val);
+	} else if (!strcmp(opt, "deadline")) {
+		/* runtime,deadline,period in microseconds */
+		if (unlikely(sscanf(val, "%llu,%llu,%llu",
+				    &runtime, &deadline, &period) != 3))
+			goto err;
+		if (unlikely((!runtime) || (runtime > deadline) || (deadline > period)))
+			goto err;
+		sched->policy = GLC_SCHED_DEADLINE;
+		sched->runtime  = (glc_utime_t) runtime * 1000;
+		sched->deadline = (glc_utime_t) deadline * 1000;
+		sched->period   = (glc_utime_t) period * 1000;
+	} else
+		goto err;
+
+	return 0;
+err:
+	glc_log(glc, GLC_ERROR, "core",
+		"invalid scheduling option '%s' for '%s'", opt, sched->stage);
+	return EINVAL;
+}
+
+/**
+ * \brief parse cpu list, eg. '2,4-7'
+ * \param list cpu list
+ * \param cpus cpu set to fill
+ * \return 0 on success otherwise an error code
+ */
+int glc_sched_parse_cpus(const char *list, cpu_set_t *cpus)
+{
+	long first, last;
+	char *end;
+
+	CPU_ZERO(cpus);
+	do {
+		first = strtol(list, &end, 10);
+		if (unlikely((end == list) || (first < 0)))
+			return EINVAL;
+		last = first;
+		if (*end == '-') {
+			list = &end[1];
+			last = strtol(list, &end, 10);
+			if (unlikely((end == list) || (last < first)))
+				return EINVAL;
+		}
+		if (unlikely(last >= CPU_SETSIZE))
+			return EINVAL;
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+		list = &end[1];
+	} while (*end == ',');
+
+	return *end == '\0' ? 0 : EINVAL;
+}
+
+int glc_apply_sched(glc_t *glc, const char *stage)
+{
+	struct glc_sched_s *sched = NULL;
+	struct sched_param param;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < glc->core->sched_num; i++) {
+		if (stage && !strcmp(glc->core->sched[i].stage, stage)) {
+			sched = &glc->core->sched[i];
+			break;
+		} else if (!strcmp(glc->core->sched[i].stage, "*"))
+			sched = &glc->core->sched[i];
+	}
+
+	if (!sched)
+		return 0;
+
+	if (sched->has_cpus) {
+		if (unlikely((ret = pthread_setaffinity_np(pthread_self(),
+						sizeof(cpu_set_t), &sched->cpus))))
+			glc_log(glc, GLC_ERROR, "core",
+				"failed to set '%s' cpu affinity: %s (%d)",
+				stage, strerror(ret), ret);
+	}
+
+	switch (sched->policy) {
+	case GLC_SCHED_NICE:
+		/* on Linux, nice value is a per thread attribute */
+		if (unlikely(setpriority(PRIO_PROCESS, syscall(SYS_gettid),
+					 sched->priority))) {
+			ret = errno;
+			glc_log(glc, GLC_ERROR, "core",
+				"failed to set '%s' nice value: %s (%d)",
+				stage, strerror(ret), ret);
+		}
+		break;
+	case GLC_SCHED_RR:
+	case GLC_SCHED_FIFO:
+		param.sched_priority = sched->priority;
+		if (unlikely((ret = pthread_setschedparam(pthread_self(),
+				sched->policy == GLC_SCHED_RR ? SCHED_RR : SCHED_FIFO,
+				&param))))
+			glc_log(glc, GLC_ERROR, "core",
+				"failed to set '%s' rt priority: %s (%d)",
+				stage, strerror(ret), ret);
+		break;
+	case GLC_SCHED_DEADLINE:
+	{
+#ifdef SYS_sched_setattr
+		struct glc_sched_attr_s attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_DEADLINE;
+		attr.sched_runtime = sched->runtime;
+		attr.sched_deadline = sched->deadline;
+		attr.sched_period = sched->period;
+		if (unlikely(syscall(SYS_sched_setattr, 0, &attr, 0)))
+			ret = errno;
+#else
+		ret = ENOTSUP;
+#endif
+		if (unlikely(ret))
+			glc_log(glc, GLC_ERROR, "core",
+				"failed to set '%s' deadline scheduling: %s (%d)",
+				stage, strerror(ret), ret);
+		break;
+	}
+	}
+
+	return ret;
+}
+
 /**  \} */
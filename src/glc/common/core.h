@@ -33,6 +33,7 @@
 #ifndef _CORE_H
 #define _CORE_H
 
+#include <packetstream.h>
 #include <glc/common/glc.h>
 
 #ifdef __cplusplus
@@ -99,8 +100,234 @@ __PUBLIC int glc_set_threads_hint(glc_t *glc, long int count);
 
 __PUBLIC void glc_account_threads(glc_t *glc, long int single, long int multi);
 
+/**
+ * \brief compute thread count hint from accounted threads
+ *
+ * Threads hint is set to the number of processors online minus
+ * single threaded processes, so every multi threaded filter may
+ * use all of them. The same number of shared worker slots is
+ * enabled, which caps busy filter and slice pool threads together
+ * so that they don't oversubscribe the processors.
+ * \param glc glc
+ */
 __PUBLIC void glc_compute_threads_hint(glc_t *glc);
 
+/**
+ * \brief set the number of shared worker slots
+ *
+ * Filters sitting between two buffers acquire a slot for the
+ * duration of the packet processing (write callback), slice pools
+ * for each slice. Idle threads waiting for packets do not hold any. This caps the number of busy
+ * threads process-wide while each filter thread count still acts
+ * as a per filter cap. Must not be called while filters are running.
+ * \param glc glc
+ * \param count number of slots, 0 disables
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_set_shared_workers(glc_t *glc, long int count);
+
+/**
+ * \brief get the number of shared worker slots
+ * \param glc glc
+ * \return number of slots, 0 if disabled
+ */
+__PUBLIC long int glc_shared_workers(glc_t *glc);
+
+/**
+ * \brief block until a shared worker slot is available
+ * \param glc glc
+ */
+__PUBLIC void glc_worker_acquire(glc_t *glc);
+
+/**
+ * \brief give back a shared worker slot
+ * \param glc glc
+ */
+__PUBLIC void glc_worker_release(glc_t *glc);
+
+/** payloads smaller than this are cheaper to copy than to reference */
+#define GLC_REF_MIN_SIZE                   4096
+/** maximum number of buffers accepting payload references */
+#define GLC_REF_MAX_BUFFERS                  64
+/** default payload bytes referenced from a single buffer */
+#define GLC_REF_DEFAULT_BUDGET        (10 * 1024 * 1024)
+
+/**
+ * \brief reference counted message payload
+ *
+ * Untouched messages are handed over between filters as
+ * GLC_MESSAGE_REF messages pointing to a glc_ref_t instead of
+ * copying the whole payload into each buffer. Only one copy is
+ * made when the payload leaves the first buffer and the last
+ * reader frees it. Payload bytes referenced from each buffer are
+ * limited like the data a buffer can hold, see glc_ref_charge().
+ * References still queued in a cancelled buffer are not released.
+ */
+typedef struct glc_ref_s {
+	/** reference count */
+	int refcount;
+	/** original message header */
+	glc_message_header_t header;
+	/** payload size */
+	size_t size;
+	/** payload */
+	char *data;
+	/** called with arg when payload isn't owned, NULL otherwise */
+	void (*release)(void *arg);
+	/** release argument */
+	void *arg;
+} glc_ref_t;
+
+/**
+ * \brief create a payload reference
+ * \param header original message header
+ * \param data payload to copy
+ * \param size payload size
+ * \return reference with count 1 or NULL if out of memory
+ */
+__PUBLIC glc_ref_t *glc_ref_create(glc_message_header_t *header,
+				   const void *data, size_t size);
+
+/**
+ * \brief create a reference to a payload owned elsewhere
+ *
+ * Payload isn't copied, it must stay valid until release is
+ * called when the last reference is dropped.
+ * \param header original message header
+ * \param data payload
+ * \param size payload size
+ * \param release called with arg when payload isn't used anymore
+ * \param arg release argument
+ * \return reference with count 1 or NULL if out of memory
+ */
+__PUBLIC glc_ref_t *glc_ref_wrap(glc_message_header_t *header,
+				 char *data, size_t size,
+				 void (*release)(void *arg), void *arg);
+
+/**
+ * \brief take an additional reference
+ * \param ref reference
+ */
+__PUBLIC void glc_ref_get(glc_ref_t *ref);
+
+/**
+ * \brief drop a reference, payload is freed with the last one
+ * \param ref reference
+ */
+__PUBLIC void glc_ref_put(glc_ref_t *ref);
+
+/**
+ * \brief set payload bytes referenced from a single buffer
+ *
+ * Applies to buffers accepted afterwards. Should be about the
+ * size of the buffers, so references don't queue more data than
+ * the buffers would. Default is GLC_REF_DEFAULT_BUDGET.
+ * \param glc glc
+ * \param budget payload bytes
+ */
+__PUBLIC void glc_ref_set_budget(glc_t *glc, size_t budget);
+
+/**
+ * \brief declare that buffer reader resolves GLC_MESSAGE_REF
+ *
+ * Writers send references only to buffers registered here.
+ * Every glc_thread_t reader registers its buffer automatically
+ * and unregisters it when it stops.
+ * \param glc glc
+ * \param buffer buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ref_accept(glc_t *glc, ps_buffer_t *buffer);
+
+/**
+ * \brief declare that buffer reader doesn't resolve GLC_MESSAGE_REF anymore
+ * \param glc glc
+ * \param buffer buffer
+ */
+__PUBLIC void glc_ref_refuse(glc_t *glc, ps_buffer_t *buffer);
+
+/**
+ * \brief check whether buffer reader resolves GLC_MESSAGE_REF
+ * \param glc glc
+ * \param buffer buffer
+ * \return 1 if references can be sent, otherwise 0
+ */
+__PUBLIC int glc_ref_accepted(glc_t *glc, ps_buffer_t *buffer);
+
+/**
+ * \brief reserve budget for a reference sent to buffer
+ *
+ * Writers charge the payload size before sending a reference and
+ * copy the payload when this fails, so they block on a full buffer
+ * as before. The reader uncharges it once it is done with the
+ * message.
+ * \param glc glc
+ * \param buffer target buffer
+ * \param size payload size
+ * \return 0 on success, ENOTSUP if buffer doesn't accept references,
+ *         ENOSPC if budget is exhausted
+ */
+__PUBLIC int glc_ref_charge(glc_t *glc, ps_buffer_t *buffer, size_t size);
+
+/**
+ * \brief reserve budget for a reference, waiting until there is some
+ *
+ * For writers that would rather not copy, such as readers of mapped
+ * files. Blocks until the reader of buffer gives back enough budget
+ * or stops.
+ * \param glc glc
+ * \param buffer target buffer
+ * \param size payload size
+ * \return 0 on success, ENOTSUP if buffer doesn't accept references
+ */
+__PUBLIC int glc_ref_charge_wait(glc_t *glc, ps_buffer_t *buffer, size_t size);
+
+/**
+ * \brief give back budget of a reference read from buffer
+ * \param glc glc
+ * \param buffer buffer reference was read from
+ * \param size payload size
+ */
+__PUBLIC void glc_ref_uncharge(glc_t *glc, ps_buffer_t *buffer, size_t size);
+
+/** leave scheduling policy untouched */
+#define GLC_SCHED_DEFAULT                     0
+/** nice value */
+#define GLC_SCHED_NICE                        1
+/** SCHED_RR */
+#define GLC_SCHED_RR                          2
+/** SCHED_FIFO */
+#define GLC_SCHED_FIFO                        3
+/** SCHED_DEADLINE */
+#define GLC_SCHED_DEADLINE                    4
+
+/**
+ * \brief set per stage cpu affinity and scheduling policy
+ *
+ * Format is stage:option/option;stage2:option... where stage
+ * is a thread name (pack, ycbcr, alsa_capture...) or '*' for
+ * every thread without its own entry. Options are
+ *   cpus=LIST           cpu list, eg. 2,4-7
+ *   nice=N              nice value
+ *   rr=PRIO, fifo=PRIO  real-time priority
+ *   deadline=R,D,P      SCHED_DEADLINE runtime, deadline and
+ *                       period in microseconds
+ * Previous configuration is replaced. Only threads started
+ * afterwards are affected.
+ * \param glc glc
+ * \param spec configuration string
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_set_sched(glc_t *glc, const char *spec);
+
+/**
+ * \brief apply scheduling configuration to calling thread
+ * \param glc glc
+ * \param stage thread name, NULL matches only '*'
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_apply_sched(glc_t *glc, const char *stage);
+
 __PUBLIC void glc_set_allow_rt(glc_t *glc, int allow);
 __PUBLIC int glc_allow_rt(glc_t *glc);
 
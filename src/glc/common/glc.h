@@ -84,7 +84,7 @@ extern "C" {
  */
 
 /** stream version */
-#define GLC_STREAM_VERSION                  0x5
+#define GLC_STREAM_VERSION                  0x6
 /** file signature = "GLC" */
 #define GLC_SIGNATURE                0x00434c47
 
@@ -178,8 +178,8 @@ typedef struct {
 	u_int32_t name_size;
 	/** size of date */
 	u_int32_t date_size;
-	/** reserved */
-	u_int64_t reserved1;
+	/** time of first message, 0 unless stream is a part of a split stream */
+	glc_utime_t start_time;
 	/** reserved */
 	u_int64_t reserved2;
 } __attribute__((packed)) glc_stream_info_t;
@@ -208,6 +208,26 @@ typedef u_int8_t glc_message_type_t;
 #define GLC_MESSAGE_LZJB               0x0a
 /** callback request */
 #define GLC_CALLBACK_REQUEST           0x0b
+/** in-process reference to a message payload, see glc_ref_create() */
+#define GLC_MESSAGE_REF                0x0c
+/** capture pace level change */
+#define GLC_MESSAGE_VIDEO_PACE         0x0d
+/** video frame identical to previous frame */
+#define GLC_MESSAGE_VIDEO_REPEAT       0x0e
+/** tile-based delta of a video frame */
+#define GLC_MESSAGE_DELTA              0x0f
+/** message compressed in independent slices */
+#define GLC_MESSAGE_SLICES             0x10
+/** lz4-compressed packet */
+#define GLC_MESSAGE_LZ4                0x11
+/** video frame rearranged for compression */
+#define GLC_MESSAGE_FILTER             0x12
+/** lossless-compressed packet */
+#define GLC_MESSAGE_LOSSLESS           0x13
+/** jpeg-compressed video frame */
+#define GLC_MESSAGE_JPEG               0x14
+/** in-process mark of a seek, see glc_state_seek() */
+#define GLC_MESSAGE_SEEK               0x15
 
 /**
  * \brief stream message header
@@ -217,6 +237,66 @@ typedef struct {
 	glc_message_type_t type;
 } __attribute__((packed)) glc_message_header_t;
 
+/** stream index trailer signature */
+#define GLC_INDEX_SIGNATURE    0x78646e69
+
+/**
+ * \brief stream index entry
+ *
+ * Stream index is written after GLC_MESSAGE_CLOSE: entries
+ * in file order, state messages in file order, then
+ * glc_index_trailer_t which ends the file. Each entry points to
+ * a video frame that doesn't depend on previous frames.
+ */
+typedef struct {
+	/** file offset of message */
+	u_int64_t offset;
+	/** time the message was written, never before frame time */
+	glc_utime_t time;
+} __attribute__((packed)) glc_index_entry_t;
+
+/**
+ * \brief state message in stream index
+ *
+ * Format and color messages are recorded so the state at an
+ * entry can be rebuilt. Header is followed by the message.
+ */
+typedef struct {
+	/** file offset of message */
+	u_int64_t offset;
+	/** message size */
+	glc_size_t size;
+	/** message header */
+	glc_message_header_t header;
+} __attribute__((packed)) glc_index_state_t;
+
+/**
+ * \brief stream index trailer
+ */
+typedef struct {
+	/** file offset of first entry */
+	u_int64_t offset;
+	/** number of entries */
+	u_int64_t entries;
+	/** size of state messages and their headers */
+	u_int64_t state_size;
+	/** trailer signature */
+	u_int32_t signature;
+} __attribute__((packed)) glc_index_trailer_t;
+
+struct glc_ref_s;
+
+/**
+ * \brief payload reference message
+ *
+ * Only exchanged between threads of the same process,
+ * never written to a stream file.
+ */
+typedef struct {
+	/** referenced payload, receiver owns one reference */
+	struct glc_ref_s *ref;
+} __attribute__((packed)) glc_ref_message_t;
+
 /**
  * \brief lzo-compressed message header
  */
@@ -247,6 +327,72 @@ typedef struct {
 	glc_message_header_t header;
 } __attribute__((packed)) glc_lzjb_header_t;
 
+/**
+ * \brief lz4-compressed message header
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+} __attribute__((packed)) glc_lz4_header_t;
+
+/** delta holds the whole picture */
+#define GLC_DELTA_KEY                   0x1
+
+/**
+ * \brief delta-encoded video frame header
+ *
+ * Picture is split in tiles of tile bytes. Uncompressed payload is
+ * the glc_video_frame_header_t followed by a bitmap with one bit
+ * per tile and the tiles that changed since previous frame of the
+ * same stream. Key frames hold the whole picture instead of bitmap
+ * and tiles.
+ */
+typedef struct {
+	/** size of video frame message the delta decodes to */
+	glc_size_t size;
+	/** uncompressed payload size */
+	glc_size_t delta_size;
+	/** payload compression, GLC_MESSAGE_LZO, GLC_MESSAGE_QUICKLZ, GLC_MESSAGE_LZJB,
+	    GLC_MESSAGE_LZ4, GLC_MESSAGE_LOSSLESS or GLC_MESSAGE_SLICES */
+	glc_message_header_t compression;
+	/** tile size in bytes */
+	u_int32_t tile;
+	/** flags */
+	glc_flags_t flags;
+} __attribute__((packed)) glc_delta_header_t;
+
+/**
+ * \brief slice-compressed message header
+ *
+ * Message is split in consecutive slices compressed independently
+ * so they can be packed and unpacked in parallel. Header is followed
+ * by one glc_slice_header_t per slice and the compressed slices,
+ * in order.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** slice compression, GLC_MESSAGE_LZO, GLC_MESSAGE_QUICKLZ, GLC_MESSAGE_LZJB,
+	    GLC_MESSAGE_LZ4 or GLC_MESSAGE_LOSSLESS */
+	glc_message_header_t compression;
+	/** number of slices */
+	u_int32_t slices;
+} __attribute__((packed)) glc_slices_header_t;
+
+/**
+ * \brief compressed slice
+ */
+typedef struct {
+	/** uncompressed slice size */
+	glc_size_t size;
+	/** compressed slice size */
+	glc_size_t compressed_size;
+} __attribute__((packed)) glc_slice_header_t;
+
 /** video format type */
 typedef u_int8_t glc_video_format_t;
 /** 24bit BGR, last row first */
@@ -276,6 +422,8 @@ typedef struct {
 
 /** double-word aligned rows (GL_PACK_ALIGNMENT = 8) */
 #define GLC_VIDEO_DWORD_ALIGNED         0x1
+/** picture already scaled at capture, don't apply scale factor again */
+#define GLC_VIDEO_SCALED                0x2
 
 /**
  * \brief video data header
@@ -287,6 +435,97 @@ typedef struct {
 	glc_utime_t time;
 } __attribute__((packed)) glc_video_frame_header_t;
 
+/** color channels are stored in separate planes */
+#define GLC_FILTER_SHUFFLE              0x1
+/** planes hold difference to left neighbour, first column to upper one */
+#define GLC_FILTER_PREDICT              0x2
+/** constant alpha channel is left out */
+#define GLC_FILTER_NO_ALPHA             0x4
+
+/**
+ * \brief pre-filtered video frame header
+ *
+ * Uncompressed payload is the glc_video_frame_header_t followed by
+ * the picture planes, each width by height bytes without row
+ * padding. BGR, BGRA and RGB pictures are split in one plane per
+ * channel, Y'CbCr pictures are already planar. Row padding decodes
+ * to zeroes.
+ */
+typedef struct {
+	/** size of video frame message the filter decodes to */
+	glc_size_t size;
+	/** uncompressed payload size */
+	glc_size_t filter_size;
+	/** payload compression, GLC_MESSAGE_LZO, GLC_MESSAGE_QUICKLZ, GLC_MESSAGE_LZJB,
+	    GLC_MESSAGE_LZ4, GLC_MESSAGE_LOSSLESS or GLC_MESSAGE_SLICES */
+	glc_message_header_t compression;
+	/** applied filters */
+	glc_flags_t filter;
+	/** picture format */
+	glc_video_format_t format;
+	/** width */
+	u_int32_t width;
+	/** height */
+	u_int32_t height;
+	/** bytes per row of interleaved pictures */
+	u_int32_t row;
+	/** value of left out alpha channel */
+	u_int8_t alpha;
+} __attribute__((packed)) glc_filter_header_t;
+
+/**
+ * \brief lossless-compressed message header
+ *
+ * Header is followed by one glc_slice_header_t per segment, prefix
+ * bytes stored as is and the coded segments. Pictures are split in
+ * bands of rows of each plane, coded with a median predictor and
+ * rANS, so planes are laid out as in glc_filter_header_t. Other
+ * messages are split in consecutive segments that are only rANS
+ * coded.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** picture format, 0 for other messages */
+	glc_video_format_t format;
+	/** width */
+	u_int32_t width;
+	/** height */
+	u_int32_t height;
+	/** bytes per row of interleaved pictures */
+	u_int32_t row;
+	/** bytes stored as is */
+	u_int32_t prefix;
+	/** number of segments */
+	u_int32_t segments;
+} __attribute__((packed)) glc_lossless_header_t;
+
+/**
+ * \brief jpeg-compressed video frame header
+ *
+ * Only GLC_VIDEO_YCBCR_420JPEG pictures are jpeg-compressed. Header
+ * is followed by one glc_slice_header_t per band, the
+ * glc_video_frame_header_t of the picture and the bands. Each band
+ * is a baseline JPEG image of consecutive rows of the picture, bands
+ * but the last are a multiple of 16 rows high. Compression is lossy.
+ */
+typedef struct {
+	/** uncompressed data size */
+	glc_size_t size;
+	/** original message header */
+	glc_message_header_t header;
+	/** width */
+	u_int32_t width;
+	/** height */
+	u_int32_t height;
+	/** quality the bands were compressed with, 1 to 100 */
+	u_int8_t quality;
+	/** number of bands */
+	u_int32_t bands;
+} __attribute__((packed)) glc_jpeg_header_t;
+
 /** audio format type */
 typedef u_int8_t glc_audio_format_t;
 /** signed 16bit little-endian */
@@ -345,6 +584,54 @@ typedef struct {
 	float blue;
 } __attribute__((packed)) glc_color_message_t;
 
+/**
+ * \brief capture pace level change message
+ *
+ * Written by capture when it degrades or restores capture to keep
+ * its overhead under frame time budget.
+ */
+typedef struct {
+	/** video stream identifier */
+	glc_stream_id_t id;
+	/** time */
+	glc_utime_t time;
+	/** pace level, 0 is full rate */
+	u_int32_t level;
+	/** time between captured frames in nanoseconds */
+	glc_utime_t interval;
+	/** average capture overhead per swap in nanoseconds */
+	glc_utime_t overhead;
+	/** frames dropped since previous message */
+	u_int32_t dropped;
+} __attribute__((packed)) glc_video_pace_message_t;
+
+/**
+ * \brief repeated video frame message
+ *
+ * Written by capture instead of a frame that is identical to
+ * the previous frame of the same video stream.
+ */
+typedef struct {
+	/** stream identifier */
+	glc_stream_id_t id;
+	/** time */
+	glc_utime_t time;
+} __attribute__((packed)) glc_video_repeat_message_t;
+
+/**
+ * \brief seek message
+ *
+ * Only exchanged between threads of the same process, never
+ * written to a stream file. Sent by a source in front of the
+ * first message read after a seek.
+ */
+typedef struct {
+	/** seek number returned by glc_state_seek() */
+	u_int32_t seek;
+	/** new position */
+	glc_utime_t time;
+} __attribute__((packed)) glc_seek_message_t;
+
 /**
  * \brief container message header
  */
@@ -54,6 +54,7 @@ struct glc_state_s {
 	/* lock maybe not needed */
 	pthread_rwlock_t time_rwlock;
 	glc_stime_t time_difference;
+	u_int32_t seek;
 
 	pthread_rwlock_t video_rwlock;
 	struct glc_state_video_s *video;
@@ -181,4 +182,26 @@ int glc_state_time_add_diff(glc_t *glc, glc_stime_t diff)
 	return 0;
 }
 
+u_int32_t glc_state_seek(glc_t *glc, glc_utime_t time)
+{
+	u_int32_t seek;
+
+	glc_log(glc, GLC_DEBUG, "state", "seeking to %" PRIu64 " nsec", time);
+	pthread_rwlock_wrlock(&glc->state->time_rwlock);
+	seek = ++glc->state->seek;
+	glc->state->time_difference = glc_time(glc) - time;
+	pthread_rwlock_unlock(&glc->state->time_rwlock);
+	return seek;
+}
+
+u_int32_t glc_state_seek_count(glc_t *glc)
+{
+	u_int32_t seek;
+
+	pthread_rwlock_rdlock(&glc->state->time_rwlock);
+	seek = glc->state->seek;
+	pthread_rwlock_unlock(&glc->state->time_rwlock);
+	return seek;
+}
+
 /**  \} */
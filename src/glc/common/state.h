@@ -132,6 +132,26 @@ __PUBLIC int glc_state_time_add_diff(glc_t *glc, glc_stime_t diff);
 
 __PUBLIC void glc_state_time_reset(glc_t *glc);
 
+/**
+ * \brief move state time to a new stream position
+ *
+ * Sources call this when they jump to another position of the
+ * stream and then send a GLC_MESSAGE_SEEK with the returned seek
+ * number. Players drop messages that are still in flight until
+ * they receive that message.
+ * \param glc glc
+ * \param time new state time
+ * \return seek number
+ */
+__PUBLIC u_int32_t glc_state_seek(glc_t *glc, glc_utime_t time);
+
+/**
+ * \brief get number of last seek
+ * \param glc glc
+ * \return seek number, 0 before first seek
+ */
+__PUBLIC u_int32_t glc_state_seek_count(glc_t *glc);
+
 #ifdef __cplusplus
 }
 #endif
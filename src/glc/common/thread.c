@@ -35,9 +35,11 @@
 #include <unistd.h>
 #include <packetstream.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include "glc.h"
 #include "thread.h"
+#include "core.h"
 #include "util.h"
 #include "log.h"
 #include "state.h"
@@ -54,9 +56,22 @@ struct glc_thread_private_s {
 	pthread_t *pthread_thread;
 	pthread_mutex_t open, finish;
 
+	/* GLC_THREAD_REORDER commit ordering */
+	pthread_mutex_t reorder;
+	pthread_cond_t reorder_cond;
+	u_int64_t read_seq, write_seq;
+	int reorder_cancel;
+
 	glc_thread_t *thread;
 	size_t running_threads;
 
+	/* processing is done in a shared worker slot */
+	int shared;
+
+	/* timing statistics, only if collect_stats is set */
+	int collect_stats;
+	glc_thread_stats_t *stats, own_stats;
+
 	int stop;
 	int ret;
 };
@@ -64,6 +79,14 @@ struct glc_thread_private_s {
 static void *glc_thread(void *argptr);
 static int glc_thread_block_signals(void);
 static int glc_thread_set_rt_priority(glc_t *glc, int ask_rt);
+static int glc_thread_reorder_wait(struct glc_thread_private_s *private,
+				   u_int64_t seq);
+static void glc_thread_reorder_done(struct glc_thread_private_s *private);
+static void glc_thread_reorder_cancel(struct glc_thread_private_s *private);
+static __inline__ glc_utime_t glc_thread_time(struct glc_thread_private_s *private);
+static void glc_thread_hist_add(struct glc_thread_private_s *private, int hist,
+				glc_utime_t start);
+static void glc_thread_print_stats(struct glc_thread_private_s *private);
 
 int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 			ps_buffer_t *to)
@@ -75,6 +98,11 @@ int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 	if (unlikely(thread->threads < 1))
 		return EINVAL;
 
+	if (unlikely((thread->flags & GLC_THREAD_REORDER) &&
+		     ((thread->flags & (GLC_THREAD_READ | GLC_THREAD_WRITE)) !=
+		      (GLC_THREAD_READ | GLC_THREAD_WRITE))))
+		return EINVAL;
+
 	if (unlikely(!(private = (struct glc_thread_private_s *)
 		calloc(1, sizeof(struct glc_thread_private_s)))))
 		return ENOMEM;
@@ -85,8 +113,25 @@ int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 	private->to = to;
 	private->thread = thread;
 
+	/* a full table only means payloads are copied */
+	if (thread->flags & GLC_THREAD_READ)
+		glc_ref_accept(glc, from);
+
+	/*
+	 * Only filters sitting between two buffers share the slots.
+	 * Sources and sinks may block on I/O in their callbacks.
+	 */
+	private->shared = (thread->flags & GLC_THREAD_READ) &&
+			  (thread->flags & GLC_THREAD_WRITE) &&
+			  glc_shared_workers(glc);
+	private->collect_stats = (thread->stats != NULL) ||
+				 (glc_log_get_level(glc) >= GLC_PERF);
+	private->stats = thread->stats ? thread->stats : &private->own_stats;
+
 	pthread_mutex_init(&private->open, NULL);
 	pthread_mutex_init(&private->finish, NULL);
+	pthread_mutex_init(&private->reorder, NULL);
+	pthread_cond_init(&private->reorder_cond, NULL);
 
 	private->pthread_thread = malloc(sizeof(pthread_t) * thread->threads);
 	for (t = 0; t < thread->threads; t++) {
@@ -118,6 +163,8 @@ int glc_thread_wait(glc_thread_t *thread)
 	}
 
 	free(private->pthread_thread);
+	pthread_cond_destroy(&private->reorder_cond);
+	pthread_mutex_destroy(&private->reorder);
 	pthread_mutex_destroy(&private->finish);
 	pthread_mutex_destroy(&private->open);
 	free(private);
@@ -126,6 +173,20 @@ int glc_thread_wait(glc_thread_t *thread)
 	return 0;
 }
 
+int glc_thread_get_stats(glc_thread_t *thread, glc_thread_stats_t *stats)
+{
+	struct glc_thread_private_s *private = thread->priv;
+
+	if (unlikely(!private))
+		return EAGAIN;
+	if (unlikely(!private->collect_stats))
+		return ENOTSUP;
+
+	/* counters are updated atomically one by one, a snapshot is good enough */
+	memcpy(stats, private->stats, sizeof(glc_thread_stats_t));
+	return 0;
+}
+
 /**
  * \brief thread loop
  *
@@ -136,7 +197,12 @@ int glc_thread_wait(glc_thread_t *thread)
  */
 void *glc_thread(void *argptr)
 {
-	int has_locked, ret, write_size_set, packets_init;
+	int has_locked, has_turn, ret, write_size_set, packets_init;
+	u_int64_t seq = 0;
+	glc_utime_t start;
+	glc_ref_t *in_ref = NULL, *out_ref = NULL;
+	glc_ref_message_t ref_msg;
+	glc_message_header_t ref_header, *write_header;
 
 	struct glc_thread_private_s *private = (struct glc_thread_private_s *) argptr;
 	glc_thread_t *thread = private->thread;
@@ -144,12 +210,14 @@ void *glc_thread(void *argptr)
 
 	ps_packet_t read, write;
 
-	write_size_set = ret = has_locked = packets_init = 0;
+	write_size_set = ret = has_locked = has_turn = packets_init = 0;
 	state.flags = state.read_size = state.write_size = 0;
 	state.ptr = thread->ptr;
+	ref_header.type = GLC_MESSAGE_REF;
 
 	glc_thread_block_signals();
 	glc_thread_set_rt_priority(private->glc, thread->ask_rt);
+	glc_apply_sched(private->glc, thread->name);
 
 	if (thread->flags & GLC_THREAD_READ) {
 		if (unlikely((ret = ps_packet_init(&read, private->from))))
@@ -177,6 +245,9 @@ void *glc_thread(void *argptr)
 				goto err;
 		}
 
+		/* waiting for read packet includes packet order lock */
+		start = glc_thread_time(private);
+
 		if ((thread->flags & GLC_THREAD_WRITE) && (thread->flags & GLC_THREAD_READ)) {
 			pthread_mutex_lock(&private->open); /* preserve packet order */
 			has_locked = 1;
@@ -185,78 +256,181 @@ void *glc_thread(void *argptr)
 		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
 			if (unlikely((ret = ps_packet_open(&read, PS_PACKET_READ))))
 				goto err;
+			glc_thread_hist_add(private, GLC_THREAD_HIST_READ_WAIT, start);
 			if (unlikely((ret = ps_packet_read(&read, &state.header,
 						  sizeof(glc_message_header_t)))))
 				goto err;
 			if (unlikely((ret = ps_packet_getsize(&read, &state.read_size))))
 				goto err;
 			state.read_size -= sizeof(glc_message_header_t);
+
+			if (state.header.type == GLC_MESSAGE_REF) {
+				/* callbacks only ever see the referenced message */
+				if (unlikely((ret = ps_packet_read(&read, &ref_msg,
+							  sizeof(glc_ref_message_t)))))
+					goto err;
+				in_ref = ref_msg.ref;
+				state.header = in_ref->header;
+				state.read_size = in_ref->size;
+			}
 			state.write_size = state.read_size;
+		}
+
+		if (thread->flags & GLC_THREAD_REORDER) {
+			/*
+			 * Packet acquisition is serialized by the open lock
+			 * only. The packet is tagged with its position in the
+			 * stream, header callback and dma overlap with other
+			 * threads, read callback waits for its turn below.
+			 */
+			seq = private->read_seq++;
+			has_locked = 0;
+			pthread_mutex_unlock(&private->open);
+		}
 
+		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
 			/* header callback */
 			if (thread->header_callback) {
+				start = glc_thread_time(private);
 				if (unlikely((ret = thread->header_callback(&state))))
 					goto err;
+				glc_thread_hist_add(private, GLC_THREAD_HIST_HEADER, start);
 			}
 
-			if (unlikely((ret = ps_packet_dma(&read, (void *) &state.read_data,
-						 state.read_size, PS_ACCEPT_FAKE_DMA))))
+			if (in_ref)
+				state.read_data = in_ref->data;
+			else if (unlikely((ret = ps_packet_dma(&read, (void *) &state.read_data,
+						      state.read_size, PS_ACCEPT_FAKE_DMA))))
 				goto err;
 
+			/* keep stream state changes in order */
+			if (thread->flags & GLC_THREAD_REORDER) {
+				if (unlikely((ret = glc_thread_reorder_wait(private, seq))))
+					goto err;
+				has_turn = 1;
+			}
+
 			/* read callback */
 			if (thread->read_callback) {
+				start = glc_thread_time(private);
 				if (unlikely((ret = thread->read_callback(&state))))
 					goto err;
+				glc_thread_hist_add(private, GLC_THREAD_HIST_READ, start);
 			}
 		}
 
+		/* waiting for write packet includes waiting for our turn */
+		start = glc_thread_time(private);
+
+		if ((thread->flags & GLC_THREAD_REORDER) && (!has_turn)) {
+			if (unlikely((ret = glc_thread_reorder_wait(private, seq))))
+				goto err;
+			has_turn = 1;
+		}
+
 		if ((thread->flags & GLC_THREAD_WRITE) &&
 		    (!(state.flags & GLC_THREAD_STATE_SKIP_WRITE))) {
+			/*
+			 * Untouched payloads are handed over by reference.
+			 * If target budget is exhausted or allocation fails,
+			 * the payload is simply copied.
+			 */
+			if ((state.flags & GLC_THREAD_COPY) &&
+			    (state.write_size >= GLC_REF_MIN_SIZE) &&
+			    (!glc_ref_charge(private->glc, private->to, state.write_size))) {
+				if ((in_ref) && (in_ref->size == state.write_size) &&
+				    (in_ref->header.type == state.header.type)) {
+					glc_ref_get(in_ref);
+					out_ref = in_ref;
+				} else
+					out_ref = glc_ref_create(&state.header, state.read_data,
+								 state.write_size);
+				if (unlikely(!out_ref))
+					glc_ref_uncharge(private->glc, private->to,
+							 state.write_size);
+			}
+
 			if (unlikely((ret = ps_packet_open(&write, PS_PACKET_WRITE))))
 				goto err;
+			glc_thread_hist_add(private, GLC_THREAD_HIST_WRITE_WAIT, start);
 
 			if (has_locked) {
 				has_locked = 0;
 				pthread_mutex_unlock(&private->open);
 			}
 
+			/* write packet position is reserved, let next one in */
+			if (has_turn) {
+				has_turn = 0;
+				glc_thread_reorder_done(private);
+			}
+
 			/* reserve space for header */
 			if (unlikely((ret = ps_packet_seek(&write,
 							sizeof(glc_message_header_t)))))
 				goto err;
 
-			if (!(state.flags & GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE)) {
-				/* 'unlock' write */
+			write_header = &state.header;
+			if (out_ref) {
+				ref_msg.ref = out_ref;
 				if (unlikely((ret = ps_packet_setsize(&write,
-					   sizeof(glc_message_header_t) + state.write_size))))
+					   sizeof(glc_message_header_t) +
+					   sizeof(glc_ref_message_t)))))
 					goto err;
 				write_size_set = 1;
-			}
-
-			if (state.flags & GLC_THREAD_COPY) {
-				/* should be faster, no need for fake dma */
-				if (unlikely((ret = ps_packet_write(&write, state.read_data,
-							state.write_size))))
+				if (unlikely((ret = ps_packet_write(&write, &ref_msg,
+							  sizeof(glc_ref_message_t)))))
 					goto err;
+				out_ref = NULL; /* reader owns it now */
+				write_header = &ref_header;
 			} else {
-				if (unlikely((ret = ps_packet_dma(&write,
-							(void *) &state.write_data,
-							 state.write_size, PS_ACCEPT_FAKE_DMA))))
+				if (!(state.flags & GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE)) {
+					/* 'unlock' write */
+					if (unlikely((ret = ps_packet_setsize(&write,
+						   sizeof(glc_message_header_t) + state.write_size))))
 						goto err;
+					write_size_set = 1;
+				}
 
-				/* write callback */
-				if (thread->write_callback) {
-					if (unlikely((ret = thread->write_callback(&state))))
+				if (state.flags & GLC_THREAD_COPY) {
+					/* should be faster, no need for fake dma */
+					if (unlikely((ret = ps_packet_write(&write, state.read_data,
+								state.write_size))))
 						goto err;
+				} else {
+					if (unlikely((ret = ps_packet_dma(&write,
+								(void *) &state.write_data,
+								 state.write_size, PS_ACCEPT_FAKE_DMA))))
+							goto err;
+
+					/* write callback */
+					if (thread->write_callback) {
+						if (private->shared)
+							glc_worker_acquire(private->glc);
+						start = glc_thread_time(private);
+						ret = thread->write_callback(&state);
+						glc_thread_hist_add(private, GLC_THREAD_HIST_WRITE, start);
+						if (private->shared)
+							glc_worker_release(private->glc);
+						if (unlikely(ret))
+							goto err;
+					}
 				}
 			}
 
-			/* write header */
-			if (unlikely((ret = ps_packet_seek(&write, 0))))
-				goto err;
-			if (unlikely((ret = ps_packet_write(&write,
-					&state.header, sizeof(glc_message_header_t)))))
-				goto err;
+			if (state.flags & GLC_THREAD_STATE_CANCEL_WRITE) {
+				ps_packet_cancel(&write);
+				state.flags |= GLC_THREAD_STATE_SKIP_WRITE;
+				state.write_data = NULL;
+				state.write_size = 0;
+			} else {
+				/* write header */
+				if (unlikely((ret = ps_packet_seek(&write, 0))))
+					goto err;
+				if (unlikely((ret = ps_packet_write(&write,
+						write_header, sizeof(glc_message_header_t)))))
+					goto err;
+			}
 		}
 
 		/* in case of we skipped writing */
@@ -265,11 +439,22 @@ void *glc_thread(void *argptr)
 			pthread_mutex_unlock(&private->open);
 		}
 
+		if (has_turn) {
+			has_turn = 0;
+			glc_thread_reorder_done(private);
+		}
+
 		if ((thread->flags & GLC_THREAD_READ) &&
 		    (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
 			ps_packet_close(&read);
 			state.read_data = NULL;
 			state.read_size = 0;
+
+			if (in_ref) {
+				glc_ref_uncharge(private->glc, private->from, in_ref->size);
+				glc_ref_put(in_ref);
+				in_ref = NULL;
+			}
 		}
 
 		if ((thread->flags & GLC_THREAD_WRITE) &&
@@ -286,8 +471,10 @@ void *glc_thread(void *argptr)
 
 		/* close callback */
 		if (thread->close_callback) {
+			start = glc_thread_time(private);
 			if (unlikely((ret = thread->close_callback(&state))))
 				goto err;
+			glc_thread_hist_add(private, GLC_THREAD_HIST_CLOSE, start);
 		}
 
 		if (state.flags & GLC_THREAD_STOP)
@@ -338,6 +525,13 @@ finish:
 	/* it is safe to unlock now */
 	pthread_mutex_unlock(&private->finish);
 
+	/* buffer may be reused by a reader that doesn't resolve references */
+	if (thread->flags & GLC_THREAD_READ)
+		glc_ref_refuse(private->glc, private->from);
+
+	if (private->collect_stats)
+		glc_thread_print_stats(private);
+
 	/* finish callback */
 	if (thread->finish_callback)
 		thread->finish_callback(state.ptr, private->ret);
@@ -348,6 +542,19 @@ err:
 	if (has_locked)
 		pthread_mutex_unlock(&private->open);
 
+	if (in_ref) {
+		glc_ref_uncharge(private->glc, private->from, in_ref->size);
+		glc_ref_put(in_ref);
+	}
+	if (out_ref) {
+		glc_ref_uncharge(private->glc, private->to, out_ref->size);
+		glc_ref_put(out_ref);
+	}
+
+	/* threads waiting for their turn would never get it */
+	if (thread->flags & GLC_THREAD_REORDER)
+		glc_thread_reorder_cancel(private);
+
 	if (ret == EINTR)
 		ret = 0;
 	else {
@@ -358,6 +565,140 @@ err:
 	goto finish;
 }
 
+/**
+ * \brief timestamp for latency measurement
+ * \param private thread private data
+ * \return current time or 0 if statistics are not collected
+ */
+__inline__ glc_utime_t glc_thread_time(struct glc_thread_private_s *private)
+{
+	if (likely(!private->collect_stats))
+		return 0;
+	return glc_time(private->glc);
+}
+
+/**
+ * \brief add elapsed time since start to a histogram
+ * \param private thread private data
+ * \param hist histogram index
+ * \param start value returned by glc_thread_time()
+ */
+void glc_thread_hist_add(struct glc_thread_private_s *private, int hist,
+			 glc_utime_t start)
+{
+	glc_thread_hist_t *h;
+	glc_utime_t elapsed, max;
+	int bucket;
+
+	if (likely(!private->collect_stats))
+		return;
+
+	h = &private->stats->hist[hist];
+	elapsed = glc_time(private->glc) - start;
+	bucket = elapsed ? 63 - __builtin_clzll(elapsed) : 0;
+	if (bucket >= GLC_THREAD_HIST_BUCKETS)
+		bucket = GLC_THREAD_HIST_BUCKETS - 1;
+
+	__sync_fetch_and_add(&h->count, 1);
+	__sync_fetch_and_add(&h->total, elapsed);
+	__sync_fetch_and_add(&h->buckets[bucket], 1);
+	while (elapsed > (max = h->max)) {
+		if (__sync_bool_compare_and_swap(&h->max, max, elapsed))
+			break;
+	}
+}
+
+/**
+ * \brief log timing statistics
+ * \param private thread private data
+ */
+void glc_thread_print_stats(struct glc_thread_private_s *private)
+{
+	static const char *hist_name[GLC_THREAD_HIST_NUM] = {
+		"read wait", "write wait", "header callback",
+		"read callback", "write callback", "close callback"
+	};
+	const char *name = private->thread->name ? private->thread->name : "glc_thread";
+	glc_thread_hist_t *h;
+	u_int64_t sum, p50, p99;
+	int i, b;
+
+	for (i = 0; i < GLC_THREAD_HIST_NUM; i++) {
+		h = &private->stats->hist[i];
+		if (!h->count)
+			continue;
+
+		/* percentiles are upper bounds of the bucket they fall in */
+		p50 = p99 = 0;
+		for (b = 0, sum = 0; b < GLC_THREAD_HIST_BUCKETS; b++) {
+			sum += h->buckets[b];
+			if ((!p50) && (sum * 2 >= h->count))
+				p50 = (u_int64_t) 2 << b;
+			if ((!p99) && (sum * 100 >= h->count * 99))
+				p99 = (u_int64_t) 2 << b;
+		}
+
+		glc_log(private->glc, GLC_PERF, name,
+			"%s: count %" PRIu64 " avg %" PRIu64 " ns p50 < %" PRIu64
+			" ns p99 < %" PRIu64 " ns max %" PRIu64 " ns", hist_name[i],
+			h->count, h->total / h->count, p50, p99, h->max);
+
+		for (b = 0; b < GLC_THREAD_HIST_BUCKETS; b++) {
+			if (h->buckets[b])
+				glc_log(private->glc, GLC_PERF, name,
+					"  %s [%" PRIu64 ", %" PRIu64 ") ns: %" PRIu64,
+					hist_name[i], b ? (u_int64_t) 1 << b : 0,
+					(u_int64_t) 2 << b,
+					h->buckets[b]);
+		}
+	}
+}
+
+/**
+ * \brief wait until packet seq is next to be committed
+ * \param private thread private data
+ * \param seq packet sequence number
+ * \return 0 on success, EINTR if processing was cancelled
+ */
+int glc_thread_reorder_wait(struct glc_thread_private_s *private,
+			    u_int64_t seq)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&private->reorder);
+	while ((private->write_seq != seq) && (!private->reorder_cancel))
+		pthread_cond_wait(&private->reorder_cond, &private->reorder);
+	if (unlikely(private->reorder_cancel))
+		ret = EINTR;
+	pthread_mutex_unlock(&private->reorder);
+
+	return ret;
+}
+
+/**
+ * \brief let the next packet in sequence be committed
+ * \param private thread private data
+ */
+void glc_thread_reorder_done(struct glc_thread_private_s *private)
+{
+	pthread_mutex_lock(&private->reorder);
+	private->write_seq++;
+	pthread_cond_broadcast(&private->reorder_cond);
+	pthread_mutex_unlock(&private->reorder);
+}
+
+/**
+ * \brief wake up all threads waiting for their turn
+ * \param private thread private data
+ */
+void glc_thread_reorder_cancel(struct glc_thread_private_s *private)
+{
+	pthread_mutex_lock(&private->reorder);
+	private->reorder_cancel = 1;
+	pthread_cond_broadcast(&private->reorder_cond);
+	pthread_mutex_unlock(&private->reorder);
+}
+
 int glc_thread_set_rt_priority(glc_t *glc, int ask_rt)
 {
 	int ret = 0;
@@ -405,6 +746,7 @@ typedef struct {
 	void *arg;
 	glc_t *glc;
 	int   ask_rt;
+	const char *name;
 } glc_simple_thread_param_t;
 
 static void *glc_simple_thread_start_routine(void *arg)
@@ -414,6 +756,7 @@ static void *glc_simple_thread_start_routine(void *arg)
 
 	glc_thread_block_signals();
 	glc_thread_set_rt_priority(param->glc, param->ask_rt);
+	glc_apply_sched(param->glc, param->name);
 	res  = param->start_routine(param->arg);
 	free(param);
 	return res;
@@ -436,6 +779,7 @@ int glc_simple_thread_create(glc_t *glc, glc_simple_thread_t *thread,
 	param->arg           = arg;
 	param->glc           = glc;
 	param->ask_rt        = thread->ask_rt;
+	param->name          = thread->name;
 
 	/* May need to set before starting the thread as some threads
 	 * might use this flag as a stop condition.
@@ -55,6 +55,8 @@ extern "C" {
 #define GLC_THREAD_COPY                      32
 /** thread wants to stop */
 #define GLC_THREAD_STOP                      64
+/** write callback wants to drop the packet it was writing */
+#define GLC_THREAD_STATE_CANCEL_WRITE       128
 
 /**
  * \brief thread state
@@ -88,6 +90,56 @@ typedef struct {
 #define GLC_THREAD_READ                       1
 /** thread does write operations */
 #define GLC_THREAD_WRITE                      2
+/** packets are tagged with a sequence number when read and the packet
+    order lock is released before the header callback. Header callback
+    and dma run in parallel, read callback and opening the write packet
+    still happen in original order so stream state changes stay ordered.
+    Write callbacks overlap like without this flag.
+    Only valid together with GLC_THREAD_READ and GLC_THREAD_WRITE. */
+#define GLC_THREAD_REORDER                    4
+
+/** number of log2 buckets in a latency histogram */
+#define GLC_THREAD_HIST_BUCKETS              32
+/** time spent waiting for a read packet */
+#define GLC_THREAD_HIST_READ_WAIT             0
+/** time spent waiting for a write packet */
+#define GLC_THREAD_HIST_WRITE_WAIT            1
+/** time spent in header callback */
+#define GLC_THREAD_HIST_HEADER                2
+/** time spent in read callback */
+#define GLC_THREAD_HIST_READ                  3
+/** time spent in write callback */
+#define GLC_THREAD_HIST_WRITE                 4
+/** time spent in close callback */
+#define GLC_THREAD_HIST_CLOSE                 5
+/** number of histograms */
+#define GLC_THREAD_HIST_NUM                   6
+
+/**
+ * \brief latency histogram
+ *
+ * Bucket i counts samples in [2^i, 2^(i+1)) nanoseconds,
+ * bucket 0 also counts 0 and last bucket everything above.
+ */
+typedef struct {
+	/** number of samples */
+	u_int64_t count;
+	/** sum of all samples in ns */
+	u_int64_t total;
+	/** largest sample in ns */
+	u_int64_t max;
+	/** sample count per bucket */
+	u_int64_t buckets[GLC_THREAD_HIST_BUCKETS];
+} glc_thread_hist_t;
+
+/**
+ * \brief per stage timing statistics
+ */
+typedef struct {
+	/** histograms, indexed with GLC_THREAD_HIST_* */
+	glc_thread_hist_t hist[GLC_THREAD_HIST_NUM];
+} glc_thread_stats_t;
+
 /**
  * \brief thread vtable
  *
@@ -96,7 +148,8 @@ typedef struct {
  * If callback is NULL, it is ignored.
  */
 typedef struct {
-	/** flags, GLC_THREAD_READ or GLC_THREAD_WRITE or both */
+	/** flags, GLC_THREAD_READ or GLC_THREAD_WRITE or both,
+	    optionally GLC_THREAD_REORDER */
 	glc_flags_t flags;
 	/** global argument pointer */
 	void *ptr;
@@ -104,8 +157,15 @@ typedef struct {
 	size_t threads;
 	/** flag to indicate that rt prio is desired. */
 	int    ask_rt;
+	/** thread name used to look up scheduling configuration,
+	    see glc_set_sched() */
+	const char *name;
 	/** implementation specific */
 	void *priv;
+	/** where timing statistics are collected, stays valid after
+	    glc_thread_wait(). If NULL, statistics are collected only
+	    at GLC_PERF log level. */
+	glc_thread_stats_t *stats;
 
 	/** thread create callback is called when a thread starts */
 	int (*thread_create_callback)(void *, void **);
@@ -119,7 +179,8 @@ typedef struct {
 	    header from packet */
 	int (*header_callback)(glc_thread_state_t *);
 	/** read callback is called when thread has read the
-	    whole packet */
+	    whole packet. In GLC_THREAD_REORDER mode it is still
+	    called in packet order. */
 	int (*read_callback)(glc_thread_state_t *);
 	/** write callback is called when thread has opened
 	    dma to write packet */
@@ -151,10 +212,25 @@ __PUBLIC int glc_thread_create(glc_t *glc, glc_thread_t *thread,
  */
 __PUBLIC int glc_thread_wait(glc_thread_t *thread);
 
+/**
+ * \brief get a snapshot of thread timing statistics
+ *
+ * Statistics are collected when thread.stats is set or log level
+ * is at least GLC_PERF when threads are created. They are also
+ * logged at GLC_PERF when all threads have finished.
+ * \param thread running thread
+ * \param stats where to copy statistics
+ * \return 0 on success, EAGAIN if threads are not running or
+ *         ENOTSUP if statistics are not collected
+ */
+__PUBLIC int glc_thread_get_stats(glc_thread_t *thread, glc_thread_stats_t *stats);
+
 typedef struct {
 	pthread_t thread;
 	/** flag to indicate that rt prio is desired. */
 	int ask_rt;
+	/** thread name, see glc_set_sched() */
+	const char *name;
 	int running;
 } glc_simple_thread_t;
 
@@ -416,6 +416,36 @@ const char *glc_util_msgtype_to_str(glc_message_type_t type)
 	case GLC_CALLBACK_REQUEST:
 		res = "GLC_CALLBACK_REQUEST";
 		break;
+	case GLC_MESSAGE_REF:
+		res = "GLC_MESSAGE_REF";
+		break;
+	case GLC_MESSAGE_VIDEO_PACE:
+		res = "GLC_MESSAGE_VIDEO_PACE";
+		break;
+	case GLC_MESSAGE_VIDEO_REPEAT:
+		res = "GLC_MESSAGE_VIDEO_REPEAT";
+		break;
+	case GLC_MESSAGE_DELTA:
+		res = "GLC_MESSAGE_DELTA";
+		break;
+	case GLC_MESSAGE_SLICES:
+		res = "GLC_MESSAGE_SLICES";
+		break;
+	case GLC_MESSAGE_LZ4:
+		res = "GLC_MESSAGE_LZ4";
+		break;
+	case GLC_MESSAGE_FILTER:
+		res = "GLC_MESSAGE_FILTER";
+		break;
+	case GLC_MESSAGE_LOSSLESS:
+		res = "GLC_MESSAGE_LOSSLESS";
+		break;
+	case GLC_MESSAGE_JPEG:
+		res = "GLC_MESSAGE_JPEG";
+		break;
+	case GLC_MESSAGE_SEEK:
+		res = "GLC_MESSAGE_SEEK";
+		break;
 	default:
 		res = "unknown";
 		break;
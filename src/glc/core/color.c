@@ -124,12 +124,14 @@ int color_init(color_t *color, glc_t *glc)
 
 	(*color)->glc = glc;
 
-	(*color)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*color)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_REORDER;
 	(*color)->thread.read_callback = &color_read_callback;
 	(*color)->thread.write_callback = &color_write_callback;
 	(*color)->thread.finish_callback = &color_finish_callback;
 	(*color)->thread.ptr = *color;
 	(*color)->thread.threads = glc_threads_hint(glc);
+	(*color)->thread.name = "color";
 
 	return 0;
 }
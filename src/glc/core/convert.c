@@ -0,0 +1,860 @@
+/**
+ * \file glc/core/convert.c
+ * \brief fused scale, conversion to BGR and color correction
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup convert
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <packetstream.h>
+#include <errno.h>
+#include <math.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+#include <glc/common/thread.h>
+#include <glc/common/util.h>
+
+#include "convert.h"
+#include "optimization.h"
+
+#define CONVERT_RUNNING      0x1
+#define CONVERT_SIZE         0x2
+#define CONVERT_OVERRIDE     0x4
+
+/* 8 bit fixed point bilinear interpolation */
+#define BILINEAR(a, b, c, d, fx, fy) \
+	((((a) * (256 - (fx)) + (b) * (fx)) * (256 - (fy)) + \
+	  ((c) * (256 - (fx)) + (d) * (fx)) * (fy)) >> 16)
+
+/* offsets of R, G and B tables in lookup table */
+#define LUT_R 0
+#define LUT_G 256
+#define LUT_B 512
+
+struct convert_video_stream_s;
+
+typedef int (*convert_proc)(convert_t convert,
+			    struct convert_video_stream_s *video,
+			    unsigned char *from,
+			    unsigned char *to);
+
+struct convert_video_stream_s {
+	glc_stream_id_t id;
+	glc_flags_t flags;
+	glc_video_format_t format;
+	int created;
+
+	/* source */
+	unsigned int w, h, bpp, row;
+	/* scaled picture and output frame */
+	unsigned int sw, sh, rw, rh, rx, ry, orow;
+	double scale;
+	size_t size;
+
+	/* separable scale maps */
+	unsigned int *x0, *x1, *fx;
+	unsigned int *y0, *y1, *fy;
+
+	float brightness, contrast;
+	float red_gamma, green_gamma, blue_gamma;
+	int correct;
+	unsigned char lookup_table[256 * 3];
+
+	convert_proc proc;
+
+	pthread_rwlock_t update;
+	struct convert_video_stream_s *next;
+};
+
+struct convert_s {
+	glc_t *glc;
+	glc_flags_t flags;
+	glc_thread_t thread;
+
+	struct convert_video_stream_s *video;
+
+	double scale;
+	unsigned int width, height;
+
+	float brightness, contrast;
+	float red_gamma, green_gamma, blue_gamma;
+
+	/* Y'CbCr -> RGB terms */
+	int cr_r[256], cb_g[256], cr_g[256], cb_b[256];
+};
+
+static int convert_read_callback(glc_thread_state_t *state);
+static int convert_write_callback(glc_thread_state_t *state);
+static void convert_finish_callback(void *ptr, int err);
+
+static void convert_get_video_stream(convert_t convert, glc_stream_id_t id,
+				     struct convert_video_stream_s **video);
+static int convert_video_format_msg(convert_t convert, glc_video_format_message_t *msg,
+				    glc_thread_state_t *state);
+static int convert_color_msg(convert_t convert, glc_color_message_t *msg);
+
+static void convert_update_proc(convert_t convert, struct convert_video_stream_s *video);
+static void convert_generate_lookup_table(convert_t convert,
+					  struct convert_video_stream_s *video);
+static int convert_generate_map(convert_t convert, struct convert_video_stream_s *video,
+				unsigned int w, unsigned int h);
+
+static int convert_bgr(convert_t convert, struct convert_video_stream_s *video,
+		       unsigned char *from, unsigned char *to);
+static int convert_bgr_scale(convert_t convert, struct convert_video_stream_s *video,
+			     unsigned char *from, unsigned char *to);
+static int convert_ycbcr(convert_t convert, struct convert_video_stream_s *video,
+			 unsigned char *from, unsigned char *to);
+static int convert_ycbcr_correct(convert_t convert, struct convert_video_stream_s *video,
+				 unsigned char *from, unsigned char *to);
+static int convert_ycbcr_scale(convert_t convert, struct convert_video_stream_s *video,
+			       unsigned char *from, unsigned char *to);
+static void convert_correct_rows(convert_t convert, struct convert_video_stream_s *video,
+				 unsigned char *from, unsigned int cy,
+				 unsigned char *Y, unsigned char *Cb, unsigned char *Cr);
+
+/* unfortunately over- and underflows will occur */
+__inline__ static unsigned char convert_clamp(int val)
+{
+	if (val > 255)
+		return 255;
+	else if (val < 0)
+		return 0;
+	return val;
+}
+
+/*
+ * Color correction of Y'CbCr data is done like the color filter
+ * does it: the sample is converted to RGB, corrected with the
+ * per-channel lookup table and converted back to Y'CbCr.
+ */
+__inline__ static void convert_correct_sample(convert_t convert, unsigned char *lut,
+					      int Y, int Cb, int Cr,
+					      int *Yc, int *Cbc, int *Crc)
+{
+	int R, G, B;
+
+	R = lut[LUT_R + convert_clamp(Y + convert->cr_r[Cr])];
+	G = lut[LUT_G + convert_clamp(Y - convert->cb_g[Cb] - convert->cr_g[Cr])];
+	B = lut[LUT_B + convert_clamp(Y + convert->cb_b[Cb])];
+
+	/* 16 bit fixed point JPEG RGB -> Y'CbCr */
+	*Yc = convert_clamp((19595 * R + 38470 * G + 7471 * B) >> 16);
+	if (Cbc) {
+		*Cbc = convert_clamp(128 + ((-11059 * R - 21709 * G + 32768 * B) >> 16));
+		*Crc = convert_clamp(128 + ((32768 * R - 27439 * G - 5329 * B) >> 16));
+	}
+}
+
+int convert_init(convert_t *convert, glc_t *glc)
+{
+	int c;
+
+	*convert = (convert_t) calloc(1, sizeof(struct convert_s));
+
+	(*convert)->glc = glc;
+	(*convert)->scale = 1.0;
+
+	for (c = 0; c < 256; c++) {
+		(*convert)->cr_r[c] = 1.402 * (c - 128);
+		(*convert)->cb_g[c] = 0.344136 * (c - 128);
+		(*convert)->cr_g[c] = 0.714136 * (c - 128);
+		(*convert)->cb_b[c] = 1.772 * (c - 128);
+	}
+
+	(*convert)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				   GLC_THREAD_REORDER;
+	(*convert)->thread.read_callback = &convert_read_callback;
+	(*convert)->thread.write_callback = &convert_write_callback;
+	(*convert)->thread.finish_callback = &convert_finish_callback;
+	(*convert)->thread.ptr = *convert;
+	(*convert)->thread.threads = glc_threads_hint(glc);
+	(*convert)->thread.name = "convert";
+
+	return 0;
+}
+
+int convert_destroy(convert_t convert)
+{
+	free(convert);
+	return 0;
+}
+
+int convert_set_scale(convert_t convert, double factor)
+{
+	if (unlikely(factor <= 0))
+		return EINVAL;
+
+	convert->scale = factor;
+	convert->flags &= ~CONVERT_SIZE;
+	return 0;
+}
+
+int convert_set_size(convert_t convert, unsigned int width, unsigned int height)
+{
+	if (unlikely((!width) || (!height)))
+		return EINVAL;
+
+	convert->width = width;
+	convert->height = height;
+	convert->flags |= CONVERT_SIZE;
+	return 0;
+}
+
+int convert_override(convert_t convert, float brightness, float contrast,
+		     float red, float green, float blue)
+{
+	convert->brightness = brightness;
+	convert->contrast = contrast;
+	convert->red_gamma = red;
+	convert->green_gamma = green;
+	convert->blue_gamma = blue;
+
+	convert->flags |= CONVERT_OVERRIDE;
+	return 0;
+}
+
+int convert_process_start(convert_t convert, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unlikely(convert->flags & CONVERT_RUNNING))
+		return EAGAIN;
+
+	if (unlikely((ret = glc_thread_create(convert->glc, &convert->thread, from, to))))
+		return ret;
+	convert->flags |= CONVERT_RUNNING;
+
+	return 0;
+}
+
+int convert_process_wait(convert_t convert)
+{
+	if (unlikely(!(convert->flags & CONVERT_RUNNING)))
+		return EAGAIN;
+
+	/* finish callback frees video stuff */
+	glc_thread_wait(&convert->thread);
+	convert->flags &= ~CONVERT_RUNNING;
+
+	return 0;
+}
+
+void convert_finish_callback(void *ptr, int err)
+{
+	convert_t convert = (convert_t) ptr;
+	struct convert_video_stream_s *del;
+
+	if (unlikely(err))
+		glc_log(convert->glc, GLC_ERROR, "convert", "%s (%d)", strerror(err), err);
+
+	while (convert->video != NULL) {
+		del = convert->video;
+		convert->video = convert->video->next;
+
+		free(del->x0);
+		free(del->y0);
+
+		pthread_rwlock_destroy(&del->update);
+		free(del);
+	}
+}
+
+int convert_read_callback(glc_thread_state_t *state)
+{
+	convert_t convert = (convert_t) state->ptr;
+	struct convert_video_stream_s *video;
+	glc_video_frame_header_t *pic_hdr;
+
+	if (state->header.type == GLC_MESSAGE_COLOR) {
+		convert_color_msg(convert, (glc_color_message_t *) state->read_data);
+
+		/* color correction is applied here */
+		state->flags |= GLC_THREAD_STATE_SKIP_WRITE;
+		return 0;
+	}
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT)
+		return convert_video_format_msg(convert,
+						(glc_video_format_message_t *) state->read_data,
+						state);
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FRAME) {
+		pic_hdr = (glc_video_frame_header_t *) state->read_data;
+		convert_get_video_stream(convert, pic_hdr->id, &video);
+		state->threadptr = video;
+
+		pthread_rwlock_rdlock(&video->update);
+
+		if (video->proc)
+			state->write_size = sizeof(glc_video_frame_header_t) + video->size;
+		else {
+			state->flags |= GLC_THREAD_COPY;
+			pthread_rwlock_unlock(&video->update);
+		}
+	} else
+		state->flags |= GLC_THREAD_COPY;
+
+	return 0;
+}
+
+int convert_write_callback(glc_thread_state_t *state)
+{
+	struct convert_video_stream_s *video = state->threadptr;
+
+	int ret;
+
+	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
+	ret = video->proc(state->ptr, video,
+			  (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
+			  (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)]);
+	pthread_rwlock_unlock(&video->update);
+
+	return ret;
+}
+
+void convert_get_video_stream(convert_t convert, glc_stream_id_t id,
+			      struct convert_video_stream_s **video)
+{
+	/* called from read callback so never called in parallel */
+	*video = convert->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			break;
+		*video = (*video)->next;
+	}
+
+	if (*video == NULL) {
+		*video = (struct convert_video_stream_s *)
+			calloc(1, sizeof(struct convert_video_stream_s));
+
+		(*video)->next = convert->video;
+		convert->video = *video;
+		(*video)->id = id;
+		(*video)->red_gamma = (*video)->green_gamma = (*video)->blue_gamma = 1.0;
+		convert_generate_lookup_table(convert, *video);
+		pthread_rwlock_init(&(*video)->update, NULL);
+	}
+}
+
+int convert_video_format_msg(convert_t convert, glc_video_format_message_t *msg,
+			     glc_thread_state_t *state)
+{
+	struct convert_video_stream_s *video;
+	glc_flags_t old_flags;
+	int ret = 0;
+
+	convert_get_video_stream(convert, msg->id, &video);
+	pthread_rwlock_wrlock(&video->update);
+
+	old_flags = video->flags;
+	video->flags = msg->flags;
+	video->format = msg->format;
+	video->w = msg->width;
+	video->h = msg->height;
+
+	if (convert->flags & CONVERT_OVERRIDE) {
+		video->brightness = convert->brightness;
+		video->contrast = convert->contrast;
+		video->red_gamma = convert->red_gamma;
+		video->green_gamma = convert->green_gamma;
+		video->blue_gamma = convert->blue_gamma;
+		convert_generate_lookup_table(convert, video);
+	}
+
+	if (convert->flags & CONVERT_SIZE) {
+		video->rw = convert->width;
+		video->rh = convert->height;
+
+		if ((float) video->rw / (float) video->w < (float) video->rh / (float) video->h)
+			video->scale = (float) video->rw / (float) video->w;
+		else
+			video->scale = (float) video->rh / (float) video->h;
+
+		video->sw = video->scale * video->w;
+		video->sh = video->scale * video->h;
+		video->rx = (video->rw - video->sw) / 2;
+		video->ry = (video->rh - video->sh) / 2;
+	} else {
+		video->scale = convert->scale;
+		video->sw = video->scale * video->w;
+		video->sh = video->scale * video->h;
+
+		video->rx = video->ry = 0;
+		video->rw = video->sw;
+		video->rh = video->sh;
+	}
+
+	if ((video->format == GLC_VIDEO_BGR) ||
+	    (video->format == GLC_VIDEO_BGRA)) {
+		video->bpp = (video->format == GLC_VIDEO_BGRA) ? 4 : 3;
+		video->row = video->w * video->bpp;
+		if ((msg->flags & GLC_VIDEO_DWORD_ALIGNED) && (video->row % 8 != 0))
+			video->row += 8 - video->row % 8;
+	} else if (video->format == GLC_VIDEO_YCBCR_420JPEG) {
+		/* Y'CbCr frame dimensions are always divisible by two */
+		video->bpp = 1;
+		video->row = video->w;
+	} else {
+		glc_log(convert->glc, GLC_WARN, "convert",
+			"unsupported video %d format 0x%02x", msg->id, msg->format);
+		video->proc = NULL;
+		goto unlock;
+	}
+
+	if ((video->rw != video->w) || (video->rh != video->h)) {
+		if (unlikely((ret = convert_generate_map(convert, video,
+							 video->w, video->h))))
+			goto unlock;
+		glc_log(convert->glc, GLC_DEBUG, "convert",
+			"scaling video %d with factor %f (from %ux%u to %ux%u)",
+			video->id, video->scale, video->w, video->h, video->sw, video->sh);
+	}
+
+	/*
+	 * BGR data that is not scaled keeps its layout so color correction
+	 * can be switched on and off by color messages without changing the
+	 * announced format. Everything else is written as packed BGR.
+	 */
+	if ((video->format == GLC_VIDEO_BGR) &&
+	    (video->rw == video->w) && (video->rh == video->h)) {
+		video->orow = video->row;
+	} else {
+		video->orow = video->rw * 3;
+		msg->flags &= ~GLC_VIDEO_DWORD_ALIGNED;
+	}
+	video->size = video->orow * video->rh;
+
+	msg->format = GLC_VIDEO_BGR;
+	msg->width = video->rw;
+	msg->height = video->rh;
+
+	convert_update_proc(convert, video);
+
+	if ((convert->flags & CONVERT_SIZE) && (video->created) &&
+	    (msg->flags == old_flags))
+		state->flags |= GLC_THREAD_STATE_SKIP_WRITE;
+	video->created = 1;
+
+unlock:
+	state->flags |= GLC_THREAD_COPY;
+	pthread_rwlock_unlock(&video->update);
+	return ret;
+}
+
+int convert_color_msg(convert_t convert, glc_color_message_t *msg)
+{
+	struct convert_video_stream_s *video;
+
+	if (convert->flags & CONVERT_OVERRIDE)
+		return 0; /* ignore */
+
+	convert_get_video_stream(convert, msg->id, &video);
+	pthread_rwlock_wrlock(&video->update);
+
+	video->brightness = msg->brightness;
+	video->contrast = msg->contrast;
+	video->red_gamma = msg->red;
+	video->green_gamma = msg->green;
+	video->blue_gamma = msg->blue;
+
+	glc_log(convert->glc, GLC_INFO, "convert",
+		 "video stream %d: brightness=%f, contrast=%f, red=%f, green=%f, blue=%f",
+		 msg->id, video->brightness, video->contrast,
+		 video->red_gamma, video->green_gamma, video->blue_gamma);
+
+	convert_generate_lookup_table(convert, video);
+	if (video->format)
+		convert_update_proc(convert, video);
+
+	pthread_rwlock_unlock(&video->update);
+	return 0;
+}
+
+void convert_update_proc(convert_t convert, struct convert_video_stream_s *video)
+{
+	int scaled = (video->rw != video->w) || (video->rh != video->h);
+
+	if (video->format == GLC_VIDEO_YCBCR_420JPEG) {
+		if (scaled)
+			video->proc = &convert_ycbcr_scale;
+		else
+			video->proc = video->correct ? &convert_ycbcr_correct : &convert_ycbcr;
+	} else if (scaled)
+		video->proc = &convert_bgr_scale;
+	else if ((video->format == GLC_VIDEO_BGRA) || (video->correct))
+		video->proc = &convert_bgr;
+	else
+		video->proc = NULL;
+}
+
+void convert_generate_lookup_table(convert_t convert,
+				   struct convert_video_stream_s *video)
+{
+	unsigned int c;
+
+	video->correct = (video->brightness != 0) ||
+			 (video->contrast != 0) ||
+			 (video->red_gamma != 1) ||
+			 (video->green_gamma != 1) ||
+			 (video->blue_gamma != 1);
+
+#define CALC(value, gamma) \
+	(video->correct ? convert_clamp( \
+		(((pow((double) value / 255.0, 1.0 / gamma) - 0.5) * (1.0 + video->contrast) + 0.5) \
+		 + video->brightness) * 255.0) : (value))
+
+	for (c = 0; c < 256; c++) {
+		video->lookup_table[LUT_R + c] = CALC(c, video->red_gamma);
+		video->lookup_table[LUT_G + c] = CALC(c, video->green_gamma);
+		video->lookup_table[LUT_B + c] = CALC(c, video->blue_gamma);
+	}
+
+#undef CALC
+}
+
+/**
+ * \brief generate separable bilinear scale map
+ *
+ * Source rows and columns are computed once per output row and
+ * column instead of per pixel, which keeps the map in cache.
+ * \param convert convert object
+ * \param video video stream
+ * \param w source width
+ * \param h source height
+ * \return 0 on success otherwise an error code
+ */
+int convert_generate_map(convert_t convert, struct convert_video_stream_s *video,
+			 unsigned int w, unsigned int h)
+{
+	unsigned int *map, i;
+	float src, d;
+
+	map = (unsigned int *) realloc(video->x0, sizeof(unsigned int) * video->sw * 3);
+	if (unlikely(!map))
+		return ENOMEM;
+	video->x0 = map;
+	video->x1 = &map[video->sw];
+	video->fx = &map[video->sw * 2];
+
+	map = (unsigned int *) realloc(video->y0, sizeof(unsigned int) * video->sh * 3);
+	if (unlikely(!map))
+		return ENOMEM;
+	video->y0 = map;
+	video->y1 = &map[video->sh];
+	video->fy = &map[video->sh * 2];
+
+	d = (float) w / (float) video->sw;
+	for (i = 0; i < video->sw; i++) {
+		src = ((float) i + 0.5) * d - 0.5;
+		if (src < 0)
+			src = 0;
+		video->x0[i] = (unsigned int) src;
+		if (video->x0[i] > w - 1)
+			video->x0[i] = w - 1;
+		video->x1[i] = (video->x0[i] + 1 < w) ? video->x0[i] + 1 : video->x0[i];
+		video->fx[i] = (src - (float) video->x0[i]) * 256.0;
+		if (video->fx[i] > 256)
+			video->fx[i] = 256;
+	}
+
+	d = (float) h / (float) video->sh;
+	for (i = 0; i < video->sh; i++) {
+		src = ((float) i + 0.5) * d - 0.5;
+		if (src < 0)
+			src = 0;
+		video->y0[i] = (unsigned int) src;
+		if (video->y0[i] > h - 1)
+			video->y0[i] = h - 1;
+		video->y1[i] = (video->y0[i] + 1 < h) ? video->y0[i] + 1 : video->y0[i];
+		video->fy[i] = (src - (float) video->y0[i]) * 256.0;
+		if (video->fy[i] > 256)
+			video->fy[i] = 256;
+	}
+
+	return 0;
+}
+
+int convert_bgr(convert_t convert, struct convert_video_stream_s *video,
+		unsigned char *from, unsigned char *to)
+{
+	unsigned int x, y;
+	unsigned char *src, *dst;
+	unsigned char *lut = video->lookup_table;
+
+	for (y = 0; y < video->h; y++) {
+		src = &from[y * video->row];
+		dst = &to[y * video->orow];
+		for (x = 0; x < video->w; x++) {
+			dst[0] = lut[LUT_B + src[0]];
+			dst[1] = lut[LUT_G + src[1]];
+			dst[2] = lut[LUT_R + src[2]];
+			src += video->bpp;
+			dst += 3;
+		}
+	}
+
+	return 0;
+}
+
+int convert_bgr_scale(convert_t convert, struct convert_video_stream_s *video,
+		      unsigned char *from, unsigned char *to)
+{
+	unsigned int x, y, xs0, xs1, fx, fy;
+	unsigned char *row0, *row1, *dst;
+	unsigned char *lut = video->lookup_table;
+
+	if (convert->flags & CONVERT_SIZE)
+		memset(to, 0, video->size);
+
+	for (y = 0; y < video->sh; y++) {
+		row0 = &from[video->y0[y] * video->row];
+		row1 = &from[video->y1[y] * video->row];
+		fy = video->fy[y];
+		dst = &to[(y + video->ry) * video->orow + video->rx * 3];
+
+		for (x = 0; x < video->sw; x++) {
+			xs0 = video->x0[x] * video->bpp;
+			xs1 = video->x1[x] * video->bpp;
+			fx = video->fx[x];
+
+			dst[0] = lut[LUT_B + BILINEAR(row0[xs0 + 0], row0[xs1 + 0],
+						      row1[xs0 + 0], row1[xs1 + 0], fx, fy)];
+			dst[1] = lut[LUT_G + BILINEAR(row0[xs0 + 1], row0[xs1 + 1],
+						      row1[xs0 + 1], row1[xs1 + 1], fx, fy)];
+			dst[2] = lut[LUT_R + BILINEAR(row0[xs0 + 2], row0[xs1 + 2],
+						      row1[xs0 + 2], row1[xs1 + 2], fx, fy)];
+			dst += 3;
+		}
+	}
+
+	return 0;
+}
+
+/* Y'CbCr streams are color corrected before conversion, not in BGR */
+#define YCBCR_TO_BGR(dst, Yv, Cbv, Crv) \
+	(dst)[0] = convert_clamp((Yv) + convert->cb_b[Cbv]); \
+	(dst)[1] = convert_clamp((Yv) - convert->cb_g[Cbv] - convert->cr_g[Crv]); \
+	(dst)[2] = convert_clamp((Yv) + convert->cr_r[Crv]);
+
+int convert_ycbcr(convert_t convert, struct convert_video_stream_s *video,
+		  unsigned char *from, unsigned char *to)
+{
+	unsigned int x, y, cw;
+	unsigned char *Y, *Cb, *Cr, *dst;
+
+	cw = video->w / 2;
+
+	/* Y'CbCr is stored top-down, BGR bottom-up */
+	for (y = 0; y < video->h; y++) {
+		Y = &from[y * video->w];
+		Cb = &from[video->w * video->h + (y / 2) * cw];
+		Cr = &Cb[cw * (video->h / 2)];
+		dst = &to[(video->h - 1 - y) * video->orow];
+
+		for (x = 0; x < video->w; x++) {
+			YCBCR_TO_BGR(dst, Y[x], Cb[x / 2], Cr[x / 2])
+			dst += 3;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief color correct one row of 2x2 blocks
+ *
+ * Same as the color filter: each Y' is corrected with the chroma
+ * of its block and chroma is corrected with the average of the
+ * corrected Y' values.
+ * \param convert convert object
+ * \param video video stream
+ * \param from source frame
+ * \param cy chroma row
+ * \param Y two corrected Y' rows
+ * \param Cb corrected Cb row
+ * \param Cr corrected Cr row
+ */
+void convert_correct_rows(convert_t convert, struct convert_video_stream_s *video,
+			  unsigned char *from, unsigned int cy,
+			  unsigned char *Y, unsigned char *Cb, unsigned char *Cr)
+{
+	unsigned int x, cw;
+	unsigned char *Y0, *Y1, *Cb_from, *Cr_from;
+	unsigned char *lut = video->lookup_table;
+	int Yc[4], Ya, Cbc, Crc;
+
+	cw = video->w / 2;
+	Y0 = &from[cy * 2 * video->w];
+	Y1 = &Y0[video->w];
+	Cb_from = &from[video->w * video->h + cy * cw];
+	Cr_from = &Cb_from[cw * (video->h / 2)];
+
+	for (x = 0; x < cw; x++) {
+		convert_correct_sample(convert, lut, Y0[x * 2], Cb_from[x], Cr_from[x],
+				       &Yc[0], NULL, NULL);
+		convert_correct_sample(convert, lut, Y0[x * 2 + 1], Cb_from[x], Cr_from[x],
+				       &Yc[1], NULL, NULL);
+		convert_correct_sample(convert, lut, Y1[x * 2], Cb_from[x], Cr_from[x],
+				       &Yc[2], NULL, NULL);
+		convert_correct_sample(convert, lut, Y1[x * 2 + 1], Cb_from[x], Cr_from[x],
+				       &Yc[3], NULL, NULL);
+		convert_correct_sample(convert, lut, (Yc[0] + Yc[1] + Yc[2] + Yc[3]) >> 2,
+				       Cb_from[x], Cr_from[x], &Ya, &Cbc, &Crc);
+
+		Y[x * 2] = Yc[0];
+		Y[x * 2 + 1] = Yc[1];
+		Y[video->w + x * 2] = Yc[2];
+		Y[video->w + x * 2 + 1] = Yc[3];
+		Cb[x] = Cbc;
+		Cr[x] = Crc;
+	}
+}
+
+int convert_ycbcr_correct(convert_t convert, struct convert_video_stream_s *video,
+			  unsigned char *from, unsigned char *to)
+{
+	unsigned int x, y, cw;
+	unsigned char *rows, *Y, *Cb, *Cr, *dst;
+
+	cw = video->w / 2;
+	rows = (unsigned char *) malloc(video->w * 3);
+	if (unlikely(!rows))
+		return ENOMEM;
+	Y = rows;
+	Cb = &rows[video->w * 2];
+	Cr = &Cb[cw];
+
+	for (y = 0; y < video->h; y += 2) {
+		convert_correct_rows(convert, video, from, y / 2, Y, Cb, Cr);
+
+		dst = &to[(video->h - 1 - y) * video->orow];
+		for (x = 0; x < video->w; x++) {
+			YCBCR_TO_BGR(dst, Y[x], Cb[x / 2], Cr[x / 2])
+			dst += 3;
+		}
+
+		dst = &to[(video->h - 2 - y) * video->orow];
+		for (x = 0; x < video->w; x++) {
+			YCBCR_TO_BGR(dst, Y[video->w + x], Cb[x / 2], Cr[x / 2])
+			dst += 3;
+		}
+	}
+
+	free(rows);
+	return 0;
+}
+
+/* corrected rows of two consecutive chroma rows are kept, slot is cy & 1 */
+#define CORRECTED_ROWS(cy) \
+	(&rows[((cy) & 1) * video->w * 3])
+
+int convert_ycbcr_scale(convert_t convert, struct convert_video_stream_s *video,
+			unsigned char *from, unsigned char *to)
+{
+	unsigned int x, y, cw, ch, cx, cy, fx, fy, Yv;
+	unsigned char *Y0, *Y1, *Cb, *Cr, *dst;
+	unsigned char *rows = NULL;
+	int corrected[2] = {-1, -1};
+	unsigned int i, src[2];
+
+	cw = video->w / 2;
+	ch = video->h / 2;
+
+	/*
+	 * Correction is done before scaling like in the color -> scale
+	 * chain, on the source rows each output row needs. Consecutive
+	 * output rows mostly need the same source rows.
+	 */
+	if (video->correct) {
+		rows = (unsigned char *) malloc(video->w * 3 * 2);
+		if (unlikely(!rows))
+			return ENOMEM;
+	}
+
+	if (convert->flags & CONVERT_SIZE)
+		memset(to, 0, video->size);
+
+	for (y = 0; y < video->sh; y++) {
+		fy = video->fy[y];
+
+		cy = video->y0[y] / 2;
+		if (cy >= ch)
+			cy = ch - 1;
+
+		if (rows) {
+			src[0] = video->y0[y] / 2;
+			src[1] = video->y1[y] / 2;
+			for (i = 0; i < 2; i++) {
+				if (corrected[src[i] & 1] != (int) src[i]) {
+					convert_correct_rows(convert, video, from, src[i],
+							     CORRECTED_ROWS(src[i]),
+							     &CORRECTED_ROWS(src[i])[video->w * 2],
+							     &CORRECTED_ROWS(src[i])[video->w * 2 + cw]);
+					corrected[src[i] & 1] = src[i];
+				}
+			}
+			Y0 = &CORRECTED_ROWS(src[0])[(video->y0[y] & 1) * video->w];
+			Y1 = &CORRECTED_ROWS(src[1])[(video->y1[y] & 1) * video->w];
+			Cb = &CORRECTED_ROWS(cy)[video->w * 2];
+			Cr = &Cb[cw];
+		} else {
+			Y0 = &from[video->y0[y] * video->w];
+			Y1 = &from[video->y1[y] * video->w];
+			Cb = &from[video->w * video->h + cy * cw];
+			Cr = &Cb[cw * ch];
+		}
+
+		dst = &to[(video->ry + video->sh - 1 - y) * video->orow + video->rx * 3];
+
+		for (x = 0; x < video->sw; x++) {
+			fx = video->fx[x];
+			Yv = BILINEAR(Y0[video->x0[x]], Y0[video->x1[x]],
+				      Y1[video->x0[x]], Y1[video->x1[x]], fx, fy);
+
+			cx = video->x0[x] / 2;
+			if (cx >= cw)
+				cx = cw - 1;
+
+			YCBCR_TO_BGR(dst, (int) Yv, Cb[cx], Cr[cx])
+			dst += 3;
+		}
+	}
+
+	free(rows);
+	return 0;
+}
+
+#undef CORRECTED_ROWS
+#undef YCBCR_TO_BGR
+
+/**  \} */
@@ -0,0 +1,127 @@
+/**
+ * \file glc/core/convert.h
+ * \brief fused scale, conversion to BGR and color correction
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup convert fused scale, BGR conversion and color correction
+ *  \{
+ */
+
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief convert object
+ */
+typedef struct convert_s* convert_t;
+
+/**
+ * \brief initialize convert object
+ * \param convert convert object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_init(convert_t *convert, glc_t *glc);
+
+/**
+ * \brief destroy convert object
+ * \param convert convert object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_destroy(convert_t convert);
+
+/**
+ * \brief set scaling factor
+ * \param convert convert object
+ * \param factor scaling factor
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_set_scale(convert_t convert, double factor);
+
+/**
+ * \brief set constant output size
+ *
+ * Aspect ratio is preserved so black borders will appear
+ * if aspect ratio doesn't match.
+ * \param convert convert object
+ * \param width width
+ * \param height height
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_set_size(convert_t convert, unsigned int width,
+			      unsigned int height);
+
+/**
+ * \brief override color correction
+ * \param convert convert object
+ * \param brightness brightness value
+ * \param contrast contrast value
+ * \param red red gamma
+ * \param green green gamma
+ * \param blue blue gamma
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_override(convert_t convert, float brightness, float contrast,
+			      float red, float green, float blue);
+
+/**
+ * \brief start convert process
+ *
+ * convert does in a single pass over each frame what
+ * rgb, scale and color do in a chain: Y'CbCr and BGRA
+ * frames are converted to BGR, scaled and color corrected.
+ * Like in the chain, Y'CbCr frames are color corrected in
+ * Y'CbCr before they are scaled.
+ * \param convert convert object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_process_start(convert_t convert, ps_buffer_t *from,
+				   ps_buffer_t *to);
+
+/**
+ * \brief block until process has finished
+ * \param convert convert object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int convert_process_wait(convert_t convert);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
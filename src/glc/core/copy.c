@@ -112,6 +112,10 @@ int copy_process_start(copy_t copy, ps_buffer_t *from)
 		return EALREADY;
 
 	copy->from = from;
+	copy->thread.name = "copy";
+
+	/* references are resolved before being fanned out */
+	glc_ref_accept(copy->glc, from);
 
 	return glc_simple_thread_create(copy->glc, &copy->thread,
 				 copy_thread, copy);
@@ -126,13 +130,17 @@ void *copy_thread(void *argptr)
 {
 	copy_t copy = (copy_t) argptr;
 	struct copy_target_s *target;
-	glc_message_header_t msg_hdr;
+	glc_message_header_t msg_hdr, ref_hdr;
+	glc_ref_message_t ref_msg;
+	glc_ref_t *in_ref = NULL, *shared = NULL;
 	size_t data_size;
 	void *data;
-	int ret = 0;
+	int ret = 0, charged;
 
 	ps_packet_t read;
 
+	ref_hdr.type = GLC_MESSAGE_REF;
+
 	if (unlikely((ret = ps_packet_init(&read, copy->from))))
 		goto err;
 
@@ -146,23 +154,57 @@ void *copy_thread(void *argptr)
 		if (unlikely((ret = ps_packet_getsize(&read, &data_size))))
 			goto err;
 		data_size -= sizeof(glc_message_header_t);
-		if (unlikely((ret = ps_packet_dma(&read, &data, data_size,
-						PS_ACCEPT_FAKE_DMA))))
+
+		if (msg_hdr.type == GLC_MESSAGE_REF) {
+			if (unlikely((ret = ps_packet_read(&read, &ref_msg,
+						sizeof(glc_ref_message_t)))))
+				goto err;
+			in_ref = ref_msg.ref;
+			msg_hdr = in_ref->header;
+			data = in_ref->data;
+			data_size = in_ref->size;
+		} else if (unlikely((ret = ps_packet_dma(&read, &data, data_size,
+						       PS_ACCEPT_FAKE_DMA))))
 			goto err;
 
 		target = copy->copy_target;
 		while (target != NULL) {
 			if ((target->type == 0) ||
 			    (target->type == msg_hdr.type)) {
+				/*
+				 * Every target shares a single copy of the payload.
+				 * Targets without budget left get their own copy.
+				 */
+				charged = (data_size >= GLC_REF_MIN_SIZE) &&
+					  (!glc_ref_charge(copy->glc, target->buffer, data_size));
+				if ((charged) && (!shared))
+					shared = in_ref ? in_ref :
+						 glc_ref_create(&msg_hdr, data, data_size);
+				if ((charged) && (unlikely(!shared))) {
+					glc_ref_uncharge(copy->glc, target->buffer, data_size);
+					charged = 0;
+				}
+
 				if (unlikely((ret = ps_packet_open(&target->packet,
 							 PS_PACKET_WRITE))))
 					goto err;
-				if (unlikely((ret = ps_packet_write(&target->packet, &msg_hdr,
-					sizeof(glc_message_header_t)))))
-					goto err;
-				if (unlikely((ret = ps_packet_write(&target->packet, data,
-					data_size))))
-					goto err;
+				if (charged) {
+					glc_ref_get(shared);
+					ref_msg.ref = shared;
+					if (unlikely((ret = ps_packet_write(&target->packet, &ref_hdr,
+						sizeof(glc_message_header_t)))))
+						goto err;
+					if (unlikely((ret = ps_packet_write(&target->packet, &ref_msg,
+						sizeof(glc_ref_message_t)))))
+						goto err;
+				} else {
+					if (unlikely((ret = ps_packet_write(&target->packet, &msg_hdr,
+						sizeof(glc_message_header_t)))))
+						goto err;
+					if (unlikely((ret = ps_packet_write(&target->packet, data,
+						data_size))))
+						goto err;
+				}
 				if (unlikely((ret = ps_packet_close(&target->packet))))
 					goto err;
 			}
@@ -170,11 +212,20 @@ void *copy_thread(void *argptr)
 		}
 
 		ps_packet_close(&read);
+
+		if ((shared) && (shared != in_ref))
+			glc_ref_put(shared);
+		if (in_ref) {
+			glc_ref_uncharge(copy->glc, copy->from, in_ref->size);
+			glc_ref_put(in_ref);
+		}
+		shared = in_ref = NULL;
 	} while ((!glc_state_test(copy->glc, GLC_STATE_CANCEL)) &&
 		 (msg_hdr.type != GLC_MESSAGE_CLOSE));
 
 finish:
 	ps_packet_destroy(&read);
+	glc_ref_refuse(copy->glc, copy->from);
 
 	if (glc_state_test(copy->glc, GLC_STATE_CANCEL)) {
 		ps_buffer_cancel(copy->from);
@@ -188,6 +239,13 @@ finish:
 
 	return NULL;
 err:
+	if ((shared) && (shared != in_ref))
+		glc_ref_put(shared);
+	if (in_ref) {
+		glc_ref_uncharge(copy->glc, copy->from, in_ref->size);
+		glc_ref_put(in_ref);
+	}
+
 	if (ret != EINTR) {
 		glc_log(copy->glc, GLC_ERROR, "copy", "%s (%d)",
 			strerror(ret), ret);
@@ -41,11 +41,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include <glc/common/state.h>
@@ -66,6 +69,42 @@
 #define FILE_INFO_READ    0x10
 #define FILE_INFO_VALID   0x20
 
+/* minimum time between index entries */
+#define FILE_INDEX_INTERVAL 100000000 /* 100 ms */
+/* no seek requested */
+#define FILE_NO_SEEK      ((glc_utime_t) -1)
+/* size of file windows mapped when reading */
+#define FILE_MMAP_WINDOW  (64 * 1024 * 1024)
+/* size of segments gathered by asynchronous writer */
+#define FILE_SEGMENT_SIZE (4 * 1024 * 1024)
+/* offset, size and address alignment of direct io */
+#define FILE_DIRECT_ALIGN 4096
+/* maximum asynchronous writes in flight */
+#define FILE_MAX_WRITES   16
+/* size of chunks allocated ahead of writes */
+#define FILE_PREALLOC_SIZE (64 * 1024 * 1024)
+/* size of chunks written back and dropped from page cache */
+#define FILE_BEHIND_SIZE  (8 * 1024 * 1024)
+/* longest time written data stays unsynced in sync mode */
+#define FILE_SYNC_INTERVAL 1000000000 /* 1 s */
+/* longest time a split waits for a key frame */
+#define FILE_SPLIT_KEY_WAIT 2000000000 /* 2 s */
+
+#define FILE_SEGMENT_FREE    0
+#define FILE_SEGMENT_QUEUED  1
+#define FILE_SEGMENT_WRITING 2
+
+struct file_index_s {
+	glc_index_entry_t *entry;
+	size_t entries, entry_alloc;
+	/* glc_index_state_t records followed by their message */
+	char *state;
+	size_t state_size, state_alloc;
+	/* records of state, only when reading */
+	glc_index_state_t **record;
+	size_t records;
+};
+
 struct file_private_s {
 	glc_t *glc;
 	glc_flags_t flags;
@@ -79,6 +118,64 @@ struct file_private_s {
 	FILE *handle;
 };
 
+/* mapped part of a source file, unmapped with last reference */
+struct file_window_s {
+	int refcount;
+	char *addr;
+	u_int64_t offset;
+	size_t size;
+};
+
+/* part of target file gathered in memory before it is written */
+struct file_segment_s {
+	char *data;
+	size_t size;
+	/* always aligned to FILE_DIRECT_ALIGN */
+	u_int64_t offset;
+	int state;
+};
+
+/*
+ * Writes segments with pwrite() from several threads. Only the
+ * sink thread fills segments, so the segment being filled is
+ * accessed without locking.
+ */
+struct file_writer_s {
+	glc_t *glc;
+	int active;
+	int fd;
+	int sync;
+	int direct;
+	int write_behind;
+	unsigned int writes;
+	struct file_segment_s *segment;
+	unsigned int segments;
+	/* segment being filled and next segment to write */
+	unsigned int fill, next;
+	/* segments queued or being written */
+	unsigned int busy;
+	glc_utime_t submitted;
+	glc_utime_t synced;
+	int error;
+	int quit;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	glc_simple_thread_t thread[FILE_MAX_WRITES];
+};
+
+/* file written by sink, next part of a split stream is opened aside */
+struct file_target_s {
+	FILE *handle;
+	char *name;
+	struct file_writer_s writer;
+	/*
+	 * end of stream, of preallocated space, of range written back and
+	 * offset where file_write_behind() has work again
+	 */
+	u_int64_t offset, allocated, behind, behind_next;
+	int preallocate, write_behind;
+};
+
 typedef struct {
 	struct sink_s sink_base;
 	struct file_private_s mpriv;
@@ -86,12 +183,34 @@ typedef struct {
 	tracker_t state_tracker;
 	callback_request_func_t callback;
 	int sync;
+	struct file_index_s index;
+	unsigned int async_writes;
+	struct file_target_s targets[2];
+	/* target being written, next part and part being closed */
+	struct file_target_s *target, *next, *prev;
+	/* stream information repeated in each part */
+	glc_stream_info_t info;
+	char *info_name, *info_date;
+	const char *target_name;
+	u_int64_t split_size;
+	glc_utime_t split_duration;
+	/* part number, when and where it started and when it is complete */
+	unsigned int part;
+	glc_utime_t part_start, split_pending;
+	u_int64_t part_offset;
+	/* opens next part or closes previous part */
+	glc_simple_thread_t split_thread;
+	int split_ret;
+	/* next part is open or being opened */
+	int split_open;
 } file_sink_t;
 
 typedef struct {
 	struct source_s source_base;
 	struct file_private_s mpriv;
 	u_int32_t stream_version;
+	struct file_index_s index;
+	glc_utime_t seek_time;
 } file_source_t;
 
 static void file_finish_callback(void *ptr, int err);
@@ -100,8 +219,34 @@ static int file_write_message(file_sink_t *file, glc_message_header_t *header,
 			      void *message, size_t message_size);
 static int file_write_state_callback(glc_message_header_t *header, void *message,
 				     size_t message_size, void *arg);
+static int file_write_stream_info(file_sink_t *file);
 static int file_test_stream_version(u_int32_t version);
-static int file_set_target(struct file_private_s *mpriv, int fd);
+static int file_set_target(glc_t *glc, int fd, FILE **handle);
+static void file_index_free(struct file_index_s *index);
+static int file_index_key(glc_message_type_t type, const char *message,
+			  size_t message_size);
+static int file_index_message(file_sink_t *file, glc_message_header_t *header,
+			      void *message, size_t message_size);
+static int file_write_index(file_sink_t *file);
+static int file_write(file_sink_t *file, const void *data, size_t size);
+static int file_sync(file_sink_t *file);
+static off_t file_tell(file_sink_t *file);
+static void file_write_behind(file_sink_t *file);
+static int file_writer_submit(struct file_writer_s *writer, int drain);
+static int file_writer_start(file_sink_t *file, struct file_target_s *target,
+			     int fd);
+static int file_writer_stop(struct file_writer_s *writer);
+static void *file_writer_thread(void *argptr);
+static int file_target_open(file_sink_t *file, struct file_target_s *target,
+			    const char *filename);
+static int file_target_close(file_sink_t *file, struct file_target_s *target);
+static int file_split(file_sink_t *file, glc_message_header_t *header,
+		      void *message, size_t message_size);
+static int file_split_switch(file_sink_t *file);
+static int file_split_start(file_sink_t *file);
+static int file_split_open(file_sink_t *file);
+static int file_split_wait(file_sink_t *file);
+static void *file_split_thread(void *argptr);
 
 static int file_can_resume(sink_t sink);
 static int file_set_sync(sink_t sink, int sync);
@@ -122,6 +267,11 @@ static int file_close_source(source_t source);
 static int file_read_info(source_t source, glc_stream_info_t *info,
 			char **info_name, char **info_date);
 static int file_read(source_t source, ps_buffer_t *to);
+static int file_read_index(file_source_t *file);
+static int file_seek(source_t source, glc_utime_t time);
+static int file_seek_apply(file_source_t *file, ps_packet_t *packet,
+			   u_int64_t *pos);
+static int file_read_mmap(file_source_t *file, ps_buffer_t *to);
 static int file_source_destroy(source_t source);
 
 static sink_ops_t file_sink_ops = {
@@ -143,11 +293,13 @@ static source_ops_t file_source_ops = {
 	.close_source        = file_close_source,
 	.read_info           = file_read_info,
 	.read                = file_read,
+	.seek                = file_seek,
 	.destroy             = file_source_destroy,
 };
 
 int file_sink_init(sink_t *sink, glc_t *glc)
 {
+	int t;
 	file_sink_t *file = (file_sink_t*)calloc(1, sizeof(file_sink_t));
 	*sink = (sink_t)file;
 	if (!file)
@@ -160,6 +312,15 @@ int file_sink_init(sink_t *sink, glc_t *glc)
 	file->thread.read_callback   = &file_read_callback;
 	file->thread.finish_callback = &file_finish_callback;
 	file->thread.threads = 1;
+	file->thread.name    = "file";
+
+	for (t = 0; t < 2; t++) {
+		file->targets[t].writer.glc = glc;
+		pthread_mutex_init(&file->targets[t].writer.mutex, NULL);
+		pthread_cond_init(&file->targets[t].writer.cond, NULL);
+	}
+	file->target = &file->targets[0];
+	file->split_thread.name = "file";
 
 	tracker_init(&file->state_tracker, file->mpriv.glc);
 
@@ -169,7 +330,22 @@ int file_sink_init(sink_t *sink, glc_t *glc)
 int file_sink_destroy(sink_t sink)
 {
 	file_sink_t *file = (file_sink_t*)sink;
+	struct file_writer_s *writer;
+	unsigned int s;
+	int t;
+
 	tracker_destroy(file->state_tracker);
+	file_index_free(&file->index);
+	for (t = 0; t < 2; t++) {
+		writer = &file->targets[t].writer;
+		for (s = 0; s < writer->segments; s++)
+			free(writer->segment[s].data);
+		free(writer->segment);
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->mutex);
+	}
+	free(file->info_name);
+	free(file->info_date);
 	free(file);
 	return 0;
 }
@@ -188,12 +364,15 @@ int file_source_init(source_t *source, glc_t *glc)
 
 	file->source_base.ops = &file_source_ops;
 	file->mpriv.glc       = glc;
+	file->seek_time       = FILE_NO_SEEK;
 	return 0;
 }
 
 int file_source_destroy(source_t source)
 {
-	free(source);
+	file_source_t *file = (file_source_t*)source;
+	file_index_free(&file->index);
+	free(file);
 	return 0;
 }
 
@@ -204,6 +383,21 @@ int file_set_sync(sink_t sink, int sync)
 	return 0;
 }
 
+int file_sink_set_async(sink_t sink, unsigned int writes)
+{
+	file_sink_t *file = (file_sink_t*)sink;
+	if (unlikely(file->mpriv.handle))
+		return EBUSY;
+	if (unlikely(writes > FILE_MAX_WRITES)) {
+		glc_log(file->mpriv.glc, GLC_WARN, "file",
+			"%u writes in flight requested, using %d",
+			writes, FILE_MAX_WRITES);
+		writes = FILE_MAX_WRITES;
+	}
+	file->async_writes = writes;
+	return 0;
+}
+
 int file_set_callback(sink_t sink, callback_request_func_t callback)
 {
 	file_sink_t *file = (file_sink_t*)sink;
@@ -216,19 +410,62 @@ int file_set_callback(sink_t sink, callback_request_func_t callback)
  */
 #define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
 
+int file_sink_set_split(sink_t sink, u_int64_t size, glc_utime_t duration)
+{
+	file_sink_t *file = (file_sink_t*)sink;
+	if (unlikely(file->mpriv.handle))
+		return EBUSY;
+	file->split_size = size;
+	file->split_duration = duration;
+	return 0;
+}
+
 int file_open_target(sink_t sink, const char *filename)
 {
-	int fd, ret = 0;
+	int ret;
 	file_sink_t *file = (file_sink_t*)sink;
 	if (unlikely(file->mpriv.handle))
 		return EBUSY;
 
+	/* index describes only this file */
+	file->index.entries = 0;
+	file->index.state_size = 0;
+
+	if (unlikely((ret = file_target_open(file, file->target, filename))))
+		return ret;
+
+	file->mpriv.handle = file->target->handle;
+	file->mpriv.flags |= FILE_WRITING;
+	file->target_name = filename;
+	file->part = 0;
+	file->part_start = glc_state_time(file->mpriv.glc);
+	file->part_offset = 0;
+	file->split_pending = 0;
+	return 0;
+}
+
+/**
+ * \brief open a target file
+ * \param file file object
+ * \param target target
+ * \param filename file name
+ * \return 0 on success otherwise an error code
+ */
+int file_target_open(file_sink_t *file, struct file_target_s *target,
+		     const char *filename)
+{
+	struct stat statbuf;
+	int fd, ret = 0;
+
 	glc_log(file->mpriv.glc, GLC_INFO, "file",
 		 "opening %s for writing stream (%s)",
 		 filename,
-		 file->sync ? "sync" : "no sync");
+		 file->sync ? (file->async_writes ? "periodic sync" : "sync") :
+			      "no sync");
 
-	fd = open(filename, O_CREAT | O_WRONLY | (file->sync ? O_SYNC : 0), FILE_MODE);
+	/* asynchronous writer syncs periodically instead */
+	fd = open(filename, O_CREAT | O_WRONLY |
+		  ((file->sync && !file->async_writes) ? O_SYNC : 0), FILE_MODE);
 
 	if (unlikely(fd < 0)) {
 		glc_log(file->mpriv.glc, GLC_ERROR, "file", "can't open %s: %s (%d)",
@@ -236,9 +473,64 @@ int file_open_target(sink_t sink, const char *filename)
 		return errno;
 	}
 
-	if (unlikely((ret = file_set_target(&file->mpriv, fd))))
+	if (unlikely((ret = file_set_target(file->mpriv.glc, fd, &target->handle)))) {
 		close(fd);
+		return ret;
+	}
+
+	/* pipes and devices can't be preallocated nor written back */
+	target->offset = target->allocated = 0;
+	target->behind = target->behind_next = 0;
+	target->preallocate = (!fstat(fd, &statbuf)) && (S_ISREG(statbuf.st_mode));
+	target->write_behind = target->preallocate &&
+			       (!file->sync || file->async_writes);
+
+	if (file->async_writes) {
+		if (unlikely((ret = file_writer_start(file, target, fd))))
+			glc_log(file->mpriv.glc, GLC_WARN, "file",
+				"can't start asynchronous writer, writing "
+				"synchronously: %s (%d)", strerror(ret), ret);
+	}
+
+	return 0;
+}
 
+/**
+ * \brief write remaining data and close a target file
+ * \param file file object
+ * \param target target
+ * \return 0 on success otherwise an error code
+ */
+int file_target_close(file_sink_t *file, struct file_target_s *target)
+{
+	int ret = 0;
+
+	if ((target->writer.active) &&
+	    (unlikely((ret = file_writer_stop(&target->writer)))))
+		glc_log(file->mpriv.glc, GLC_ERROR, "file",
+			 "can't write file: %s (%d)",
+			 strerror(ret), ret);
+
+	/* release space preallocated after end of stream */
+	if ((target->allocated > target->offset) &&
+	    ((fflush_unlocked(target->handle)) ||
+	     (ftruncate(fileno(target->handle), target->offset)))) {
+		ret = errno;
+		glc_log(file->mpriv.glc, GLC_ERROR, "file",
+			 "can't truncate file: %s (%d)",
+			 strerror(errno), errno);
+	}
+
+	if (unlikely(fclose(target->handle))) {
+		ret = errno;
+		glc_log(file->mpriv.glc, GLC_ERROR, "file",
+			 "can't close file: %s (%d)",
+			 strerror(errno), errno);
+	}
+
+	target->handle = NULL;
+	free(target->name);
+	target->name = NULL;
 	return ret;
 }
 
@@ -258,11 +550,9 @@ static int lock_reg(int fd, int cmd, int type, off_t offset, int whence, off_t l
         lock_reg((fd), F_SETLK, F_WRLCK, (offset), (whence), (len))
 #define lockfile(fd) write_lock((fd), 0, SEEK_SET, 0)
 
-int file_set_target(struct file_private_s *mpriv, int fd)
+int file_set_target(glc_t *glc, int fd, FILE **handle)
 {
 	struct stat statbuf;
-	if (unlikely(mpriv->handle))
-		return EBUSY;
 
 	/*
 	 * turn on set-group-ID and turn off group-execute.
@@ -272,18 +562,18 @@ int file_set_target(struct file_private_s *mpriv, int fd)
 	 */
 
         if (unlikely(fstat(fd, &statbuf) < 0)) {
-		glc_log(mpriv->glc, GLC_ERROR, "file",
+		glc_log(glc, GLC_ERROR, "file",
 			"fstat error: %s (%d)", strerror(errno), errno);
 		return errno;
 	}
         if (unlikely(fchmod(fd, (statbuf.st_mode & ~S_IXGRP) | S_ISGID) < 0)) {
-		glc_log(mpriv->glc, GLC_ERROR, "file",
+		glc_log(glc, GLC_ERROR, "file",
 			"fchmod error: %s (%d)", strerror(errno), errno);
 		return errno;
 	}
 
 	if (unlikely(lockfile(fd) < 0)) {
-		glc_log(mpriv->glc, GLC_ERROR, "file",
+		glc_log(glc, GLC_ERROR, "file",
 			 "can't lock file: %s (%d)", strerror(errno), errno);
 		return errno;
 	}
@@ -292,13 +582,12 @@ int file_set_target(struct file_private_s *mpriv, int fd)
 	lseek(fd, 0, SEEK_SET);
 	ftruncate(fd, 0);
 
-	mpriv->handle = fdopen(fd, "w");
-	if (unlikely(!mpriv->handle)) {
-		glc_log(mpriv->glc, GLC_ERROR, "file", "fdopen error: %s (%d)",
+	*handle = fdopen(fd, "w");
+	if (unlikely(!*handle)) {
+		glc_log(glc, GLC_ERROR, "file", "fdopen error: %s (%d)",
 			strerror(errno), errno);
 		return errno;
 	}
-	mpriv->flags |= FILE_WRITING;
 	return 0;
 }
 
@@ -314,10 +603,16 @@ int file_close_target(sink_t sink)
 	if (unlikely(!is_write_open_not_running(&file->mpriv)))
 		return EAGAIN;
 
-	if (unlikely(fclose(file->mpriv.handle)))
-		glc_log(file->mpriv.glc, GLC_ERROR, "file",
-			 "can't close file: %s (%d)",
-			 strerror(errno), errno);
+	/* previous part is closed and an unused next part removed */
+	file_split_wait(file);
+	file->split_open = 0;
+	if (file->next) {
+		unlink(file->next->name);
+		file_target_close(file, file->next);
+		file->next = NULL;
+	}
+
+	file_target_close(file, file->target);
 
 	file->mpriv.handle = NULL;
 	file->mpriv.flags &= ~(FILE_WRITING | FILE_INFO_WRITTEN);
@@ -328,55 +623,70 @@ int file_close_target(sink_t sink)
 int file_write_info(sink_t sink, glc_stream_info_t *info,
 		    const char *info_name, const char *info_date)
 {
+	int ret;
+	void *ptr;
 	file_sink_t *file = (file_sink_t*)sink;
 	if (unlikely(!is_write_open_not_running(&file->mpriv)))
 		return EAGAIN;
 
-	if (unlikely(fwrite_unlocked(info,
-		sizeof(glc_stream_info_t), 1, file->mpriv.handle) != 1))
-		goto err;
-	if (unlikely(fwrite_unlocked(info_name,
-		info->name_size, 1, file->mpriv.handle) != 1))
+	/* next parts of a split stream start with the same information */
+	file->info = *info;
+	ret = ENOMEM;
+	if (unlikely(!(ptr = realloc(file->info_name, info->name_size))))
 		goto err;
-	if (unlikely(fwrite_unlocked(info_date,
-		info->date_size, 1, file->mpriv.handle) != 1))
+	file->info_name = (char *) memcpy(ptr, info_name, info->name_size);
+	if (unlikely(!(ptr = realloc(file->info_date, info->date_size))))
 		goto err;
+	file->info_date = (char *) memcpy(ptr, info_date, info->date_size);
 
-	if (unlikely(file->sync))
-		if (unlikely(fflush_unlocked(file->mpriv.handle)))
-			goto err;
+	if (unlikely((ret = file_write_stream_info(file))))
+		goto err;
 
 	file->mpriv.flags |= FILE_INFO_WRITTEN;
 	return 0;
 err:
 	glc_log(file->mpriv.glc, GLC_ERROR, "file",
 		 "can't write stream information: %s (%d)",
-		 strerror(errno), errno);
-	return errno;
+		 strerror(ret), ret);
+	return ret;
+}
+
+/**
+ * \brief write stream information kept by file_write_info()
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_write_stream_info(file_sink_t *file)
+{
+	int ret;
+
+	if (unlikely((ret = file_write(file, &file->info, sizeof(glc_stream_info_t)))))
+		return ret;
+	if (unlikely((ret = file_write(file, file->info_name, file->info.name_size))))
+		return ret;
+	if (unlikely((ret = file_write(file, file->info_date, file->info.date_size))))
+		return ret;
+
+	return file_sync(file);
 }
 
 int file_write_message(file_sink_t *file, glc_message_header_t *header,
 			void *message, size_t message_size)
 {
 	glc_size_t glc_size = (glc_size_t) message_size;
+	int ret;
 
-	if (unlikely(fwrite_unlocked(&glc_size, sizeof(glc_size_t),
-				1, file->mpriv.handle) != 1))
-		goto err;
-	if (unlikely(fwrite_unlocked(header, sizeof(glc_message_header_t),
-				1, file->mpriv.handle) != 1))
-		goto err;
+	if (unlikely((ret = file_index_message(file, header, message, message_size))))
+		return ret;
+	if (unlikely((ret = file_write(file, &glc_size, sizeof(glc_size_t)))))
+		return ret;
+	if (unlikely((ret = file_write(file, header, sizeof(glc_message_header_t)))))
+		return ret;
 	if (likely(message_size > 0))
-		if (unlikely(fwrite_unlocked(message, message_size,
-				1, file->mpriv.handle) != 1))
-			goto err;
+		if (unlikely((ret = file_write(file, message, message_size))))
+			return ret;
 
-	if (unlikely(file->sync))
-		if (unlikely(fflush_unlocked(file->mpriv.handle)))
-			goto err;
-	return 0;
-err:
-	return errno;
+	return file_sync(file);
 }
 
 int file_write_eof(sink_t sink)
@@ -393,6 +703,8 @@ int file_write_eof(sink_t sink)
 	hdr.type = GLC_MESSAGE_CLOSE;
 	if (unlikely((ret = file_write_message(file, &hdr, NULL, 0))))
 		goto err;
+	if (unlikely((ret = file_write_index(file))))
+		goto err;
 
 	return 0;
 err:
@@ -482,6 +794,7 @@ int file_read_callback(glc_thread_state_t *state)
 	glc_container_message_header_t *container;
 	glc_size_t glc_size;
 	glc_callback_request_t *callback_req;
+	int ret = 0;
 
 	/* let state tracker to process this message */
 	tracker_submit(file->state_tracker, &state->header, state->read_data, state->read_size);
@@ -497,37 +810,763 @@ int file_read_callback(glc_thread_state_t *state)
 		}
 	} else if (state->header.type == GLC_MESSAGE_CONTAINER) {
 		container = (glc_container_message_header_t *) state->read_data;
-		if (unlikely(fwrite_unlocked(state->read_data,
-			sizeof(glc_container_message_header_t) + container->size,
-			1, file->mpriv.handle)
-		    != 1))
+		if ((file->split_size || file->split_duration) &&
+		    (unlikely((ret = file_split(file, &container->header,
+				&state->read_data[sizeof(glc_container_message_header_t)],
+				container->size)))))
+			goto err;
+		if (unlikely((ret = file_index_message(file, &container->header,
+				&state->read_data[sizeof(glc_container_message_header_t)],
+				container->size))))
+			goto err;
+		if (unlikely((ret = file_write(file, state->read_data,
+			sizeof(glc_container_message_header_t) + container->size))))
+			goto err;
+		if (unlikely((ret = file_sync(file))))
 			goto err;
-		if (unlikely(file->sync))
-			if (unlikely(fflush_unlocked(file->mpriv.handle)))
-				goto err;
 	} else {
 		/* emulate container message */
+		if ((file->split_size || file->split_duration) &&
+		    (unlikely((ret = file_split(file, &state->header,
+					state->read_data, state->read_size)))))
+			goto err;
+		if (unlikely((ret = file_index_message(file, &state->header,
+						 state->read_data, state->read_size))))
+			goto err;
 		glc_size = state->read_size;
-		if (unlikely(fwrite_unlocked(&glc_size,
-				   sizeof(glc_size_t), 1, file->mpriv.handle) != 1))
+		if (unlikely((ret = file_write(file, &glc_size, sizeof(glc_size_t)))))
 			goto err;
-		if (unlikely(fwrite_unlocked(&state->header, sizeof(glc_message_header_t),
-					1, file->mpriv.handle)
-		    != 1))
+		if (unlikely((ret = file_write(file, &state->header,
+					       sizeof(glc_message_header_t)))))
 			goto err;
-		if (unlikely(fwrite_unlocked(state->read_data,
-				   state->read_size, 1, file->mpriv.handle) != 1))
+		if (unlikely((ret = file_write(file, state->read_data,
+					       state->read_size))))
+			goto err;
+		if (unlikely((ret = file_sync(file))))
 			goto err;
-		if (unlikely(file->sync))
-			if (unlikely(fflush_unlocked(file->mpriv.handle)))
-				goto err;
 	}
 
 	return 0;
 
 err:
-	glc_log(file->mpriv.glc, GLC_ERROR, "file", "%s (%d)", strerror(errno), errno);
-	return errno;
+	glc_log(file->mpriv.glc, GLC_ERROR, "file", "%s (%d)", strerror(ret), ret);
+	return ret;
+}
+
+/**
+ * \brief split stream when current part is complete
+ *
+ * Next part is opened in background once current part is half
+ * complete. A complete part is switched right before next key
+ * frame, or any message when no key frame comes for
+ * FILE_SPLIT_KEY_WAIT. unpack drops pictures of a part that come
+ * before its first key frame, so parts can be played on their own.
+ * \param file file object
+ * \param header header of next message
+ * \param message next message
+ * \param message_size next message size
+ * \return 0 on success otherwise an error code
+ */
+int file_split(file_sink_t *file, glc_message_header_t *header,
+	       void *message, size_t message_size)
+{
+	glc_utime_t time = glc_state_time(file->mpriv.glc);
+	u_int64_t size = file->target->offset - file->part_offset;
+
+	if (header->type == GLC_MESSAGE_CLOSE)
+		return 0;
+
+	if (!file->split_pending) {
+		if (((file->split_size) && (size >= file->split_size)) ||
+		    ((file->split_duration) &&
+		     (time - file->part_start >= file->split_duration)))
+			file->split_pending = time;
+		else {
+			if ((!file->split_open) &&
+			    (((file->split_size) && (size >= file->split_size / 2)) ||
+			     ((file->split_duration) &&
+			      (time - file->part_start >= file->split_duration / 2))))
+				return file_split_open(file);
+			return 0;
+		}
+	}
+
+	if ((!file_index_key(header->type, message, message_size)) &&
+	    (time - file->split_pending < FILE_SPLIT_KEY_WAIT))
+		return 0;
+
+	return file_split_switch(file);
+}
+
+/**
+ * \brief switch to next part between two messages
+ *
+ * Current part is ended like a stream and closed in background.
+ * Next part starts with stream information and current state.
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_split_switch(file_sink_t *file)
+{
+	struct file_target_s *prev;
+	glc_message_header_t hdr;
+	int ret;
+
+	/* next part is usually open long before */
+	if ((!file->split_open) && (unlikely((ret = file_split_open(file)))))
+		return ret;
+	file_split_wait(file);
+
+	file->split_open = 0;
+	file->split_pending = 0;
+	if (unlikely(!file->next)) {
+		/* try again when this part is complete again */
+		glc_log(file->mpriv.glc, GLC_WARN, "file",
+			"can't open part %u, continuing part %u",
+			file->part + 1, file->part);
+		file->part_start = glc_state_time(file->mpriv.glc);
+		file->part_offset = file->target->offset;
+		return 0;
+	}
+
+	hdr.type = GLC_MESSAGE_CLOSE;
+	if (unlikely((ret = file_write_message(file, &hdr, NULL, 0))))
+		return ret;
+	if (unlikely((ret = file_write_index(file))))
+		return ret;
+
+	prev = file->target;
+	file->target = file->next;
+	file->next = NULL;
+	file->mpriv.handle = file->target->handle;
+	file->index.entries = 0;
+	file->index.state_size = 0;
+
+	/* players start the part at this time */
+	file->info.start_time = glc_state_time(file->mpriv.glc);
+	if (unlikely((ret = file_write_stream_info(file))))
+		return ret;
+	if (unlikely((ret = tracker_iterate_state(file->state_tracker,
+						  &file_write_state_callback, file))))
+		return ret;
+
+	file->part++;
+	file->part_start = glc_state_time(file->mpriv.glc);
+	file->part_offset = 0;
+	glc_log(file->mpriv.glc, GLC_INFO, "file", "switched to part %u (%s)",
+		file->part, file->target->name);
+
+	file->prev = prev;
+	return file_split_start(file);
+}
+
+/**
+ * \brief close previous part or open next part in background
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_split_start(file_sink_t *file)
+{
+	file_split_wait(file);
+	return glc_simple_thread_create(file->mpriv.glc, &file->split_thread,
+					&file_split_thread, file);
+}
+
+/**
+ * \brief open next part in background
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_split_open(file_sink_t *file)
+{
+	int ret;
+
+	/* previous part must be closed first */
+	file_split_wait(file);
+	if (unlikely((ret = file_split_start(file))))
+		return ret;
+	file->split_open = 1;
+	return 0;
+}
+
+/**
+ * \brief wait until previous part is closed or next part is open
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_split_wait(file_sink_t *file)
+{
+	if (!file->split_thread.running)
+		return 0;
+	glc_simple_thread_wait(file->mpriv.glc, &file->split_thread);
+	return file->split_ret;
+}
+
+void *file_split_thread(void *argptr)
+{
+	file_sink_t *file = (file_sink_t *) argptr;
+	struct file_target_s *target;
+	const char *ext;
+	char *name;
+	size_t size;
+	int ret;
+
+	if (file->prev) {
+		ret = file_target_close(file, file->prev);
+		file->prev = NULL;
+		goto finish;
+	}
+
+	/* name of part n is target name with -n before extension */
+	ext = strrchr(file->target_name, '.');
+	if ((!ext) || (strchr(ext, '/')))
+		ext = &file->target_name[strlen(file->target_name)];
+	size = strlen(file->target_name) + 16;
+	ret = ENOMEM;
+	if (unlikely(!(name = (char *) malloc(size))))
+		goto finish;
+	snprintf(name, size, "%.*s-%03u%s", (int) (ext - file->target_name),
+		 file->target_name, file->part + 1, ext);
+
+	target = &file->targets[file->target == &file->targets[0] ? 1 : 0];
+	if (unlikely((ret = file_target_open(file, target, name)))) {
+		free(name);
+		goto finish;
+	}
+	target->name = name;
+	file->next = target;
+finish:
+	file->split_ret = ret;
+	return NULL;
+}
+
+/**
+ * \brief write data to target
+ * \param file file object
+ * \param data data
+ * \param size data size
+ * \return 0 on success otherwise an error code
+ */
+int file_write(file_sink_t *file, const void *data, size_t size)
+{
+	struct file_target_s *target = file->target;
+	struct file_writer_s *writer = &target->writer;
+	struct file_segment_s *segment;
+	size_t part;
+	int ret;
+
+	target->offset += size;
+	if (unlikely(target->offset >= target->behind_next))
+		file_write_behind(file);
+
+	if (!writer->active) {
+		if (unlikely(fwrite_unlocked(data, size, 1, target->handle) != 1))
+			return errno;
+		return 0;
+	}
+
+	while (size > 0) {
+		segment = &writer->segment[writer->fill];
+		part = FILE_SEGMENT_SIZE - segment->size;
+		if (part > size)
+			part = size;
+		memcpy(&segment->data[segment->size], data, part);
+		segment->size += part;
+		data = (const char *) data + part;
+		size -= part;
+
+		if ((segment->size == FILE_SEGMENT_SIZE) &&
+		    (unlikely((ret = file_writer_submit(writer, 0)))))
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief make written messages durable in sync mode
+ *
+ * Without asynchronous writer, target is opened with O_SYNC and
+ * this flushes stdio buffer. Asynchronous writer syncs written
+ * segments periodically and writes the segment being filled when
+ * it has waited for FILE_SYNC_INTERVAL.
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_sync(file_sink_t *file)
+{
+	struct file_writer_s *writer = &file->target->writer;
+
+	if (likely(!file->sync))
+		return 0;
+
+	if (!writer->active) {
+		if (unlikely(fflush_unlocked(file->target->handle)))
+			return errno;
+		return 0;
+	}
+
+	if ((writer->segment[writer->fill].size > 0) &&
+	    (glc_time(writer->glc) - writer->submitted >= FILE_SYNC_INTERVAL))
+		return file_writer_submit(writer, 1);
+	return 0;
+}
+
+/**
+ * \brief get offset of next write in target
+ * \param file file object
+ * \return offset, or -1 on error
+ */
+off_t file_tell(file_sink_t *file)
+{
+	return file->target->offset;
+}
+
+/**
+ * \brief allocate target ahead of writes and write back written data
+ *
+ * Target is allocated in FILE_PREALLOC_SIZE chunks so filesystem
+ * doesn't allocate its extents piecemeal. Written chunks are written
+ * back as soon as they are complete, and dropped from page cache
+ * once the previous chunk is on disk, so dirty pages don't pile up
+ * until kernel flushes them all at once and capture doesn't evict
+ * cache of the application. Asynchronous writer writes back its
+ * segments itself.
+ * \param file file object
+ */
+void file_write_behind(file_sink_t *file)
+{
+	struct file_target_s *target = file->target;
+	int fd = fileno(target->handle);
+
+	while ((target->preallocate) &&
+	       (target->offset + FILE_PREALLOC_SIZE / 2 >= target->allocated)) {
+		if (unlikely(fallocate(fd, FALLOC_FL_KEEP_SIZE, target->allocated,
+				       FILE_PREALLOC_SIZE))) {
+			glc_log(file->mpriv.glc, GLC_DEBUG, "file",
+				"can't preallocate file: %s (%d)",
+				strerror(errno), errno);
+			target->preallocate = 0;
+		} else
+			target->allocated += FILE_PREALLOC_SIZE;
+	}
+
+	target->behind_next = target->preallocate ?
+			      target->allocated - FILE_PREALLOC_SIZE / 2 : UINT64_MAX;
+
+	if ((!target->write_behind) || (target->writer.active))
+		return;
+
+	while (target->offset >= target->behind + 2 * FILE_BEHIND_SIZE) {
+		/* start writeback of last chunk, then wait for previous one */
+		sync_file_range(fd, target->behind + FILE_BEHIND_SIZE,
+				FILE_BEHIND_SIZE, SYNC_FILE_RANGE_WRITE);
+		sync_file_range(fd, target->behind, FILE_BEHIND_SIZE,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd, target->behind, FILE_BEHIND_SIZE,
+			      POSIX_FADV_DONTNEED);
+		target->behind += FILE_BEHIND_SIZE;
+	}
+
+	if (target->behind + 2 * FILE_BEHIND_SIZE < target->behind_next)
+		target->behind_next = target->behind + 2 * FILE_BEHIND_SIZE;
+}
+
+/**
+ * \brief queue segment being filled for writing
+ *
+ * Blocks until next segment is free. When draining, blocks until
+ * all segments are written and keeps the unaligned end of the
+ * segment in next one, so the following write rewrites that block
+ * with direct io.
+ * \param writer writer
+ * \param drain wait until all segments are written
+ * \return 0 on success otherwise an error code
+ */
+int file_writer_submit(struct file_writer_s *writer, int drain)
+{
+	struct file_segment_s *segment = &writer->segment[writer->fill];
+	struct file_segment_s *next;
+	size_t aligned, carry = 0;
+	int ret;
+
+	if (writer->direct) {
+		aligned = (segment->size + FILE_DIRECT_ALIGN - 1) &
+			  ~((size_t) FILE_DIRECT_ALIGN - 1);
+		memset(&segment->data[segment->size], 0, aligned - segment->size);
+		carry = segment->size % FILE_DIRECT_ALIGN;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	segment->state = FILE_SEGMENT_QUEUED;
+	writer->busy++;
+	writer->fill = (writer->fill + 1) % writer->segments;
+	next = &writer->segment[writer->fill];
+	pthread_cond_broadcast(&writer->cond);
+
+	/* segments are freed even after an error */
+	if (drain) {
+		while (writer->busy)
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+	} else {
+		while (next->state != FILE_SEGMENT_FREE)
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		carry = 0;
+	}
+	ret = writer->error;
+	pthread_mutex_unlock(&writer->mutex);
+
+	memcpy(next->data, &segment->data[segment->size - carry], carry);
+	next->offset = segment->offset + segment->size - carry;
+	next->size = carry;
+	writer->submitted = glc_time(writer->glc);
+
+	if ((drain) && (writer->sync) && (likely(!ret))) {
+		if (unlikely(fdatasync(writer->fd)))
+			ret = errno;
+		writer->synced = writer->submitted;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief write a segment to target
+ * \param writer writer
+ * \param segment segment
+ * \return 0 on success otherwise an error code
+ */
+static int file_writer_pwrite(struct file_writer_s *writer,
+			      struct file_segment_s *segment)
+{
+	size_t size = segment->size, done = 0;
+	glc_utime_t time, synced;
+	ssize_t ret;
+
+	if (writer->direct)
+		size = (size + FILE_DIRECT_ALIGN - 1) &
+		       ~((size_t) FILE_DIRECT_ALIGN - 1);
+
+	while (done < size) {
+		ret = pwrite(writer->fd, &segment->data[done], size - done,
+			     segment->offset + done);
+		if (unlikely(ret < 0)) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		} else if (unlikely(ret == 0))
+			return EIO;
+		done += ret;
+	}
+
+	/* direct io bypasses page cache */
+	if ((!writer->direct) && (writer->write_behind)) {
+		sync_file_range(writer->fd, segment->offset, size,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(writer->fd, segment->offset, size,
+			      POSIX_FADV_DONTNEED);
+	} else if ((!writer->direct) && (writer->sync))
+		sync_file_range(writer->fd, segment->offset, size,
+				SYNC_FILE_RANGE_WRITE);
+
+	if (!writer->sync)
+		return 0;
+
+	time = glc_time(writer->glc);
+	synced = writer->synced;
+	if ((time - synced >= FILE_SYNC_INTERVAL) &&
+	    (__sync_bool_compare_and_swap(&writer->synced, synced, time))) {
+		if (unlikely(fdatasync(writer->fd)))
+			return errno;
+	}
+	return 0;
+}
+
+void *file_writer_thread(void *argptr)
+{
+	struct file_writer_s *writer = (struct file_writer_s *) argptr;
+	struct file_segment_s *segment;
+	int ret;
+
+	pthread_mutex_lock(&writer->mutex);
+	for (;;) {
+		while ((!writer->quit) &&
+		       (writer->segment[writer->next].state != FILE_SEGMENT_QUEUED))
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		segment = &writer->segment[writer->next];
+		if (segment->state != FILE_SEGMENT_QUEUED)
+			break;
+
+		segment->state = FILE_SEGMENT_WRITING;
+		writer->next = (writer->next + 1) % writer->segments;
+		pthread_mutex_unlock(&writer->mutex);
+
+		ret = file_writer_pwrite(writer, segment);
+
+		pthread_mutex_lock(&writer->mutex);
+		if (unlikely(ret)) {
+			glc_log(writer->glc, GLC_ERROR, "file",
+				"can't write segment at %" PRIu64 ": %s (%d)",
+				segment->offset, strerror(ret), ret);
+			if (!writer->error)
+				writer->error = ret;
+		}
+		segment->state = FILE_SEGMENT_FREE;
+		writer->busy--;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+/**
+ * \brief start asynchronous writer on target
+ *
+ * Target is switched to direct io when the filesystem supports it.
+ * \param file file object
+ * \param fd target file descriptor
+ * \return 0 on success otherwise an error code
+ */
+int file_writer_start(file_sink_t *file, struct file_target_s *target, int fd)
+{
+	struct file_writer_s *writer = &target->writer;
+	unsigned int segments = file->async_writes + 2;
+	unsigned int s, t;
+	int flags, ret;
+	void *ptr;
+
+	/* each write in flight has its segment, plus one to fill */
+	if (writer->segments < segments) {
+		if (unlikely(!(ptr = realloc(writer->segment,
+				segments * sizeof(struct file_segment_s)))))
+			return ENOMEM;
+		writer->segment = (struct file_segment_s *) ptr;
+		for (s = writer->segments; s < segments; s++) {
+			if (unlikely((ret = posix_memalign(&ptr, FILE_DIRECT_ALIGN,
+							   FILE_SEGMENT_SIZE))))
+				return ret;
+			writer->segment[s].data = (char *) ptr;
+			writer->segments = s + 1;
+		}
+	}
+
+	for (s = 0; s < writer->segments; s++) {
+		writer->segment[s].size = 0;
+		writer->segment[s].offset = 0;
+		writer->segment[s].state = FILE_SEGMENT_FREE;
+	}
+
+	writer->fd = fd;
+	writer->sync = file->sync;
+	writer->write_behind = target->write_behind;
+	writer->writes = file->async_writes;
+	writer->fill = writer->next = writer->busy = 0;
+	writer->error = writer->quit = 0;
+	writer->submitted = writer->synced = glc_time(writer->glc);
+
+	flags = fcntl(fd, F_GETFL);
+	writer->direct = (flags >= 0) && (!fcntl(fd, F_SETFL, flags | O_DIRECT));
+	if (!writer->direct)
+		glc_log(file->mpriv.glc, GLC_INFO, "file",
+			"direct io not supported: %s (%d)", strerror(errno), errno);
+
+	for (t = 0; t < writer->writes; t++) {
+		writer->thread[t].name = "file";
+		if (unlikely((ret = glc_simple_thread_create(file->mpriv.glc,
+				&writer->thread[t], &file_writer_thread, writer)))) {
+			writer->writes = t;
+			file_writer_stop(writer);
+			if (writer->direct)
+				fcntl(fd, F_SETFL, flags);
+			return ret;
+		}
+	}
+
+	writer->active = 1;
+	glc_log(file->mpriv.glc, GLC_INFO, "file",
+		"writing %u KiB segments with %u writes in flight%s",
+		FILE_SEGMENT_SIZE / 1024, writer->writes,
+		writer->direct ? ", direct io" : "");
+	return 0;
+}
+
+/**
+ * \brief write remaining data and stop asynchronous writer
+ * \param writer writer
+ * \return 0 on success otherwise an error code
+ */
+int file_writer_stop(struct file_writer_s *writer)
+{
+	struct file_segment_s *segment = &writer->segment[writer->fill];
+	u_int64_t end = segment->offset + segment->size;
+	unsigned int t;
+	int ret = 0;
+
+	if ((writer->writes) && (segment->size > 0))
+		ret = file_writer_submit(writer, 1);
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->quit = 1;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+
+	for (t = 0; t < writer->writes; t++)
+		glc_simple_thread_wait(writer->glc, &writer->thread[t]);
+
+	/* cut padding of last direct write */
+	if ((writer->direct) && (unlikely(ftruncate(writer->fd, end))) && (!ret))
+		ret = errno;
+
+	writer->active = 0;
+	return ret;
+}
+
+void file_index_free(struct file_index_s *index)
+{
+	free(index->entry);
+	free(index->state);
+	free(index->record);
+	memset(index, 0, sizeof(struct file_index_s));
+}
+
+/**
+ * \brief test if a message holds a picture that doesn't depend on others
+ * \param type message type
+ * \param message message
+ * \param message_size message size
+ * \return 1 if message is a key frame, otherwise 0
+ */
+static int file_index_key(glc_message_type_t type, const char *message,
+			  size_t message_size)
+{
+	if ((type == GLC_MESSAGE_VIDEO_FRAME) || (type == GLC_MESSAGE_FILTER))
+		return 1;
+	else if (type == GLC_MESSAGE_DELTA)
+		return (message_size >= sizeof(glc_delta_header_t)) &&
+		       (((glc_delta_header_t *) message)->flags & GLC_DELTA_KEY);
+	else if ((type == GLC_MESSAGE_LZO) || (type == GLC_MESSAGE_QUICKLZ) ||
+		 (type == GLC_MESSAGE_LZJB) || (type == GLC_MESSAGE_LZ4) ||
+		 (type == GLC_MESSAGE_SLICES) || (type == GLC_MESSAGE_LOSSLESS) ||
+		 (type == GLC_MESSAGE_JPEG))
+		/* all these headers start with size and original header */
+		return (message_size >= sizeof(glc_lzo_header_t)) &&
+		       (((glc_lzo_header_t *) message)->header.type ==
+			GLC_MESSAGE_VIDEO_FRAME);
+	return 0;
+}
+
+/**
+ * \brief record a message in stream index before it is written
+ *
+ * Picture messages don't expose their time without decompression,
+ * so entries use state time, which is never before the time of a
+ * picture that is already written.
+ * \param file file object
+ * \param header message header
+ * \param message message
+ * \param message_size message size
+ * \return 0 on success otherwise an error code
+ */
+int file_index_message(file_sink_t *file, glc_message_header_t *header,
+		       void *message, size_t message_size)
+{
+	struct file_index_s *index = &file->index;
+	glc_index_state_t *record;
+	glc_utime_t time;
+	size_t need;
+	off_t offset;
+	void *ptr;
+
+	if ((header->type == GLC_MESSAGE_VIDEO_FORMAT) ||
+	    (header->type == GLC_MESSAGE_AUDIO_FORMAT) ||
+	    (header->type == GLC_MESSAGE_COLOR)) {
+		if (unlikely((offset = file_tell(file)) < 0))
+			return errno;
+
+		need = index->state_size + sizeof(glc_index_state_t) + message_size;
+		if (index->state_alloc < need) {
+			need += need / 2 + 256;
+			if (unlikely(!(ptr = realloc(index->state, need))))
+				return ENOMEM;
+			index->state = (char *) ptr;
+			index->state_alloc = need;
+		}
+
+		record = (glc_index_state_t *) &index->state[index->state_size];
+		record->offset = offset;
+		record->size = message_size;
+		record->header = *header;
+		memcpy(&record[1], message, message_size);
+		index->state_size += sizeof(glc_index_state_t) + message_size;
+		return 0;
+	}
+
+	if (!file_index_key(header->type, message, message_size))
+		return 0;
+
+	time = glc_state_time(file->mpriv.glc);
+	if ((index->entries) &&
+	    (time < index->entry[index->entries - 1].time + FILE_INDEX_INTERVAL))
+		return 0;
+
+	if (unlikely((offset = file_tell(file)) < 0))
+		return errno;
+
+	if (index->entries == index->entry_alloc) {
+		need = index->entry_alloc ? index->entry_alloc * 2 : 1024;
+		if (unlikely(!(ptr = realloc(index->entry,
+					     need * sizeof(glc_index_entry_t)))))
+			return ENOMEM;
+		index->entry = (glc_index_entry_t *) ptr;
+		index->entry_alloc = need;
+	}
+
+	index->entry[index->entries].offset = offset;
+	index->entry[index->entries++].time = time;
+	return 0;
+}
+
+/**
+ * \brief write stream index after end of stream
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_write_index(file_sink_t *file)
+{
+	glc_index_trailer_t trailer;
+	off_t offset;
+	int ret;
+
+	if (unlikely((offset = file_tell(file)) < 0))
+		return errno;
+
+	trailer.offset = offset;
+	trailer.entries = file->index.entries;
+	trailer.state_size = file->index.state_size;
+	trailer.signature = GLC_INDEX_SIGNATURE;
+
+	if (likely(file->index.entries > 0))
+		if (unlikely((ret = file_write(file, file->index.entry,
+				sizeof(glc_index_entry_t) * file->index.entries))))
+			return ret;
+	if (likely(file->index.state_size > 0))
+		if (unlikely((ret = file_write(file, file->index.state,
+					       file->index.state_size))))
+			return ret;
+	if (unlikely((ret = file_write(file, &trailer, sizeof(glc_index_trailer_t)))))
+		return ret;
+
+	if (unlikely((ret = file_sync(file))))
+		return ret;
+
+	glc_log(file->mpriv.glc, GLC_DEBUG, "file",
+		"wrote stream index with %zu entries", file->index.entries);
+	return 0;
 }
 
 int file_open_source(source_t source, const char *filename)
@@ -593,6 +1632,8 @@ int file_close_source(source_t source)
 
 	file->mpriv.handle = NULL;
 	file->mpriv.flags &= ~(FILE_READING | FILE_INFO_READ | FILE_INFO_VALID);
+	file_index_free(&file->index);
+	file->seek_time = FILE_NO_SEEK;
 
 	return 0;	
 }
@@ -607,9 +1648,15 @@ int file_test_stream_version(u_int32_t version)
 	 * code, we normalize timestamps in this module
 	 * by making sure that all outgoing timestamps are in
 	 * nanoseconds.
+	 * 0x06 adds GLC_MESSAGE_VIDEO_REPEAT, GLC_MESSAGE_DELTA,
+	 * GLC_MESSAGE_SLICES, GLC_MESSAGE_LZ4, GLC_MESSAGE_FILTER,
+	 * GLC_MESSAGE_LOSSLESS and GLC_MESSAGE_JPEG, so 0x05 streams
+	 * are read as is.
 	 */
 	if (likely(version == GLC_STREAM_VERSION)) {
 		return 0;
+	} else if (version == 0x05) {
+		return 0;
 	} else if (version == 0x03 || version ==0x04) {
 		/*
 		 0.5.5 was last version to use 0x03.
@@ -625,6 +1672,7 @@ int file_read_info(source_t source, glc_stream_info_t *info,
 		   char **info_name, char **info_date)
 {
 	file_source_t *file = (file_source_t*)source;
+	int ret;
 	*info_name = NULL;
 	*info_date = NULL;
 	if (unlikely(!is_read_open(&file->mpriv)))
@@ -665,10 +1713,411 @@ int file_read_info(source_t source, glc_stream_info_t *info,
 			return errno;
 	}
 
+	if (unlikely((ret = file_read_index(file))))
+		return ret;
+
 	file->mpriv.flags |= FILE_INFO_VALID;
 	return 0;
 }
 
+/**
+ * \brief load stream index from end of file
+ *
+ * Streams without index, or that can't be seeked, are still
+ * read but seeking isn't supported.
+ * \param file file object
+ * \return 0 on success otherwise an error code
+ */
+int file_read_index(file_source_t *file)
+{
+	struct file_index_s *index = &file->index;
+	glc_index_trailer_t trailer;
+	glc_index_state_t *record;
+	size_t off, records;
+	off_t pos, end;
+
+	file_index_free(index);
+
+	if (unlikely((pos = ftello(file->mpriv.handle)) < 0))
+		goto unseekable;
+	if (fseeko(file->mpriv.handle, -(off_t) sizeof(glc_index_trailer_t), SEEK_END))
+		goto unseekable;
+
+	if (fread_unlocked(&trailer, sizeof(glc_index_trailer_t), 1,
+			   file->mpriv.handle) != 1)
+		goto none;
+	end = ftello(file->mpriv.handle);
+	if ((trailer.signature != GLC_INDEX_SIGNATURE) ||
+	    (trailer.offset < (u_int64_t) pos) || (trailer.offset >= (u_int64_t) end) ||
+	    (trailer.entries > (end - trailer.offset) / sizeof(glc_index_entry_t)) ||
+	    (trailer.offset + trailer.entries * sizeof(glc_index_entry_t) +
+	     trailer.state_size + sizeof(glc_index_trailer_t) != (u_int64_t) end))
+		goto none;
+
+	index->entries = trailer.entries;
+	index->state_size = trailer.state_size;
+	if (unlikely((!(index->entry = (glc_index_entry_t *)
+			malloc(index->entries * sizeof(glc_index_entry_t) + 1))) ||
+		     (!(index->state = (char *) malloc(index->state_size + 1)))))
+		goto none;
+
+	if (fseeko(file->mpriv.handle, trailer.offset, SEEK_SET))
+		goto none;
+	if ((index->entries) &&
+	    (fread_unlocked(index->entry, sizeof(glc_index_entry_t), index->entries,
+			    file->mpriv.handle) != index->entries))
+		goto none;
+	if ((index->state_size) &&
+	    (fread_unlocked(index->state, index->state_size, 1, file->mpriv.handle) != 1))
+		goto none;
+
+	/* state records are looked up by position */
+	for (off = 0, records = 0; off < index->state_size;
+	     off += sizeof(glc_index_state_t) + record->size, records++) {
+		record = (glc_index_state_t *) &index->state[off];
+		if ((index->state_size - off < sizeof(glc_index_state_t)) ||
+		    (record->size > index->state_size - off - sizeof(glc_index_state_t)) ||
+		    (record->size < sizeof(glc_stream_id_t)))
+			goto none;
+	}
+	if (unlikely(!(index->record = (glc_index_state_t **)
+			malloc(records * sizeof(glc_index_state_t *) + 1))))
+		goto none;
+	for (off = 0; index->records < records;
+	     off += sizeof(glc_index_state_t) + record->size)
+		index->record[index->records++] = record =
+			(glc_index_state_t *) &index->state[off];
+
+	glc_log(file->mpriv.glc, GLC_INFO, "file",
+		"stream index has %zu entries", index->entries);
+	goto finish;
+
+none:
+	glc_log(file->mpriv.glc, GLC_DEBUG, "file", "stream has no index");
+	file_index_free(index);
+finish:
+	if (unlikely(fseeko(file->mpriv.handle, pos, SEEK_SET))) {
+		glc_log(file->mpriv.glc, GLC_ERROR, "file",
+			"can't seek back to stream: %s (%d)", strerror(errno), errno);
+		return errno;
+	}
+	return 0;
+
+unseekable:
+	glc_log(file->mpriv.glc, GLC_DEBUG, "file", "stream can't be seeked");
+	return 0;
+}
+
+int file_seek(source_t source, glc_utime_t time)
+{
+	file_source_t *file = (file_source_t*)source;
+	if (unlikely(!is_read_open(&file->mpriv)))
+		return EAGAIN;
+	if (unlikely(!file->index.entries))
+		return ENOTSUP;
+
+	if (unlikely(time == FILE_NO_SEEK))
+		time--;
+	/* picked up by file_read() */
+	__sync_lock_test_and_set(&file->seek_time, time);
+	return 0;
+}
+
+/**
+ * \brief find last state message of the same kind before an offset
+ * \param index stream index
+ * \param like state message
+ * \param offset file offset
+ * \return state message or NULL
+ */
+static glc_index_state_t *file_index_state_get(struct file_index_s *index,
+					       glc_index_state_t *like,
+					       u_int64_t offset)
+{
+	glc_index_state_t *found = NULL;
+	size_t r;
+
+	/* format and color messages all start with stream id */
+	for (r = 0; (r < index->records) && (index->record[r]->offset < offset); r++) {
+		if ((index->record[r]->header.type == like->header.type) &&
+		    (!memcmp(&index->record[r][1], &like[1], sizeof(glc_stream_id_t))))
+			found = index->record[r];
+	}
+	return found;
+}
+
+static int file_send_message(ps_packet_t *packet, glc_message_header_t *header,
+			     void *message, size_t message_size)
+{
+	int ret;
+	if (unlikely((ret = ps_packet_open(packet, PS_PACKET_WRITE))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(packet, header,
+					    sizeof(glc_message_header_t)))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(packet, message, message_size))))
+		return ret;
+	return ps_packet_close(packet);
+}
+
+/**
+ * \brief jump to requested position
+ *
+ * Reading resumes at last index entry not after requested time.
+ * GLC_MESSAGE_SEEK is sent first, followed by format and color
+ * messages that differ from those already read.
+ * \param file file object
+ * \param packet packet to write messages with
+ * \param pos offset of next message, replaced with offset to read from
+ * \return 0 on success otherwise an error code
+ */
+int file_seek_apply(file_source_t *file, ps_packet_t *packet, u_int64_t *pos)
+{
+	struct file_index_s *index = &file->index;
+	glc_index_state_t *target, *current;
+	glc_message_header_t header;
+	glc_seek_message_t seek_msg;
+	glc_utime_t time;
+	size_t lo, hi, mid, r;
+	u_int64_t offset;
+	int ret;
+
+	time = __sync_lock_test_and_set(&file->seek_time, FILE_NO_SEEK);
+
+	/* entries are in file order, so time order */
+	lo = 0;
+	hi = index->entries;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entry[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	offset = index->entry[lo].offset;
+
+	seek_msg.seek = glc_state_seek(file->mpriv.glc, time);
+	seek_msg.time = time;
+	header.type = GLC_MESSAGE_SEEK;
+	if (unlikely((ret = file_send_message(packet, &header, &seek_msg,
+					      sizeof(glc_seek_message_t)))))
+		return ret;
+
+	for (r = 0; (r < index->records) && (index->record[r]->offset < offset); r++) {
+		target = index->record[r];
+		if (file_index_state_get(index, target, offset) != target)
+			continue; /* replaced before entry */
+
+		current = file_index_state_get(index, target, *pos);
+		if ((current) && (current->size == target->size) &&
+		    (!memcmp(&current[1], &target[1], target->size)))
+			continue;
+
+		if (unlikely((ret = file_send_message(packet, &target->header,
+						      &target[1], target->size))))
+			return ret;
+	}
+
+	glc_log(file->mpriv.glc, GLC_INFO, "file",
+		"seeked to %" PRIu64 " ms at offset %" PRIu64,
+		time / 1000000, offset);
+	*pos = offset;
+	return 0;
+}
+
+static void file_window_put(void *arg)
+{
+	struct file_window_s *window = (struct file_window_s *) arg;
+
+	if (__sync_sub_and_fetch(&window->refcount, 1) == 0) {
+		munmap(window->addr, window->size);
+		free(window);
+	}
+}
+
+/**
+ * \brief map window of file that holds a range
+ *
+ * Previous window is released, payloads still referencing it keep
+ * it mapped.
+ * \param file file object
+ * \param fd file descriptor
+ * \param file_size file size
+ * \param offset start of range
+ * \param size size of range
+ * \param window current window, replaced with new window
+ * \return 0 on success otherwise an error code
+ */
+static int file_window_map(file_source_t *file, int fd, u_int64_t file_size,
+			   u_int64_t offset, size_t size,
+			   struct file_window_s **window)
+{
+	struct file_window_s *map;
+	u_int64_t start;
+	size_t len = FILE_MMAP_WINDOW;
+	int ret;
+
+	start = offset & ~((u_int64_t) sysconf(_SC_PAGESIZE) - 1);
+	if (offset + size - start > len)
+		len = offset + size - start;
+	if (start + len > file_size)
+		len = file_size - start;
+
+	if (unlikely(!(map = (struct file_window_s *)
+			malloc(sizeof(struct file_window_s)))))
+		return ENOMEM;
+
+	/* private writable pages, readers never change the file */
+	map->addr = (char *) mmap(NULL, len, PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE, fd, start);
+	if (unlikely(map->addr == MAP_FAILED)) {
+		ret = errno;
+		free(map);
+		return ret;
+	}
+	map->refcount = 1;
+	map->offset = start;
+	map->size = len;
+
+	madvise(map->addr, len, MADV_SEQUENTIAL);
+	madvise(map->addr, len, MADV_WILLNEED);
+	/* next window is read while this one is processed */
+	if (start + len < file_size)
+		posix_fadvise(fd, start + len, FILE_MMAP_WINDOW, POSIX_FADV_WILLNEED);
+
+	if (*window)
+		file_window_put(*window);
+	*window = map;
+	return 0;
+}
+
+/**
+ * \brief read stream through mapped file windows
+ *
+ * Messages are read straight from page cache. Large payloads are
+ * sent as GLC_MESSAGE_REF when the target buffer accepts references,
+ * so they are never copied before unpack. Reading waits while
+ * referenced payloads fill the budget of the target buffer.
+ * \param file file object
+ * \param to target buffer
+ * \return 0 on success, ENOTSUP if file can't be mapped, otherwise an
+ *         error code
+ */
+int file_read_mmap(file_source_t *file, ps_buffer_t *to)
+{
+	struct file_window_s *window = NULL;
+	glc_message_header_t header, ref_header;
+	glc_ref_message_t ref_msg;
+	ps_packet_t packet;
+	struct stat statbuf;
+	u_int64_t pos, size;
+	size_t packet_size = 0;
+	glc_size_t glc_ps;
+	off_t offset;
+	char *data;
+	int fd, refs, ret = 0;
+
+	fd = fileno(file->mpriv.handle);
+	if ((fstat(fd, &statbuf) < 0) || (!S_ISREG(statbuf.st_mode)) ||
+	    ((offset = ftello(file->mpriv.handle)) < 0) ||
+	    (offset >= statbuf.st_size))
+		return ENOTSUP;
+	pos = offset;
+	size = statbuf.st_size;
+
+	if (file_window_map(file, fd, size, pos, 0, &window))
+		return ENOTSUP;
+
+	refs = glc_ref_accepted(file->mpriv.glc, to);
+	glc_log(file->mpriv.glc, GLC_DEBUG, "file", "reading mapped stream%s",
+		refs ? ", payloads by reference" : "");
+
+	ps_packet_init(&packet, to);
+	ref_header.type = GLC_MESSAGE_REF;
+
+	do {
+		if (unlikely(file->seek_time != FILE_NO_SEEK))
+			if (unlikely((ret = file_seek_apply(file, &packet, &pos))))
+				goto err;
+
+		if (unlikely(size - pos < sizeof(glc_size_t) + sizeof(glc_message_header_t)))
+			goto send_eof;
+		if (unlikely((pos < window->offset) ||
+			     (pos + sizeof(glc_size_t) + sizeof(glc_message_header_t) >
+			      window->offset + window->size)))
+			if (unlikely((ret = file_window_map(file, fd, size, pos,
+					sizeof(glc_size_t) + sizeof(glc_message_header_t),
+					&window))))
+				goto err;
+
+		/* same header format as in container messages */
+		data = &window->addr[pos - window->offset];
+		memcpy(&glc_ps, data, sizeof(glc_size_t));
+		memcpy(&header, &data[sizeof(glc_size_t)], sizeof(glc_message_header_t));
+		pos += sizeof(glc_size_t) + sizeof(glc_message_header_t);
+
+		if (unlikely(glc_ps > size - pos))
+			goto send_eof;
+		packet_size = glc_ps;
+		if (unlikely(pos + packet_size > window->offset + window->size))
+			if (unlikely((ret = file_window_map(file, fd, size, pos,
+							    packet_size, &window))))
+				goto err;
+		data = &window->addr[pos - window->offset];
+		pos += packet_size;
+
+		ref_msg.ref = NULL;
+		/* don't read further ahead than buffer budget */
+		if ((refs) && (packet_size >= GLC_REF_MIN_SIZE) &&
+		    (!glc_ref_charge_wait(file->mpriv.glc, to, packet_size))) {
+			ref_msg.ref = glc_ref_wrap(&header, data, packet_size,
+						   &file_window_put, window);
+			if (unlikely(!ref_msg.ref))
+				glc_ref_uncharge(file->mpriv.glc, to, packet_size);
+		}
+
+		if (ref_msg.ref) {
+			__sync_fetch_and_add(&window->refcount, 1);
+			if (unlikely((ret = file_send_message(&packet, &ref_header, &ref_msg,
+							      sizeof(glc_ref_message_t))))) {
+				glc_ref_uncharge(file->mpriv.glc, to, packet_size);
+				glc_ref_put(ref_msg.ref);
+				goto err;
+			}
+		} else if (unlikely((ret = file_send_message(&packet, &header,
+							     data, packet_size))))
+			goto err;
+	} while ((header.type != GLC_MESSAGE_CLOSE) &&
+		 (!glc_state_test(file->mpriv.glc, GLC_STATE_CANCEL)));
+
+finish:
+	ps_packet_destroy(&packet);
+	file_window_put(window);
+
+	file->mpriv.flags &= ~(FILE_INFO_READ | FILE_INFO_VALID);
+	return ret;
+
+send_eof:
+	header.type = GLC_MESSAGE_CLOSE;
+	ps_packet_open(&packet, PS_PACKET_WRITE);
+	ps_packet_write(&packet, &header, sizeof(glc_message_header_t));
+	ps_packet_close(&packet);
+
+	glc_log(file->mpriv.glc, GLC_ERROR, "file", "unexpected EOF");
+	goto finish;
+
+err:
+	if (ret == EINTR) {
+		ret = 0;
+		goto finish; /* just cancel */
+	}
+
+	glc_log(file->mpriv.glc, GLC_ERROR, "file", "%s (%d)", strerror(ret), ret);
+	glc_log(file->mpriv.glc, GLC_DEBUG, "file", "packet size is %zd", packet_size);
+	ps_buffer_cancel(to);
+	goto finish;
+}
+
 int file_read(source_t source, ps_buffer_t *to)
 {
 	file_source_t *file = (file_source_t*)source;
@@ -678,6 +2127,8 @@ int file_read(source_t source, ps_buffer_t *to)
 	ps_packet_t packet;
 	char *dma;
 	glc_size_t glc_ps;
+	u_int64_t pos;
+	off_t offset;
 
 	if (unlikely(!is_read_open(&file->mpriv)))
 		return EAGAIN;
@@ -695,9 +2146,25 @@ int file_read(source_t source, ps_buffer_t *to)
 		return EINVAL;
 	}
 
+	/* streams that are passed on as is are mapped when possible */
+	if ((file->stream_version >= 0x05) &&
+	    ((ret = file_read_mmap(file, to)) != ENOTSUP))
+		return ret;
+	ret = 0;
+
 	ps_packet_init(&packet, to);
 
 	do {
+		if (unlikely(file->seek_time != FILE_NO_SEEK)) {
+			if (unlikely((offset = ftello(file->mpriv.handle)) < 0))
+				goto seek_fail;
+			pos = offset;
+			if (unlikely((ret = file_seek_apply(file, &packet, &pos))))
+				goto err;
+			if (unlikely(fseeko(file->mpriv.handle, pos, SEEK_SET)))
+				goto seek_fail;
+		}
+
 		if (unlikely(file->stream_version == 0x03)) {
 			/* old order */
 			if (unlikely(fread_unlocked(&header,
@@ -765,6 +2232,10 @@ send_eof:
 	glc_log(file->mpriv.glc, GLC_ERROR, "file", "unexpected EOF");
 	goto finish;
 
+seek_fail:
+	ret = errno;
+	goto err;
+
 read_fail:
 	ret = EBADMSG;
 	glc_log(file->mpriv.glc, GLC_ERROR, "file",
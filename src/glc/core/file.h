@@ -59,6 +59,13 @@ extern "C" {
  * file->ops->write_info() must be called before starting write
  * process.
  *
+ * file->ops->write_eof() writes an index of the stream after its
+ * end so file sources can seek.
+ *
+ * Regular files are allocated ahead of writes in large chunks.
+ * Written data is written back as it goes and dropped from page
+ * cache, so capture doesn't evict cache of the application.
+ *
  * One stream file can actually hold multiple individual
  * streams: [info0][stream0][info1][stream1]...
  * \param file file object
@@ -67,10 +74,48 @@ extern "C" {
  */
 __PUBLIC int file_sink_init(sink_t *sink, glc_t *glc);
 
+/**
+ * \brief write target asynchronously
+ *
+ * Messages are gathered in 4 MiB segments that are written by
+ * writes threads, so a slow disk doesn't block the sink thread
+ * until all segments are in flight. Target is written with direct
+ * io when the filesystem supports it. In sync mode, target isn't
+ * opened with O_SYNC, written data is instead synced at least every
+ * second.
+ * \note this must be set before opening sink
+ * \param sink file sink object
+ * \param writes writes in flight, 0 disables, more than 16 are
+ *               limited to 16
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_sink_set_async(sink_t sink, unsigned int writes);
+
+/**
+ * \brief split stream in parts
+ *
+ * When current part reaches size or duration, the stream goes on
+ * in a new file named after the target with -001, -002... before
+ * its extension. Next part is opened in background when current
+ * part is half complete and previous part is closed in background,
+ * so the sink thread doesn't wait on either. Parts are switched
+ * before a key frame and start with stream information and current
+ * state, so each can be played on its own.
+ * \note this must be set before opening sink
+ * \param sink file sink object
+ * \param size part size in bytes, 0 for no limit
+ * \param duration part duration in nanoseconds, 0 for no limit
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int file_sink_set_split(sink_t sink, u_int64_t size,
+				 glc_utime_t duration);
+
 /**
  * \brief initialize file sink object
  *
- * Reading stream from file is done in same thread.
+ * Reading stream from file is done in same thread. Regular files
+ * are mapped in windows and large payloads are handed to the
+ * next filter by reference, without copying them.
  * \code
  * // reading example
  * file_source_init(*file, glc);
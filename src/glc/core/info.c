@@ -57,7 +57,7 @@ struct info_video_stream_s {
 	glc_video_format_t format;
 	unsigned int w, h;
 
-	unsigned long pictures;
+	unsigned long pictures, repeats;
 	size_t bytes;
 
 	unsigned long fps;
@@ -100,6 +100,8 @@ static void video_frame_info(info_t info, glc_video_frame_header_t *pic_header);
 static void audio_format_info(info_t info, glc_audio_format_message_t *fmt_message);
 static void audio_data_info(info_t info, glc_audio_data_header_t *audio_header);
 static void color_info(info_t info, glc_color_message_t *color_msg);
+static void pace_info(info_t info, glc_video_pace_message_t *pace_msg);
+static void video_repeat_info(info_t info, glc_video_repeat_message_t *repeat_msg);
 
 static void print_time(FILE *stream, glc_utime_t time);
 static void print_bytes(FILE *stream, size_t bytes);
@@ -120,6 +122,7 @@ int info_init(info_t *info, glc_t *glc)
 	(*info)->thread.read_callback = &info_read_callback;
 	(*info)->thread.finish_callback = &info_finish_callback;
 	(*info)->thread.threads = 1;
+	(*info)->thread.name = "info";
 
 	return 0;
 }
@@ -185,6 +188,7 @@ void info_finish_callback(void *ptr, int err)
 
 		fprintf(info->stream, "video stream %d\n", video->id);
 		fprintf(info->stream, "  frames      = %lu\n", video->pictures);
+		fprintf(info->stream, "  repeated    = %lu\n", video->repeats);
 		fprintf(info->stream, "  fps         = %04.2f\n",
 		       (double) (video->pictures) / (double) (info->time/1000000000.0));
 		fprintf(info->stream, "  bytes       = ");
@@ -226,6 +230,10 @@ int info_read_callback(glc_thread_state_t *state)
 		audio_data_info(info, (glc_audio_data_header_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_COLOR)
 		color_info(info, (glc_color_message_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_PACE)
+		pace_info(info, (glc_video_pace_message_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		video_repeat_info(info, (glc_video_repeat_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_CLOSE) {
 		print_time(info->stream, info->time);
 		fprintf(info->stream, "end of stream\n");
@@ -375,6 +383,33 @@ void video_frame_info(info_t info, glc_video_frame_header_t *pic_header)
 	}
 }
 
+void video_repeat_info(info_t info, glc_video_repeat_message_t *repeat_msg)
+{
+	struct info_video_stream_s *video;
+	info->time = repeat_msg->time;
+
+	info_get_video_stream(info, &video, repeat_msg->id);
+
+	if (info->level >= INFO_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "repeated picture (video %d)\n", repeat_msg->id);
+	}
+
+	/* repeated frames are frames too, but take no space */
+	video->pictures++;
+	video->repeats++;
+	video->fps++;
+
+	if ((info->level >= INFO_FPS) && (repeat_msg->time - video->fps_time >= 1000000000)) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "video %d: %04.2f fps\n", video->id,
+			(double) (video->fps * 1000000) / (double) (repeat_msg->time - video->last_fps_time)*1000);
+		video->last_fps_time = repeat_msg->time;
+		video->fps_time += 1000000000;
+		video->fps = 0;
+	}
+}
+
 void audio_format_info(info_t info, glc_audio_format_message_t *fmt_message)
 {
 	INFO_FLAGS
@@ -443,6 +478,23 @@ void color_info(info_t info, glc_color_message_t *color_msg)
 		fprintf(info->stream, "color correction information for video %d\n", color_msg->id);
 }
 
+void pace_info(info_t info, glc_video_pace_message_t *pace_msg)
+{
+	print_time(info->stream, info->time);
+	if (info->level >= INFO_DETAILED_VIDEO) {
+		fprintf(info->stream, "capture pace message\n");
+		fprintf(info->stream, "  stream id   = %d\n", pace_msg->id);
+		fprintf(info->stream, "  level       = %u\n", pace_msg->level);
+		fprintf(info->stream, "  interval    = %llu nsec\n",
+			(unsigned long long) pace_msg->interval);
+		fprintf(info->stream, "  overhead    = %llu nsec\n",
+			(unsigned long long) pace_msg->overhead);
+		fprintf(info->stream, "  dropped     = %u\n", pace_msg->dropped);
+	} else
+		fprintf(info->stream, "capture pace level %u for video %d\n",
+			pace_msg->level, pace_msg->id);
+}
+
 /*
 void stream_info(info_t info)
 {
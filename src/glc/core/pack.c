@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <glc/common/glc.h>
 #include <glc/common/core.h>
@@ -68,77 +69,474 @@
 # include <lzjb.h>
 #endif
 
+#ifdef __LZ4
+# include <lz4.h>
+# include <lz4hc.h>
+# define __lz4_worstcase(size) LZ4_COMPRESSBOUND(size)
+#endif
+
+#ifdef __JPEG
+# include <setjmp.h>
+# include <jpeglib.h>
+/* bands that don't fit are coded losslessly instead */
+# define __jpeg_worstcase(size) ((size) + (size) / 2 + 1024)
+#endif
+
+/* delta encoding compares pictures in tiles of this many bytes */
+#define PACK_DELTA_TILE 256
+/* messages are split in slices of at least this many bytes */
+#define PACK_SLICE_MIN (256 * 1024)
+/* pictures have at most this many planes */
+#define PACK_PLANES_MAX 4
+
+/* lossless segments are rANS coded with probabilities of PACK_RANS_BITS bits */
+#define PACK_RANS_BITS         12
+#define PACK_RANS_L            (1u << 23)
+/* first byte of a lossless segment */
+#define PACK_LOSSLESS_RAW      0
+#define PACK_LOSSLESS_RANS     1
+/* slack lets the coded stream expand a bit over residuals not coded yet */
+#define __lossless_worstcase(size) \
+	((size) + (size) / 8 + 64 + 1 + 256 * sizeof(u_int16_t) + sizeof(u_int32_t))
+
+/* adaptive compression modes */
+#define PACK_MODE_STORE        0
+#define PACK_MODE_FAST         1
+#define PACK_MODE_STRONG       2
+#define PACK_MODE_NUM          3
+/* weight of a new sample in moving averages */
+#define PACK_CTL_WEIGHT        (1.0 / 16.0)
+/* store messages the fast codec shrinks by less than 5% */
+#define PACK_CTL_STORE_RATIO   0.95
+/* busy or blocked time fractions considered high and low */
+#define PACK_CTL_HIGH          0.85
+#define PACK_CTL_LOW           0.25
+/* fast codec is measured again every this many messages */
+#define PACK_CTL_PROBE         32
+
+typedef int (*pack_write_callback_t)(glc_thread_state_t *state);
+
 struct pack_stat_s {
 	uint64_t pack_size;
 	uint64_t unpack_size;
+	/* data through codec and time spent on it, in ns */
+	uint64_t codec_size;
+	uint64_t codec_time;
 };
 
 typedef struct pack_stat_s pack_stat_t;
 
+/* last picture of a video stream, reference for next delta */
+struct pack_delta_stream_s {
+	glc_stream_id_t id;
+	char *ref;
+	size_t size;
+	unsigned int frames;
+
+	struct pack_delta_stream_s *next;
+};
+
+/* format of a video stream, needed to filter its pictures */
+struct pack_video_s {
+	glc_stream_id_t id;
+	glc_video_format_t format;
+	unsigned int width, height, row;
+
+	struct pack_video_s *next;
+};
+
+/* channel or plane of a picture, filtered to width x height bytes */
+struct pack_plane_s {
+	size_t offset, step, pitch;
+	unsigned int width, height;
+};
+
+/* part of a message compressed or decompressed independently */
+struct pack_slice_s {
+	const char *src;
+	size_t size;
+	char *dst;
+	/* compressed size when packing, destination size when unpacking */
+	size_t dst_size;
+	/* PACK_* when packing, GLC_MESSAGE_* when unpacking */
+	int codec;
+	glc_message_type_t compression;
+	int ret;
+
+	/* band of a picture plane for lossless coding, 0 width otherwise */
+	unsigned int width;
+	size_t step, pitch;
+
+	/* rows y to y + rows of a width x height picture for JPEG coding */
+	unsigned int height, y, rows;
+	int quality;
+
+	unsigned int *pending;
+	struct pack_slice_s *next;
+};
+
+/* threads helping with slices of messages processed by other threads */
+struct pack_slice_pool_s {
+	glc_t *glc;
+	pack_t pack; /* NULL when decompressing */
+	size_t wrkmem_size;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	struct pack_slice_s *first, *last;
+	int stop;
+
+	glc_simple_thread_t *threads;
+	unsigned int threads_num;
+};
+
+/* adaptive compression estimates of an audio or video stream */
+struct pack_ctl_stream_s {
+	glc_message_type_t type;
+	glc_stream_id_t id;
+	int mode;
+	unsigned int messages;
+
+	/* compressed to uncompressed size ratio and ns per byte per mode */
+	double ratio[PACK_MODE_NUM];
+	double cost[PACK_MODE_NUM];
+	unsigned int samples[PACK_MODE_NUM];
+
+	struct pack_ctl_stream_s *next;
+};
+
+#ifdef __JPEG
+/* libjpeg errors jump back to the band being coded */
+struct pack_jpeg_error_s {
+	struct jpeg_error_mgr mgr;
+	jmp_buf jump;
+};
+#endif
+
+/* rANS encoder symbol, division by frequency done as multiplication */
+struct pack_rans_sym_s {
+	u_int32_t x_max;
+	u_int32_t rcp_freq;
+	u_int32_t rcp_shift;
+	u_int32_t bias;
+	u_int32_t cmpl_freq;
+};
+
+struct pack_thread_s {
+	/* large enough for both fast and strong codecs */
+	void *wrkmem;
+
+	/* codec of current message */
+	int codec;
+	/* adaptive compression of current message */
+	struct pack_ctl_stream_s *ctl;
+	int mode;
+	glc_utime_t idle, read_time, write_time;
+
+	/* slices of current message, chosen in read callback */
+	struct pack_slice_s *slice;
+	unsigned int slices;
+	size_t slice_size;
+
+	/* delta of current picture, built in read callback */
+	char *delta;
+	size_t delta_alloc, delta_size;
+	glc_size_t frame_size;
+	glc_flags_t delta_flags;
+
+	/* filtered picture, built in read callback */
+	char *filter;
+	size_t filter_alloc;
+	glc_filter_header_t filter_header;
+
+	/* lossless coding of current message, segments are slices */
+	glc_lossless_header_t lossless_header;
+
+	/* JPEG bands of current picture, slices after lossless segments */
+	glc_jpeg_header_t jpeg_header;
+	unsigned int jpeg_bands;
+};
+
 struct pack_s {
 	glc_t *glc;
 	glc_thread_t thread;
+	glc_thread_stats_t thread_stats;
 	size_t compress_min;
 	int running;
 	int compression;
+	pack_write_callback_t write_callback;
 	pack_stat_t stats;
+
+	/* adaptive compression, estimates are updated by write callbacks */
+	int adaptive;
+	int strong;
+	pack_write_callback_t strong_write_callback;
+	pthread_mutex_t ctl_mutex;
+	struct pack_ctl_stream_s *ctl;
+	size_t wrkmem_size;
+	/* busy and output blocked fractions of thread time, ns per byte */
+	double load, blocked, cost;
+	uint64_t modes[PACK_MODE_NUM];
+
+	/* read callbacks are called in stream order, no lock needed */
+	unsigned int delta_interval;
+	struct pack_delta_stream_s *delta;
+
+	unsigned int slices;
+	/* slices one message may need */
+	unsigned int slice_max;
+	struct pack_slice_pool_s pool;
+
+	glc_flags_t filter;
+	struct pack_video_s *video;
+
+	int jpeg_quality;
+};
+
+struct unpack_thread_s {
+	void *qlz;
+
+	struct pack_slice_s *slice;
+	unsigned int slice_alloc;
+
+	char *delta;
+	size_t delta_alloc;
+	u_int64_t seq;
+
+	char *filter;
+	size_t filter_alloc;
 };
 
 struct unpack_s {
 	glc_t *glc;
 	glc_thread_t thread;
+	glc_thread_stats_t thread_stats;
 	int running;
 	pack_stat_t stats;
+
+	/* deltas are applied in the order they were read */
+	pthread_mutex_t delta_mutex;
+	pthread_cond_t delta_cond;
+	u_int64_t delta_seq, delta_next;
+	int delta_cancel;
+	struct pack_delta_stream_s *delta;
+
+	struct pack_slice_pool_s pool;
 };
 
 static int pack_thread_create_callback(void *ptr, void **threadptr);
 static void pack_thread_finish_callback(void *ptr, void *threadptr, int err);
 static int pack_read_callback(glc_thread_state_t *state);
+static int pack_read_message(pack_t pack, glc_thread_state_t *state);
+static int pack_codec_init(pack_t pack, int compression, pack_write_callback_t *callback);
 static int pack_quicklz_write_callback(glc_thread_state_t *state);
 static int pack_lzo_write_callback(glc_thread_state_t *state);
 static int pack_lzjb_write_callback(glc_thread_state_t *state);
+static int pack_lz4_write_callback(glc_thread_state_t *state);
+static int pack_lossless_write_callback(glc_thread_state_t *state);
+static int pack_jpeg_write_callback(glc_thread_state_t *state);
+static int pack_write_callback(glc_thread_state_t *state);
 static void pack_finish_callback(void *ptr, int err);
 
+static int pack_delta_encode(pack_t pack, glc_thread_state_t *state);
+static int pack_delta_write_callback(glc_thread_state_t *state);
+static void pack_delta_reset(pack_t pack, glc_stream_id_t id);
+static int pack_video_format(pack_t pack, glc_video_format_message_t *format);
+static struct pack_video_s *pack_video_get(pack_t pack, glc_stream_id_t id);
+static int pack_filter_encode(pack_t pack, glc_thread_state_t *state);
+static int pack_filter_write_callback(glc_thread_state_t *state);
+static size_t pack_worstcase(int compression, size_t size);
+static size_t pack_compress(int compression, void *wrkmem,
+			    const char *src, size_t size, char *dst);
+static size_t pack_wrkmem_size(int compression);
+static glc_message_type_t pack_message_type(int compression);
+static const char *pack_codec_name(int compression);
+static unsigned int pack_slices_prepare(pack_t pack, struct pack_thread_s *thread,
+					size_t size);
+static size_t pack_slices_worstcase(pack_t pack, struct pack_thread_s *thread);
+static int pack_slices_write_callback(glc_thread_state_t *state);
+static size_t pack_lossless_prepare(pack_t pack, struct pack_thread_s *thread,
+				    glc_thread_state_t *state);
+static size_t pack_jpeg_prepare(pack_t pack, struct pack_thread_s *thread,
+				glc_thread_state_t *state);
+static size_t pack_slices_compress(pack_t pack, struct pack_thread_s *thread,
+				   const char *src, size_t size,
+				   glc_message_header_t *header, char *dst);
+
+static int unpack_thread_create_callback(void *ptr, void **threadptr);
 static void unpack_thread_finish_callback(void *ptr, void *threadptr, int err);
 static int unpack_read_callback(glc_thread_state_t *state);
 static int unpack_write_callback(glc_thread_state_t *state);
 static void unpack_finish_callback(void *ptr, int err);
-static void print_stats(glc_t *glc, pack_stat_t *stat);
+static int unpack_message_write(unpack_t unpack, glc_thread_state_t *state);
+static void print_stats(glc_t *glc, const char *codec, pack_stat_t *stat);
+
+static int unpack_delta_write(unpack_t unpack, glc_thread_state_t *state);
+static int unpack_delta_apply(unpack_t unpack, glc_delta_header_t *delta_hdr,
+			      const char *delta, char *to);
+static int unpack_filter_write(unpack_t unpack, glc_thread_state_t *state);
+static int unpack_lossless(unpack_t unpack, struct unpack_thread_s *thread,
+			   const char *src, size_t src_size, char *dst, size_t dst_size);
+static int unpack_jpeg(unpack_t unpack, struct unpack_thread_s *thread,
+		       const char *src, size_t src_size, char *dst, size_t dst_size);
+static int unpack_slices_alloc(struct unpack_thread_s *thread, unsigned int slices);
+static int unpack_slices(unpack_t unpack, struct unpack_thread_s *thread,
+			 const char *src, size_t src_size, char *dst, size_t dst_size);
+static int unpack_decompress(glc_message_type_t type, void *qlz,
+			     const char *src, size_t src_size, char *dst, size_t dst_size);
+static int delta_get_stream(struct pack_delta_stream_s **list,
+			    glc_stream_id_t id, struct pack_delta_stream_s **video);
+static void delta_free_streams(struct pack_delta_stream_s **list);
+
+static unsigned int filter_planes(glc_video_format_t format, unsigned int width,
+				  unsigned int height, unsigned int row,
+				  struct pack_plane_s *plane, size_t *size);
+static void filter_clear_padding(const struct pack_plane_s *plane, unsigned char *pic);
+static int filter_constant(const struct pack_plane_s *plane,
+			   const unsigned char *pic, u_int8_t *value);
+static unsigned char *filter_encode_plane(const struct pack_plane_s *plane, int predict,
+					  const unsigned char *pic, unsigned char *to);
+static const unsigned char *filter_decode_plane(const struct pack_plane_s *plane, int predict,
+						const unsigned char *from, unsigned char *pic);
+
+static size_t lossless_compress(const unsigned char *src, size_t size,
+				unsigned int width, size_t step, size_t pitch,
+				unsigned char *dst);
+static int lossless_decompress(const unsigned char *src, size_t src_size,
+			       unsigned char *dst, size_t size,
+			       unsigned int width, size_t step, size_t pitch);
+static void lossless_normalize(const u_int32_t *count, size_t total, u_int16_t *freq);
+static void lossless_rans_init(struct pack_rans_sym_s *sym, u_int32_t start,
+			       u_int32_t freq);
+
+static size_t lossy_compress(const struct pack_slice_s *slice);
+static int lossy_decompress(const struct pack_slice_s *slice);
+#ifdef __JPEG
+static void lossy_error_exit(j_common_ptr cinfo);
+static void lossy_output_message(j_common_ptr cinfo);
+static void lossy_dest_init(j_compress_ptr cinfo);
+static boolean lossy_dest_empty(j_compress_ptr cinfo);
+static void lossy_dest_term(j_compress_ptr cinfo);
+static void lossy_src_init(j_decompress_ptr cinfo);
+static boolean lossy_src_fill(j_decompress_ptr cinfo);
+static void lossy_src_skip(j_decompress_ptr cinfo, long num_bytes);
+static void lossy_src_term(j_decompress_ptr cinfo);
+#endif
+
+static int pack_ctl_choose(pack_t pack, struct pack_thread_s *thread,
+			   glc_thread_state_t *state, int can_store);
+static int pack_ctl_mode(pack_t pack, struct pack_ctl_stream_s *ctl, int can_store);
+static void pack_ctl_update(pack_t pack, struct pack_thread_s *thread,
+			    size_t size, size_t packed_size, glc_utime_t start);
+static void pack_ctl_average(double *avg, double sample, unsigned int samples);
+
+static void slice_pool_init(struct pack_slice_pool_s *pool, glc_t *glc, pack_t pack);
+static void slice_pool_destroy(struct pack_slice_pool_s *pool);
+static int slice_pool_start(struct pack_slice_pool_s *pool, unsigned int threads,
+			    size_t wrkmem_size, const char *name);
+static void slice_pool_stop(struct pack_slice_pool_s *pool);
+static int slice_pool_run(struct pack_slice_pool_s *pool, struct pack_slice_s *slice,
+			  unsigned int slices, void *wrkmem);
+static void slice_pool_do(struct pack_slice_pool_s *pool, struct pack_slice_s *slice,
+			  void *wrkmem);
+static void *slice_pool_thread(void *argptr);
 
 int pack_init(pack_t *pack, glc_t *glc)
 {
-#if !defined(__QUICKLZ) && !defined(__LZO) && !defined(__LZJB)
-	glc_log(glc, GLC_ERROR, "pack",
-		 "no supported compression algorithms found");
-	return ENOTSUP;
-#else
+	/* lossless coding is always available */
 	*pack = (pack_t) calloc(1, sizeof(struct pack_s));
 
 	(*pack)->glc = glc;
 	(*pack)->compress_min = 1024;
+	(*pack)->jpeg_quality = 85;
 
-	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
+	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ |
+				GLC_THREAD_REORDER;
 	(*pack)->thread.ptr = *pack;
 	(*pack)->thread.thread_create_callback = &pack_thread_create_callback;
 	(*pack)->thread.thread_finish_callback = &pack_thread_finish_callback;
 	(*pack)->thread.read_callback = &pack_read_callback;
+	(*pack)->thread.write_callback = &pack_write_callback;
 	(*pack)->thread.finish_callback = &pack_finish_callback;
 	(*pack)->thread.threads = glc_threads_hint(glc);
+	(*pack)->thread.name = "pack";
+	(*pack)->thread.stats = &(*pack)->thread_stats;
+
+	slice_pool_init(&(*pack)->pool, glc, *pack);
+	pthread_mutex_init(&(*pack)->ctl_mutex, NULL);
 
 	return 0;
-#endif
 }
 
 int pack_set_compression(pack_t pack, int compression)
 {
+	int ret;
+
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	if (unlikely((ret = pack_codec_init(pack, compression, &pack->write_callback))))
+		return ret;
+	glc_log(pack->glc, GLC_INFO, "pack",
+		 "compressing using %s", pack_codec_name(compression));
+
+	pack->compression = compression;
+	return 0;
+}
+
+int pack_set_adaptive(pack_t pack, int adaptive)
+{
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	pack->adaptive = adaptive;
+	if (adaptive)
+		glc_log(pack->glc, GLC_INFO, "pack",
+			 "choosing compression for each message");
+	return 0;
+}
+
+int pack_set_strong_compression(pack_t pack, int compression)
+{
+	int ret;
+
 	if (unlikely(pack->running))
 		return EALREADY;
 
+	if (!compression) {
+		pack->strong = 0;
+		return 0;
+	}
+
+	/* adaptive compression must not change what is decoded */
+	if (unlikely(compression == PACK_JPEG)) {
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			 "lossy compression can't be the strong compression");
+		return EINVAL;
+	}
+
+	if (unlikely((ret = pack_codec_init(pack, compression,
+					    &pack->strong_write_callback))))
+		return ret;
+	glc_log(pack->glc, GLC_INFO, "pack",
+		 "strong compression using %s", pack_codec_name(compression));
+
+	pack->strong = compression;
+	return 0;
+}
+
+/**
+ * \brief check compression support
+ * \param pack pack object
+ * \param compression compression algorithm
+ * \param callback where to store write callback of compression
+ * \return 0 on success otherwise an error code
+ */
+int pack_codec_init(pack_t pack, int compression, pack_write_callback_t *callback)
+{
 	if (compression == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
-		pack->thread.write_callback = &pack_quicklz_write_callback;
-		glc_log(pack->glc, GLC_INFO, "pack",
-			 "compressing using QuickLZ");
+		*callback = &pack_quicklz_write_callback;
 #else
 		glc_log(pack->glc, GLC_ERROR, "pack",
 			 "QuickLZ not supported");
@@ -146,9 +544,7 @@ int pack_set_compression(pack_t pack, int compression)
 #endif
 	} else if (compression == PACK_LZO) {
 #ifdef __LZO
-		pack->thread.write_callback = &pack_lzo_write_callback;
-		glc_log(pack->glc, GLC_INFO, "pack",
-			 "compressing using LZO");
+		*callback = &pack_lzo_write_callback;
 		lzo_init();
 #else
 		glc_log(pack->glc, GLC_ERROR, "pack",
@@ -157,13 +553,29 @@ int pack_set_compression(pack_t pack, int compression)
 #endif
 	} else if (compression == PACK_LZJB) {
 #ifdef __LZJB
-		pack->thread.write_callback = &pack_lzjb_write_callback;
-		glc_log(pack->glc, GLC_INFO, "pack",
-			"compressing using LZJB");
+		*callback = &pack_lzjb_write_callback;
 #else
 		glc_log(pack->glc, GLC_ERROR, "pack",
 			"LZJB not supported");
 		return ENOTSUP;
+#endif
+	} else if ((compression == PACK_LZ4) || (compression == PACK_LZ4HC)) {
+#ifdef __LZ4
+		*callback = &pack_lz4_write_callback;
+#else
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			"LZ4 not supported");
+		return ENOTSUP;
+#endif
+	} else if (compression == PACK_LOSSLESS) {
+		*callback = &pack_lossless_write_callback;
+	} else if (compression == PACK_JPEG) {
+#ifdef __JPEG
+		*callback = &pack_jpeg_write_callback;
+#else
+		glc_log(pack->glc, GLC_ERROR, "pack",
+			"JPEG not supported");
+		return ENOTSUP;
 #endif
 	} else {
 		glc_log(pack->glc, GLC_ERROR, "pack",
@@ -172,7 +584,6 @@ int pack_set_compression(pack_t pack, int compression)
 		return ENOTSUP;
 	}
 
-	pack->compression = compression;
 	return 0;
 }
 
@@ -188,6 +599,53 @@ int pack_set_minimum_size(pack_t pack, size_t min_size)
 	return 0;
 }
 
+int pack_set_delta_interval(pack_t pack, unsigned int interval)
+{
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	pack->delta_interval = interval;
+	if (interval)
+		glc_log(pack->glc, GLC_INFO, "pack",
+			 "delta encoding pictures, key frame every %u frames", interval);
+	return 0;
+}
+
+int pack_set_slices(pack_t pack, unsigned int slices)
+{
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	pack->slices = slices;
+	return 0;
+}
+
+int pack_set_jpeg_quality(pack_t pack, int quality)
+{
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	if (unlikely((quality < 1) || (quality > 100)))
+		return EINVAL;
+
+	pack->jpeg_quality = quality;
+	return 0;
+}
+
+int pack_set_filter(pack_t pack, glc_flags_t filter)
+{
+	if (unlikely(pack->running))
+		return EALREADY;
+
+	if (unlikely(filter & ~(GLC_FILTER_SHUFFLE | GLC_FILTER_PREDICT | GLC_FILTER_NO_ALPHA)))
+		return EINVAL;
+
+	pack->filter = filter;
+	if (filter)
+		glc_log(pack->glc, GLC_INFO, "pack", "filtering pictures before compression");
+	return 0;
+}
+
 int pack_process_start(pack_t pack, ps_buffer_t *from, ps_buffer_t *to)
 {
 	int ret;
@@ -200,8 +658,34 @@ int pack_process_start(pack_t pack, ps_buffer_t *from, ps_buffer_t *to)
 		return EINVAL;
 	}
 
-	if (unlikely((ret = glc_thread_create(pack->glc, &pack->thread, from, to))))
+	pack->wrkmem_size = pack_wrkmem_size(pack->compression);
+	if (pack->adaptive && pack->strong &&
+	    (pack_wrkmem_size(pack->strong) > pack->wrkmem_size))
+		pack->wrkmem_size = pack_wrkmem_size(pack->strong);
+
+	if (!pack->slices)
+		pack->slices = glc_threads_hint(pack->glc);
+	if (pack->slices > 1)
+		glc_log(pack->glc, GLC_INFO, "pack",
+			 "compressing large messages in up to %u slices", pack->slices);
+
+	/*
+	 * lossless coding splits each plane of a picture, JPEG coding
+	 * prepares lossless segments of YCbCr pictures and its own bands
+	 */
+	pack->slice_max = (pack->slices > 1) ? pack->slices : 0;
+	if ((pack->compression == PACK_LOSSLESS) || (pack->compression == PACK_JPEG) ||
+	    (pack->adaptive && (pack->strong == PACK_LOSSLESS)))
+		pack->slice_max = PACK_PLANES_MAX * pack->slices;
+
+	if (unlikely((ret = slice_pool_start(&pack->pool, pack->slices - 1,
+					     pack->wrkmem_size, pack->thread.name))))
+		return ret;
+
+	if (unlikely((ret = glc_thread_create(pack->glc, &pack->thread, from, to)))) {
+		slice_pool_stop(&pack->pool);
 		return ret;
+	}
 	pack->running = 1;
 
 	return 0;
@@ -213,14 +697,29 @@ int pack_process_wait(pack_t pack)
 		return EAGAIN;
 
 	glc_thread_wait(&pack->thread);
+	slice_pool_stop(&pack->pool);
 	pack->running = 0;
 
 	return 0;
 }
 
+int pack_get_stats(pack_t pack, glc_thread_stats_t *stats)
+{
+	memcpy(stats, &pack->thread_stats, sizeof(glc_thread_stats_t));
+	return 0;
+}
+
 int pack_destroy(pack_t pack)
 {
-	print_stats(pack->glc,&pack->stats);
+	print_stats(pack->glc, pack_codec_name(pack->compression), &pack->stats);
+	if (pack->adaptive)
+		glc_log(pack->glc, GLC_PERF, "pack",
+			 "stored %llu, fast %llu, strong %llu messages",
+			 (unsigned long long) pack->modes[PACK_MODE_STORE],
+			 (unsigned long long) pack->modes[PACK_MODE_FAST],
+			 (unsigned long long) pack->modes[PACK_MODE_STRONG]);
+	slice_pool_destroy(&pack->pool);
+	pthread_mutex_destroy(&pack->ctl_mutex);
 	free(pack);
 	return 0;
 }
@@ -228,44 +727,159 @@ int pack_destroy(pack_t pack)
 void pack_finish_callback(void *ptr, int err)
 {
 	pack_t pack = (pack_t) ptr;
+	struct pack_ctl_stream_s *ctl;
+	struct pack_video_s *video;
 
 	if (unlikely(err))
 		glc_log(pack->glc, GLC_ERROR, "pack", "%s (%d)", strerror(err), err);
+
+	delta_free_streams(&pack->delta);
+
+	while (pack->video != NULL) {
+		video = pack->video;
+		pack->video = video->next;
+		free(video);
+	}
+
+	while (pack->ctl != NULL) {
+		ctl = pack->ctl;
+		pack->ctl = ctl->next;
+		free(ctl);
+	}
 }
 
 int pack_thread_create_callback(void *ptr, void **threadptr)
 {
 	pack_t pack = (pack_t) ptr;
+	struct pack_thread_s *thread;
 
-	if (pack->compression == PACK_QUICKLZ) {
-#ifdef __QUICKLZ
-		*threadptr = malloc(sizeof(qlz_state_compress));
-#endif
-	} else if (pack->compression == PACK_LZO) {
-#ifdef __LZO
-		*threadptr = malloc(__lzo_wrk_mem);
-#endif
-	}
+	if (unlikely(!(thread = (struct pack_thread_s *)
+		       calloc(1, sizeof(struct pack_thread_s)))))
+		return ENOMEM;
+	*threadptr = thread;
+
+	if (pack->wrkmem_size &&
+	    unlikely(!(thread->wrkmem = malloc(pack->wrkmem_size))))
+		return ENOMEM;
+
+	if (pack->slice_max &&
+	    unlikely(!(thread->slice = (struct pack_slice_s *)
+		       calloc(pack->slice_max, sizeof(struct pack_slice_s)))))
+		return ENOMEM;
 
 	return 0;
 }
 
 void pack_thread_finish_callback(void *ptr, void *threadptr, int err)
 {
-	free(threadptr);
+	struct pack_thread_s *thread = (struct pack_thread_s *) threadptr;
+
+	if (thread) {
+		free(thread->wrkmem);
+		free(thread->slice);
+		free(thread->delta);
+		free(thread->filter);
+		free(thread);
+	}
 }
 
 int pack_read_callback(glc_thread_state_t *state)
 {
 	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	int ret;
+
+	if (!pack->adaptive)
+		return pack_read_message(pack, state);
+
+	/* time since this thread was done with its previous message */
+	thread->read_time = glc_time(pack->glc);
+	thread->idle = thread->write_time ? thread->read_time - thread->write_time : 0;
+
+	ret = pack_read_message(pack, state);
+
+	thread->read_time = glc_time(pack->glc);
+	return ret;
+}
+
+int pack_read_message(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	size_t worstcase;
+	int ret;
 
 	__sync_fetch_and_add(&pack->stats.unpack_size, state->read_size);
 
+	thread->codec = pack->compression;
+	thread->mode = PACK_MODE_FAST;
+	thread->ctl = NULL;
+	thread->jpeg_bands = 0;
+	if (pack->adaptive && (state->read_size > pack->compress_min) &&
+	    ((state->header.type == GLC_MESSAGE_VIDEO_FRAME) ||
+	     (state->header.type == GLC_MESSAGE_AUDIO_DATA))) {
+		/* deltas are always compressed */
+		if (unlikely((ret = pack_ctl_choose(pack, thread, state,
+				!(pack->delta_interval &&
+				  (state->header.type == GLC_MESSAGE_VIDEO_FRAME))))))
+			return ret;
+	}
+
+	/*
+	 * only YCbCr pictures are JPEG coded, everything else losslessly,
+	 * stored pictures aren't prepared at all
+	 */
+	if (thread->codec == PACK_JPEG) {
+		thread->codec = PACK_LOSSLESS;
+		if ((state->header.type == GLC_MESSAGE_VIDEO_FRAME) &&
+		    (thread->mode != PACK_MODE_STORE) &&
+		    (state->read_size > pack->compress_min) &&
+		    (worstcase = pack_jpeg_prepare(pack, thread, state))) {
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + worstcase;
+			return 0;
+		}
+	}
+
+	if (pack->delta_interval) {
+		/* every picture, even small ones, is the reference for next delta */
+		if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
+			return pack_delta_encode(pack, state);
+		else if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT)
+			pack_delta_reset(pack, ((glc_video_format_message_t *)
+						state->read_data)->id);
+		else if (state->header.type == GLC_CALLBACK_REQUEST)
+			pack_delta_reset(pack, 0); /* target may be reloaded */
+	}
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT) {
+		if (unlikely((ret = pack_video_format(pack,
+				(glc_video_format_message_t *) state->read_data))))
+			return ret;
+	}
+
+	/* lossless coding predicts pictures by itself */
+	if (pack->filter && (thread->codec != PACK_LOSSLESS) &&
+	    (state->header.type == GLC_MESSAGE_VIDEO_FRAME) &&
+	    (state->read_size > pack->compress_min) &&
+	    (thread->mode != PACK_MODE_STORE)) {
+		if (unlikely((ret = pack_filter_encode(pack, state))))
+			return ret;
+		if (thread->filter_header.filter_size)
+			return 0;
+	}
+
 	/* compress only audio and pictures */
 	if ((state->read_size > pack->compress_min) &&
+	    (thread->mode != PACK_MODE_STORE) &&
 	    ((state->header.type == GLC_MESSAGE_VIDEO_FRAME) ||
 	     (state->header.type == GLC_MESSAGE_AUDIO_DATA))) {
-		if (pack->compression == PACK_QUICKLZ) {
+		if (thread->codec == PACK_LOSSLESS) {
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + pack_lossless_prepare(pack, thread, state);
+		} else if (pack_slices_prepare(pack, thread, state->read_size)) {
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + pack_slices_worstcase(pack, thread);
+		} else if (thread->codec == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_quicklz_header_t)
@@ -273,7 +887,7 @@ int pack_read_callback(glc_thread_state_t *state)
 #else
 			goto copy;
 #endif
-		} else if (pack->compression == PACK_LZO) {
+		} else if (thread->codec == PACK_LZO) {
 #ifdef __LZO
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_lzo_header_t)
@@ -281,13 +895,22 @@ int pack_read_callback(glc_thread_state_t *state)
 #else
 			goto copy;
 #endif
-		} else if (pack->compression == PACK_LZJB) {
+		} else if (thread->codec == PACK_LZJB) {
 #ifdef __LZJB
 			state->write_size = sizeof(glc_container_message_header_t)
 					    + sizeof(glc_lzjb_header_t)
 					    + __lzjb_worstcase(state->read_size);
 #else
 			goto copy;
+#endif
+		} else if ((thread->codec == PACK_LZ4) ||
+			   (thread->codec == PACK_LZ4HC)) {
+#ifdef __LZ4
+			state->write_size = sizeof(glc_container_message_header_t)
+					    + sizeof(glc_lz4_header_t)
+					    + __lz4_worstcase(state->read_size);
+#else
+			goto copy;
 #endif
 		} else
 			goto copy;
@@ -308,10 +931,18 @@ int pack_lzo_write_callback(glc_thread_state_t *state)
 		(glc_lzo_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
 	lzo_uint compressed_size;
 
+	if (((struct pack_thread_s *) state->threadptr)->delta_size)
+		return pack_delta_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->filter_header.filter_size)
+		return pack_filter_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write_callback(state);
+
 	__lzo_compress((unsigned char *) state->read_data, state->read_size,
 		       (unsigned char *) &state->write_data[sizeof(glc_lzo_header_t) +
 		       					    sizeof(glc_container_message_header_t)],
-		       &compressed_size, (lzo_voidp) state->threadptr);
+		       &compressed_size,
+		       (lzo_voidp) ((struct pack_thread_s *) state->threadptr)->wrkmem);
 
 	lzo_header->size = (glc_size_t) state->read_size;
 	memcpy(&lzo_header->header, &state->header, sizeof(glc_message_header_t));
@@ -336,12 +967,21 @@ int pack_quicklz_write_callback(glc_thread_state_t *state)
 	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
 	glc_quicklz_header_t *quicklz_header =
 		(glc_quicklz_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
-	size_t compressed_size =
+	size_t compressed_size;
+
+	if (((struct pack_thread_s *) state->threadptr)->delta_size)
+		return pack_delta_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->filter_header.filter_size)
+		return pack_filter_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write_callback(state);
+
+	compressed_size =
 	qlz_compress((const void *) state->read_data,
 			(void *) &state->write_data[sizeof(glc_quicklz_header_t) +
 			 			    sizeof(glc_container_message_header_t)],
 			 state->read_size,
-			 (qlz_state_compress *) state->threadptr);
+			 (qlz_state_compress *) ((struct pack_thread_s *) state->threadptr)->wrkmem);
 
 	quicklz_header->size = (glc_size_t) state->read_size;
 	memcpy(&quicklz_header->header, &state->header, sizeof(glc_message_header_t));
@@ -366,11 +1006,19 @@ int pack_lzjb_write_callback(glc_thread_state_t *state)
 	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
 	glc_lzjb_header_t *lzjb_header =
 		(glc_lzjb_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t compressed_size;
 
-	size_t compressed_size = lzjb_compress(state->read_data,
-					       &state->write_data[sizeof(glc_lzjb_header_t) +
-					       			  sizeof(glc_container_message_header_t)],
-					       state->read_size);
+	if (((struct pack_thread_s *) state->threadptr)->delta_size)
+		return pack_delta_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->filter_header.filter_size)
+		return pack_filter_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write_callback(state);
+
+	compressed_size = lzjb_compress(state->read_data,
+					&state->write_data[sizeof(glc_lzjb_header_t) +
+							   sizeof(glc_container_message_header_t)],
+					state->read_size);
 
 	lzjb_header->size = (glc_size_t) state->read_size;
 	memcpy(&lzjb_header->header, &state->header, sizeof(glc_message_header_t));
@@ -389,79 +1037,1169 @@ int pack_lzjb_write_callback(glc_thread_state_t *state)
 #endif
 }
 
-int unpack_init(unpack_t *unpack, glc_t *glc)
+int pack_lz4_write_callback(glc_thread_state_t *state)
 {
-	*unpack = (unpack_t) calloc(1, sizeof(struct unpack_s));
+#ifdef __LZ4
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_lz4_header_t *lz4_header =
+		(glc_lz4_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	size_t compressed_size;
 
-	(*unpack)->glc = glc;
+	if (((struct pack_thread_s *) state->threadptr)->delta_size)
+		return pack_delta_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->filter_header.filter_size)
+		return pack_filter_write_callback(state);
+	if (((struct pack_thread_s *) state->threadptr)->slices)
+		return pack_slices_write_callback(state);
 
-	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
-	(*unpack)->thread.ptr = *unpack;
-	(*unpack)->thread.thread_finish_callback = &unpack_thread_finish_callback;
-	(*unpack)->thread.read_callback = &unpack_read_callback;
-	(*unpack)->thread.write_callback = &unpack_write_callback;
-	(*unpack)->thread.finish_callback = &unpack_finish_callback;
-	(*unpack)->thread.threads = glc_threads_hint(glc);
+	compressed_size = pack_compress(((struct pack_thread_s *) state->threadptr)->codec,
+					((struct pack_thread_s *) state->threadptr)->wrkmem,
+					state->read_data, state->read_size,
+					&state->write_data[sizeof(glc_lz4_header_t) +
+							   sizeof(glc_container_message_header_t)]);
 
-#ifdef __LZO
-	lzo_init();
-#endif
+	lz4_header->size = (glc_size_t) state->read_size;
+	memcpy(&lz4_header->header, &state->header, sizeof(glc_message_header_t));
 
-	return 0;
-}
+	container->size = compressed_size + sizeof(glc_lz4_header_t);
+	container->header.type = GLC_MESSAGE_LZ4;
 
-int unpack_process_start(unpack_t unpack, ps_buffer_t *from, ps_buffer_t *to)
-{
-	int ret;
-	if (unlikely(unpack->running))
-		return EAGAIN;
+	state->header.type = GLC_MESSAGE_CONTAINER;
 
-	if (unlikely((ret = glc_thread_create(unpack->glc, &unpack->thread, from, to))))
-		return ret;
-	unpack->running = 1;
+	__sync_fetch_and_add(&((pack_t) state->ptr)->stats.pack_size,
+				compressed_size);
 
 	return 0;
+#else
+	return ENOTSUP;
+#endif
 }
 
-int unpack_process_wait(unpack_t unpack)
+/**
+ * \brief code segments chosen by pack_lossless_prepare()
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_lossless_write_callback(glc_thread_state_t *state)
 {
-	if (unlikely(!unpack->running))
-		return EAGAIN;
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	char *dst = &state->write_data[sizeof(glc_container_message_header_t)];
+	glc_slice_header_t *slice_header =
+		(glc_slice_header_t *) &dst[sizeof(glc_lossless_header_t)];
+	char *to = (char *) &slice_header[thread->slices];
+	size_t worstcase = 0;
+	unsigned int s;
+
+	if (thread->delta_size)
+		return pack_delta_write_callback(state);
+	if (thread->filter_header.filter_size)
+		return pack_filter_write_callback(state);
+
+	memcpy(to, state->read_data, thread->lossless_header.prefix);
+	to += thread->lossless_header.prefix;
+
+	for (s = 0; s < thread->slices; s++) {
+		thread->slice[s].dst = &to[worstcase];
+		worstcase += __lossless_worstcase(thread->slice[s].size);
+	}
 
-	glc_thread_wait(&unpack->thread);
-	unpack->running = 0;
+	slice_pool_run(&pack->pool, thread->slice, thread->slices, thread->wrkmem);
 
-	return 0;
-}
+	for (s = 0; s < thread->slices; s++) {
+		slice_header[s].size = thread->slice[s].size;
+		slice_header[s].compressed_size = thread->slice[s].dst_size;
+		if (thread->slice[s].dst != to)
+			memmove(to, thread->slice[s].dst, thread->slice[s].dst_size);
+		to += thread->slice[s].dst_size;
+	}
+
+	memcpy(dst, &thread->lossless_header, sizeof(glc_lossless_header_t));
+
+	container->size = to - dst;
+	container->header.type = GLC_MESSAGE_LOSSLESS;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+	thread->slices = 0;
+
+	__sync_fetch_and_add(&pack->stats.pack_size, container->size);
 
-int unpack_destroy(unpack_t unpack)
-{
-	print_stats(unpack->glc, &unpack->stats);
-	free(unpack);
 	return 0;
 }
 
-void unpack_finish_callback(void *ptr, int err)
+/**
+ * \brief code bands chosen by pack_jpeg_prepare()
+ *
+ * If a band doesn't fit in its worst case size, whole message is
+ * coded losslessly instead.
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_jpeg_write_callback(glc_thread_state_t *state)
 {
-	unpack_t unpack = (unpack_t) ptr;
+#ifdef __JPEG
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	char *dst = &state->write_data[sizeof(glc_container_message_header_t)];
+	glc_slice_header_t *slice_header =
+		(glc_slice_header_t *) &dst[sizeof(glc_jpeg_header_t)];
+	struct pack_slice_s *band = &thread->slice[thread->slices];
+	char *to = (char *) &slice_header[thread->jpeg_bands];
+	size_t worstcase = 0;
+	unsigned int s;
+
+	if (!thread->jpeg_bands)
+		return pack_lossless_write_callback(state);
+
+	memcpy(to, state->read_data, sizeof(glc_video_frame_header_t));
+	to += sizeof(glc_video_frame_header_t);
+
+	for (s = 0; s < thread->jpeg_bands; s++) {
+		band[s].dst = &to[worstcase];
+		worstcase += __jpeg_worstcase(band[s].size);
+	}
 
-	if (unlikely(err))
-		glc_log(unpack->glc, GLC_ERROR, "unpack", "%s (%d)", strerror(err), err);
-}
+	slice_pool_run(&pack->pool, band, thread->jpeg_bands, thread->wrkmem);
 
-void unpack_thread_finish_callback(void *ptr, void *threadptr, int err)
-{
-	free(threadptr);
-}
+	for (s = 0; s < thread->jpeg_bands; s++) {
+		if (unlikely(!band[s].dst_size)) {
+			glc_log(pack->glc, GLC_DEBUG, "pack",
+				 "JPEG band too large, coding picture losslessly");
+			thread->jpeg_bands = 0;
+			return pack_lossless_write_callback(state);
+		}
+	}
 
-int unpack_read_callback(glc_thread_state_t *state)
-{
-	unpack_t unpack = (unpack_t) state->ptr;
+	for (s = 0; s < thread->jpeg_bands; s++) {
+		slice_header[s].size = band[s].size;
+		slice_header[s].compressed_size = band[s].dst_size;
+		if (band[s].dst != to)
+			memmove(to, band[s].dst, band[s].dst_size);
+		to += band[s].dst_size;
+	}
 
-	if (state->header.type == GLC_MESSAGE_LZO) {
-#ifdef __LZO
-		state->write_size = ((glc_lzo_header_t *) state->read_data)->size;
-		return 0;
+	memcpy(dst, &thread->jpeg_header, sizeof(glc_jpeg_header_t));
+
+	container->size = to - dst;
+	container->header.type = GLC_MESSAGE_JPEG;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+	thread->slices = 0;
+	thread->jpeg_bands = 0;
+
+	__sync_fetch_and_add(&pack->stats.pack_size, container->size);
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+/**
+ * \brief time compression of a message
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_write_callback(glc_thread_state_t *state)
+{
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_utime_t start = glc_time(pack->glc);
+	int ret;
+
+	if (thread->mode == PACK_MODE_STRONG)
+		ret = pack->strong_write_callback(state);
+	else
+		ret = pack->write_callback(state);
+
+	thread->write_time = glc_time(pack->glc);
+	__sync_fetch_and_add(&pack->stats.codec_time, thread->write_time - start);
+	__sync_fetch_and_add(&pack->stats.codec_size, state->read_size);
+
+	if (thread->ctl && likely(!ret))
+		pack_ctl_update(pack, thread, state->read_size,
+				((glc_container_message_header_t *) state->write_data)->size,
+				start);
+	return ret;
+}
+
+/**
+ * \brief choose how to compress an audio or video message
+ * \param pack pack object
+ * \param thread thread private data
+ * \param state thread state
+ * \param can_store message may be written uncompressed
+ * \return 0 on success otherwise an error code
+ */
+int pack_ctl_choose(pack_t pack, struct pack_thread_s *thread,
+		    glc_thread_state_t *state, int can_store)
+{
+	/* both audio and video headers start with stream id */
+	glc_stream_id_t id = *((glc_stream_id_t *) state->read_data);
+	struct pack_ctl_stream_s *ctl = pack->ctl;
+	int prev;
+
+	while ((ctl != NULL) &&
+	       ((ctl->type != state->header.type) || (ctl->id != id)))
+		ctl = ctl->next;
+
+	/* read callbacks are called in stream order, list is only appended here */
+	if (!ctl) {
+		if (unlikely(!(ctl = (struct pack_ctl_stream_s *)
+			       calloc(1, sizeof(struct pack_ctl_stream_s)))))
+			return ENOMEM;
+		ctl->type = state->header.type;
+		ctl->id = id;
+		ctl->mode = PACK_MODE_FAST;
+		ctl->next = pack->ctl;
+		pack->ctl = ctl;
+	}
+
+	pthread_mutex_lock(&pack->ctl_mutex);
+	prev = ctl->mode;
+	thread->mode = pack_ctl_mode(pack, ctl, can_store);
+	pthread_mutex_unlock(&pack->ctl_mutex);
+
+	if (ctl->mode != prev)
+		glc_log(pack->glc, GLC_DEBUG, "pack",
+			 "%s %d: %s (ratio %.2f, load %.2f, blocked %.2f)",
+			 state->header.type == GLC_MESSAGE_VIDEO_FRAME ? "video" : "audio",
+			 id, ctl->mode == PACK_MODE_STORE ? "storing" :
+			 (ctl->mode == PACK_MODE_FAST ? "fast compression" : "strong compression"),
+			 ctl->ratio[PACK_MODE_FAST], pack->load, pack->blocked);
+
+	thread->ctl = ctl;
+	thread->codec = (thread->mode == PACK_MODE_STRONG) ? pack->strong : pack->compression;
+	pack->modes[thread->mode]++;
+	return 0;
+}
+
+/**
+ * \brief pick mode of next message of a stream
+ *
+ * Messages that hardly compress are stored. Otherwise the fast codec
+ * is used, unless pack threads are busy while output keeps up, then
+ * messages are stored, or output is blocked while threads have time
+ * left for the strong codec, then it is used. Fast codec is tried
+ * now and then to keep its estimates current.
+ * \param pack pack object
+ * \param ctl stream estimates
+ * \param can_store message may be written uncompressed
+ * \return mode of next message
+ */
+int pack_ctl_mode(pack_t pack, struct pack_ctl_stream_s *ctl, int can_store)
+{
+	int mode = PACK_MODE_FAST;
+
+	ctl->messages++;
+	if (!ctl->samples[PACK_MODE_FAST])
+		return PACK_MODE_FAST;
+
+	if (ctl->ratio[PACK_MODE_FAST] > PACK_CTL_STORE_RATIO)
+		mode = PACK_MODE_STORE;
+	else if ((pack->strong) && (pack->blocked > PACK_CTL_HIGH)) {
+		/* expected load with strong codec */
+		if ((!ctl->samples[PACK_MODE_STRONG]) || (pack->cost <= 0.0) ||
+		    (pack->load * ctl->cost[PACK_MODE_STRONG] / pack->cost < PACK_CTL_HIGH))
+			mode = PACK_MODE_STRONG;
+	} else if ((pack->load > PACK_CTL_HIGH) && (pack->blocked < PACK_CTL_LOW))
+		mode = PACK_MODE_STORE;
+
+	if ((mode == PACK_MODE_STORE) && (!can_store))
+		mode = PACK_MODE_FAST;
+	ctl->mode = mode;
+
+	if ((mode != PACK_MODE_FAST) && (!(ctl->messages % PACK_CTL_PROBE)))
+		return PACK_MODE_FAST;
+	return mode;
+}
+
+/**
+ * \brief update estimates with a compressed message
+ * \param pack pack object
+ * \param thread thread private data
+ * \param size uncompressed size
+ * \param packed_size compressed size
+ * \param start when compression started
+ */
+void pack_ctl_update(pack_t pack, struct pack_thread_s *thread,
+		     size_t size, size_t packed_size, glc_utime_t start)
+{
+	struct pack_ctl_stream_s *ctl = thread->ctl;
+	double busy = thread->write_time - start;
+	/* time between read and write callbacks is spent waiting for output */
+	double blocked = start - thread->read_time;
+	double idle = thread->idle;
+
+	pthread_mutex_lock(&pack->ctl_mutex);
+	pack_ctl_average(&ctl->ratio[thread->mode], (double) packed_size / size,
+			 ctl->samples[thread->mode]);
+	pack_ctl_average(&ctl->cost[thread->mode], busy / size,
+			 ctl->samples[thread->mode]);
+	ctl->samples[thread->mode]++;
+
+	pack_ctl_average(&pack->cost, busy / size, pack->cost > 0.0);
+	if (busy + blocked > 0.0)
+		pack_ctl_average(&pack->blocked, blocked / (busy + blocked), 1);
+	if (busy + idle > 0.0)
+		pack_ctl_average(&pack->load, busy / (busy + idle), 1);
+	pthread_mutex_unlock(&pack->ctl_mutex);
+
+	thread->ctl = NULL;
+}
+
+void pack_ctl_average(double *avg, double sample, unsigned int samples)
+{
+	if (!samples)
+		*avg = sample;
+	else
+		*avg += (sample - *avg) * PACK_CTL_WEIGHT;
+}
+
+/**
+ * \brief delta encode a picture
+ *
+ * Called in stream order. Tiles that changed since previous picture
+ * of the same stream are copied to the per-thread delta buffer and
+ * to the reference picture, compression is left to write callback
+ * so it still runs in parallel.
+ * \param pack pack object
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_delta_encode(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	struct pack_delta_stream_s *video;
+	const char *pic = &state->read_data[sizeof(glc_video_frame_header_t)];
+	size_t size = state->read_size - sizeof(glc_video_frame_header_t);
+	size_t tiles = (size + PACK_DELTA_TILE - 1) / PACK_DELTA_TILE;
+	size_t need, t, off, len;
+	unsigned char *bitmap;
+	char *to;
+	int ret, key;
+
+	if (unlikely((ret = delta_get_stream(&pack->delta,
+			((glc_video_frame_header_t *) state->read_data)->id, &video))))
+		return ret;
+
+	key = (!video->ref) || (video->size != size) ||
+	      (video->frames >= pack->delta_interval);
+	if (key) {
+		if (video->size != size) {
+			free(video->ref);
+			if (unlikely(!(video->ref = (char *) malloc(size)))) {
+				video->size = 0;
+				return ENOMEM;
+			}
+			video->size = size;
+		}
+		video->frames = 0;
+	}
+	video->frames++;
+
+	/* a delta can't be bigger than bitmap and whole picture */
+	need = sizeof(glc_video_frame_header_t) + (tiles + 7) / 8 + size;
+	if (thread->delta_alloc < need) {
+		free(thread->delta);
+		if (unlikely(!(thread->delta = (char *) malloc(need)))) {
+			thread->delta_alloc = 0;
+			return ENOMEM;
+		}
+		thread->delta_alloc = need;
+	}
+
+	memcpy(thread->delta, state->read_data, sizeof(glc_video_frame_header_t));
+	to = &thread->delta[sizeof(glc_video_frame_header_t)];
+
+	if (key) {
+		memcpy(video->ref, pic, size);
+		memcpy(to, pic, size);
+		to += size;
+	} else {
+		bitmap = (unsigned char *) to;
+		memset(bitmap, 0, (tiles + 7) / 8);
+		to += (tiles + 7) / 8;
+
+		for (t = 0, off = 0; t < tiles; t++, off += PACK_DELTA_TILE) {
+			len = (size - off < PACK_DELTA_TILE) ? size - off : PACK_DELTA_TILE;
+			if (!memcmp(&video->ref[off], &pic[off], len))
+				continue;
+
+			bitmap[t / 8] |= 1 << (t % 8);
+			memcpy(&video->ref[off], &pic[off], len);
+			memcpy(to, &pic[off], len);
+			to += len;
+		}
+	}
+
+	thread->delta_size = to - thread->delta;
+	thread->delta_flags = key ? GLC_DELTA_KEY : 0;
+	thread->frame_size = state->read_size;
+
+	state->write_size = sizeof(glc_container_message_header_t)
+			    + sizeof(glc_delta_header_t);
+	if (pack_slices_prepare(pack, thread, thread->delta_size))
+		state->write_size += pack_slices_worstcase(pack, thread);
+	else
+		state->write_size += pack_worstcase(thread->codec, thread->delta_size);
+	return 0;
+}
+
+/**
+ * \brief compress delta built in read callback
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_delta_write_callback(glc_thread_state_t *state)
+{
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	glc_delta_header_t *delta_header =
+		(glc_delta_header_t *) &state->write_data[sizeof(glc_container_message_header_t)];
+	char *dst = &state->write_data[sizeof(glc_delta_header_t) +
+				       sizeof(glc_container_message_header_t)];
+	size_t compressed_size;
+
+	if (thread->slices) {
+		compressed_size = pack_slices_compress(pack, thread, thread->delta,
+						       thread->delta_size, &state->header, dst);
+		delta_header->compression.type = GLC_MESSAGE_SLICES;
+	} else {
+		compressed_size = pack_compress(thread->codec, thread->wrkmem, thread->delta,
+						thread->delta_size, dst);
+		delta_header->compression.type = pack_message_type(thread->codec);
+	}
+
+	delta_header->size = thread->frame_size;
+	delta_header->delta_size = thread->delta_size;
+	delta_header->tile = PACK_DELTA_TILE;
+	delta_header->flags = thread->delta_flags;
+
+	container->size = compressed_size + sizeof(glc_delta_header_t);
+	container->header.type = GLC_MESSAGE_DELTA;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+	thread->delta_size = 0;
+	thread->slices = 0;
+
+	__sync_fetch_and_add(&pack->stats.pack_size, compressed_size);
+
+	return 0;
+}
+
+/**
+ * \brief write whole picture next
+ * \param pack pack object
+ * \param id video stream, 0 means all streams
+ */
+void pack_delta_reset(pack_t pack, glc_stream_id_t id)
+{
+	struct pack_delta_stream_s *video = pack->delta;
+
+	while (video != NULL) {
+		if ((!id) || (video->id == id))
+			video->frames = pack->delta_interval;
+		video = video->next;
+	}
+}
+
+/**
+ * \brief remember format of a video stream
+ * \param pack pack object
+ * \param format video format message
+ * \return 0 on success otherwise an error code
+ */
+int pack_video_format(pack_t pack, glc_video_format_message_t *format)
+{
+	struct pack_video_s *video = pack_video_get(pack, format->id);
+
+	if (video == NULL) {
+		if (unlikely(!(video = (struct pack_video_s *)
+			       calloc(1, sizeof(struct pack_video_s)))))
+			return ENOMEM;
+		video->id = format->id;
+		video->next = pack->video;
+		pack->video = video;
+	}
+
+	video->format = format->format;
+	video->width = format->width;
+	video->height = format->height;
+	video->row = video->width * ((format->format == GLC_VIDEO_BGRA) ? 4 : 3);
+	if ((format->flags & GLC_VIDEO_DWORD_ALIGNED) && (video->row % 8 != 0))
+		video->row += 8 - video->row % 8;
+	return 0;
+}
+
+struct pack_video_s *pack_video_get(pack_t pack, glc_stream_id_t id)
+{
+	struct pack_video_s *video = pack->video;
+
+	while (video != NULL) {
+		if (video->id == id)
+			break;
+		video = video->next;
+	}
+	return video;
+}
+
+/**
+ * \brief filter a picture
+ *
+ * Picture is rearranged in planes of bytes that compress better to
+ * the per-thread filter buffer. Compression is left to write callback
+ * so it still runs in parallel. Pictures of unknown or unsupported
+ * formats are left as is.
+ * \param pack pack object
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_filter_encode(pack_t pack, glc_thread_state_t *state)
+{
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_filter_header_t *filter_hdr = &thread->filter_header;
+	const unsigned char *pic = (const unsigned char *)
+				   &state->read_data[sizeof(glc_video_frame_header_t)];
+	struct pack_video_s *video;
+	struct pack_plane_s plane[PACK_PLANES_MAX];
+	unsigned int planes, p;
+	unsigned char *to;
+	size_t size, need;
+
+	filter_hdr->filter_size = 0;
+
+	video = pack_video_get(pack, ((glc_video_frame_header_t *) state->read_data)->id);
+	if (video == NULL)
+		return 0;
+
+	filter_hdr->format = video->format;
+	filter_hdr->width = video->width;
+	filter_hdr->height = video->height;
+	filter_hdr->row = video->row;
+	filter_hdr->alpha = 0;
+
+	/* interleaved pictures have to be shuffled in planes first */
+	if (video->format == GLC_VIDEO_YCBCR_420JPEG)
+		filter_hdr->filter = pack->filter & GLC_FILTER_PREDICT;
+	else if (pack->filter & GLC_FILTER_SHUFFLE)
+		filter_hdr->filter = pack->filter & (GLC_FILTER_SHUFFLE | GLC_FILTER_PREDICT);
+	else
+		return 0;
+
+	if ((!filter_hdr->filter) ||
+	    (!(planes = filter_planes(video->format, video->width, video->height,
+				      video->row, plane, &size))) ||
+	    (state->read_size != sizeof(glc_video_frame_header_t) + size))
+		return 0;
+
+	if ((planes == 4) && (pack->filter & GLC_FILTER_NO_ALPHA) &&
+	    filter_constant(&plane[3], pic, &filter_hdr->alpha)) {
+		filter_hdr->filter |= GLC_FILTER_NO_ALPHA;
+		planes = 3;
+	}
+
+	need = sizeof(glc_video_frame_header_t);
+	for (p = 0; p < planes; p++)
+		need += (size_t) plane[p].width * plane[p].height;
+
+	if (thread->filter_alloc < need) {
+		free(thread->filter);
+		if (unlikely(!(thread->filter = (char *) malloc(need)))) {
+			thread->filter_alloc = 0;
+			return ENOMEM;
+		}
+		thread->filter_alloc = need;
+	}
+
+	memcpy(thread->filter, state->read_data, sizeof(glc_video_frame_header_t));
+	to = (unsigned char *) &thread->filter[sizeof(glc_video_frame_header_t)];
+	for (p = 0; p < planes; p++)
+		to = filter_encode_plane(&plane[p], filter_hdr->filter & GLC_FILTER_PREDICT,
+					 pic, to);
+
+	filter_hdr->size = state->read_size;
+	filter_hdr->filter_size = need;
+
+	state->write_size = sizeof(glc_container_message_header_t)
+			    + sizeof(glc_filter_header_t);
+	if (pack_slices_prepare(pack, thread, need))
+		state->write_size += pack_slices_worstcase(pack, thread);
+	else
+		state->write_size += pack_worstcase(thread->codec, need);
+	return 0;
+}
+
+/**
+ * \brief compress picture filtered in read callback
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_filter_write_callback(glc_thread_state_t *state)
+{
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	char *dst = &state->write_data[sizeof(glc_filter_header_t) +
+				       sizeof(glc_container_message_header_t)];
+	size_t compressed_size;
+
+	if (thread->slices) {
+		compressed_size = pack_slices_compress(pack, thread, thread->filter,
+						       thread->filter_header.filter_size,
+						       &state->header, dst);
+		thread->filter_header.compression.type = GLC_MESSAGE_SLICES;
+	} else {
+		compressed_size = pack_compress(thread->codec, thread->wrkmem, thread->filter,
+						thread->filter_header.filter_size, dst);
+		thread->filter_header.compression.type = pack_message_type(thread->codec);
+	}
+
+	memcpy(&state->write_data[sizeof(glc_container_message_header_t)],
+	       &thread->filter_header, sizeof(glc_filter_header_t));
+
+	container->size = compressed_size + sizeof(glc_filter_header_t);
+	container->header.type = GLC_MESSAGE_FILTER;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+	thread->filter_header.filter_size = 0;
+	thread->slices = 0;
+
+	__sync_fetch_and_add(&pack->stats.pack_size, compressed_size);
+
+	return 0;
+}
+
+size_t pack_worstcase(int compression, size_t size)
+{
+#ifdef __QUICKLZ
+	if (compression == PACK_QUICKLZ)
+		return __quicklz_worstcase(size);
+#endif
+#ifdef __LZO
+	if (compression == PACK_LZO)
+		return __lzo_worstcase(size);
+#endif
+#ifdef __LZJB
+	if (compression == PACK_LZJB)
+		return __lzjb_worstcase(size);
+#endif
+#ifdef __LZ4
+	if ((compression == PACK_LZ4) || (compression == PACK_LZ4HC))
+		return __lz4_worstcase(size);
+#endif
+	if (compression == PACK_LOSSLESS)
+		return __lossless_worstcase(size);
+	return size;
+}
+
+size_t pack_compress(int compression, void *wrkmem, const char *src, size_t size, char *dst)
+{
+#ifdef __LZO
+	lzo_uint compressed_size;
+#endif
+
+	if (compression == PACK_QUICKLZ) {
+#ifdef __QUICKLZ
+		return qlz_compress((const void *) src, (void *) dst, size,
+				    (qlz_state_compress *) wrkmem);
+#endif
+	} else if (compression == PACK_LZO) {
+#ifdef __LZO
+		__lzo_compress((unsigned char *) src, size, (unsigned char *) dst,
+			       &compressed_size, (lzo_voidp) wrkmem);
+		return compressed_size;
+#endif
+	} else if (compression == PACK_LZJB) {
+#ifdef __LZJB
+		return lzjb_compress((void *) src, dst, size);
+#endif
+	} else if (compression == PACK_LZ4) {
+#ifdef __LZ4
+		return LZ4_compress_fast_extState(wrkmem, src, dst, size,
+						  __lz4_worstcase(size), 1);
+#endif
+	} else if (compression == PACK_LZ4HC) {
+#ifdef __LZ4
+		return LZ4_compress_HC_extStateHC(wrkmem, src, dst, size,
+						  __lz4_worstcase(size),
+						  LZ4HC_CLEVEL_DEFAULT);
+#endif
+	} else if (compression == PACK_LOSSLESS) {
+		return lossless_compress((const unsigned char *) src, size, 0, 0, 0,
+					 (unsigned char *) dst);
+	}
+
+	return 0;
+}
+
+size_t pack_wrkmem_size(int compression)
+{
+#ifdef __QUICKLZ
+	if (compression == PACK_QUICKLZ)
+		return sizeof(qlz_state_compress);
+#endif
+#ifdef __LZO
+	if (compression == PACK_LZO)
+		return __lzo_wrk_mem;
+#endif
+#ifdef __LZ4
+	if (compression == PACK_LZ4)
+		return LZ4_sizeofState();
+	if (compression == PACK_LZ4HC)
+		return LZ4_sizeofStateHC();
+#endif
+	return 0;
+}
+
+glc_message_type_t pack_message_type(int compression)
+{
+	if (compression == PACK_QUICKLZ)
+		return GLC_MESSAGE_QUICKLZ;
+	else if (compression == PACK_LZO)
+		return GLC_MESSAGE_LZO;
+	else if ((compression == PACK_LZ4) || (compression == PACK_LZ4HC))
+		return GLC_MESSAGE_LZ4;
+	else if (compression == PACK_LOSSLESS)
+		return GLC_MESSAGE_LOSSLESS;
+	return GLC_MESSAGE_LZJB;
+}
+
+const char *pack_codec_name(int compression)
+{
+	switch (compression) {
+	case PACK_QUICKLZ:
+		return "QuickLZ";
+	case PACK_LZO:
+		return "LZO";
+	case PACK_LZJB:
+		return "LZJB";
+	case PACK_LZ4:
+		return "LZ4";
+	case PACK_LZ4HC:
+		return "LZ4-HC";
+	case PACK_LOSSLESS:
+		return "lossless";
+	case PACK_JPEG:
+		return "JPEG";
+	}
+	return "none";
+}
+
+/**
+ * \brief choose slices for a message
+ * \param pack pack object
+ * \param thread thread private data
+ * \param size message size
+ * \return number of slices, 0 if message isn't worth splitting
+ */
+unsigned int pack_slices_prepare(pack_t pack, struct pack_thread_s *thread, size_t size)
+{
+	size_t slices = size / PACK_SLICE_MIN;
+
+	if (slices > pack->slices)
+		slices = pack->slices;
+	if (slices < 2) {
+		thread->slices = 0;
+		return 0;
+	}
+
+	/* keep slices cache line aligned, last one gets the remainder */
+	thread->slice_size = ((size + slices - 1) / slices + 63) & ~((size_t) 63);
+	thread->slices = (size + thread->slice_size - 1) / thread->slice_size;
+	return thread->slices;
+}
+
+size_t pack_slices_worstcase(pack_t pack, struct pack_thread_s *thread)
+{
+	return sizeof(glc_slices_header_t) +
+	       thread->slices * (sizeof(glc_slice_header_t) +
+				 pack_worstcase(thread->codec, thread->slice_size));
+}
+
+/**
+ * \brief compress a message in slices
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int pack_slices_write_callback(glc_thread_state_t *state)
+{
+	pack_t pack = (pack_t) state->ptr;
+	struct pack_thread_s *thread = (struct pack_thread_s *) state->threadptr;
+	glc_container_message_header_t *container = (glc_container_message_header_t *) state->write_data;
+	size_t compressed_size;
+
+	compressed_size = pack_slices_compress(pack, thread, state->read_data, state->read_size,
+					       &state->header,
+					       &state->write_data[sizeof(glc_container_message_header_t)]);
+
+	container->size = compressed_size;
+	container->header.type = GLC_MESSAGE_SLICES;
+
+	state->header.type = GLC_MESSAGE_CONTAINER;
+	thread->slices = 0;
+
+	__sync_fetch_and_add(&pack->stats.pack_size, compressed_size);
+
+	return 0;
+}
+
+/**
+ * \brief split a message in segments for lossless coding
+ *
+ * Each plane of a picture of known format is split in bands of rows,
+ * other messages in consecutive segments. Segments are coded in
+ * parallel by the slice pool.
+ * \param pack pack object
+ * \param thread thread private data
+ * \param state thread state
+ * \return worst case size of lossless-compressed message
+ */
+size_t pack_lossless_prepare(pack_t pack, struct pack_thread_s *thread,
+			     glc_thread_state_t *state)
+{
+	glc_lossless_header_t *lossless_hdr = &thread->lossless_header;
+	struct pack_slice_s *slice = thread->slice;
+	struct pack_plane_s plane[PACK_PLANES_MAX];
+	struct pack_video_s *video = NULL;
+	const char *pic;
+	unsigned int planes = 0, p, bands, rows, y;
+	size_t size, chunk, off, worstcase;
+
+	memset(lossless_hdr, 0, sizeof(glc_lossless_header_t));
+	lossless_hdr->size = state->read_size;
+	memcpy(&lossless_hdr->header, &state->header, sizeof(glc_message_header_t));
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
+		video = pack_video_get(pack, ((glc_video_frame_header_t *) state->read_data)->id);
+	if (video != NULL) {
+		planes = filter_planes(video->format, video->width, video->height,
+				       video->row, plane, &size);
+		if (state->read_size != sizeof(glc_video_frame_header_t) + size)
+			planes = 0;
+	}
+
+	thread->slices = 0;
+	if (planes) {
+		lossless_hdr->format = video->format;
+		lossless_hdr->width = video->width;
+		lossless_hdr->height = video->height;
+		lossless_hdr->row = video->row;
+		lossless_hdr->prefix = sizeof(glc_video_frame_header_t);
+		pic = &state->read_data[sizeof(glc_video_frame_header_t)];
+
+		for (p = 0; p < planes; p++) {
+			bands = (size_t) plane[p].width * plane[p].height / PACK_SLICE_MIN;
+			if (bands > pack->slices)
+				bands = pack->slices;
+			if (bands < 1)
+				bands = 1;
+			rows = (plane[p].height + bands - 1) / bands;
+
+			for (y = 0; y < plane[p].height; y += rows) {
+				slice[thread->slices].src = &pic[plane[p].offset + y * plane[p].pitch];
+				slice[thread->slices].size = (size_t) plane[p].width *
+					((plane[p].height - y < rows) ? plane[p].height - y : rows);
+				slice[thread->slices].width = plane[p].width;
+				slice[thread->slices].step = plane[p].step;
+				slice[thread->slices].pitch = plane[p].pitch;
+				thread->slices++;
+			}
+		}
+	} else {
+		bands = state->read_size / PACK_SLICE_MIN;
+		if (bands > pack->slices)
+			bands = pack->slices;
+		if (bands < 1)
+			bands = 1;
+		chunk = ((state->read_size + bands - 1) / bands + 63) & ~((size_t) 63);
+
+		for (off = 0; off < state->read_size; off += chunk) {
+			slice[thread->slices].src = &state->read_data[off];
+			slice[thread->slices].size = (state->read_size - off < chunk) ?
+						     state->read_size - off : chunk;
+			slice[thread->slices].width = 0;
+			thread->slices++;
+		}
+	}
+	lossless_hdr->segments = thread->slices;
+
+	worstcase = sizeof(glc_lossless_header_t) + lossless_hdr->prefix +
+		    thread->slices * sizeof(glc_slice_header_t);
+	for (p = 0; p < thread->slices; p++) {
+		slice[p].codec = PACK_LOSSLESS;
+		worstcase += __lossless_worstcase(slice[p].size);
+	}
+	return worstcase;
+}
+
+/**
+ * \brief split a YCbCr picture in bands for JPEG coding
+ *
+ * Bands are a multiple of 16 rows high so they join without seams
+ * between chroma rows. Lossless segments are prepared too, picture is
+ * coded with them if a band doesn't fit.
+ * \param pack pack object
+ * \param thread thread private data
+ * \param state thread state
+ * \return worst case size of compressed message, 0 if picture can't
+ *         be JPEG coded
+ */
+size_t pack_jpeg_prepare(pack_t pack, struct pack_thread_s *thread,
+			 glc_thread_state_t *state)
+{
+#ifdef __JPEG
+	glc_jpeg_header_t *jpeg_hdr = &thread->jpeg_header;
+	struct pack_video_s *video;
+	struct pack_slice_s *band;
+	unsigned int bands, rows, y;
+	size_t size, worstcase, lossless;
+
+	video = pack_video_get(pack, ((glc_video_frame_header_t *) state->read_data)->id);
+	if ((video == NULL) || (video->format != GLC_VIDEO_YCBCR_420JPEG) ||
+	    (!video->width) || (!video->height) ||
+	    (video->width & 1) || (video->height & 1))
+		return 0;
+
+	size = (size_t) video->width * video->height * 3 / 2;
+	if (state->read_size != sizeof(glc_video_frame_header_t) + size)
+		return 0;
+
+	lossless = pack_lossless_prepare(pack, thread, state);
+	band = &thread->slice[thread->slices];
+
+	bands = size / PACK_SLICE_MIN;
+	if (bands > pack->slices)
+		bands = pack->slices;
+	if (bands < 1)
+		bands = 1;
+	rows = ((video->height + bands - 1) / bands + 15) & ~15u;
+
+	worstcase = sizeof(glc_jpeg_header_t) + sizeof(glc_video_frame_header_t);
+	for (y = 0; y < video->height; y += rows) {
+		band[thread->jpeg_bands].src = &state->read_data[sizeof(glc_video_frame_header_t)];
+		band[thread->jpeg_bands].codec = PACK_JPEG;
+		band[thread->jpeg_bands].width = video->width;
+		band[thread->jpeg_bands].height = video->height;
+		band[thread->jpeg_bands].y = y;
+		band[thread->jpeg_bands].rows = (video->height - y < rows) ?
+						video->height - y : rows;
+		band[thread->jpeg_bands].size = (size_t) video->width *
+						band[thread->jpeg_bands].rows * 3 / 2;
+		band[thread->jpeg_bands].quality = pack->jpeg_quality;
+		worstcase += sizeof(glc_slice_header_t) +
+			     __jpeg_worstcase(band[thread->jpeg_bands].size);
+		thread->jpeg_bands++;
+	}
+
+	memset(jpeg_hdr, 0, sizeof(glc_jpeg_header_t));
+	jpeg_hdr->size = state->read_size;
+	memcpy(&jpeg_hdr->header, &state->header, sizeof(glc_message_header_t));
+	jpeg_hdr->width = video->width;
+	jpeg_hdr->height = video->height;
+	jpeg_hdr->quality = pack->jpeg_quality;
+	jpeg_hdr->bands = thread->jpeg_bands;
+
+	return (worstcase > lossless) ? worstcase : lossless;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * \brief compress slices chosen by pack_slices_prepare()
+ *
+ * Slices are handed to the slice pool and compressed in place at
+ * their worst case offset, then moved next to each other.
+ * \param pack pack object
+ * \param thread thread private data
+ * \param src data to compress
+ * \param size data size
+ * \param header original message header
+ * \param dst where to write glc_slices_header_t and slices
+ * \return size written to dst
+ */
+size_t pack_slices_compress(pack_t pack, struct pack_thread_s *thread,
+			    const char *src, size_t size,
+			    glc_message_header_t *header, char *dst)
+{
+	glc_slices_header_t *slices_header = (glc_slices_header_t *) dst;
+	glc_slice_header_t *slice_header =
+		(glc_slice_header_t *) &dst[sizeof(glc_slices_header_t)];
+	char *to = (char *) &slice_header[thread->slices];
+	size_t worstcase = pack_worstcase(thread->codec, thread->slice_size);
+	unsigned int s;
+
+	for (s = 0; s < thread->slices; s++) {
+		thread->slice[s].src = &src[s * thread->slice_size];
+		thread->slice[s].size = (s + 1 < thread->slices) ? thread->slice_size :
+					size - s * thread->slice_size;
+		thread->slice[s].dst = &to[s * worstcase];
+		thread->slice[s].codec = thread->codec;
+		thread->slice[s].width = 0;
+	}
+
+	slice_pool_run(&pack->pool, thread->slice, thread->slices, thread->wrkmem);
+
+	for (s = 0; s < thread->slices; s++) {
+		slice_header[s].size = thread->slice[s].size;
+		slice_header[s].compressed_size = thread->slice[s].dst_size;
+		if (thread->slice[s].dst != to)
+			memmove(to, thread->slice[s].dst, thread->slice[s].dst_size);
+		to += thread->slice[s].dst_size;
+	}
+
+	slices_header->size = size;
+	memcpy(&slices_header->header, header, sizeof(glc_message_header_t));
+	slices_header->compression.type = pack_message_type(thread->codec);
+	slices_header->slices = thread->slices;
+
+	return to - dst;
+}
+
+int unpack_init(unpack_t *unpack, glc_t *glc)
+{
+	*unpack = (unpack_t) calloc(1, sizeof(struct unpack_s));
+
+	(*unpack)->glc = glc;
+
+	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ |
+				  GLC_THREAD_REORDER;
+	(*unpack)->thread.ptr = *unpack;
+	(*unpack)->thread.thread_create_callback = &unpack_thread_create_callback;
+	(*unpack)->thread.thread_finish_callback = &unpack_thread_finish_callback;
+	(*unpack)->thread.read_callback = &unpack_read_callback;
+	(*unpack)->thread.write_callback = &unpack_write_callback;
+	(*unpack)->thread.finish_callback = &unpack_finish_callback;
+	(*unpack)->thread.threads = glc_threads_hint(glc);
+	(*unpack)->thread.name = "unpack";
+	(*unpack)->thread.stats = &(*unpack)->thread_stats;
+
+	pthread_mutex_init(&(*unpack)->delta_mutex, NULL);
+	pthread_cond_init(&(*unpack)->delta_cond, NULL);
+	slice_pool_init(&(*unpack)->pool, glc, NULL);
+
+#ifdef __LZO
+	lzo_init();
+#endif
+
+	return 0;
+}
+
+int unpack_process_start(unpack_t unpack, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unlikely(unpack->running))
+		return EAGAIN;
+
+#ifdef __QUICKLZ
+	ret = slice_pool_start(&unpack->pool, unpack->thread.threads - 1,
+			       sizeof(qlz_state_decompress), unpack->thread.name);
+#else
+	ret = slice_pool_start(&unpack->pool, unpack->thread.threads - 1,
+			       0, unpack->thread.name);
+#endif
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely((ret = glc_thread_create(unpack->glc, &unpack->thread, from, to)))) {
+		slice_pool_stop(&unpack->pool);
+		return ret;
+	}
+	unpack->running = 1;
+
+	return 0;
+}
+
+int unpack_process_wait(unpack_t unpack)
+{
+	if (unlikely(!unpack->running))
+		return EAGAIN;
+
+	glc_thread_wait(&unpack->thread);
+	slice_pool_stop(&unpack->pool);
+	unpack->running = 0;
+
+	return 0;
+}
+
+int unpack_get_stats(unpack_t unpack, glc_thread_stats_t *stats)
+{
+	memcpy(stats, &unpack->thread_stats, sizeof(glc_thread_stats_t));
+	return 0;
+}
+
+int unpack_destroy(unpack_t unpack)
+{
+	print_stats(unpack->glc, NULL, &unpack->stats);
+	pthread_cond_destroy(&unpack->delta_cond);
+	pthread_mutex_destroy(&unpack->delta_mutex);
+	slice_pool_destroy(&unpack->pool);
+	free(unpack);
+	return 0;
+}
+
+void unpack_finish_callback(void *ptr, int err)
+{
+	unpack_t unpack = (unpack_t) ptr;
+
+	if (unlikely(err))
+		glc_log(unpack->glc, GLC_ERROR, "unpack", "%s (%d)", strerror(err), err);
+
+	delta_free_streams(&unpack->delta);
+	unpack->delta_seq = unpack->delta_next = 0;
+	unpack->delta_cancel = 0;
+}
+
+int unpack_thread_create_callback(void *ptr, void **threadptr)
+{
+	struct unpack_thread_s *thread;
+
+	if (unlikely(!(thread = (struct unpack_thread_s *)
+		       calloc(1, sizeof(struct unpack_thread_s)))))
+		return ENOMEM;
+	*threadptr = thread;
+
+#ifdef __QUICKLZ
+	if (unlikely(!(thread->qlz = malloc(sizeof(qlz_state_decompress)))))
+		return ENOMEM;
+#endif
+	return 0;
+}
+
+void unpack_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	unpack_t unpack = (unpack_t) ptr;
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) threadptr;
+
+	/* a delta this thread was to apply may never come */
+	if (unlikely(err)) {
+		pthread_mutex_lock(&unpack->delta_mutex);
+		unpack->delta_cancel = 1;
+		pthread_cond_broadcast(&unpack->delta_cond);
+		pthread_mutex_unlock(&unpack->delta_mutex);
+	}
+
+	if (thread) {
+		free(thread->qlz);
+		free(thread->slice);
+		free(thread->delta);
+		free(thread->filter);
+		free(thread);
+	}
+}
+
+int unpack_read_callback(glc_thread_state_t *state)
+{
+	unpack_t unpack = (unpack_t) state->ptr;
+
+	if (state->header.type == GLC_MESSAGE_LZO) {
+#ifdef __LZO
+		state->write_size = ((glc_lzo_header_t *) state->read_data)->size;
+		return 0;
 #else
 		glc_log(unpack->glc,
 			 GLC_ERROR, "unpack", "LZO not supported");
@@ -471,87 +2209,1723 @@ int unpack_read_callback(glc_thread_state_t *state)
 #ifdef __QUICKLZ
 		state->write_size = ((glc_quicklz_header_t *) state->read_data)->size;
 		return 0;
-#else
-		glc_log(unpack->glc,
-			 GLC_ERROR, "unpack", "QuickLZ not supported");
-		return ENOTSUP;
-#endif
-	} else if (state->header.type == GLC_MESSAGE_LZJB) {
-#ifdef __LZJB
-		state->write_size = ((glc_lzjb_header_t *) state->read_data)->size;
+#else
+		glc_log(unpack->glc,
+			 GLC_ERROR, "unpack", "QuickLZ not supported");
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_LZJB) {
+#ifdef __LZJB
+		state->write_size = ((glc_lzjb_header_t *) state->read_data)->size;
+		return 0;
+#else
+		glc_log(unpack->glc,
+			GLC_ERROR, "unpack", "LZJB not supported");
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_LZ4) {
+#ifdef __LZ4
+		state->write_size = ((glc_lz4_header_t *) state->read_data)->size;
+		return 0;
+#else
+		glc_log(unpack->glc,
+			GLC_ERROR, "unpack", "LZ4 not supported");
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_DELTA) {
+		/* read callbacks are called in stream order */
+		((struct unpack_thread_s *) state->threadptr)->seq = unpack->delta_seq++;
+		state->write_size = ((glc_delta_header_t *) state->read_data)->size;
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_SLICES) {
+		state->write_size = ((glc_slices_header_t *) state->read_data)->size;
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_FILTER) {
+		state->write_size = ((glc_filter_header_t *) state->read_data)->size;
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_LOSSLESS) {
+		state->write_size = ((glc_lossless_header_t *) state->read_data)->size;
+		return 0;
+	} else if (state->header.type == GLC_MESSAGE_JPEG) {
+#ifdef __JPEG
+		state->write_size = ((glc_jpeg_header_t *) state->read_data)->size;
+		return 0;
+#else
+		glc_log(unpack->glc,
+			GLC_ERROR, "unpack", "JPEG not supported");
+		return ENOTSUP;
+#endif
+	}
+	__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size);
+	__sync_fetch_and_add(&unpack->stats.unpack_size, state->read_size);
+	state->flags |= GLC_THREAD_COPY;
+	return 0;
+}
+
+/**
+ * \brief time decompression of a message
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int unpack_write_callback(glc_thread_state_t *state)
+{
+	unpack_t unpack = (unpack_t) state->ptr;
+	glc_utime_t start = glc_time(unpack->glc);
+	int ret;
+
+	ret = unpack_message_write(unpack, state);
+
+	__sync_fetch_and_add(&unpack->stats.codec_time, glc_time(unpack->glc) - start);
+	__sync_fetch_and_add(&unpack->stats.codec_size, state->write_size);
+	return ret;
+}
+
+int unpack_message_write(unpack_t unpack, glc_thread_state_t *state)
+{
+	int ret;
+
+	if (state->header.type == GLC_MESSAGE_LZO) {
+#ifdef __LZO
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size - sizeof(glc_lzo_header_t));
+		memcpy(&state->header, &((glc_lzo_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		__lzo_decompress((unsigned char *) &state->read_data[sizeof(glc_lzo_header_t)],
+				state->read_size - sizeof(glc_lzo_header_t),
+				(unsigned char *) state->write_data,
+				(lzo_uintp) &state->write_size,
+				NULL);
+#else
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_QUICKLZ) {
+#ifdef __QUICKLZ
+		__sync_fetch_and_add(&unpack->stats.pack_size,
+					state->read_size - sizeof(glc_quicklz_header_t));
+		memcpy(&state->header, &((glc_quicklz_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		qlz_decompress((const void *) &state->read_data[sizeof(glc_quicklz_header_t)],
+				(void *) state->write_data,
+				(qlz_state_decompress *)
+				((struct unpack_thread_s *) state->threadptr)->qlz);
+#else
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_LZJB) {
+#ifdef __LZJB
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size - sizeof(glc_lzjb_header_t));
+		memcpy(&state->header, &((glc_quicklz_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		lzjb_decompress(&state->read_data[sizeof(glc_lzjb_header_t)],
+				state->write_data,
+				state->read_size - sizeof(glc_lzjb_header_t),
+				state->write_size);
+#else
+		return ENOTSUP;
+#endif
+	} else if (state->header.type == GLC_MESSAGE_LZ4) {
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size - sizeof(glc_lz4_header_t));
+		memcpy(&state->header, &((glc_lz4_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if (unlikely((ret = unpack_decompress(GLC_MESSAGE_LZ4, NULL,
+				&state->read_data[sizeof(glc_lz4_header_t)],
+				state->read_size - sizeof(glc_lz4_header_t),
+				state->write_data, state->write_size)))) {
+			glc_log(unpack->glc, GLC_ERROR, "unpack", "broken LZ4 message");
+			return ret;
+		}
+	} else if (state->header.type == GLC_MESSAGE_SLICES) {
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size);
+		memcpy(&state->header, &((glc_slices_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if (unlikely((ret = unpack_slices(unpack,
+				(struct unpack_thread_s *) state->threadptr,
+				state->read_data, state->read_size,
+				state->write_data, state->write_size))))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_LOSSLESS) {
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size);
+		memcpy(&state->header, &((glc_lossless_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if (unlikely((ret = unpack_lossless(unpack,
+				(struct unpack_thread_s *) state->threadptr,
+				state->read_data, state->read_size,
+				state->write_data, state->write_size))))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_JPEG) {
+		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size);
+		memcpy(&state->header, &((glc_jpeg_header_t *) state->read_data)->header,
+		       sizeof(glc_message_header_t));
+		if (unlikely((ret = unpack_jpeg(unpack,
+				(struct unpack_thread_s *) state->threadptr,
+				state->read_data, state->read_size,
+				state->write_data, state->write_size))))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_DELTA)
+		return unpack_delta_write(unpack, state);
+	else if (state->header.type == GLC_MESSAGE_FILTER)
+		return unpack_filter_write(unpack, state);
+	else
+		return ENOTSUP;
+	__sync_fetch_and_add(&unpack->stats.unpack_size, state->write_size);
+	return 0;
+}
+
+/**
+ * \brief decode a delta-encoded picture
+ *
+ * Payload is decompressed in parallel with other threads, but
+ * deltas are applied one after another in the order they were read.
+ * Deltas before the first key frame of a stream are dropped.
+ * \param unpack unpack object
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int unpack_delta_write(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_delta_header_t *delta_hdr = (glc_delta_header_t *) state->read_data;
+	char *src = &state->read_data[sizeof(glc_delta_header_t)];
+	size_t src_size = state->read_size - sizeof(glc_delta_header_t);
+	int ret = 0;
+
+	if (thread->delta_alloc < delta_hdr->delta_size) {
+		free(thread->delta);
+		if (unlikely(!(thread->delta = (char *) malloc(delta_hdr->delta_size)))) {
+			thread->delta_alloc = 0;
+			ret = ENOMEM;
+		} else
+			thread->delta_alloc = delta_hdr->delta_size;
+	}
+
+	if (unlikely(ret)) {
+		/* nothing to do, still take turn below */
+	} else if (delta_hdr->compression.type == GLC_MESSAGE_SLICES) {
+		ret = unpack_slices(unpack, thread, src, src_size,
+				    thread->delta, delta_hdr->delta_size);
+	} else {
+		ret = unpack_decompress(delta_hdr->compression.type, thread->qlz,
+					src, src_size, thread->delta, delta_hdr->delta_size);
+		if (unlikely(ret == ENOTSUP))
+			glc_log(unpack->glc, GLC_ERROR, "unpack",
+				 "unsupported delta compression %s (%d)",
+				 glc_util_msgtype_to_str(delta_hdr->compression.type),
+				 delta_hdr->compression.type);
+		else if (unlikely(ret))
+			glc_log(unpack->glc, GLC_ERROR, "unpack", "broken delta");
+	}
+
+	pthread_mutex_lock(&unpack->delta_mutex);
+	while ((unpack->delta_next != thread->seq) && (!unpack->delta_cancel))
+		pthread_cond_wait(&unpack->delta_cond, &unpack->delta_mutex);
+
+	if (unlikely(unpack->delta_cancel))
+		ret = EINTR;
+	else if (likely(!ret))
+		ret = unpack_delta_apply(unpack, delta_hdr, thread->delta, state->write_data);
+
+	unpack->delta_next++;
+	pthread_cond_broadcast(&unpack->delta_cond);
+	pthread_mutex_unlock(&unpack->delta_mutex);
+
+	/* nothing to apply delta to yet */
+	if (ret == ENODATA) {
+		state->flags |= GLC_THREAD_STATE_CANCEL_WRITE;
+		return 0;
+	}
+	if (unlikely(ret))
+		return ret;
+
+	state->header.type = GLC_MESSAGE_VIDEO_FRAME;
+	__sync_fetch_and_add(&unpack->stats.pack_size, src_size);
+	__sync_fetch_and_add(&unpack->stats.unpack_size, state->write_size);
+	return 0;
+}
+
+/**
+ * \brief apply delta to reference picture
+ * \param unpack unpack object
+ * \param delta_hdr delta header
+ * \param delta decompressed payload
+ * \param to video frame message
+ * \return 0 on success, ENODATA if stream has had no key frame yet,
+ *         otherwise an error code
+ */
+int unpack_delta_apply(unpack_t unpack, glc_delta_header_t *delta_hdr,
+		       const char *delta, char *to)
+{
+	struct pack_delta_stream_s *video;
+	glc_video_frame_header_t *pic_hdr = (glc_video_frame_header_t *) delta;
+	const unsigned char *bitmap;
+	size_t size, avail, tiles, t, off, len;
+	int ret;
+
+	if (unlikely((delta_hdr->size < sizeof(glc_video_frame_header_t)) ||
+		     (delta_hdr->delta_size < sizeof(glc_video_frame_header_t)) ||
+		     (!delta_hdr->tile)))
+		goto broken;
+
+	size = delta_hdr->size - sizeof(glc_video_frame_header_t);
+	avail = delta_hdr->delta_size - sizeof(glc_video_frame_header_t);
+	delta += sizeof(glc_video_frame_header_t);
+
+	if (unlikely((ret = delta_get_stream(&unpack->delta, pic_hdr->id, &video))))
+		return ret;
+
+	if (delta_hdr->flags & GLC_DELTA_KEY) {
+		if (unlikely(avail < size))
+			goto broken;
+
+		if (video->size != size) {
+			free(video->ref);
+			if (unlikely(!(video->ref = (char *) malloc(size)))) {
+				video->size = 0;
+				return ENOMEM;
+			}
+			video->size = size;
+		}
+		memcpy(video->ref, delta, size);
+		if (unlikely(video->frames)) {
+			glc_log(unpack->glc, GLC_INFO, "unpack",
+				 "dropped %u frames of video %d before key frame",
+				 video->frames, pic_hdr->id);
+			video->frames = 0;
+		}
+	} else {
+		/* split streams may start in the middle of a key interval */
+		if (!video->ref) {
+			if (!video->frames++)
+				glc_log(unpack->glc, GLC_WARN, "unpack",
+					 "video %d starts without key frame", pic_hdr->id);
+			return ENODATA;
+		}
+		if (unlikely(video->size != size)) {
+			glc_log(unpack->glc, GLC_ERROR, "unpack",
+				 "delta for video %d without key frame", pic_hdr->id);
+			return EINVAL;
+		}
+
+		tiles = (size + delta_hdr->tile - 1) / delta_hdr->tile;
+		if (unlikely(avail < (tiles + 7) / 8))
+			goto broken;
+		bitmap = (const unsigned char *) delta;
+		delta += (tiles + 7) / 8;
+		avail -= (tiles + 7) / 8;
+
+		for (t = 0, off = 0; t < tiles; t++, off += delta_hdr->tile) {
+			if (!(bitmap[t / 8] & (1 << (t % 8))))
+				continue;
+
+			len = (size - off < delta_hdr->tile) ? size - off : delta_hdr->tile;
+			if (unlikely(avail < len))
+				goto broken;
+			memcpy(&video->ref[off], delta, len);
+			delta += len;
+			avail -= len;
+		}
+	}
+
+	memcpy(to, pic_hdr, sizeof(glc_video_frame_header_t));
+	memcpy(&to[sizeof(glc_video_frame_header_t)], video->ref, size);
+	return 0;
+
+broken:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "broken delta");
+	return EINVAL;
+}
+
+/**
+ * \brief decode a filtered picture
+ * \param unpack unpack object
+ * \param state thread state
+ * \return 0 on success otherwise an error code
+ */
+int unpack_filter_write(unpack_t unpack, glc_thread_state_t *state)
+{
+	struct unpack_thread_s *thread = (struct unpack_thread_s *) state->threadptr;
+	glc_filter_header_t *filter_hdr = (glc_filter_header_t *) state->read_data;
+	char *src = &state->read_data[sizeof(glc_filter_header_t)];
+	size_t src_size = state->read_size - sizeof(glc_filter_header_t);
+	struct pack_plane_s plane[PACK_PLANES_MAX];
+	const unsigned char *from;
+	unsigned char *pic;
+	unsigned int planes, p, x, y;
+	size_t size, need;
+	int ret;
+
+	planes = filter_planes(filter_hdr->format, filter_hdr->width, filter_hdr->height,
+			       filter_hdr->row, plane, &size);
+	if ((planes == 4) && (filter_hdr->filter & GLC_FILTER_NO_ALPHA))
+		planes = 3;
+
+	need = sizeof(glc_video_frame_header_t);
+	for (p = 0; p < planes; p++)
+		need += (size_t) plane[p].width * plane[p].height;
+
+	if (unlikely((!planes) ||
+		     (filter_hdr->size != sizeof(glc_video_frame_header_t) + size) ||
+		     (filter_hdr->filter_size != need) ||
+		     ((filter_hdr->format == GLC_VIDEO_YCBCR_420JPEG) ==
+		      !!(filter_hdr->filter & GLC_FILTER_SHUFFLE))))
+		goto broken;
+
+	if (thread->filter_alloc < need) {
+		free(thread->filter);
+		if (unlikely(!(thread->filter = (char *) malloc(need)))) {
+			thread->filter_alloc = 0;
+			return ENOMEM;
+		}
+		thread->filter_alloc = need;
+	}
+
+	if (filter_hdr->compression.type == GLC_MESSAGE_SLICES) {
+		if (unlikely((ret = unpack_slices(unpack, thread, src, src_size,
+						  thread->filter, need))))
+			return ret;
+	} else {
+		ret = unpack_decompress(filter_hdr->compression.type, thread->qlz,
+					src, src_size, thread->filter, need);
+		if (unlikely(ret == ENOTSUP)) {
+			glc_log(unpack->glc, GLC_ERROR, "unpack",
+				 "unsupported filter compression %s (%d)",
+				 glc_util_msgtype_to_str(filter_hdr->compression.type),
+				 filter_hdr->compression.type);
+			return ret;
+		} else if (unlikely(ret))
+			goto broken;
+	}
+
+	memcpy(state->write_data, thread->filter, sizeof(glc_video_frame_header_t));
+	pic = (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)];
+	from = (const unsigned char *) &thread->filter[sizeof(glc_video_frame_header_t)];
+
+	filter_clear_padding(&plane[0], pic);
+
+	for (p = 0; p < planes; p++)
+		from = filter_decode_plane(&plane[p], filter_hdr->filter & GLC_FILTER_PREDICT,
+					   from, pic);
+
+	if (filter_hdr->filter & GLC_FILTER_NO_ALPHA) {
+		for (y = 0; y < plane[3].height; y++) {
+			for (x = 0; x < plane[3].width; x++)
+				pic[plane[3].offset + y * plane[3].pitch + x * plane[3].step] =
+					filter_hdr->alpha;
+		}
+	}
+
+	state->header.type = GLC_MESSAGE_VIDEO_FRAME;
+	__sync_fetch_and_add(&unpack->stats.pack_size, src_size);
+	__sync_fetch_and_add(&unpack->stats.unpack_size, state->write_size);
+	return 0;
+
+broken:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "broken filtered picture");
+	return EINVAL;
+}
+
+/**
+ * \brief decode a lossless-compressed message
+ *
+ * Segments are handed to the slice pool and decoded in parallel.
+ * \param unpack unpack object
+ * \param thread thread private data
+ * \param src glc_lossless_header_t, segment headers, prefix and segments
+ * \param src_size size of src
+ * \param dst where to decode
+ * \param dst_size uncompressed size
+ * \return 0 on success otherwise an error code
+ */
+int unpack_lossless(unpack_t unpack, struct unpack_thread_s *thread,
+		    const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+	glc_lossless_header_t *lossless_hdr = (glc_lossless_header_t *) src;
+	glc_slice_header_t *slice_header;
+	struct pack_plane_s plane[PACK_PLANES_MAX];
+	struct pack_slice_s *slice;
+	unsigned int planes = 0, p = 0, s;
+	size_t size, off, rows, y = 0;
+	unsigned char *pic;
+	int ret;
+
+	if (unlikely((src_size < sizeof(glc_lossless_header_t)) ||
+		     (!lossless_hdr->segments) ||
+		     (lossless_hdr->size != dst_size) ||
+		     (lossless_hdr->prefix > dst_size) ||
+		     ((src_size - sizeof(glc_lossless_header_t)) / sizeof(glc_slice_header_t)
+		      < lossless_hdr->segments)))
+		goto broken;
+
+	slice_header = (glc_slice_header_t *) &src[sizeof(glc_lossless_header_t)];
+	src = (const char *) &slice_header[lossless_hdr->segments];
+	size = src_size - sizeof(glc_lossless_header_t)
+	       - lossless_hdr->segments * sizeof(glc_slice_header_t);
+	if (unlikely(size < lossless_hdr->prefix))
+		goto broken;
+
+	memcpy(dst, src, lossless_hdr->prefix);
+	src += lossless_hdr->prefix;
+	size -= lossless_hdr->prefix;
+	off = lossless_hdr->prefix;
+	pic = (unsigned char *) &dst[lossless_hdr->prefix];
+
+	if (lossless_hdr->format) {
+		planes = filter_planes(lossless_hdr->format, lossless_hdr->width,
+				       lossless_hdr->height, lossless_hdr->row, plane, &off);
+		if (unlikely((!planes) || (lossless_hdr->prefix + off != dst_size)))
+			goto broken;
+		filter_clear_padding(&plane[0], pic);
+	}
+
+	if (unlikely((ret = unpack_slices_alloc(thread, lossless_hdr->segments))))
+		return ret;
+
+	for (s = 0; s < lossless_hdr->segments; s++) {
+		slice = &thread->slice[s];
+		if (unlikely(slice_header[s].compressed_size > size))
+			goto broken;
+
+		slice->src = src;
+		slice->size = slice_header[s].compressed_size;
+		slice->dst_size = slice_header[s].size;
+		slice->compression = GLC_MESSAGE_LOSSLESS;
+
+		if (planes) {
+			/* a segment is a band of whole rows of current plane */
+			if (unlikely((p >= planes) || (!slice_header[s].size) ||
+				     (slice_header[s].size % plane[p].width)))
+				goto broken;
+			rows = slice_header[s].size / plane[p].width;
+			if (unlikely(rows > plane[p].height - y))
+				goto broken;
+
+			slice->dst = (char *) &pic[plane[p].offset + y * plane[p].pitch];
+			slice->width = plane[p].width;
+			slice->step = plane[p].step;
+			slice->pitch = plane[p].pitch;
+
+			if ((y += rows) == plane[p].height) {
+				p++;
+				y = 0;
+			}
+		} else {
+			if (unlikely(slice_header[s].size > dst_size - off))
+				goto broken;
+			slice->dst = &dst[off];
+			slice->width = 0;
+			off += slice_header[s].size;
+		}
+
+		src += slice_header[s].compressed_size;
+		size -= slice_header[s].compressed_size;
+	}
+
+	if (unlikely(planes ? (p != planes) : (off != dst_size)))
+		goto broken;
+
+	if (unlikely(slice_pool_run(&unpack->pool, thread->slice,
+				    lossless_hdr->segments, thread->qlz)))
+		goto broken;
+	return 0;
+
+broken:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "broken lossless message");
+	return EINVAL;
+}
+
+/**
+ * \brief decode a jpeg-compressed picture
+ *
+ * Bands are handed to the slice pool and decoded in parallel.
+ * \param unpack unpack object
+ * \param thread thread private data
+ * \param src glc_jpeg_header_t, band headers, picture header and bands
+ * \param src_size size of src
+ * \param dst where to decode
+ * \param dst_size uncompressed size
+ * \return 0 on success otherwise an error code
+ */
+int unpack_jpeg(unpack_t unpack, struct unpack_thread_s *thread,
+		const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+	glc_jpeg_header_t *jpeg_hdr = (glc_jpeg_header_t *) src;
+	glc_slice_header_t *slice_header;
+	struct pack_slice_s *slice;
+	size_t size, line;
+	unsigned int s, y = 0;
+	int ret;
+
+	if (unlikely((src_size < sizeof(glc_jpeg_header_t)) ||
+		     (!jpeg_hdr->bands) ||
+		     (jpeg_hdr->size != dst_size) ||
+		     (!jpeg_hdr->width) || (!jpeg_hdr->height) ||
+		     (jpeg_hdr->width & 1) || (jpeg_hdr->height & 1) ||
+		     (dst_size != sizeof(glc_video_frame_header_t) +
+				  (size_t) jpeg_hdr->width * jpeg_hdr->height * 3 / 2) ||
+		     ((src_size - sizeof(glc_jpeg_header_t)) / sizeof(glc_slice_header_t)
+		      < jpeg_hdr->bands)))
+		goto broken;
+
+	slice_header = (glc_slice_header_t *) &src[sizeof(glc_jpeg_header_t)];
+	src = (const char *) &slice_header[jpeg_hdr->bands];
+	size = src_size - sizeof(glc_jpeg_header_t)
+	       - jpeg_hdr->bands * sizeof(glc_slice_header_t);
+	if (unlikely(size < sizeof(glc_video_frame_header_t)))
+		goto broken;
+
+	memcpy(dst, src, sizeof(glc_video_frame_header_t));
+	src += sizeof(glc_video_frame_header_t);
+	size -= sizeof(glc_video_frame_header_t);
+
+	if (unlikely((ret = unpack_slices_alloc(thread, jpeg_hdr->bands))))
+		return ret;
+
+	/* a band is an even number of whole rows of all planes */
+	line = (size_t) jpeg_hdr->width * 3 / 2;
+	for (s = 0; s < jpeg_hdr->bands; s++) {
+		slice = &thread->slice[s];
+		if (unlikely((slice_header[s].compressed_size > size) ||
+			     (!slice_header[s].size) ||
+			     (slice_header[s].size % (2 * line)) ||
+			     (slice_header[s].size / line > jpeg_hdr->height - y)))
+			goto broken;
+
+		slice->src = src;
+		slice->size = slice_header[s].compressed_size;
+		slice->dst = &dst[sizeof(glc_video_frame_header_t)];
+		slice->dst_size = slice_header[s].size;
+		slice->compression = GLC_MESSAGE_JPEG;
+		slice->width = jpeg_hdr->width;
+		slice->height = jpeg_hdr->height;
+		slice->y = y;
+		slice->rows = slice_header[s].size / line;
+
+		y += slice->rows;
+		src += slice_header[s].compressed_size;
+		size -= slice_header[s].compressed_size;
+	}
+
+	if (unlikely(y != jpeg_hdr->height))
+		goto broken;
+
+	if (unlikely(slice_pool_run(&unpack->pool, thread->slice,
+				    jpeg_hdr->bands, thread->qlz)))
+		goto broken;
+	return 0;
+
+broken:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "broken JPEG message");
+	return EINVAL;
+}
+
+int unpack_slices_alloc(struct unpack_thread_s *thread, unsigned int slices)
+{
+	if (thread->slice_alloc >= slices)
+		return 0;
+
+	free(thread->slice);
+	if (unlikely(!(thread->slice = (struct pack_slice_s *)
+		       calloc(slices, sizeof(struct pack_slice_s))))) {
+		thread->slice_alloc = 0;
+		return ENOMEM;
+	}
+	thread->slice_alloc = slices;
+	return 0;
+}
+
+/**
+ * \brief decompress a slice-compressed message
+ *
+ * Slices are handed to the slice pool and decompressed in parallel.
+ * \param unpack unpack object
+ * \param thread thread private data
+ * \param src glc_slices_header_t, slice headers and slices
+ * \param src_size size of src
+ * \param dst where to decompress
+ * \param dst_size uncompressed size
+ * \return 0 on success otherwise an error code
+ */
+int unpack_slices(unpack_t unpack, struct unpack_thread_s *thread,
+		  const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+	glc_slices_header_t *slices_header = (glc_slices_header_t *) src;
+	glc_slice_header_t *slice_header;
+	size_t off = 0, size;
+	unsigned int s;
+	int ret;
+
+	/* JPEG bands are never a slice */
+	if (unlikely((src_size < sizeof(glc_slices_header_t)) ||
+		     (!slices_header->slices) ||
+		     (slices_header->compression.type == GLC_MESSAGE_JPEG) ||
+		     (slices_header->size != dst_size) ||
+		     ((src_size - sizeof(glc_slices_header_t)) / sizeof(glc_slice_header_t)
+		      < slices_header->slices)))
+		goto broken;
+
+	if (unlikely((ret = unpack_slices_alloc(thread, slices_header->slices))))
+		return ret;
+
+	slice_header = (glc_slice_header_t *) &src[sizeof(glc_slices_header_t)];
+	src = (const char *) &slice_header[slices_header->slices];
+	size = src_size - sizeof(glc_slices_header_t)
+	       - slices_header->slices * sizeof(glc_slice_header_t);
+
+	for (s = 0; s < slices_header->slices; s++) {
+		if (unlikely((slice_header[s].compressed_size > size) ||
+			     (slice_header[s].size > dst_size - off)))
+			goto broken;
+
+		thread->slice[s].src = src;
+		thread->slice[s].size = slice_header[s].compressed_size;
+		thread->slice[s].dst = &dst[off];
+		thread->slice[s].dst_size = slice_header[s].size;
+		thread->slice[s].compression = slices_header->compression.type;
+		thread->slice[s].width = 0;
+
+		src += slice_header[s].compressed_size;
+		size -= slice_header[s].compressed_size;
+		off += slice_header[s].size;
+	}
+
+	if (unlikely(off != dst_size))
+		goto broken;
+
+	ret = slice_pool_run(&unpack->pool, thread->slice, slices_header->slices, thread->qlz);
+	if (unlikely(ret == ENOTSUP))
+		glc_log(unpack->glc, GLC_ERROR, "unpack",
+			 "unsupported slice compression %s (%d)",
+			 glc_util_msgtype_to_str(slices_header->compression.type),
+			 slices_header->compression.type);
+	else if (unlikely(ret))
+		goto broken;
+	return ret;
+
+broken:
+	glc_log(unpack->glc, GLC_ERROR, "unpack", "broken slices");
+	return EINVAL;
+}
+
+int unpack_decompress(glc_message_type_t type, void *qlz,
+		      const char *src, size_t src_size, char *dst, size_t dst_size)
+{
+#ifdef __LZO
+	lzo_uint size = dst_size;
+#endif
+
+	if (type == GLC_MESSAGE_LZO) {
+#ifdef __LZO
+		__lzo_decompress((unsigned char *) src, src_size,
+				 (unsigned char *) dst, &size, NULL);
+		return 0;
+#endif
+	} else if (type == GLC_MESSAGE_QUICKLZ) {
+#ifdef __QUICKLZ
+		qlz_decompress(src, (void *) dst, (qlz_state_decompress *) qlz);
+		return 0;
+#endif
+	} else if (type == GLC_MESSAGE_LZJB) {
+#ifdef __LZJB
+		lzjb_decompress((void *) src, dst, src_size, dst_size);
+		return 0;
+#endif
+	} else if (type == GLC_MESSAGE_LZ4) {
+#ifdef __LZ4
+		/* unlike others, corrupted data is detected */
+		if (unlikely(LZ4_decompress_safe(src, dst, src_size, dst_size) != dst_size))
+			return EINVAL;
+		return 0;
+#endif
+	} else if (type == GLC_MESSAGE_LOSSLESS) {
+		return lossless_decompress((const unsigned char *) src, src_size,
+					   (unsigned char *) dst, dst_size, 0, 0, 0);
+	}
+
+	return ENOTSUP;
+}
+
+int delta_get_stream(struct pack_delta_stream_s **list, glc_stream_id_t id,
+		     struct pack_delta_stream_s **video)
+{
+	*video = *list;
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			return 0;
+		*video = (*video)->next;
+	}
+
+	if (unlikely(!(*video = (struct pack_delta_stream_s *)
+		       calloc(1, sizeof(struct pack_delta_stream_s)))))
+		return ENOMEM;
+
+	(*video)->id = id;
+	(*video)->next = *list;
+	*list = *video;
+	return 0;
+}
+
+void delta_free_streams(struct pack_delta_stream_s **list)
+{
+	struct pack_delta_stream_s *del;
+
+	while (*list != NULL) {
+		del = *list;
+		*list = del->next;
+		free(del->ref);
+		free(del);
+	}
+}
+
+/**
+ * \brief planes of a picture
+ * \param format picture format
+ * \param width width
+ * \param height height
+ * \param row bytes per row of interleaved pictures
+ * \param plane PACK_PLANES_MAX planes
+ * \param size picture size
+ * \return number of planes, 0 if format isn't supported
+ */
+unsigned int filter_planes(glc_video_format_t format, unsigned int width,
+			   unsigned int height, unsigned int row,
+			   struct pack_plane_s *plane, size_t *size)
+{
+	size_t w = width, h = height;
+	unsigned int bpp, c;
+
+	if ((!w) || (!h))
+		return 0;
+
+	if (format == GLC_VIDEO_YCBCR_420JPEG) {
+		if ((w < 2) || (h < 2))
+			return 0;
+
+		plane[0].offset = 0;
+		plane[0].width = plane[0].pitch = w;
+		plane[0].height = h;
+		for (c = 1; c < 3; c++) {
+			plane[c].offset = plane[c - 1].offset + plane[c - 1].pitch * plane[c - 1].height;
+			plane[c].width = plane[c].pitch = w / 2;
+			plane[c].height = h / 2;
+		}
+		for (c = 0; c < 3; c++)
+			plane[c].step = 1;
+		*size = plane[2].offset + plane[2].pitch * plane[2].height;
+		return 3;
+	}
+
+	if ((format == GLC_VIDEO_BGR) || (format == GLC_VIDEO_RGB))
+		bpp = 3;
+	else if (format == GLC_VIDEO_BGRA)
+		bpp = 4;
+	else
 		return 0;
-#else
-		glc_log(unpack->glc,
-			GLC_ERROR, "unpack", "LZJB not supported");
-		return ENOTSUP;
-#endif
+
+	if (row < w * bpp)
+		return 0;
+
+	for (c = 0; c < bpp; c++) {
+		plane[c].offset = c;
+		plane[c].step = bpp;
+		plane[c].pitch = row;
+		plane[c].width = w;
+		plane[c].height = h;
 	}
-	__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size);
-	__sync_fetch_and_add(&unpack->stats.unpack_size, state->read_size);
-	state->flags |= GLC_THREAD_COPY;
+	*size = row * h;
+	return bpp;
+}
+
+/**
+ * \brief zero row padding of an interleaved picture
+ * \param plane first plane of picture
+ * \param pic picture
+ */
+void filter_clear_padding(const struct pack_plane_s *plane, unsigned char *pic)
+{
+	size_t pad = plane->pitch - plane->width * plane->step;
+	unsigned int y;
+
+	if ((plane->step == 1) || (!pad))
+		return;
+
+	for (y = 0; y < plane->height; y++)
+		memset(&pic[y * plane->pitch + plane->pitch - pad], 0, pad);
+}
+
+/**
+ * \brief check if all bytes of a plane are equal
+ * \param plane plane
+ * \param pic picture
+ * \param value value of all bytes
+ * \return 1 if plane is constant, otherwise 0
+ */
+int filter_constant(const struct pack_plane_s *plane,
+		    const unsigned char *pic, u_int8_t *value)
+{
+	const unsigned char *src;
+	unsigned int x, y;
+
+	*value = pic[plane->offset];
+	for (y = 0; y < plane->height; y++) {
+		src = &pic[plane->offset + y * plane->pitch];
+		for (x = 0; x < plane->width; x++) {
+			if (src[x * plane->step] != *value)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+unsigned char *filter_encode_plane(const struct pack_plane_s *plane, int predict,
+				   const unsigned char *pic, unsigned char *to)
+{
+	const unsigned char *src;
+	unsigned int x, y;
+
+	for (y = 0; y < plane->height; y++) {
+		src = &pic[plane->offset + y * plane->pitch];
+		if (!predict) {
+			for (x = 0; x < plane->width; x++)
+				*to++ = src[x * plane->step];
+			continue;
+		}
+
+		*to++ = y ? src[0] - src[-(ptrdiff_t) plane->pitch] : src[0];
+		for (x = 1; x < plane->width; x++)
+			*to++ = src[x * plane->step] - src[(x - 1) * plane->step];
+	}
+	return to;
+}
+
+const unsigned char *filter_decode_plane(const struct pack_plane_s *plane, int predict,
+					 const unsigned char *from, unsigned char *pic)
+{
+	unsigned char *dst;
+	unsigned int x, y;
+
+	for (y = 0; y < plane->height; y++) {
+		dst = &pic[plane->offset + y * plane->pitch];
+		if (!predict) {
+			for (x = 0; x < plane->width; x++)
+				dst[x * plane->step] = *from++;
+			continue;
+		}
+
+		dst[0] = y ? dst[-(ptrdiff_t) plane->pitch] + *from++ : *from++;
+		for (x = 1; x < plane->width; x++)
+			dst[x * plane->step] = dst[(x - 1) * plane->step] + *from++;
+	}
+	return from;
+}
+
+/**
+ * \brief median predictor of LOCO-I
+ * \param a left neighbour
+ * \param b upper neighbour
+ * \param c upper left neighbour
+ * \return a + b - c clamped between a and b
+ */
+__inline__ static int lossless_med(int a, int b, int c)
+{
+	int min = a < b ? a : b, max = a < b ? b : a, p = a + b - c;
+
+	return p < min ? min : (p > max ? max : p);
+}
+
+/**
+ * \brief prediction residuals of a row of a picture band
+ *
+ * First row of a band is predicted from left neighbours only and
+ * first column from upper neighbours only.
+ * \param cur current row
+ * \param up previous row, NULL on first row
+ * \param width bytes per row
+ * \param step distance between bytes of a row
+ * \param res width residuals
+ */
+__inline__ static void lossless_residuals(const unsigned char *cur, const unsigned char *up,
+					  unsigned int width, size_t step, unsigned char *res)
+{
+	unsigned int x;
+
+	if (!up) {
+		res[0] = cur[0];
+		for (x = 1; x < width; x++)
+			res[x] = cur[x * step] - cur[(x - 1) * step];
+		return;
+	}
+
+	res[0] = cur[0] - up[0];
+	for (x = 1; x < width; x++)
+		res[x] = cur[x * step] - lossless_med(cur[(x - 1) * step], up[x * step],
+						      up[(x - 1) * step]);
+}
+
+__inline__ static void lossless_rans_put(u_int32_t *state, unsigned char **ptr,
+					 const struct pack_rans_sym_s *sym)
+{
+	u_int32_t x = *state, q;
+
+	while (x >= sym->x_max) {
+		*--(*ptr) = x & 0xff;
+		x >>= 8;
+	}
+
+	q = (u_int32_t) (((u_int64_t) x * sym->rcp_freq) >> 32) >> sym->rcp_shift;
+	*state = x + sym->bias + q * sym->cmpl_freq;
+}
+
+__inline__ static int lossless_rans_get(u_int32_t *state, const unsigned char **ptr,
+					const unsigned char *end, const u_int16_t *freq,
+					const u_int16_t *start, const unsigned char *slot)
+{
+	u_int32_t x = *state, mask = (1 << PACK_RANS_BITS) - 1;
+	unsigned char s = slot[x & mask];
+
+	x = freq[s] * (x >> PACK_RANS_BITS) + (x & mask) - start[s];
+	while (x < PACK_RANS_L) {
+		if (unlikely(*ptr == end))
+			return -1;
+		x = (x << 8) | *(*ptr)++;
+	}
+
+	*state = x;
+	return s;
+}
+
+/**
+ * \brief code a lossless segment
+ *
+ * Residuals are computed and counted first, then rANS coded
+ * backwards. Picture residuals are kept in dst where the coded
+ * stream ends up, the stream is written from the end of dst and
+ * must not catch up with residuals not coded yet. Segments that
+ * don't shrink are stored as is.
+ * \param src first byte of segment
+ * \param size number of bytes
+ * \param width bytes per row of a picture band, 0 for plain data
+ * \param step distance between bytes of a row
+ * \param pitch distance between rows
+ * \param dst at least __lossless_worstcase(size) bytes
+ * \return coded size
+ */
+size_t lossless_compress(const unsigned char *src, size_t size,
+			 unsigned int width, size_t step, size_t pitch,
+			 unsigned char *dst)
+{
+	struct pack_rans_sym_s sym[256];
+	u_int32_t count[256], state = PACK_RANS_L;
+	u_int16_t freq[256];
+	unsigned char *limit = &dst[1 + sizeof(freq) + sizeof(u_int32_t)];
+	unsigned char *ptr = &dst[__lossless_worstcase(size)];
+	const unsigned char *res = src;
+	size_t rows = width ? size / width : 0, x, y, coded;
+	unsigned int s, start;
+
+	if (unlikely(!size))
+		goto raw;
+
+	if (width) {
+		for (y = 0; y < rows; y++)
+			lossless_residuals(&src[y * pitch], y ? &src[(y - 1) * pitch] : NULL,
+					   width, step, &limit[y * width]);
+		res = limit;
+	}
+
+	memset(count, 0, sizeof(count));
+	for (x = 0; x < size; x++)
+		count[res[x]]++;
+
+	lossless_normalize(count, size, freq);
+	for (s = 0, start = 0; s < 256; start += freq[s], s++)
+		lossless_rans_init(&sym[s], start, freq[s]);
+
+	/* a symbol is at most two bytes */
+	if (!width) {
+		for (x = size; x > 0; x--) {
+			if (unlikely(ptr - limit < 2))
+				goto raw;
+			lossless_rans_put(&state, &ptr, &sym[res[x - 1]]);
+		}
+	} else {
+		for (x = size; x > 0; x--) {
+			if (unlikely(ptr - &res[x - 1] < 2))
+				goto raw;
+			lossless_rans_put(&state, &ptr, &sym[res[x - 1]]);
+		}
+	}
+
+	ptr -= sizeof(u_int32_t);
+	ptr[0] = state & 0xff;
+	ptr[1] = (state >> 8) & 0xff;
+	ptr[2] = (state >> 16) & 0xff;
+	ptr[3] = state >> 24;
+
+	coded = &dst[__lossless_worstcase(size)] - ptr;
+	if (sizeof(freq) + coded >= size)
+		goto raw;
+
+	dst[0] = PACK_LOSSLESS_RANS;
+	memcpy(&dst[1], freq, sizeof(freq));
+	memmove(&dst[1 + sizeof(freq)], ptr, coded);
+	return 1 + sizeof(freq) + coded;
+
+raw:
+	dst[0] = PACK_LOSSLESS_RAW;
+	if (!width)
+		memcpy(&dst[1], src, size);
+	else {
+		for (y = 0; y < rows; y++) {
+			for (x = 0; x < width; x++)
+				dst[1 + y * width + x] = src[y * pitch + x * step];
+		}
+	}
+	return 1 + size;
+}
+
+/**
+ * \brief decode a lossless segment
+ * \param src coded segment
+ * \param src_size coded size
+ * \param dst first byte of segment
+ * \param size number of bytes
+ * \param width bytes per row of a picture band, 0 for plain data
+ * \param step distance between bytes of a row
+ * \param pitch distance between rows
+ * \return 0 on success, EINVAL if segment is broken
+ */
+int lossless_decompress(const unsigned char *src, size_t src_size,
+			unsigned char *dst, size_t size,
+			unsigned int width, size_t step, size_t pitch)
+{
+	unsigned char slot[1 << PACK_RANS_BITS], *cur, *up;
+	u_int16_t freq[256], start[256];
+	const unsigned char *end = &src[src_size], *ptr;
+	size_t rows = width ? size / width : 0, x, y;
+	unsigned int s, total;
+	u_int32_t state;
+	int sym;
+
+	if (unlikely(!src_size))
+		return EINVAL;
+
+	if (src[0] == PACK_LOSSLESS_RAW) {
+		if (unlikely(src_size != 1 + size))
+			return EINVAL;
+		if (!width)
+			memcpy(dst, &src[1], size);
+		else {
+			for (y = 0; y < rows; y++) {
+				for (x = 0; x < width; x++)
+					dst[y * pitch + x * step] = src[1 + y * width + x];
+			}
+		}
+		return 0;
+	}
+
+	if (unlikely((src[0] != PACK_LOSSLESS_RANS) ||
+		     (src_size < 1 + sizeof(freq) + sizeof(u_int32_t))))
+		return EINVAL;
+
+	memcpy(freq, &src[1], sizeof(freq));
+	for (s = 0, total = 0; s < 256; s++) {
+		if (unlikely(freq[s] > (1 << PACK_RANS_BITS) - total))
+			return EINVAL;
+		start[s] = total;
+		memset(&slot[total], s, freq[s]);
+		total += freq[s];
+	}
+	if (unlikely(total != (1 << PACK_RANS_BITS)))
+		return EINVAL;
+
+	ptr = &src[1 + sizeof(freq)];
+	state = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((u_int32_t) ptr[3] << 24);
+	ptr += sizeof(u_int32_t);
+
+#define LOSSLESS_GET(to) \
+	if (unlikely((sym = lossless_rans_get(&state, &ptr, end, freq, start, slot)) < 0)) \
+		return EINVAL; \
+	to = sym
+
+	if (!width) {
+		for (x = 0; x < size; x++) {
+			LOSSLESS_GET(dst[x]);
+		}
+	} else {
+		for (y = 0; y < rows; y++) {
+			cur = &dst[y * pitch];
+			if (!y) {
+				LOSSLESS_GET(cur[0]);
+				for (x = 1; x < width; x++) {
+					LOSSLESS_GET(cur[x * step]);
+					cur[x * step] += cur[(x - 1) * step];
+				}
+				continue;
+			}
+
+			up = cur - pitch;
+			LOSSLESS_GET(cur[0]);
+			cur[0] += up[0];
+			for (x = 1; x < width; x++) {
+				LOSSLESS_GET(cur[x * step]);
+				cur[x * step] += lossless_med(cur[(x - 1) * step], up[x * step],
+							      up[(x - 1) * step]);
+			}
+		}
+	}
+#undef LOSSLESS_GET
+
+	/* encoder started from PACK_RANS_L */
+	if (unlikely((state != PACK_RANS_L) || (ptr != end)))
+		return EINVAL;
 	return 0;
 }
 
-int unpack_write_callback(glc_thread_state_t *state)
+/**
+ * \brief scale symbol counts to rANS frequencies
+ *
+ * Frequencies sum to 1 << PACK_RANS_BITS and symbols that occur
+ * keep a non-zero frequency.
+ * \param count symbol counts
+ * \param total sum of counts
+ * \param freq frequencies
+ */
+void lossless_normalize(const u_int32_t *count, size_t total, u_int16_t *freq)
 {
-	unpack_t unpack = (unpack_t) state->ptr;
+	unsigned int s, max = 0, sum = 0;
+
+	for (s = 0; s < 256; s++) {
+		freq[s] = ((u_int64_t) count[s] << PACK_RANS_BITS) / total;
+		if ((!freq[s]) && count[s])
+			freq[s] = 1;
+		sum += freq[s];
+		if (count[s] > count[max])
+			max = s;
+	}
 
-	if (state->header.type == GLC_MESSAGE_LZO) {
-#ifdef __LZO
-		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size - sizeof(glc_lzo_header_t));
-		memcpy(&state->header, &((glc_lzo_header_t *) state->read_data)->header,
-		       sizeof(glc_message_header_t));
-		__lzo_decompress((unsigned char *) &state->read_data[sizeof(glc_lzo_header_t)],
-				state->read_size - sizeof(glc_lzo_header_t),
-				(unsigned char *) state->write_data,
-				(lzo_uintp) &state->write_size,
-				NULL);
-#else
-		return ENOTSUP;
+	if (sum < (1 << PACK_RANS_BITS))
+		freq[max] += (1 << PACK_RANS_BITS) - sum;
+
+	/* rounding rare symbols up may overshoot, take from the largest */
+	while (sum > (1 << PACK_RANS_BITS)) {
+		for (s = 0, max = 0; s < 256; s++) {
+			if (freq[s] > freq[max])
+				max = s;
+		}
+		if (sum - (1 << PACK_RANS_BITS) < freq[max] / 2) {
+			freq[max] -= sum - (1 << PACK_RANS_BITS);
+			sum = 1 << PACK_RANS_BITS;
+		} else {
+			sum -= freq[max] / 2;
+			freq[max] -= freq[max] / 2;
+		}
+	}
+}
+
+void lossless_rans_init(struct pack_rans_sym_s *sym, u_int32_t start, u_int32_t freq)
+{
+	u_int32_t shift = 0;
+
+	sym->x_max = ((PACK_RANS_L >> PACK_RANS_BITS) << 8) * freq;
+	sym->cmpl_freq = (1 << PACK_RANS_BITS) - freq;
+	if (freq < 2) {
+		sym->rcp_freq = ~0u;
+		sym->rcp_shift = 0;
+		sym->bias = start + (1 << PACK_RANS_BITS) - 1;
+	} else {
+		while (freq > (1u << shift))
+			shift++;
+		sym->rcp_freq = (u_int32_t) (((1ull << (shift + 31)) + freq - 1) / freq);
+		sym->rcp_shift = shift - 1;
+		sym->bias = start;
+	}
+}
+
+#ifdef __JPEG
+/**
+ * \brief row of a plane padded to whole blocks
+ * \param src row
+ * \param width row width
+ * \param pad padded width
+ * \param buf where to pad row if needed
+ * \return padded row
+ */
+__inline__ static JSAMPROW lossy_row(const unsigned char *src, size_t width,
+				     size_t pad, unsigned char *buf)
+{
+	if (width == pad)
+		return (JSAMPROW) src;
+
+	memcpy(buf, src, width);
+	memset(&buf[width], src[width - 1], pad - width);
+	return buf;
+}
 #endif
-	} else if (state->header.type == GLC_MESSAGE_QUICKLZ) {
-#ifdef __QUICKLZ
-		__sync_fetch_and_add(&unpack->stats.pack_size,
-					state->read_size - sizeof(glc_quicklz_header_t));
-		memcpy(&state->header, &((glc_quicklz_header_t *) state->read_data)->header,
-		       sizeof(glc_message_header_t));
-		if (!state->threadptr)
-			state->threadptr = malloc(sizeof(qlz_state_decompress));
-		qlz_decompress((const void *) &state->read_data[sizeof(glc_quicklz_header_t)],
-				(void *) state->write_data,
-				(qlz_state_decompress *) state->threadptr);
+
+/**
+ * \brief JPEG code a band of a YCbCr picture
+ *
+ * Rows are handed to libjpeg as raw 4:2:0 data, so there is no color
+ * conversion nor resampling. Rows and columns past the picture repeat
+ * its last ones.
+ * \param slice band
+ * \return size of band in slice->dst, 0 if it didn't fit or failed
+ */
+size_t lossy_compress(const struct pack_slice_s *slice)
+{
+#ifdef __JPEG
+	struct jpeg_compress_struct cinfo;
+	struct pack_jpeg_error_s jerr;
+	struct jpeg_destination_mgr dest;
+	JSAMPROW row[32];
+	JSAMPARRAY planes[3] = {&row[0], &row[16], &row[24]};
+	const unsigned char *pic = (const unsigned char *) slice->src;
+	const unsigned char *cb, *cr;
+	size_t w = slice->width, cw = slice->width / 2, pad, size = 0;
+	unsigned int y, r, line;
+	unsigned char *buf;
+
+	cb = &pic[w * slice->height];
+	cr = &cb[cw * (slice->height / 2)];
+	/* libjpeg reads whole blocks */
+	pad = (w + 15) & ~((size_t) 15);
+	if (unlikely(!(buf = (unsigned char *) malloc(pad * 24))))
+		return 0;
+
+	cinfo.err = jpeg_std_error(&jerr.mgr);
+	jerr.mgr.error_exit = &lossy_error_exit;
+	jerr.mgr.output_message = &lossy_output_message;
+	if (setjmp(jerr.jump)) {
+		jpeg_destroy_compress(&cinfo);
+		free(buf);
+		return 0;
+	}
+	jpeg_create_compress(&cinfo);
+
+	dest.next_output_byte = (JOCTET *) slice->dst;
+	dest.free_in_buffer = __jpeg_worstcase(slice->size);
+	dest.init_destination = &lossy_dest_init;
+	dest.empty_output_buffer = &lossy_dest_empty;
+	dest.term_destination = &lossy_dest_term;
+	cinfo.dest = &dest;
+
+	cinfo.image_width = slice->width;
+	cinfo.image_height = slice->rows;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_YCbCr;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+	jpeg_set_quality(&cinfo, slice->quality, TRUE);
+	cinfo.raw_data_in = TRUE;
+	cinfo.comp_info[0].h_samp_factor = cinfo.comp_info[0].v_samp_factor = 2;
+	for (r = 1; r < 3; r++)
+		cinfo.comp_info[r].h_samp_factor = cinfo.comp_info[r].v_samp_factor = 1;
+
+	jpeg_start_compress(&cinfo, TRUE);
+	for (y = 0; y < slice->rows; y += 16) {
+		for (r = 0; r < 16; r++) {
+			line = slice->y + ((y + r < slice->rows) ? y + r : slice->rows - 1);
+			row[r] = lossy_row(&pic[line * w], w, pad, &buf[r * pad]);
+			if (r & 1)
+				continue;
+			line /= 2;
+			row[16 + r / 2] = lossy_row(&cb[line * cw], cw, pad / 2,
+						    &buf[16 * pad + (r / 2) * (pad / 2)]);
+			row[24 + r / 2] = lossy_row(&cr[line * cw], cw, pad / 2,
+						    &buf[20 * pad + (r / 2) * (pad / 2)]);
+		}
+		jpeg_write_raw_data(&cinfo, planes, 16);
+	}
+	jpeg_finish_compress(&cinfo);
+
+	size = __jpeg_worstcase(slice->size) - dest.free_in_buffer;
+	jpeg_destroy_compress(&cinfo);
+	free(buf);
+	return size;
 #else
-		return ENOTSUP;
+	return 0;
 #endif
-	} else if (state->header.type == GLC_MESSAGE_LZJB) {
-#ifdef __LZJB
-		__sync_fetch_and_add(&unpack->stats.pack_size, state->read_size - sizeof(glc_lzjb_header_t));
-		memcpy(&state->header, &((glc_quicklz_header_t *) state->read_data)->header,
-		       sizeof(glc_message_header_t));
-		lzjb_decompress(&state->read_data[sizeof(glc_lzjb_header_t)],
-				state->write_data,
-				state->read_size - sizeof(glc_lzjb_header_t),
-				state->write_size);
+}
+
+/**
+ * \brief decode a JPEG band of a YCbCr picture
+ *
+ * Band must be a 4:2:0 YCbCr image as wide as the picture and as high
+ * as the band.
+ * \param slice band
+ * \return 0 on success otherwise an error code
+ */
+int lossy_decompress(const struct pack_slice_s *slice)
+{
+#ifdef __JPEG
+	struct jpeg_decompress_struct cinfo;
+	struct pack_jpeg_error_s jerr;
+	struct jpeg_source_mgr src;
+	JSAMPROW row[32];
+	JSAMPARRAY planes[3] = {&row[0], &row[16], &row[24]};
+	unsigned char *pic = (unsigned char *) slice->dst;
+	unsigned char *cb, *cr;
+	size_t w = slice->width, cw = slice->width / 2, pad;
+	unsigned int y, r, rows;
+	unsigned char *buf;
+
+	cb = &pic[w * slice->height];
+	cr = &cb[cw * (slice->height / 2)];
+	pad = (w + 15) & ~((size_t) 15);
+	if (unlikely(!(buf = (unsigned char *) malloc(pad * 24))))
+		return ENOMEM;
+
+	cinfo.err = jpeg_std_error(&jerr.mgr);
+	jerr.mgr.error_exit = &lossy_error_exit;
+	jerr.mgr.output_message = &lossy_output_message;
+	if (setjmp(jerr.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		free(buf);
+		return EINVAL;
+	}
+	jpeg_create_decompress(&cinfo);
+
+	src.next_input_byte = (const JOCTET *) slice->src;
+	src.bytes_in_buffer = slice->size;
+	src.init_source = &lossy_src_init;
+	src.fill_input_buffer = &lossy_src_fill;
+	src.skip_input_data = &lossy_src_skip;
+	src.resync_to_restart = &jpeg_resync_to_restart;
+	src.term_source = &lossy_src_term;
+	cinfo.src = &src;
+
+	jpeg_read_header(&cinfo, TRUE);
+	if (unlikely((cinfo.image_width != slice->width) ||
+		     (cinfo.image_height != slice->rows) ||
+		     (cinfo.num_components != 3) ||
+		     (cinfo.comp_info[0].h_samp_factor != 2) ||
+		     (cinfo.comp_info[0].v_samp_factor != 2) ||
+		     (cinfo.comp_info[1].h_samp_factor != 1) ||
+		     (cinfo.comp_info[1].v_samp_factor != 1) ||
+		     (cinfo.comp_info[2].h_samp_factor != 1) ||
+		     (cinfo.comp_info[2].v_samp_factor != 1)))
+		longjmp(jerr.jump, 1);
+
+	cinfo.raw_data_out = TRUE;
+	cinfo.out_color_space = JCS_YCbCr;
+	jpeg_start_decompress(&cinfo);
+
+	for (y = 0; y < slice->rows; y += 16) {
+		for (r = 0; r < 16; r++) {
+			row[r] = &buf[r * pad];
+			if (!(r & 1)) {
+				row[16 + r / 2] = &buf[16 * pad + (r / 2) * (pad / 2)];
+				row[24 + r / 2] = &buf[20 * pad + (r / 2) * (pad / 2)];
+			}
+		}
+		jpeg_read_raw_data(&cinfo, planes, 16);
+
+		rows = (slice->rows - y < 16) ? slice->rows - y : 16;
+		for (r = 0; r < rows; r++) {
+			memcpy(&pic[(slice->y + y + r) * w], row[r], w);
+			if (r & 1)
+				continue;
+			memcpy(&cb[((slice->y + y + r) / 2) * cw], row[16 + r / 2], cw);
+			memcpy(&cr[((slice->y + y + r) / 2) * cw], row[24 + r / 2], cw);
+		}
+	}
+	jpeg_finish_decompress(&cinfo);
+
+	jpeg_destroy_decompress(&cinfo);
+	free(buf);
+	return 0;
 #else
-		return ENOTSUP;
+	return ENOTSUP;
 #endif
-	} else
-		return ENOTSUP;
-	__sync_fetch_and_add(&unpack->stats.unpack_size, state->write_size);
-	return 0;
 }
 
-void print_stats(glc_t *glc, pack_stat_t *stat)
+#ifdef __JPEG
+void lossy_error_exit(j_common_ptr cinfo)
+{
+	longjmp(((struct pack_jpeg_error_s *) cinfo->err)->jump, 1);
+}
+
+void lossy_output_message(j_common_ptr cinfo)
+{
+	/* warnings about broken bands aren't interesting */
+}
+
+void lossy_dest_init(j_compress_ptr cinfo)
+{
+}
+
+boolean lossy_dest_empty(j_compress_ptr cinfo)
+{
+	/* band didn't fit in its worst case size */
+	longjmp(((struct pack_jpeg_error_s *) cinfo->err)->jump, 1);
+	return FALSE;
+}
+
+void lossy_dest_term(j_compress_ptr cinfo)
+{
+}
+
+void lossy_src_init(j_decompress_ptr cinfo)
+{
+}
+
+boolean lossy_src_fill(j_decompress_ptr cinfo)
+{
+	/* band is truncated */
+	longjmp(((struct pack_jpeg_error_s *) cinfo->err)->jump, 1);
+	return FALSE;
+}
+
+void lossy_src_skip(j_decompress_ptr cinfo, long num_bytes)
+{
+	if (num_bytes <= 0)
+		return;
+	if (unlikely((size_t) num_bytes > cinfo->src->bytes_in_buffer))
+		longjmp(((struct pack_jpeg_error_s *) cinfo->err)->jump, 1);
+
+	cinfo->src->next_input_byte += num_bytes;
+	cinfo->src->bytes_in_buffer -= num_bytes;
+}
+
+void lossy_src_term(j_decompress_ptr cinfo)
+{
+}
+#endif
+
+void slice_pool_init(struct pack_slice_pool_s *pool, glc_t *glc, pack_t pack)
+{
+	pool->glc = glc;
+	pool->pack = pack;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+}
+
+void slice_pool_destroy(struct pack_slice_pool_s *pool)
+{
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+/**
+ * \brief start slice pool threads
+ *
+ * Threads calling slice_pool_run() work on slices too, so
+ * any number of pool threads, even 0, is fine.
+ * \param pool slice pool
+ * \param threads number of threads
+ * \param wrkmem_size size of per-thread work memory
+ * \param name thread name, see glc_set_sched()
+ * \return 0 on success otherwise an error code
+ */
+int slice_pool_start(struct pack_slice_pool_s *pool, unsigned int threads,
+		     size_t wrkmem_size, const char *name)
+{
+	int ret = 0;
+
+	pool->stop = 0;
+	pool->wrkmem_size = wrkmem_size;
+	pool->threads_num = 0;
+	if (!threads)
+		return 0;
+
+	if (unlikely(!(pool->threads = (glc_simple_thread_t *)
+		       calloc(threads, sizeof(glc_simple_thread_t)))))
+		return ENOMEM;
+
+	for (; pool->threads_num < threads; pool->threads_num++) {
+		pool->threads[pool->threads_num].name = name;
+		if (unlikely((ret = glc_simple_thread_create(pool->glc,
+					&pool->threads[pool->threads_num],
+					slice_pool_thread, pool)))) {
+			slice_pool_stop(pool);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+void slice_pool_stop(struct pack_slice_pool_s *pool)
+{
+	unsigned int t;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (t = 0; t < pool->threads_num; t++)
+		glc_simple_thread_wait(pool->glc, &pool->threads[t]);
+
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->threads_num = 0;
+}
+
+/**
+ * \brief process slices
+ *
+ * First slice is processed by the calling thread, others are queued
+ * for pool threads. While waiting, the calling thread takes queued
+ * slices too, its own or not.
+ * \param pool slice pool
+ * \param slice slices
+ * \param slices number of slices
+ * \param wrkmem work memory of calling thread
+ * \return 0 on success otherwise first error of a slice
+ */
+int slice_pool_run(struct pack_slice_pool_s *pool, struct pack_slice_s *slice,
+		   unsigned int slices, void *wrkmem)
+{
+	struct pack_slice_s *next;
+	unsigned int pending = slices - 1, s;
+	int ret = 0;
+
+	if (slices > 1) {
+		for (s = 1; s < slices; s++) {
+			slice[s].pending = &pending;
+			slice[s].next = &slice[s + 1];
+		}
+		slice[slices - 1].next = NULL;
+
+		pthread_mutex_lock(&pool->mutex);
+		if (pool->last)
+			pool->last->next = &slice[1];
+		else
+			pool->first = &slice[1];
+		pool->last = &slice[slices - 1];
+		pthread_cond_broadcast(&pool->work_cond);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	slice_pool_do(pool, &slice[0], wrkmem);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pending) {
+		if (!pool->first) {
+			pthread_cond_wait(&pool->done_cond, &pool->mutex);
+			continue;
+		}
+
+		next = pool->first;
+		if (!(pool->first = next->next))
+			pool->last = NULL;
+		pthread_mutex_unlock(&pool->mutex);
+
+		slice_pool_do(pool, next, wrkmem);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (!--(*next->pending))
+			pthread_cond_broadcast(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (s = 0; s < slices; s++) {
+		if (unlikely(slice[s].ret) && !ret)
+			ret = slice[s].ret;
+	}
+	return ret;
+}
+
+void slice_pool_do(struct pack_slice_pool_s *pool, struct pack_slice_s *slice,
+		   void *wrkmem)
+{
+	if (pool->pack) {
+		if (slice->codec == PACK_JPEG)
+			slice->dst_size = lossy_compress(slice);
+		else if (slice->width)
+			slice->dst_size = lossless_compress((const unsigned char *) slice->src,
+							    slice->size, slice->width,
+							    slice->step, slice->pitch,
+							    (unsigned char *) slice->dst);
+		else
+			slice->dst_size = pack_compress(slice->codec, wrkmem,
+							slice->src, slice->size, slice->dst);
+		slice->ret = 0;
+	} else if (slice->compression == GLC_MESSAGE_JPEG)
+		slice->ret = lossy_decompress(slice);
+	else if (slice->width)
+		slice->ret = lossless_decompress((const unsigned char *) slice->src, slice->size,
+						 (unsigned char *) slice->dst, slice->dst_size,
+						 slice->width, slice->step, slice->pitch);
+	else
+		slice->ret = unpack_decompress(slice->compression, wrkmem,
+					       slice->src, slice->size,
+					       slice->dst, slice->dst_size);
+}
+
+void *slice_pool_thread(void *argptr)
+{
+	struct pack_slice_pool_s *pool = (struct pack_slice_pool_s *) argptr;
+	struct pack_slice_s *slice;
+	void *wrkmem = NULL;
+
+	/* without work memory, slices are left to the threads that queued them */
+	if (pool->wrkmem_size &&
+	    unlikely(!(wrkmem = malloc(pool->wrkmem_size)))) {
+		glc_log(pool->glc, GLC_WARN, "pack",
+			 "slice thread out of memory");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while ((!pool->first) && (!pool->stop))
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		if (!pool->first)
+			break;
+
+		/*
+		 * Slices count against shared worker slots like filter
+		 * threads. A slot is taken before a slice so the thread
+		 * that queued it can still do it meanwhile.
+		 */
+		pthread_mutex_unlock(&pool->mutex);
+		glc_worker_acquire(pool->glc);
+		pthread_mutex_lock(&pool->mutex);
+		if (!(slice = pool->first)) {
+			pthread_mutex_unlock(&pool->mutex);
+			glc_worker_release(pool->glc);
+			pthread_mutex_lock(&pool->mutex);
+			continue;
+		}
+
+		if (!(pool->first = slice->next))
+			pool->last = NULL;
+		pthread_mutex_unlock(&pool->mutex);
+
+		slice_pool_do(pool, slice, wrkmem);
+		glc_worker_release(pool->glc);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (!--(*slice->pending))
+			pthread_cond_broadcast(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	free(wrkmem);
+	return NULL;
+}
+
+void print_stats(glc_t *glc, const char *codec, pack_stat_t *stat)
 {
-	double ratio;
+	double ratio, speed;
 	if (!stat->unpack_size)
 		ratio = 0.0;
 	else
 		ratio = (double)stat->pack_size/(double)stat->unpack_size;
 
+	/* codec_time is the sum of all threads time */
+	if (!stat->codec_time)
+		speed = 0.0;
+	else
+		speed = (double)stat->codec_size * 1000000000.0 /
+			((double)stat->codec_time * 1024.0 * 1024.0);
+
 	glc_log(glc, GLC_PERF, "pack",
-		"unpack_size: %llu pack_size: %llu %remn: %.1f",
-		stat->unpack_size, stat->pack_size, ratio*100);
+		"%s%sunpack_size: %llu pack_size: %llu %remn: %.1f speed: %.1f MiB/s per thread",
+		codec ? codec : "", codec ? " " : "",
+		stat->unpack_size, stat->pack_size, ratio*100, speed);
 }
 
 /**  \} */
@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/common/thread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,6 +35,14 @@ typedef struct pack_s* pack_t;
 #define PACK_LZO           0x2
 /** LZJB compression */
 #define PACK_LZJB          0x3
+/** LZ4 compression */
+#define PACK_LZ4           0x4
+/** LZ4 high compression, same stream format as LZ4 */
+#define PACK_LZ4HC         0x5
+/** lossless predictive coding of pictures */
+#define PACK_LOSSLESS      0x6
+/** lossy JPEG coding of YCbCr pictures */
+#define PACK_JPEG          0x7
 
 /**
  * \brief unpack object
@@ -51,15 +60,61 @@ __PUBLIC int pack_init(pack_t *pack, glc_t *glc);
 /**
  * \brief set compression
  *
- * QuickLZ (PACK_QUICKLZ) and LZO (PACK_LZO) are currently supported.
- * Both are fast enough for stream compression.
+ * QuickLZ (PACK_QUICKLZ), LZO (PACK_LZO), LZJB (PACK_LZJB) and
+ * LZ4 (PACK_LZ4) are fast enough for stream compression.
  * LZO compresses marginally better but is slower. QuickLZ is default.
+ * LZ4 high compression (PACK_LZ4HC) is much slower to compress but
+ * decompresses as fast as LZ4, it is meant for recompressing
+ * streams offline.
+ * Lossless coding (PACK_LOSSLESS) predicts each byte of a picture
+ * from its neighbours in the same plane and entropy codes the
+ * residuals. It compresses natural pictures much better than the
+ * LZ codecs, other messages are only entropy coded.
+ * JPEG coding (PACK_JPEG) is lossy, it codes GLC_VIDEO_YCBCR_420JPEG
+ * pictures as they are with libjpeg. Other messages are coded
+ * losslessly and pictures aren't delta encoded.
  * \param pack pack object
  * \param compression compression algorithm
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int pack_set_compression(pack_t pack, int compression);
 
+/**
+ * \brief choose compression of each message
+ *
+ * Each audio and video stream keeps track of the ratio and speed
+ * the codecs achieve on it. Messages that hardly compress are stored
+ * as is. When pack threads are always busy while output keeps up,
+ * messages are stored too. When output blocks and threads have time
+ * left, the strong compression is used if one is set. Otherwise the
+ * compression set with pack_set_compression() is used.
+ * Default is disabled.
+ * \param pack pack object
+ * \param adaptive 1 enables, 0 disables
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_adaptive(pack_t pack, int adaptive);
+
+/**
+ * \brief set strong compression for adaptive compression
+ *
+ * Strong compression can't be PACK_JPEG.
+ * \param pack pack object
+ * \param compression compression algorithm, 0 for none
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_strong_compression(pack_t pack, int compression);
+
+/**
+ * \brief set JPEG quality
+ *
+ * Default is 85.
+ * \param pack pack object
+ * \param quality quality from 1 to 100
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_jpeg_quality(pack_t pack, int quality);
+
 /**
  * \brief set compression threshold
  *
@@ -71,6 +126,48 @@ __PUBLIC int pack_set_compression(pack_t pack, int compression);
  */
 __PUBLIC int pack_set_minimum_size(pack_t pack, size_t min_size);
 
+/**
+ * \brief set delta key frame interval
+ *
+ * With delta encoding, only tiles of a picture that changed since
+ * previous picture of the same stream are compressed. A whole
+ * picture is still written every interval frames, after format
+ * changes and after callback requests, so streams can be reloaded.
+ * Default is 0, delta encoding is disabled.
+ * \param pack pack object
+ * \param interval frames between key frames, 0 disables delta encoding
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_delta_interval(pack_t pack, unsigned int interval);
+
+/**
+ * \brief set maximum number of slices per message
+ *
+ * Large pictures are split in up to slices parts that are compressed
+ * by different threads, so a single picture doesn't wait on one
+ * thread. Each slice is at least 256 KiB. Default is 0, which uses
+ * glc_threads_hint(). 1 disables slicing.
+ * \param pack pack object
+ * \param slices maximum number of slices
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_slices(pack_t pack, unsigned int slices);
+
+/**
+ * \brief set picture filters
+ *
+ * Filters rearrange pictures before compression so codecs find
+ * longer matches: GLC_FILTER_SHUFFLE splits BGR, BGRA and RGB
+ * pictures in one plane per channel, GLC_FILTER_PREDICT stores
+ * difference of each byte to its left neighbour and GLC_FILTER_NO_ALPHA
+ * leaves out alpha channel when it is constant. Pictures encoded as
+ * deltas aren't filtered. Default is 0, pictures are compressed as is.
+ * \param pack pack object
+ * \param filter GLC_FILTER_* flags
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_set_filter(pack_t pack, glc_flags_t filter);
+
 /**
  * \brief start processing threads
  *
@@ -91,6 +188,17 @@ __PUBLIC int pack_process_start(pack_t pack, ps_buffer_t *from, ps_buffer_t *to)
  */
 __PUBLIC int pack_process_wait(pack_t pack);
 
+/**
+ * \brief get timing statistics of pack threads
+ *
+ * Statistics are always collected. They cover threads that are
+ * running or have finished, for every packet processed so far.
+ * \param pack pack object
+ * \param stats where to copy statistics
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int pack_get_stats(pack_t pack, glc_thread_stats_t *stats);
+
 /**
  * \brief destroy pack object
  * \param pack pack object
@@ -110,7 +218,10 @@ __PUBLIC int unpack_init(unpack_t *unpack, glc_t *glc);
 /**
  * \brief start processing threads
  *
- * unpack decompresses all supported compressed messages.
+ * unpack decompresses all supported compressed messages and
+ * decodes delta-encoded pictures. Pictures before the first key
+ * frame of a stream, as in later parts of a split stream, are
+ * dropped. Slices of a message are decompressed in parallel.
  * \param unpack unpack object
  * \param from source buffer
  * \param to target buffer
@@ -126,6 +237,17 @@ __PUBLIC int unpack_process_start(unpack_t unpack, ps_buffer_t *from,
  */
 __PUBLIC int unpack_process_wait(unpack_t unpack);
 
+/**
+ * \brief get timing statistics of unpack threads
+ *
+ * Statistics are always collected. They cover threads that are
+ * running or have finished, for every packet processed so far.
+ * \param unpack unpack object
+ * \param stats where to copy statistics
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int unpack_get_stats(unpack_t unpack, glc_thread_stats_t *stats);
+
 /**
  * \brief destroy unpack object
  * \param unpack unpack object
@@ -142,6 +142,7 @@ int pipe_sink_init(sink_t *sink, glc_t *glc, const char *exec_file, int invert)
 	pipe_sink->thread.read_callback   = &pipe_read_callback;
 	pipe_sink->thread.finish_callback = &pipe_finish_callback;
 	pipe_sink->thread.threads = 1;
+	pipe_sink->thread.name    = "pipe";
 
 	tracker_init(&pipe_sink->state_tracker, pipe_sink->glc);
 
@@ -518,6 +519,8 @@ int pipe_read_callback(glc_thread_state_t *state)
 			break;
 		}
 		case GLC_MESSAGE_CLOSE: // noop
+		case GLC_MESSAGE_VIDEO_PACE:
+		case GLC_MESSAGE_VIDEO_REPEAT: /* not written with pipe sink */
 			break;
 		default:
 			glc_log(pipe_sink->glc, GLC_WARN, "pipe", "unexpected packet type %s (%u)",
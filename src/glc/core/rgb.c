@@ -140,12 +140,14 @@ int rgb_init(rgb_t *rgb, glc_t *glc)
 
 	rgb_init_lookup(*rgb);
 
-	(*rgb)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*rgb)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+			       GLC_THREAD_REORDER;
 	(*rgb)->thread.read_callback = &rgb_read_callback;
 	(*rgb)->thread.write_callback = &rgb_write_callback;
 	(*rgb)->thread.finish_callback = &rgb_finish_callback;
 	(*rgb)->thread.ptr = *rgb;
 	(*rgb)->thread.threads = glc_threads_hint(glc);
+	(*rgb)->thread.name = "rgb";
 
 	return 0;
 }
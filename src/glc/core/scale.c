@@ -115,12 +115,14 @@ int scale_init(scale_t *scale, glc_t *glc)
 
 	(*scale)->glc = glc;
 
-	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_REORDER;
 	(*scale)->thread.read_callback = &scale_read_callback;
 	(*scale)->thread.write_callback = &scale_write_callback;
 	(*scale)->thread.finish_callback = &scale_finish_callback;
 	(*scale)->thread.ptr = *scale;
 	(*scale)->thread.threads = glc_threads_hint(glc);
+	(*scale)->thread.name = "scale";
 	(*scale)->scale = 1.0;
 
 	return 0;
@@ -494,7 +496,10 @@ int scale_video_format_message(scale_t scale,
 			 "real size is %ux%u, scaled picture starts at %ux%u",
 			 video->rw, video->rh, video->rx, video->ry);
 	} else {
-		video->scale = scale->scale;
+		if (format_message->flags & GLC_VIDEO_SCALED)
+			video->scale = 1.0; /* already scaled on GPU */
+		else
+			video->scale = scale->scale;
 		video->sw = video->scale * video->w;
 		video->sh = video->scale * video->h;
 
@@ -581,6 +586,7 @@ int scale_video_format_message(scale_t scale,
 		video->created = 1;
 	}
 
+	format_message->flags &= ~GLC_VIDEO_SCALED;
 	state->flags |= GLC_THREAD_COPY;
 
 	pthread_rwlock_unlock(&video->update);
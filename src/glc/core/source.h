@@ -70,6 +70,18 @@ typedef struct
 	 * \return 0 on success otherwise an error code
 	 */
 	int (*read)(source_t source, ps_buffer_t *to);
+	/**
+	 * \brief jump to another position of the stream
+	 *
+	 * May be called from any thread while read() is running,
+	 * the jump is done before next message is read. Reading
+	 * resumes at the last point from where the stream can be
+	 * decoded that isn't after time.
+	 * \param source source object
+	 * \param time stream time
+	 * \return 0 on success otherwise an error code
+	 */
+	int (*seek)(source_t source, glc_utime_t time);
 	int (*destroy)(source_t source);
 } source_ops_t;
 
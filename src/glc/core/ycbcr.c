@@ -129,12 +129,14 @@ int ycbcr_init(ycbcr_t *ycbcr, glc_t *glc)
 
 	(*ycbcr)->glc = glc;
 
-	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_REORDER;
 	(*ycbcr)->thread.read_callback = &ycbcr_read_callback;
 	(*ycbcr)->thread.write_callback = &ycbcr_write_callback;
 	(*ycbcr)->thread.finish_callback = &ycbcr_finish_callback;
 	(*ycbcr)->thread.ptr = *ycbcr;
 	(*ycbcr)->thread.threads = glc_threads_hint(glc);
+	(*ycbcr)->thread.name = "ycbcr";
 	(*ycbcr)->scale = 1.0;
 
 	return 0;
@@ -443,6 +445,8 @@ int ycbcr_video_format_message(ycbcr_t ycbcr, glc_video_format_message_t *video_
 		video->bpp = 3;
 	else {
 		video->convert = NULL;
+		/* converted and scaled at capture */
+		video_format->flags &= ~GLC_VIDEO_SCALED;
 		pthread_rwlock_unlock(&video->update);
 		return 0;
 	}
@@ -457,7 +461,10 @@ int ycbcr_video_format_message(ycbcr_t ycbcr, glc_video_format_message_t *video_
 			video->row += 8 - video->row % 8;
 	}
 
-	video->scale = ycbcr->scale;
+	if (video_format->flags & GLC_VIDEO_SCALED)
+		video->scale = 1.0; /* already scaled on GPU */
+	else
+		video->scale = ycbcr->scale;
 	video->yw = video->w * video->scale;
 	video->yh = video->h * video->scale;
 	video->yw -= video->yw % 2; /* safer and faster             */
@@ -467,7 +474,7 @@ int ycbcr_video_format_message(ycbcr_t ycbcr, glc_video_format_message_t *video_
 	video->ch = video->yh / 2;
 
 	/* nuke old flags */
-	video_format->flags &= ~GLC_VIDEO_DWORD_ALIGNED;
+	video_format->flags &= ~(GLC_VIDEO_DWORD_ALIGNED | GLC_VIDEO_SCALED);
 	video_format->format = GLC_VIDEO_YCBCR_420JPEG;
 	video_format->width = video->yw;
 	video_format->height = video->yh;
@@ -69,6 +69,7 @@ struct img_s {
 	unsigned int row;
 	unsigned char *prev_video_frame_message;
 	glc_utime_t time;
+	glc_utime_t start_time;
 	int i;
 
 	img_write_proc write_proc;
@@ -80,6 +81,7 @@ static int img_read_callback(glc_thread_state_t *state);
 static int img_video_format_message(img_t img, glc_video_format_message_t *video_format);
 static int img_video_frame_message(img_t img, glc_video_frame_header_t *pic_hdr,
 	    const unsigned char *pic, size_t pic_size);
+static int img_video_repeat_message(img_t img, glc_video_repeat_message_t *repeat_msg);
 
 static int img_write_bmp(img_t img, const unsigned char *pic,
 		  unsigned int w, unsigned int h,
@@ -104,6 +106,7 @@ int img_init(img_t *img, glc_t *glc)
 	(*img)->thread.read_callback = &img_read_callback;
 	(*img)->thread.finish_callback = &img_finish_callback;
 	(*img)->thread.threads = 1;
+	(*img)->thread.name = "img";
 
 	return 0;
 }
@@ -145,6 +148,13 @@ int img_set_fps(img_t img, double fps)
 	return 0;
 }
 
+int img_set_start_time(img_t img, glc_utime_t start_time)
+{
+	img->start_time = start_time;
+	img->time = start_time;
+	return 0;
+}
+
 int img_set_filename(img_t img, const char *filename)
 {
 	img->filename_format = filename;
@@ -187,7 +197,7 @@ void img_finish_callback(void *ptr, int err)
 	}
 
 	img->i = 0;
-	img->time = 0;
+	img->time = img->start_time;
 }
 
 int img_read_callback(glc_thread_state_t *state)
@@ -202,6 +212,9 @@ int img_read_callback(glc_thread_state_t *state)
 		ret = img_video_frame_message(img, (glc_video_frame_header_t *) state->read_data,
 		      (const unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
 			      state->read_size);
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT) {
+		ret = img_video_repeat_message(img,
+			(glc_video_repeat_message_t *) state->read_data);
 	}
 
 	return ret;
@@ -262,11 +275,26 @@ int img_video_frame_message(img_t img, glc_video_frame_header_t *pic_hdr,
 		ret = img->write_proc(img, pic, img->w, img->h, filename);
 	}
 
-	memcpy(img->prev_video_frame_message, pic, pic_size);
+	if (pic != img->prev_video_frame_message)
+		memcpy(img->prev_video_frame_message, pic, pic_size);
 
 	return ret;
 }
 
+int img_video_repeat_message(img_t img, glc_video_repeat_message_t *repeat_msg)
+{
+	glc_video_frame_header_t pic_hdr;
+
+	if ((repeat_msg->id != img->id) ||
+	    (unlikely(!img->prev_video_frame_message)))
+		return 0;
+
+	pic_hdr.id = repeat_msg->id;
+	pic_hdr.time = repeat_msg->time;
+	return img_video_frame_message(img, &pic_hdr, img->prev_video_frame_message,
+				       img->row * img->h);
+}
+
 int img_write_bmp(img_t img, const unsigned char *pic,
 		  unsigned int w, unsigned int h, const char *filename)
 {
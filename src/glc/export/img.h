@@ -81,6 +81,17 @@ __PUBLIC int img_set_stream_id(img_t img, glc_stream_id_t id);
  */
 __PUBLIC int img_set_fps(img_t img, double fps);
 
+/**
+ * \brief set time of stream start
+ *
+ * Parts of a split stream start at the time given in their stream
+ * information. Default is 0.
+ * \param img img object
+ * \param start_time start time
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int img_set_start_time(img_t img, glc_utime_t start_time);
+
 /**
  * \brief set format
  *
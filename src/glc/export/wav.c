@@ -117,6 +117,7 @@ int wav_init(wav_t *wav, glc_t *glc)
 	(*wav)->thread.read_callback = &wav_read_callback;
 	(*wav)->thread.finish_callback = &wav_finish_callback;
 	(*wav)->thread.threads = 1;
+	(*wav)->thread.name = "wav";
 
 	return 0;
 }
@@ -158,6 +159,12 @@ int wav_set_interpolation(wav_t wav, int interpolate)
 	return 0;
 }
 
+int wav_set_start_time(wav_t wav, glc_utime_t start_time)
+{
+	wav->time = start_time;
+	return 0;
+}
+
 int wav_set_filename(wav_t wav, const char *filename)
 {
 	wav->filename_format = filename;
@@ -82,6 +82,17 @@ __PUBLIC int wav_set_stream_id(wav_t wav, glc_stream_id_t id);
  */
 __PUBLIC int wav_set_interpolation(wav_t wav, int interpolate);
 
+/**
+ * \brief set time of stream start
+ *
+ * Parts of a split stream start at the time given in their stream
+ * information. Default is 0.
+ * \param wav wav object
+ * \param start_time start time
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int wav_set_start_time(wav_t wav, glc_utime_t start_time);
+
 /**
  * \brief set silence threshold
  *
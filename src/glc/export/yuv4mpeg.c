@@ -56,6 +56,7 @@ struct yuv4mpeg_s {
 	FILE *to;
 
 	glc_utime_t time;
+	glc_utime_t start_time;
 	glc_utime_t fps_usec;
 	double fps;
 
@@ -73,6 +74,8 @@ static void yuv4mpeg_finish_callback(void *priv, int err);
 static int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_format);
 static int yuv4mpeg_handle_video_frame_message(yuv4mpeg_t yuv4mpeg,
 			glc_video_frame_header_t *pic_header, char *data);
+static int yuv4mpeg_handle_video_repeat_message(yuv4mpeg_t yuv4mpeg,
+			glc_video_repeat_message_t *repeat_msg);
 static int yuv4mpeg_write_video_frame_message(yuv4mpeg_t yuv4mpeg, char *pic);
 
 int yuv4mpeg_init(yuv4mpeg_t *yuv4mpeg, glc_t *glc)
@@ -91,6 +94,7 @@ int yuv4mpeg_init(yuv4mpeg_t *yuv4mpeg, glc_t *glc)
 	(*yuv4mpeg)->thread.read_callback = &yuv4mpeg_read_callback;
 	(*yuv4mpeg)->thread.finish_callback = &yuv4mpeg_finish_callback;
 	(*yuv4mpeg)->thread.threads = 1;
+	(*yuv4mpeg)->thread.name = "yuv4mpeg";
 
 	return 0;
 }
@@ -120,6 +124,13 @@ int yuv4mpeg_set_fps(yuv4mpeg_t yuv4mpeg, double fps)
 	return 0;
 }
 
+int yuv4mpeg_set_start_time(yuv4mpeg_t yuv4mpeg, glc_utime_t start_time)
+{
+	yuv4mpeg->start_time = start_time;
+	yuv4mpeg->time = start_time;
+	return 0;
+}
+
 int yuv4mpeg_set_interpolation(yuv4mpeg_t yuv4mpeg, int interpolate)
 {
 	yuv4mpeg->interpolate = interpolate;
@@ -168,7 +179,7 @@ void yuv4mpeg_finish_callback(void *priv, int err)
 	}
 
 	yuv4mpeg->file_count = 0;
-	yuv4mpeg->time = 0;
+	yuv4mpeg->time = yuv4mpeg->start_time;
 }
 
 int yuv4mpeg_read_callback(glc_thread_state_t *state)
@@ -182,6 +193,9 @@ int yuv4mpeg_read_callback(glc_thread_state_t *state)
 		return yuv4mpeg_handle_video_frame_message(yuv4mpeg,
 			(glc_video_frame_header_t *) state->read_data,
 			&state->read_data[sizeof(glc_video_frame_header_t)]);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		return yuv4mpeg_handle_video_repeat_message(yuv4mpeg,
+			(glc_video_repeat_message_t *) state->read_data);
 
 	return 0;
 }
@@ -218,20 +232,19 @@ int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_f
 	yuv4mpeg->size = video_format->width * video_format->height +
 			 (video_format->width * video_format->height) / 2;
 
-	if (yuv4mpeg->interpolate) {
-		if (yuv4mpeg->prev_video_frame_message)
-			yuv4mpeg->prev_video_frame_message = (char *)
-			realloc(yuv4mpeg->prev_video_frame_message, yuv4mpeg->size);
-		else
-			yuv4mpeg->prev_video_frame_message = (char *) malloc(yuv4mpeg->size);
-
-		/* Set Y' 0 */
-		memset(yuv4mpeg->prev_video_frame_message, 0,
-			video_format->width * video_format->height);
-		/* Set CbCr 128 */
-		memset(&yuv4mpeg->prev_video_frame_message[video_format->width * video_format->height],
-		       128, (video_format->width * video_format->height) / 2);
-	}
+	/* previous frame is also needed to expand repeated frames */
+	if (yuv4mpeg->prev_video_frame_message)
+		yuv4mpeg->prev_video_frame_message = (char *)
+		realloc(yuv4mpeg->prev_video_frame_message, yuv4mpeg->size);
+	else
+		yuv4mpeg->prev_video_frame_message = (char *) malloc(yuv4mpeg->size);
+
+	/* Set Y' 0 */
+	memset(yuv4mpeg->prev_video_frame_message, 0,
+		video_format->width * video_format->height);
+	/* Set CbCr 128 */
+	memset(&yuv4mpeg->prev_video_frame_message[video_format->width * video_format->height],
+	       128, (video_format->width * video_format->height) / 2);
 
 	/* calculate fps in p/q */
 	/** \todo something more intelligent perhaps... */
@@ -263,12 +276,27 @@ int yuv4mpeg_handle_video_frame_message(yuv4mpeg_t yuv4mpeg, glc_video_frame_hea
 		yuv4mpeg->time += yuv4mpeg->fps_usec;
 	}
 
-	if (yuv4mpeg->interpolate)
+	if (data != yuv4mpeg->prev_video_frame_message)
 		memcpy(yuv4mpeg->prev_video_frame_message, data, yuv4mpeg->size);
 
 	return 0;
 }
 
+int yuv4mpeg_handle_video_repeat_message(yuv4mpeg_t yuv4mpeg,
+					 glc_video_repeat_message_t *repeat_msg)
+{
+	glc_video_frame_header_t pic_hdr;
+
+	if ((repeat_msg->id != yuv4mpeg->id) ||
+	    (unlikely(!yuv4mpeg->prev_video_frame_message)))
+		return 0;
+
+	pic_hdr.id = repeat_msg->id;
+	pic_hdr.time = repeat_msg->time;
+	return yuv4mpeg_handle_video_frame_message(yuv4mpeg, &pic_hdr,
+						   yuv4mpeg->prev_video_frame_message);
+}
+
 int yuv4mpeg_write_video_frame_message(yuv4mpeg_t yuv4mpeg, char *pic)
 {
 	fprintf(yuv4mpeg->to, "FRAME\n");
@@ -78,6 +78,17 @@ __PUBLIC int yuv4mpeg_set_stream_id(yuv4mpeg_t yuv4mpeg, glc_stream_id_t id);
  */
 __PUBLIC int yuv4mpeg_set_fps(yuv4mpeg_t yuv4mpeg, double fps);
 
+/**
+ * \brief set time of stream start
+ *
+ * Parts of a split stream start at the time given in their stream
+ * information. Default is 0.
+ * \param yuv4mpeg yuv4mpeg object
+ * \param start_time start time
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int yuv4mpeg_set_start_time(yuv4mpeg_t yuv4mpeg, glc_utime_t start_time);
+
 /**
  * \brief set interpolation
  *
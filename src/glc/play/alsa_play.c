@@ -66,6 +66,8 @@ struct alsa_play_s {
 	int fmt;
 
 	void **bufs;
+
+	u_int32_t seek;
 };
 
 static int alsa_play_read_callback(glc_thread_state_t *state);
@@ -77,6 +79,7 @@ static int alsa_play_play(alsa_play_t alsa_play, glc_audio_data_header_t *audio_
 static snd_pcm_format_t glc_fmt_to_pcm_fmt(glc_audio_format_t format);
 
 static int alsa_play_xrun(alsa_play_t alsa_play, int err);
+static int alsa_play_seek(alsa_play_t alsa_play, glc_seek_message_t *seek_msg);
 
 snd_pcm_format_t glc_fmt_to_pcm_fmt(glc_audio_format_t format)
 {
@@ -107,6 +110,7 @@ int alsa_play_init(alsa_play_t *alsa_play, glc_t *glc)
 	(*alsa_play)->thread.read_callback = &alsa_play_read_callback;
 	(*alsa_play)->thread.finish_callback = &alsa_play_finish_callback;
 	(*alsa_play)->thread.threads = 1;
+	(*alsa_play)->thread.name    = "alsa_play";
 	(*alsa_play)->thread.ask_rt  = 1;
 
 	return 0;
@@ -181,6 +185,8 @@ int alsa_play_read_callback(glc_thread_state_t *state)
 
 	if (unlikely(state->header.type == GLC_MESSAGE_AUDIO_FORMAT))
 		res = alsa_play_hw(alsa_play, (glc_audio_format_message_t *) state->read_data);
+	else if (unlikely(state->header.type == GLC_MESSAGE_SEEK))
+		res = alsa_play_seek(alsa_play, (glc_seek_message_t *) state->read_data);
 	else if (likely(state->header.type == GLC_MESSAGE_AUDIO_DATA))
 		res = alsa_play_play(alsa_play, (glc_audio_data_header_t *) state->read_data,
 				       &state->read_data[sizeof(glc_audio_data_header_t)]);
@@ -288,6 +294,8 @@ int alsa_play_play(alsa_play_t alsa_play, glc_audio_data_header_t *audio_hdr, ch
 
 	frames = snd_pcm_bytes_to_frames(alsa_play->pcm, audio_hdr->size);
 	glc_utime_t time = glc_state_time(alsa_play->glc);
+	if (unlikely(glc_state_seek_count(alsa_play->glc) != alsa_play->seek))
+		return 0; /* read before a seek */
 	glc_utime_t duration = ((glc_utime_t) 1000000000 * (glc_utime_t) frames) /
 			       (glc_utime_t) alsa_play->rate;
 
@@ -371,4 +379,22 @@ int alsa_play_xrun(alsa_play_t alsa_play, int err)
 	return -err;
 }
 
+int alsa_play_seek(alsa_play_t alsa_play, glc_seek_message_t *seek_msg)
+{
+	int ret;
+
+	alsa_play->seek = seek_msg->seek;
+	if (!alsa_play->pcm)
+		return 0;
+
+	/* don't finish audio from previous position */
+	snd_pcm_drop(alsa_play->pcm);
+	if (unlikely((ret = snd_pcm_prepare(alsa_play->pcm)) < 0)) {
+		glc_log(alsa_play->glc, GLC_ERROR, "alsa_play",
+			"can't prepare pcm after seek: %s (%d)", snd_strerror(ret), ret);
+		return -ret;
+	}
+	return 0;
+}
+
 /**  \} */
@@ -103,6 +103,7 @@ struct demux_s {
 	glc_simple_thread_t thread;
 
 	const char *alsa_playback_device;
+	source_t source;
 
 	ps_bufferattr_t video_bufferattr;
 	ps_bufferattr_t audio_bufferattr;
@@ -186,6 +187,12 @@ int demux_set_alsa_playback_device(demux_t demux, const char *device)
 	return 0;
 }
 
+int demux_set_source(demux_t demux, source_t source)
+{
+	demux->source = source;
+	return 0;
+}
+
 int demux_insert_video_filter(demux_t demux, ps_buffer_t *in, ps_buffer_t *out)
 {
 	if (unlikely(!demux || !in || !out))
@@ -206,6 +213,7 @@ int demux_process_start(demux_t demux, ps_buffer_t *from)
 		return EAGAIN;
 
 	demux->from = from;
+	demux->thread.name = "demux";
 
 	return glc_simple_thread_create(demux->glc, &demux->thread,
 					demux_thread, demux);
@@ -264,8 +272,10 @@ void *demux_thread(void *argptr)
 						PS_ACCEPT_FAKE_DMA))))
 			goto err;
 
-		if ((msg_hdr.type == GLC_MESSAGE_CLOSE)       ||
-		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FRAME) ||
+		if ((msg_hdr.type == GLC_MESSAGE_CLOSE)        ||
+		    (msg_hdr.type == GLC_MESSAGE_SEEK)         ||
+		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FRAME)  ||
+		    (msg_hdr.type == GLC_MESSAGE_VIDEO_REPEAT) ||
 		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FORMAT)) {
 			if (!demux->vfilter) {
 				/* handle msg to gl_play */
@@ -278,6 +288,7 @@ void *demux_thread(void *argptr)
 		}
 
 		if ((msg_hdr.type == GLC_MESSAGE_CLOSE) ||
+		    (msg_hdr.type == GLC_MESSAGE_SEEK) ||
 		    (msg_hdr.type == GLC_MESSAGE_AUDIO_FORMAT) ||
 		    (msg_hdr.type == GLC_MESSAGE_AUDIO_DATA)) {
 			/* handle msg to alsa_play */
@@ -364,7 +375,8 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 	glc_stream_id_t id;
 	int ret;
 
-	if (header->type == GLC_MESSAGE_CLOSE) {
+	if ((header->type == GLC_MESSAGE_CLOSE) ||
+	    (header->type == GLC_MESSAGE_SEEK)) {
 		/* broadcast to all */
 		video = demux->video;
 		while (video != NULL) {
@@ -380,6 +392,8 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 		id = ((glc_video_format_message_t *) data)->id;
 	else if (header->type == GLC_MESSAGE_VIDEO_FRAME)
 		id = ((glc_video_frame_header_t *) data)->id;
+	else if (header->type == GLC_MESSAGE_VIDEO_REPEAT)
+		id = ((glc_video_repeat_message_t *) data)->id;
 	else
 		return EINVAL;
 
@@ -481,6 +495,9 @@ int demux_video_stream_get(demux_t demux, glc_stream_id_t id,
 		if (unlikely((ret = gl_play_set_stream_id((*video)->gl_play,
 						(*video)->id))))
 			return ret;
+		if (unlikely((ret = gl_play_set_source((*video)->gl_play,
+						demux->source))))
+			return ret;
 		if (unlikely((ret = gl_play_process_start((*video)->gl_play,
 						&(*video)->buffer))))
 			return ret;
@@ -514,7 +531,8 @@ int demux_audio_stream_message(demux_t demux, glc_message_header_t *header,
 	glc_stream_id_t id;
 	int ret;
 
-	if (header->type == GLC_MESSAGE_CLOSE) {
+	if ((header->type == GLC_MESSAGE_CLOSE) ||
+	    (header->type == GLC_MESSAGE_SEEK)) {
 		/* broadcast to all */
 		audio = demux->audio;
 		while (audio != NULL) {
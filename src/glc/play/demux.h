@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/core/source.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,17 @@ __PUBLIC int demux_set_audio_buffer_size(demux_t demux, size_t size);
  */
 __PUBLIC int demux_set_alsa_playback_device(demux_t demux, const char *device);
 
+/**
+ * \brief set stream source
+ *
+ * Video windows seek in source when arrow keys are pressed.
+ * Default is no source, seeking is disabled.
+ * \param demux demux object
+ * \param source source object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int demux_set_source(demux_t demux, source_t source);
+
 /**
  * \brief start demux process
  *
@@ -76,6 +76,9 @@ struct gl_play_s {
 	glc_utime_t sleep_threshold;
 	glc_utime_t skip_threshold;
 
+	source_t source;
+	u_int32_t seek;
+
 	Display *dpy;
 	Window win;
 	GLXContext ctx;
@@ -111,6 +114,7 @@ static int gl_play_destroy_textures(gl_play_t gl_play);
 static int gl_play_draw_video_frame_messageture(gl_play_t gl_play, char *from);
 
 static int gl_play_handle_xevents(gl_play_t gl_play, glc_thread_state_t *state);
+static int gl_play_seek(gl_play_t gl_play, glc_stime_t diff);
 
 static int gl_play_next_texture_size(gl_play_t gl_play, unsigned int number);
 
@@ -129,6 +133,7 @@ int gl_play_init(gl_play_t *gl_play, glc_t *glc)
 	(*gl_play)->play_thread.read_callback = &gl_play_read_callback;
 	(*gl_play)->play_thread.finish_callback = &gl_play_finish_callback;
 	(*gl_play)->play_thread.threads = 1;
+	(*gl_play)->play_thread.name = "gl_play";
 
 	/* TODO support more formats */
 	(*gl_play)->format = GL_BGR;
@@ -148,6 +153,12 @@ int gl_play_set_stream_id(gl_play_t gl_play, glc_stream_id_t ctx)
 	return 0;
 }
 
+int gl_play_set_source(gl_play_t gl_play, source_t source)
+{
+	gl_play->source = source;
+	return 0;
+}
+
 int gl_play_process_start(gl_play_t gl_play, ps_buffer_t *from)
 {
 	int ret;
@@ -567,8 +578,15 @@ int gl_handle_xevents(gl_play_t gl_play, glc_thread_state_t *state)
 		case KeyPress:
 			code = XLookupKeysym(&event.xkey, 0);
 
-			if (code == XK_Right)
-				glc_state_time_add_diff(gl_play->glc, -100000);
+			if (code == XK_Right) {
+				if (gl_play_seek(gl_play, 10000000000LL))
+					glc_state_time_add_diff(gl_play->glc, -100000);
+			} else if (code == XK_Left)
+				gl_play_seek(gl_play, -10000000000LL);
+			else if (code == XK_Up)
+				gl_play_seek(gl_play, 60000000000LL);
+			else if (code == XK_Down)
+				gl_play_seek(gl_play, -60000000000LL);
 			else if (code == XK_f)
 				gl_play_toggle_fullscreen(gl_play);
 			break;
@@ -614,6 +632,31 @@ int gl_handle_xevents(gl_play_t gl_play, glc_thread_state_t *state)
 	return 0;
 }
 
+/**
+ * \brief ask source to jump from current position
+ * \param gl_play gl_play object
+ * \param diff time to jump in nanoseconds
+ * \return 0 on success otherwise an error code
+ */
+int gl_play_seek(gl_play_t gl_play, glc_stime_t diff)
+{
+	glc_utime_t time = glc_state_time(gl_play->glc);
+	int ret;
+
+	if (!gl_play->source)
+		return ENOTSUP;
+
+	if ((diff < 0) && (time < (glc_utime_t) -diff))
+		time = 0;
+	else
+		time += diff;
+
+	if (unlikely((ret = gl_play->source->ops->seek(gl_play->source, time))))
+		glc_log(gl_play->glc, GLC_WARN, "gl_play", "can't seek: %s (%d)",
+			strerror(ret), ret);
+	return ret;
+}
+
 int gl_play_read_callback(glc_thread_state_t *state)
 {
 	gl_play_t gl_play = (gl_play_t) state->ptr;
@@ -627,7 +670,10 @@ int gl_play_read_callback(glc_thread_state_t *state)
 	if (state->flags & GLC_THREAD_STOP)
 		return 0;
 
-	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT) {
+	if (state->header.type == GLC_MESSAGE_SEEK) {
+		/* pictures from new position follow */
+		gl_play->seek = ((glc_seek_message_t *) state->read_data)->seek;
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT) {
 		format_msg = (glc_video_format_message_t *) state->read_data;
 		if (format_msg->id != gl_play->id)
 			return 0; /* just ignore it */
@@ -674,6 +720,8 @@ int gl_play_read_callback(glc_thread_state_t *state)
 
 		/* check if we have to draw this frame */
 		time = glc_state_time(gl_play->glc);
+		if (unlikely(glc_state_seek_count(gl_play->glc) != gl_play->seek))
+			return 0; /* read before a seek */
 		if (time > pic_hdr->time + gl_play->skip_threshold) {
 			glc_log(gl_play->glc, GLC_DEBUG, "gl_play",
 				"dropped frame. now %" PRId64 " ts %" PRId64, time, pic_hdr->time);
@@ -687,7 +735,8 @@ int gl_play_read_callback(glc_thread_state_t *state)
 		glFinish();
 
 		time = glc_state_time(gl_play->glc);
-		if (pic_hdr->time > time + gl_play->sleep_threshold) {
+		if ((pic_hdr->time > time + gl_play->sleep_threshold) &&
+		    (likely(glc_state_seek_count(gl_play->glc) == gl_play->seek))) {
 			struct timespec ts = { .tv_sec  = (pic_hdr->time - time)/1000000000,
 					       .tv_nsec = (pic_hdr->time - time)%1000000000 };
 			nanosleep(&ts,NULL);
@@ -695,6 +744,7 @@ int gl_play_read_callback(glc_thread_state_t *state)
 
 		glXSwapBuffers(gl_play->dpy, gl_play->win);
 	}
+	/* on GLC_MESSAGE_VIDEO_REPEAT previous picture just stays on screen */
 
 	return 0;
 }
@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/core/source.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +54,17 @@ __PUBLIC int gl_play_destroy(gl_play_t gl_play);
  */
 __PUBLIC int gl_play_set_stream_id(gl_play_t gl_play, glc_stream_id_t id);
 
+/**
+ * \brief set stream source
+ *
+ * Left and right arrow keys seek 10 seconds, down and up arrow
+ * keys a minute. Default is no source, seeking is disabled.
+ * \param gl_play gl_play object
+ * \param source source object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_play_set_source(gl_play_t gl_play, source_t source);
+
 /**
  * \brief start gl_play process
  *
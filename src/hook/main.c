@@ -59,6 +59,12 @@
 #define MAIN_SYNC                 0x20
 #define MAIN_COMPRESS_LZJB        0x40
 #define MAIN_START                0x80
+#define MAIN_COMPRESS_LZ4        0x100
+#define MAIN_COMPRESS_LZ4HC      0x200
+#define MAIN_COMPRESS_ADAPTIVE   0x400
+#define MAIN_COMPRESS_FILTER     0x800
+#define MAIN_COMPRESS_LOSSLESS  0x1000
+#define MAIN_COMPRESS_JPEG      0x2000
 
 #define SINK_CB_RELOAD_ARG         0x1
 #define SINK_CB_STOP_ARG           0x2
@@ -70,6 +76,13 @@ struct main_private_s {
 	ps_buffer_t *uncompressed;
 	ps_buffer_t *compressed;
 	size_t uncompressed_size, compressed_size;
+	unsigned int delta_interval;
+	unsigned int slices;
+	int strong_compression;
+	int jpeg_quality;
+	unsigned int async_writes;
+	u_int64_t split_size;
+	glc_utime_t split_duration;
 
 	sink_t sink;
 	pack_t pack;
@@ -221,6 +234,17 @@ int load_environ()
 			mpriv.flags |= MAIN_SYNC;
 	}
 
+	mpriv.async_writes = 0;
+	if ((env_val = getenv("GLC_ASYNC_WRITE")))
+		mpriv.async_writes = atoi(env_val);
+
+	mpriv.split_size = 0;
+	if ((env_val = getenv("GLC_SPLIT_SIZE")))
+		mpriv.split_size = (u_int64_t) atoi(env_val) * 1024 * 1024;
+	mpriv.split_duration = 0;
+	if ((env_val = getenv("GLC_SPLIT_TIME")))
+		mpriv.split_duration = (glc_utime_t) atoi(env_val) * 1000000000;
+
 	mpriv.uncompressed_size = 1024 * 1024 * 25;
 	if ((env_val = getenv("GLC_UNCOMPRESSED_BUFFER_SIZE")))
 		mpriv.uncompressed_size = atoi(env_val) * 1024 * 1024;
@@ -253,16 +277,57 @@ int load_environ()
 				mpriv.flags |= MAIN_COMPRESS_QUICKLZ;
 			else if (!strcmp(env_val, "lzjb"))
 				mpriv.flags |= MAIN_COMPRESS_LZJB;
+			else if (!strcmp(env_val, "lz4"))
+				mpriv.flags |= MAIN_COMPRESS_LZ4;
+			else if (!strcmp(env_val, "lz4hc"))
+				mpriv.flags |= MAIN_COMPRESS_LZ4HC;
+			else if (!strcmp(env_val, "lossless"))
+				mpriv.flags |= MAIN_COMPRESS_LOSSLESS;
+			else if (!strcmp(env_val, "jpeg"))
+				mpriv.flags |= MAIN_COMPRESS_JPEG;
 			else
 				mpriv.flags |= MAIN_COMPRESS_NONE;
 		} else
 			mpriv.flags |= MAIN_COMPRESS_LZO;
+
+		if ((env_val = getenv("GLC_DELTA")))
+			mpriv.delta_interval = atoi(env_val);
+		if ((env_val = getenv("GLC_SLICES")))
+			mpriv.slices = atoi(env_val);
+
+		if ((env_val = getenv("GLC_ADAPTIVE"))) {
+			if (atoi(env_val))
+				mpriv.flags |= MAIN_COMPRESS_ADAPTIVE;
+		}
+		if ((env_val = getenv("GLC_FILTER"))) {
+			if (atoi(env_val))
+				mpriv.flags |= MAIN_COMPRESS_FILTER;
+		}
+		if ((env_val = getenv("GLC_COMPRESS_STRONG"))) {
+			if (!strcmp(env_val, "lzo"))
+				mpriv.strong_compression = PACK_LZO;
+			else if (!strcmp(env_val, "quicklz"))
+				mpriv.strong_compression = PACK_QUICKLZ;
+			else if (!strcmp(env_val, "lzjb"))
+				mpriv.strong_compression = PACK_LZJB;
+			else if (!strcmp(env_val, "lz4"))
+				mpriv.strong_compression = PACK_LZ4;
+			else if (!strcmp(env_val, "lz4hc"))
+				mpriv.strong_compression = PACK_LZ4HC;
+			else if (!strcmp(env_val, "lossless"))
+				mpriv.strong_compression = PACK_LOSSLESS;
+		}
+		if ((env_val = getenv("GLC_JPEG_QUALITY")))
+			mpriv.jpeg_quality = atoi(env_val);
 	} else
 		 mpriv.flags |= MAIN_COMPRESS_NONE;
 
 	if ((env_val = getenv("GLC_RTPRIO")))
 		glc_set_allow_rt(&mpriv.glc, atoi(env_val));
 
+	if ((env_val = getenv("GLC_SCHED")))
+		glc_set_sched(&mpriv.glc, env_val); /* errors are logged, keep going */
+
 	glc_account_threads(&mpriv.glc,1,!(mpriv.flags & MAIN_COMPRESS_NONE));
 
 	glc_log(&mpriv.glc, GLC_DEBUG, "main", "flags: %08X", mpriv.flags);
@@ -279,6 +344,9 @@ int init_buffers()
 	if (glc_log_get_level(&mpriv.glc) >= GLC_PERF)
 		ps_bufferattr_setflags(&attr, PS_BUFFER_STATS);
 
+	/* referenced payloads shouldn't queue more than buffers hold */
+	glc_ref_set_budget(&mpriv.glc, mpriv.uncompressed_size);
+
 	ps_bufferattr_setsize(&attr, mpriv.uncompressed_size);
 	mpriv.uncompressed = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
 	if (unlikely((ret = ps_buffer_init(mpriv.uncompressed, &attr))))
@@ -508,6 +576,12 @@ int start_glc()
 	} else {
 		if (unlikely((ret = file_sink_init(&mpriv.sink, &mpriv.glc))))
 			return ret;
+		if (unlikely((ret = file_sink_set_async(mpriv.sink,
+							mpriv.async_writes))))
+			return ret;
+		if (unlikely((ret = file_sink_set_split(mpriv.sink,
+					mpriv.split_size, mpriv.split_duration))))
+			return ret;
 	}
 	if (unlikely((ret = mpriv.sink->ops->set_callback(mpriv.sink,
 							&stream_sink_callback))))
@@ -529,6 +603,25 @@ int start_glc()
 			pack_set_compression(mpriv.pack, PACK_LZO);
 		else if (mpriv.flags & MAIN_COMPRESS_LZJB)
 			pack_set_compression(mpriv.pack, PACK_LZJB);
+		else if (mpriv.flags & MAIN_COMPRESS_LZ4)
+			pack_set_compression(mpriv.pack, PACK_LZ4);
+		else if (mpriv.flags & MAIN_COMPRESS_LZ4HC)
+			pack_set_compression(mpriv.pack, PACK_LZ4HC);
+		else if (mpriv.flags & MAIN_COMPRESS_LOSSLESS)
+			pack_set_compression(mpriv.pack, PACK_LOSSLESS);
+		else if (mpriv.flags & MAIN_COMPRESS_JPEG)
+			pack_set_compression(mpriv.pack, PACK_JPEG);
+		if (mpriv.jpeg_quality)
+			pack_set_jpeg_quality(mpriv.pack, mpriv.jpeg_quality);
+		pack_set_delta_interval(mpriv.pack, mpriv.delta_interval);
+		pack_set_slices(mpriv.pack, mpriv.slices);
+		if (mpriv.flags & MAIN_COMPRESS_FILTER)
+			pack_set_filter(mpriv.pack, GLC_FILTER_SHUFFLE | GLC_FILTER_PREDICT |
+						    GLC_FILTER_NO_ALPHA);
+		if (mpriv.flags & MAIN_COMPRESS_ADAPTIVE) {
+			pack_set_adaptive(mpriv.pack, 1);
+			pack_set_strong_compression(mpriv.pack, mpriv.strong_compression);
+		}
 
 		if (unlikely((ret = pack_process_start(mpriv.pack, mpriv.uncompressed,
 						       mpriv.compressed))))
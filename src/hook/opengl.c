@@ -84,6 +84,7 @@ int opengl_init(glc_t *glc)
 {
 	int ret = 0;
 	unsigned int x, y, w, h;
+	int gpu_scale;
 	char *env_val;
 
 	opengl.glc              = glc;
@@ -145,6 +146,28 @@ int opengl_init(glc_t *glc)
 	if ((env_val = getenv("GLC_TRY_PBO")))
 		gl_capture_try_pbo(opengl.gl_capture, atoi(env_val));
 
+	if ((env_val = getenv("GLC_PBO_NUM")))
+		gl_capture_set_pbo_num(opengl.gl_capture, atoi(env_val));
+
+	if ((env_val = getenv("GLC_COPY_THREAD")))
+		gl_capture_copy_thread(opengl.gl_capture, atoi(env_val));
+
+	/* ycbcr or scale still get the factor, for when GPU can't scale */
+	gpu_scale = 0;
+	if ((env_val = getenv("GLC_GPU_SCALE")) && atoi(env_val) &&
+	    (opengl.scale_factor < 1.0))
+		gpu_scale = !gl_capture_set_gpu_scale(opengl.gl_capture, opengl.scale_factor);
+
+	/* ycbcr filter passes converted pictures through, but can't scale them */
+	if ((env_val = getenv("GLC_GPU_YCBCR")) && atoi(env_val) &&
+	    (opengl.colorspace == CS_YCBCR_420JPEG)) {
+		if ((opengl.scale_factor == 1.0) || (gpu_scale))
+			gl_capture_try_gpu_ycbcr(opengl.gl_capture, 1);
+		else
+			glc_log(opengl.glc, GLC_WARN, "opengl",
+				 "GLC_GPU_YCBCR needs GLC_GPU_SCALE when scaling");
+	}
+
 	gl_capture_set_pack_alignment(opengl.gl_capture, 8);
 	if ((env_val = getenv("GLC_CAPTURE_DWORD_ALIGNED"))) {
 		if (!atoi(env_val))
@@ -168,6 +191,18 @@ int opengl_init(glc_t *glc)
 	if ((env_val = getenv("GLC_LOCK_FPS")))
 		gl_capture_lock_fps(opengl.gl_capture, atoi(env_val));
 
+	if ((env_val = getenv("GLC_FRAME_BUDGET")))
+		gl_capture_set_frame_budget(opengl.gl_capture, atof(env_val));
+
+	/* pipe sink writes raw frames as they come and can't expand repeats */
+	if ((env_val = getenv("GLC_SKIP_REPEATS")) && atoi(env_val)) {
+		if (getenv("GLC_PIPE"))
+			glc_log(opengl.glc, GLC_WARN, "opengl",
+				 "GLC_SKIP_REPEATS is ignored with GLC_PIPE");
+		else
+			gl_capture_skip_repeats(opengl.gl_capture, atoi(env_val));
+	}
+
 	get_real_opengl();
 	glc_account_threads(opengl.glc, 1, (opengl.scale_factor != 1.0) ||
 					   opengl.colorspace == CS_YCBCR_420JPEG);
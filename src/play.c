@@ -29,6 +29,7 @@
 #include <getopt.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include <glc/common/glc.h>
 #include <glc/common/core.h>
@@ -38,11 +39,11 @@
 
 #include <glc/core/file.h>
 #include <glc/core/pack.h>
-#include <glc/core/rgb.h>
 #include <glc/core/color.h>
 #include <glc/core/info.h>
 #include <glc/core/ycbcr.h>
 #include <glc/core/scale.h>
+#include <glc/core/convert.h>
 
 #include <glc/export/img.h>
 #include <glc/export/wav.h>
@@ -91,6 +92,7 @@ struct play_s {
 
 	int log_level;
 	int allow_rt;
+	const char *sched;
 };
 
 int show_info_value(struct play_s *play, const char *value);
@@ -127,6 +129,7 @@ int main(int argc, char *argv[])
 		{"help",		0, NULL, 'h'},
 		{"version",		0, NULL, 'V'},
 		{"rtprio",		0, NULL, 'P'},
+		{"sched",		1, NULL, 'S'},
 		{0, 0, 0, 0}
 	};
 	memset(&play, 0, sizeof(struct play_s));
@@ -162,7 +165,7 @@ int main(int argc, char *argv[])
 	play.green_gamma = 1.0;
 	play.blue_gamma  = 1.0;
 
-	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:s:v:hVP",
+	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:s:v:hVPS:",
 				  long_options, &optind)) != -1) {
 		switch (opt) {
 		case 'i':
@@ -255,6 +258,9 @@ int main(int argc, char *argv[])
 		case 'P':
 			play.allow_rt = 1;
 			break;
+		case 'S':
+			play.sched = optarg;
+			break;
 		case 'h':
 		default:
 			goto usage;
@@ -278,6 +284,9 @@ int main(int argc, char *argv[])
 	glc_state_init(&play.glc);
 	glc_log_set_level(&play.glc, play.log_level);
 	glc_set_allow_rt(&play.glc, play.allow_rt);
+	if (play.sched && unlikely(glc_set_sched(&play.glc, play.sched)))
+		return EXIT_FAILURE;
+	glc_ref_set_budget(&play.glc, play.buffer_size_arr[UNCOMPRESSED_IDX]);
 	glc_util_log_version(&play.glc);
 
 	/* open stream file */
@@ -298,6 +307,9 @@ int main(int argc, char *argv[])
 	if (play.fps == 0)
 		play.fps = play.stream_info.fps;
 
+	/* parts of a split stream don't start at 0 */
+	glc_state_time_add_diff(&play.glc, -(glc_stime_t) play.stream_info.start_time);
+
 	switch (play.action) {
 	case action_play:
 		if (unlikely(play_stream(&play)))
@@ -363,10 +375,20 @@ usage:
 	       "                             default is 10 MiB\n"
 	       "  -s, --show=VAL           show stream summary value, possible values are:\n"
 	       "                             all, signature, version, flags, fps,\n"
-	       "                             pid, name, date\n"
+	       "                             pid, name, date, start\n"
 	       "  -P, --rtprio             use rt priority for alsa threads\n"
+	       "  -S, --sched=CONFIG       per thread cpu affinity and scheduling policy\n"
+	       "                             format is thread:option/option;thread2:...\n"
+	       "                             options: cpus=LIST, nice=N, rr=PRIO,\n"
+	       "                             fifo=PRIO, deadline=RUNTIME,DEADLINE,PERIOD (us)\n"
 	       "  -v, --verbosity=LEVEL    verbosity level\n"
-	       "  -h, --help               show help\n");
+	       "  -h, --help               show help\n"
+	       "\nplayback keys:\n"
+	       "  left/right               seek 10 seconds backward/forward\n"
+	       "  down/up                  seek 1 minute backward/forward\n"
+	       "                             streams without index can't be seeked\n"
+	       "  f                        toggle fullscreen\n"
+	       "  esc                      quit\n");
 
 	return EXIT_FAILURE;
 }
@@ -381,6 +403,7 @@ int show_info_value(struct play_s *play, const char *value)
 		printf("  pid         = %d\n", play->stream_info.pid);
 		printf("  name        = %s\n", play->info_name);
 		printf("  date        = %s\n", play->info_date);
+		printf("  start       = %" PRIu64 "\n", play->stream_info.start_time);
 	} else if (!strcmp("signature", value))
 		printf("0x%08x\n", play->stream_info.signature);
 	else if (!strcmp("version", value))
@@ -395,6 +418,8 @@ int show_info_value(struct play_s *play, const char *value)
 		printf("%s\n", play->info_name);
 	else if (!strcmp("date", value))
 		printf("%s\n", play->info_date);
+	else if (!strcmp("start", value))
+		printf("%" PRIu64 "\n", play->stream_info.start_time);
 	else
 		return ENOTSUP;
 	return 0;
@@ -421,6 +446,24 @@ err:
 	return ret;
 }
 
+static void log_stats(glc_t *glc, const char *name, glc_thread_stats_t *stats)
+{
+	glc_thread_hist_t *work = &stats->hist[GLC_THREAD_HIST_WRITE];
+	glc_thread_hist_t *idle = &stats->hist[GLC_THREAD_HIST_READ_WAIT];
+	glc_thread_hist_t *blocked = &stats->hist[GLC_THREAD_HIST_WRITE_WAIT];
+
+	if (!work->count)
+		return;
+
+	/* per message averages, waiting for input means this stage keeps up */
+	glc_log(glc, GLC_INFO, name,
+		"%" PRIu64 " messages processed in %" PRIu64 " us (max %" PRIu64
+		" us), waiting %" PRIu64 " us for input and %" PRIu64 " us for output",
+		work->count, work->total / work->count / 1000, work->max / 1000,
+		idle->count ? idle->total / idle->count / 1000 : 0,
+		blocked->count ? blocked->total / blocked->count / 1000 : 0);
+}
+
 static void destroy_buffers(ps_buffer_t *buffer_arr, unsigned nm)
 {
 	unsigned i;
@@ -430,11 +473,11 @@ static void destroy_buffers(ps_buffer_t *buffer_arr, unsigned nm)
 
 #define compressed_buffer   buffer_arr[0]
 #define uncompressed_buffer buffer_arr[1]
-#define rgb_buffer          buffer_arr[2]
 #define ycbcr_buffer        buffer_arr[2]
 #define color_buffer        buffer_arr[3]
 #define scale_buffer        buffer_arr[4]
-#define vfilter_in_buffer   buffer_arr[5]
+#define convert_buffer      buffer_arr[2]
+#define vfilter_in_buffer   buffer_arr[3]
 
 /*
  * Undef to use the video filter.
@@ -449,65 +492,63 @@ int play_stream(struct play_s *play)
 
 	 file -(uncompressed)->     reads data from stream file
 	 unpack -(uncompressed)->   decompresses lzo/quicklz packets
-	 rgb -(rgb)->               does conversion to BGR
-	 scale -(scale)->           does rescaling
-	 color -(color)->           applies color correction
+	 convert -(convert)->       does conversion to BGR, rescaling and
+	                            color correction in a single pass
 	 demux -(...)-> gl_play, alsa_play
 
 	 Each filter, except demux and file, has glc_threads_hint(glc) worker
-	 threads. Packet order in stream is preserved. Demux creates
+	 threads sharing glc_shared_workers(glc) processing slots. Packet
+	 order in stream is preserved. Demux creates
 	 separate buffer and _play handler for each video/audio stream.
 	*/
 #ifndef USE_VFILTER
-	ps_buffer_t buffer_arr[5];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 4};
+	ps_buffer_t buffer_arr[3];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 2};
 #else
-	ps_buffer_t buffer_arr[6];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 5};
+	ps_buffer_t buffer_arr[4];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 3};
 #endif
 	demux_t demux;
-	color_t color;
-	scale_t scale;
+	convert_t convert;
 	unpack_t unpack;
-	rgb_t rgb;
+	glc_thread_stats_t stats;
 	int ret = 0;
 
 	if (unlikely((ret = init_buffers(buffer_arr, play->buffer_size_arr, nm_arr))))
 		goto err;
 
 	/* init filters */
-	glc_account_threads(&play->glc,4,4);
+	glc_account_threads(&play->glc,4,2);
 	glc_compute_threads_hint(&play->glc);
 	if (unlikely((ret = unpack_init(&unpack, &play->glc))))
 		goto err;
-	if (unlikely((ret = rgb_init(&rgb, &play->glc))))
-		goto err;
-	if (unlikely((ret = scale_init(&scale, &play->glc))))
+	if (unlikely((ret = convert_init(&convert, &play->glc))))
 		goto err;
 	if (play->scale_width && play->scale_height)
-		scale_set_size(scale, play->scale_width, play->scale_height);
+		convert_set_size(convert, play->scale_width, play->scale_height);
 	else
-		scale_set_scale(scale, play->scale_factor);
-	if (unlikely((ret = color_init(&color, &play->glc))))
-		goto err;
+		convert_set_scale(convert, play->scale_factor);
 	if (play->override_color_correction)
-		color_override(color, play->brightness, play->contrast,
-			       play->red_gamma, play->green_gamma, play->blue_gamma);
+		convert_override(convert, play->brightness, play->contrast,
+				 play->red_gamma, play->green_gamma, play->blue_gamma);
 	if (unlikely((ret = demux_init(&demux, &play->glc))))
 		goto err;
 	demux_set_video_buffer_size(demux, play->buffer_size_arr[UNCOMPRESSED_IDX]);
 	demux_set_audio_buffer_size(demux, play->buffer_size_arr[UNCOMPRESSED_IDX] / 10);
 	demux_set_alsa_playback_device(demux, play->alsa_playback_device);
+	demux_set_source(demux, play->file);
 
 	/* construct a pipeline for playback */
 #ifndef USE_VFILTER
-	if (unlikely((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer))))
+	if (unlikely((ret = convert_process_start(convert, &uncompressed_buffer,
+						  &convert_buffer))))
 		goto err;
-	if (unlikely((ret = demux_process_start(demux, &color_buffer))))
+	if (unlikely((ret = demux_process_start(demux, &convert_buffer))))
 		goto err;
 #else
-	demux_insert_video_filter(demux, &vfilter_in_buffer, &color_buffer);
-	if (unlikely((ret = rgb_process_start(rgb, &vfilter_in_buffer, &rgb_buffer))))
+	demux_insert_video_filter(demux, &vfilter_in_buffer, &convert_buffer);
+	if (unlikely((ret = convert_process_start(convert, &vfilter_in_buffer,
+						  &convert_buffer))))
 		goto err;
 	if (unlikely((ret = demux_process_start(demux, &uncompressed_buffer))))
 		goto err;
@@ -515,10 +556,6 @@ int play_stream(struct play_s *play)
 	if (unlikely((ret = unpack_process_start(unpack, &compressed_buffer,
 						&uncompressed_buffer))))
 		goto err;
-	if (unlikely((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer))))
-		goto err;
-	if (unlikely((ret = color_process_start(color, &scale_buffer, &color_buffer))))
-		goto err;
 
 	/* the pipeline is ready - lets give it some data */
 	if (unlikely((ret = play->file->ops->read(play->file, &compressed_buffer))))
@@ -527,20 +564,17 @@ int play_stream(struct play_s *play)
 	/* we've done our part - just wait for the threads */
 	if (unlikely((ret = demux_process_wait(demux))))
 		goto err; /* wait for demux, since when it quits, others should also */
-	if (unlikely((ret = color_process_wait(color))))
-		goto err;
-	if (unlikely((ret = scale_process_wait(scale))))
-		goto err;
-	if (unlikely((ret = rgb_process_wait(rgb))))
+	if (unlikely((ret = convert_process_wait(convert))))
 		goto err;
 	if (unlikely((ret = unpack_process_wait(unpack))))
 		goto err;
 
+	unpack_get_stats(unpack, &stats);
+	log_stats(&play->glc, "unpack", &stats);
+
 	/* stream processed - clean up time */
 	unpack_destroy(unpack);
-	rgb_destroy(rgb);
-	scale_destroy(scale);
-	color_destroy(color);
+	convert_destroy(convert);
 	demux_destroy(demux);
 
 	destroy_buffers(buffer_arr,sizeof(buffer_arr)/sizeof(ps_buffer_t));
@@ -620,60 +654,51 @@ int export_img(struct play_s *play)
 
 	 file -(uncompressed_buffer)->     reads data from stream file
 	 unpack -(uncompressed_buffer)->   decompresses lzo/quicklz packets
-	 rgb -(rgb)->               does conversion to BGR
-	 scale -(scale)->           does rescaling
-	 color -(color)->           applies color correction
+	 convert -(convert)->       does conversion to BGR, rescaling and
+	                            color correction in a single pass
 	 img                        writes separate image files for each frame
 	*/
 
-	ps_buffer_t buffer_arr[5];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 4};
+	ps_buffer_t buffer_arr[3];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 2};
 	img_t img;
-	color_t color;
-	scale_t scale;
+	convert_t convert;
 	unpack_t unpack;
-	rgb_t rgb;
 	int ret = 0;
 
 	if (unlikely((ret = init_buffers(buffer_arr, play->buffer_size_arr, nm_arr))))
 		goto err;
 
 	/* filters */
-	glc_account_threads(&play->glc,2,4);
+	glc_account_threads(&play->glc,2,2);
 	glc_compute_threads_hint(&play->glc);
 	if (unlikely((ret = unpack_init(&unpack, &play->glc))))
 		goto err;
-	if (unlikely((ret = rgb_init(&rgb, &play->glc))))
-		goto err;
-	if (unlikely((ret = scale_init(&scale, &play->glc))))
+	if (unlikely((ret = convert_init(&convert, &play->glc))))
 		goto err;
 	if (play->scale_width && play->scale_height)
-		scale_set_size(scale, play->scale_width, play->scale_height);
+		convert_set_size(convert, play->scale_width, play->scale_height);
 	else
-		scale_set_scale(scale, play->scale_factor);
-	if (unlikely((ret = color_init(&color, &play->glc))))
-		goto err;
+		convert_set_scale(convert, play->scale_factor);
 	if (play->override_color_correction)
-		color_override(color, play->brightness, play->contrast,
-			       play->red_gamma, play->green_gamma, play->blue_gamma);
+		convert_override(convert, play->brightness, play->contrast,
+				 play->red_gamma, play->green_gamma, play->blue_gamma);
 	if (unlikely((ret = img_init(&img, &play->glc))))
 		goto err;
 	img_set_filename(img, play->export_filename_format);
 	img_set_stream_id(img, play->export_video_id);
 	img_set_format(img, play->img_format);
 	img_set_fps(img, play->fps);
+	img_set_start_time(img, play->stream_info.start_time);
 
 	/* pipeline... */
 	if (unlikely((ret = unpack_process_start(unpack, &compressed_buffer,
 						&uncompressed_buffer))))
 		goto err;
-	if (unlikely((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer))))
-		goto err;
-	if (unlikely((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer))))
-		goto err;
-	if (unlikely((ret = color_process_start(color, &scale_buffer, &color_buffer))))
+	if (unlikely((ret = convert_process_start(convert, &uncompressed_buffer,
+						  &convert_buffer))))
 		goto err;
-	if (unlikely((ret = img_process_start(img, &color_buffer))))
+	if (unlikely((ret = img_process_start(img, &convert_buffer))))
 		goto err;
 
 	/* ok, read the file */
@@ -683,19 +708,13 @@ int export_img(struct play_s *play)
 	/* wait 'till its done and clean up the mess... */
 	if (unlikely((ret = img_process_wait(img))))
 		goto err;
-	if (unlikely((ret = color_process_wait(color))))
-		goto err;
-	if (unlikely((ret = scale_process_wait(scale))))
-		goto err;
-	if (unlikely((ret = rgb_process_wait(rgb))))
+	if (unlikely((ret = convert_process_wait(convert))))
 		goto err;
 	if (unlikely((ret = unpack_process_wait(unpack))))
 		goto err;
 
 	unpack_destroy(unpack);
-	rgb_destroy(rgb);
-	scale_destroy(scale);
-	color_destroy(color);
+	convert_destroy(convert);
 	img_destroy(img);
 
 	destroy_buffers(buffer_arr,sizeof(buffer_arr)/sizeof(ps_buffer_t));
@@ -754,6 +773,7 @@ int export_yuv4mpeg(struct play_s *play)
 	yuv4mpeg_set_fps(yuv4mpeg, play->fps);
 	yuv4mpeg_set_stream_id(yuv4mpeg, play->export_video_id);
 	yuv4mpeg_set_interpolation(yuv4mpeg, play->interpolate);
+	yuv4mpeg_set_start_time(yuv4mpeg, play->stream_info.start_time);
 	yuv4mpeg_set_filename(yuv4mpeg, play->export_filename_format);
 
 	/* construct the pipeline */
@@ -827,6 +847,7 @@ int export_wav(struct play_s *play)
 	if (unlikely((ret = wav_init(&wav, &play->glc))))
 		goto err;
 	wav_set_interpolation(wav, play->interpolate);
+	wav_set_start_time(wav, play->stream_info.start_time);
 	wav_set_filename(wav, play->export_filename_format);
 	wav_set_stream_id(wav, play->export_audio_id);
 	wav_set_silence_threshold(wav, play->silence_threshold);